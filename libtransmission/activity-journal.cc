@@ -0,0 +1,104 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+
+#include "transmission.h"
+
+#include "activity-journal.h"
+
+uint64_t tr_activity_journal::add(int torrent_id, time_t now, Kind kind)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    prune(now);
+
+    auto const seq = ++sequence_;
+    entries_.push_back({ seq, now, torrent_id, kind });
+    newest_[torrent_id] = seq;
+    return seq;
+}
+
+void tr_activity_journal::prune(time_t now)
+{
+    // drop entries that have aged out
+    while (!std::empty(entries_) && entries_.front().when < now - retention_secs_)
+    {
+        auto const& entry = entries_.front();
+
+        if (auto const it = newest_.find(entry.torrent_id); it != std::end(newest_) && it->second == entry.seq)
+        {
+            newest_.erase(it);
+        }
+
+        pruned_sequence_ = entry.seq;
+        entries_.pop_front();
+    }
+
+    // if most of the journal is entries that have been superseded
+    // by newer ones for the same torrent, sweep them out
+    if (std::size(entries_) > 1024 && std::size(entries_) > 2 * std::size(newest_))
+    {
+        auto const superseded = [this](Entry const& entry)
+        {
+            return newest_.at(entry.torrent_id) != entry.seq;
+        };
+
+        entries_.erase(std::remove_if(std::begin(entries_), std::end(entries_), superseded), std::end(entries_));
+    }
+}
+
+template<typename Done>
+tr_activity_journal::Changes tr_activity_journal::collect(Done done)
+{
+    auto changes = Changes{};
+
+    // walk from newest to oldest, skipping entries that a newer one superseded
+    for (auto it = std::rbegin(entries_), end = std::rend(entries_); it != end && !done(*it); ++it)
+    {
+        if (newest_.at(it->torrent_id) != it->seq)
+        {
+            continue;
+        }
+
+        if (it->torrent_id == AllTorrents)
+        {
+            changes.all = true;
+        }
+        else if (it->kind == Kind::Removed)
+        {
+            changes.removed.push_back(it->torrent_id);
+        }
+        else
+        {
+            changes.changed.push_back(it->torrent_id);
+        }
+    }
+
+    read_sequence_ = sequence_;
+    return changes;
+}
+
+std::optional<tr_activity_journal::Changes> tr_activity_journal::changesSince(uint64_t seq)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (seq < pruned_sequence_ || seq > sequence_)
+    {
+        return {};
+    }
+
+    return collect([seq](Entry const& entry) { return entry.seq <= seq; });
+}
+
+tr_activity_journal::Changes tr_activity_journal::changesAfter(time_t cutoff)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    return collect([cutoff](Entry const& entry) { return entry.when < cutoff; });
+}
@@ -0,0 +1,151 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A journal of which torrents changed and when, so that RPC
+ * "recently-active" requests can be answered without looking
+ * at every torrent in the session.
+ *
+ * Every entry gets the next number in a monotonic sequence. A client
+ * can pass back the sequence number from its previous request to get
+ * just the torrents that changed since then, including removals.
+ *
+ * A torrent that changes many times between two reads only needs one
+ * entry, so callers can skip adding another one while their previous
+ * entry is still pending. See isPending().
+ *
+ * It's safe to use from multiple threads, since e.g. verifying
+ * a torrent's local data marks it as changed.
+ */
+class tr_activity_journal
+{
+public:
+    struct Changes
+    {
+        // every torrent changed
+        bool all = false;
+
+        // torrent ids, newest first
+        std::vector<int> changed;
+        std::vector<int> removed;
+    };
+
+    /**
+     * @param retention_secs how long entries are kept. This bounds how far
+     *        back changesSince() and changesAfter() can see.
+     */
+    explicit tr_activity_journal(time_t retention_secs)
+        : retention_secs_{ retention_secs }
+    {
+    }
+
+    /** @return the new entry's sequence number */
+    uint64_t addChanged(int torrent_id, time_t now)
+    {
+        return add(torrent_id, now, Kind::Changed);
+    }
+
+    /** @return the new entry's sequence number */
+    uint64_t addRemoved(int torrent_id, time_t now)
+    {
+        return add(torrent_id, now, Kind::Removed);
+    }
+
+    /** @return the new entry's sequence number */
+    uint64_t addAllChanged(time_t now)
+    {
+        return add(AllTorrents, now, Kind::Changed);
+    }
+
+    /** @return the sequence number of the newest entry */
+    [[nodiscard]] uint64_t sequence() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return sequence_;
+    }
+
+    /**
+     * @return the sequence number of the newest entry, which is handed to a
+     *         client to pass back next time. Since that client won't look at
+     *         entries up to it again, they're no longer pending.
+     */
+    uint64_t markRead()
+    {
+        auto const lock = std::lock_guard(mutex_);
+        read_sequence_ = sequence_;
+        return sequence_;
+    }
+
+    /** @return true if the entry numbered `seq` is still in the journal and hasn't been read yet */
+    [[nodiscard]] bool isPending(uint64_t seq) const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return seq > read_sequence_ && seq > pruned_sequence_;
+    }
+
+    /** @return the changes after sequence number `seq`, or nullopt if the journal doesn't reach back that far */
+    [[nodiscard]] std::optional<Changes> changesSince(uint64_t seq);
+
+    /** @return the changes made at or after `cutoff` */
+    [[nodiscard]] Changes changesAfter(time_t cutoff);
+
+    [[nodiscard]] size_t size() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return std::size(entries_);
+    }
+
+private:
+    static auto constexpr AllTorrents = int{ 0 };
+
+    enum class Kind
+    {
+        Changed,
+        Removed
+    };
+
+    struct Entry
+    {
+        uint64_t seq;
+        time_t when;
+        int torrent_id;
+        Kind kind;
+    };
+
+    uint64_t add(int torrent_id, time_t now, Kind kind);
+    void prune(time_t now);
+
+    template<typename Done>
+    Changes collect(Done done);
+
+    mutable std::mutex mutex_;
+
+    std::deque<Entry> entries_;
+
+    // torrent id -> sequence number of its newest entry
+    std::unordered_map<int, uint64_t> newest_;
+
+    time_t const retention_secs_;
+    uint64_t sequence_ = 0;
+    uint64_t read_sequence_ = 0;
+    uint64_t pruned_sequence_ = 0;
+};
@@ -24,59 +24,52 @@
 ****
 ***/
 
-unsigned int Bandwidth::getSpeedBytesPerSecond(RateControl& r, unsigned int interval_msec, uint64_t now)
+void Bandwidth::expire(RateControl& r, uint64_t now)
 {
-    if (now == 0)
+    auto const slice = now / GranularityMSec;
+
+    if (slice <= r.newest_)
     {
-        now = tr_time_msec();
+        return;
     }
 
-    if (now != r.cache_time_)
+    if (slice - r.newest_ >= HistorySize)
     {
-        uint64_t bytes = 0;
-        uint64_t const cutoff = now - interval_msec;
-
-        for (int i = r.newest_; r.transfers_[i].date_ > cutoff;)
+        r.slices_.fill(0);
+        r.total_ = 0;
+    }
+    else
+    {
+        for (auto i = r.newest_ + 1; i <= slice; ++i)
         {
-            bytes += r.transfers_[i].size_;
-
-            if (--i == -1)
-            {
-                i = HistorySize - 1; /* circular history */
-            }
-
-            if (i == r.newest_)
-            {
-                break; /* we've come all the way around */
-            }
+            auto& bytes = r.slices_[i % HistorySize];
+            r.total_ -= bytes;
+            bytes = 0;
         }
-
-        r.cache_val_ = unsigned(bytes * 1000U / interval_msec);
-        r.cache_time_ = now;
     }
 
-    return r.cache_val_;
+    r.newest_ = slice;
 }
 
-void Bandwidth::notifyBandwidthConsumedBytes(uint64_t const now, RateControl* r, size_t size)
+unsigned int Bandwidth::getSpeedBytesPerSecond(RateControl& r, uint64_t now)
 {
-    if (r->transfers_[r->newest_].date_ + GranularityMSec >= now)
+    if (now == 0)
     {
-        r->transfers_[r->newest_].size_ += size;
+        now = tr_time_msec();
     }
-    else
-    {
-        if (++r->newest_ == HistorySize)
-        {
-            r->newest_ = 0;
-        }
 
-        r->transfers_[r->newest_].date_ = now;
-        r->transfers_[r->newest_].size_ = size;
-    }
+    expire(r, now);
+
+    return unsigned(r.total_ * 1000U / HistoryMSec);
+}
+
+void Bandwidth::notifyBandwidthConsumedBytes(uint64_t const now, RateControl* r, size_t size)
+{
+    expire(*r, now);
 
-    /* invalidate cache_val*/
-    r->cache_time_ = 0;
+    // if the clock went backwards, count the bytes in the newest slice
+    r->slices_[r->newest_ % HistorySize] += size;
+    r->total_ += size;
 }
 
 /***
@@ -128,7 +128,7 @@ public:
     {
         TR_ASSERT(tr_isDirection(dir));
 
-        return getSpeedBytesPerSecond(this->band_[dir].raw_, HistoryMSec, now);
+        return getSpeedBytesPerSecond(this->band_[dir].raw_, now);
     }
 
     /** @brief Get the number of piece data bytes read or sent by this bandwidth subtree. */
@@ -136,7 +136,7 @@ public:
     {
         TR_ASSERT(tr_isDirection(dir));
 
-        return getSpeedBytesPerSecond(this->band_[dir].piece_, HistoryMSec, now);
+        return getSpeedBytesPerSecond(this->band_[dir].piece_, now);
     }
 
     /**
@@ -206,17 +206,14 @@ public:
     static constexpr size_t GranularityMSec = 200;
     static constexpr size_t HistorySize = (IntervalMSec / GranularityMSec);
 
+    /* A ring of GranularityMSec-wide slices covering the last HistoryMSec,
+     * plus a running total of the bytes in the ring. Slices are expired
+     * lazily as time moves forward, so both adding and reading are O(1). */
     struct RateControl
     {
-        struct Transfer
-        {
-            uint64_t date_;
-            uint64_t size_;
-        };
-        std::array<Transfer, HistorySize> transfers_;
-        uint64_t cache_time_;
-        unsigned int cache_val_;
-        int newest_;
+        std::array<uint64_t, HistorySize> slices_;
+        uint64_t total_;
+        uint64_t newest_; // index of the newest slice, i.e. its time / GranularityMSec
     };
 
     struct Band
@@ -230,7 +227,9 @@ public:
     };
 
 private:
-    static unsigned int getSpeedBytesPerSecond(RateControl& r, unsigned int interval_msec, uint64_t now);
+    static void expire(RateControl& r, uint64_t now);
+
+    static unsigned int getSpeedBytesPerSecond(RateControl& r, uint64_t now);
 
     static void notifyBandwidthConsumedBytes(uint64_t now, RateControl* r, size_t size);
 
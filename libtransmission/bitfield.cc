@@ -7,6 +7,9 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <iterator> // std::prev
+#include <numeric> // std::accumulate
 #include <vector>
 
 #include "transmission.h"
@@ -49,6 +52,123 @@ constexpr int8_t const trueBitCount[256] = {
     6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
 };
 
+// SWAR popcount. Compilers recognize this and emit
+// a popcnt instruction when the target has one.
+constexpr size_t popcount64(uint64_t v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (v * 0x0101010101010101ULL) >> 56;
+}
+
+constexpr uint64_t loadWord(uint8_t const* bytes)
+{
+    // Bit order within the word doesn't matter to any of the callers,
+    // so just assemble the bytes in native order without branching on endianness.
+    uint64_t word = 0;
+    for (size_t i = 0; i < sizeof(word); ++i)
+    {
+        word |= uint64_t{ bytes[i] } << (i * 8);
+    }
+    return word;
+}
+
+constexpr void storeWord(uint8_t* bytes, uint64_t word)
+{
+    for (size_t i = 0; i < sizeof(word); ++i)
+    {
+        bytes[i] = uint8_t(word >> (i * 8));
+    }
+}
+
+size_t countBytes(uint8_t const* bytes, size_t n)
+{
+    size_t ret = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        ret += popcount64(loadWord(bytes + i));
+    }
+
+    for (; i < n; ++i)
+    {
+        ret += trueBitCount[bytes[i]];
+    }
+
+    return ret;
+}
+
+// the number of bytes in flags that can hold bits in [0..bit_count)
+size_t usableBytes(std::vector<uint8_t> const& flags, size_t bit_count)
+{
+    return bit_count == 0 ? std::size(flags) : std::min(std::size(flags), getBytesNeeded(bit_count));
+}
+
+// sets bits [begin, end) in a BEP0003-ordered bit array
+void setBits(uint8_t* bytes, size_t begin, size_t end)
+{
+    for (; begin < end && (begin & 7U) != 0; ++begin)
+    {
+        bytes[begin >> 3U] |= 0x80 >> (begin & 7U);
+    }
+
+    if (begin + 8 <= end)
+    {
+        auto const n = (end - begin) >> 3U;
+        std::fill_n(bytes + (begin >> 3U), n, 0xFF);
+        begin += n * 8;
+    }
+
+    for (; begin < end; ++begin)
+    {
+        bytes[begin >> 3U] |= 0x80 >> (begin & 7U);
+    }
+}
+
+// a = op(a, b) for the first n bytes
+template<typename Op>
+void transformBytes(uint8_t* a, uint8_t const* b, size_t n, Op op)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        storeWord(a + i, op(loadWord(a + i), loadWord(b + i)));
+    }
+
+    for (; i < n; ++i)
+    {
+        a[i] = uint8_t(op(a[i], b[i]));
+    }
+}
+
+// true if any(op(a, b)) for the first n bytes
+template<typename Op>
+bool anyBytes(uint8_t const* a, uint8_t const* b, size_t n, Op op)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        if (op(loadWord(a + i), loadWord(b + i)) != 0)
+        {
+            return true;
+        }
+    }
+
+    for (; i < n; ++i)
+    {
+        if (op(uint64_t{ a[i] }, uint64_t{ b[i] }) != 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 } // namespace
 
 /****
@@ -56,12 +176,33 @@ constexpr int8_t const trueBitCount[256] = {
 ****/
 
 size_t tr_bitfield::countFlags() const
+{
+    if (!std::empty(runs_))
+    {
+        return std::accumulate(
+            std::begin(runs_),
+            std::end(runs_),
+            size_t{},
+            [](size_t sum, Span const& run) { return sum + (run.end - run.begin); });
+    }
+
+    return countBytes(std::data(flags_), std::size(flags_));
+}
+
+size_t tr_bitfield::countRuns(size_t begin, size_t end) const
 {
     size_t ret = 0;
 
-    for (auto ch : flags_)
+    // the first run that ends after `begin`
+    auto it = std::upper_bound(
+        std::begin(runs_),
+        std::end(runs_),
+        begin,
+        [](size_t bit, Span const& run) { return bit < run.end; });
+
+    for (; it != std::end(runs_) && it->begin < end; ++it)
     {
-        ret += trueBitCount[ch];
+        ret += std::min(end, it->end) - std::max(begin, it->begin);
     }
 
     return ret;
@@ -69,6 +210,11 @@ size_t tr_bitfield::countFlags() const
 
 size_t tr_bitfield::countFlags(size_t begin, size_t end) const
 {
+    if (!std::empty(runs_))
+    {
+        return countRuns(begin, end);
+    }
+
     size_t ret = 0;
     size_t const first_byte = begin >> 3U;
     size_t const last_byte = (end - 1) >> 3U;
@@ -111,9 +257,9 @@ size_t tr_bitfield::countFlags(size_t begin, size_t end) const
         ret += trueBitCount[val];
 
         /* middle bytes */
-        for (size_t i = first_byte + 1; i < walk_end; ++i)
+        if (first_byte + 1 < walk_end)
         {
-            ret += trueBitCount[flags_[i]];
+            ret += countBytes(std::data(flags_) + first_byte + 1, walk_end - (first_byte + 1));
         }
 
         /* last byte */
@@ -148,6 +294,16 @@ size_t tr_bitfield::count(size_t begin, size_t end) const
 
 bool tr_bitfield::testFlag(size_t n) const
 {
+    if (!std::empty(runs_))
+    {
+        auto const it = std::upper_bound(
+            std::begin(runs_),
+            std::end(runs_),
+            n,
+            [](size_t bit, Span const& run) { return bit < run.end; });
+        return it != std::end(runs_) && it->begin <= n;
+    }
+
     if (n >> 3U >= std::size(flags_))
     {
         return false;
@@ -165,7 +321,13 @@ bool tr_bitfield::testFlag(size_t n) const
 
 bool tr_bitfield::assertValid() const
 {
-    TR_ASSERT(std::empty(flags_) || true_count_ == countFlags());
+    TR_ASSERT(std::empty(flags_) || std::empty(runs_));
+    TR_ASSERT((std::empty(flags_) && std::empty(runs_)) || true_count_ == countFlags());
+    TR_ASSERT(std::all_of(std::begin(runs_), std::end(runs_), [](Span const& run) { return run.begin < run.end; }));
+    TR_ASSERT(std::adjacent_find(
+                  std::begin(runs_),
+                  std::end(runs_),
+                  [](Span const& a, Span const& b) { return a.end >= b.begin; }) == std::end(runs_));
 
     return true;
 }
@@ -183,6 +345,16 @@ std::vector<uint8_t> tr_bitfield::raw() const
 
     auto raw = std::vector<uint8_t>(n);
 
+    if (!std::empty(runs_))
+    {
+        for (auto const& run : runs_)
+        {
+            setBits(std::data(raw), run.begin, run.end);
+        }
+
+        return raw;
+    }
+
     if (hasAll())
     {
         setAllTrue(std::data(raw), std::size(raw));
@@ -193,6 +365,8 @@ std::vector<uint8_t> tr_bitfield::raw() const
 
 void tr_bitfield::ensureBitsAlloced(size_t n)
 {
+    useFlags();
+
     bool const has_all = hasAll();
 
     size_t const bytes_needed = has_all ? getBytesNeeded(std::max(n, true_count_)) : getBytesNeeded(n);
@@ -223,6 +397,157 @@ bool tr_bitfield::ensureNthBitAlloced(size_t nth)
 void tr_bitfield::freeArray()
 {
     flags_ = std::vector<uint8_t>{};
+    runs_ = std::vector<Span>{};
+}
+
+/***
+****
+***/
+
+// past this many runs, the dense bit array is smaller
+size_t tr_bitfield::maxRunCount() const
+{
+    return getBytesNeeded(bit_count_) / sizeof(Span);
+}
+
+// true if the bits [0..end) can be changed by editing runs_
+bool tr_bitfield::canUseRuns(size_t end) const
+{
+    if (!std::empty(runs_))
+    {
+        return end <= bit_count_;
+    }
+
+    // start using runs when leaving have-all or have-none
+    return std::empty(flags_) && end <= bit_count_ && maxRunCount() > 0;
+}
+
+void tr_bitfield::setRunsSpan(size_t begin, size_t end, bool value)
+{
+    TR_ASSERT(begin < end);
+
+    if (std::empty(runs_) && hasAll())
+    {
+        runs_.push_back({ 0, bit_count_ });
+    }
+
+    if (value)
+    {
+        // merge with any runs that overlap or touch [begin, end)
+        auto const first = std::lower_bound(
+            std::begin(runs_),
+            std::end(runs_),
+            begin,
+            [](Span const& run, size_t bit) { return run.end < bit; });
+        auto const last = std::upper_bound(
+            first,
+            std::end(runs_),
+            end,
+            [](size_t bit, Span const& run) { return bit < run.begin; });
+
+        auto merged = Span{ begin, end };
+        if (first != last)
+        {
+            merged.begin = std::min(begin, first->begin);
+            merged.end = std::max(end, std::prev(last)->end);
+        }
+
+        runs_.insert(runs_.erase(first, last), merged);
+    }
+    else
+    {
+        // trim any runs that overlap [begin, end)
+        auto const first = std::lower_bound(
+            std::begin(runs_),
+            std::end(runs_),
+            begin,
+            [](Span const& run, size_t bit) { return run.end <= bit; });
+        auto const last = std::lower_bound(
+            first,
+            std::end(runs_),
+            end,
+            [](Span const& run, size_t bit) { return run.begin < bit; });
+
+        if (first == last)
+        {
+            return;
+        }
+
+        auto pieces = std::array<Span, 2>{};
+        size_t n_pieces = 0;
+        if (first->begin < begin)
+        {
+            pieces[n_pieces++] = Span{ first->begin, begin };
+        }
+        if (std::prev(last)->end > end)
+        {
+            pieces[n_pieces++] = Span{ end, std::prev(last)->end };
+        }
+
+        auto const it = runs_.erase(first, last);
+        runs_.insert(it, std::begin(pieces), std::begin(pieces) + n_pieces);
+    }
+}
+
+// switch from runs to a dense bit array
+void tr_bitfield::useFlags()
+{
+    if (!std::empty(runs_))
+    {
+        flags_ = raw();
+        runs_ = std::vector<Span>{};
+    }
+}
+
+// switch from a dense bit array to runs if the runs would take much less memory
+void tr_bitfield::useRunsIfSmaller()
+{
+    if (std::empty(flags_) || bit_count_ == 0)
+    {
+        return;
+    }
+
+    auto const n_bits = std::size(flags_) * 8;
+    auto const find_next = [this, n_bits](size_t bit, bool value)
+    {
+        auto const skip = value ? uint8_t{ 0x00 } : uint8_t{ 0xFF };
+
+        while (bit < n_bits)
+        {
+            if ((bit & 7U) == 0 && flags_[bit >> 3U] == skip)
+            {
+                bit += 8;
+            }
+            else if (testFlag(bit) == value)
+            {
+                break;
+            }
+            else
+            {
+                ++bit;
+            }
+        }
+
+        return std::min(bit, n_bits);
+    };
+
+    // leave some headroom so that we don't flip-flop between the two
+    auto const max_runs = maxRunCount() / 2;
+    auto runs = std::vector<Span>{};
+    for (size_t bit = find_next(0, true); bit < n_bits; bit = find_next(bit, true))
+    {
+        if (std::size(runs) == max_runs)
+        {
+            return;
+        }
+
+        auto const end = find_next(bit, false);
+        runs.push_back({ bit, end });
+        bit = end;
+    }
+
+    runs_ = std::move(runs);
+    flags_ = std::vector<uint8_t>{};
 }
 
 void tr_bitfield::setTrueCount(size_t n)
@@ -310,7 +635,9 @@ void tr_bitfield::setRaw(uint8_t const* raw, size_t byte_count)
         }
     }
 
+    runs_ = std::vector<Span>{};
     rebuildTrueCount();
+    useRunsIfSmaller();
 }
 
 void tr_bitfield::setFromBools(bool const* flags, size_t n)
@@ -330,6 +657,7 @@ void tr_bitfield::setFromBools(bool const* flags, size_t n)
     }
 
     setTrueCount(trueCount);
+    useRunsIfSmaller();
 }
 
 void tr_bitfield::set(size_t nth, bool value)
@@ -339,6 +667,27 @@ void tr_bitfield::set(size_t nth, bool value)
         return;
     }
 
+    if (nth != SIZE_MAX && canUseRuns(nth + 1))
+    {
+        setRunsSpan(nth, nth + 1, value);
+
+        if (value)
+        {
+            incrementTrueCount(1);
+        }
+        else
+        {
+            decrementTrueCount(1);
+        }
+
+        if (std::size(runs_) > maxRunCount())
+        {
+            useFlags();
+        }
+
+        return;
+    }
+
     if (!ensureNthBitAlloced(nth))
     {
         return;
@@ -374,6 +723,27 @@ void tr_bitfield::setSpan(size_t begin, size_t end, bool value)
         return;
     }
 
+    if (canUseRuns(end))
+    {
+        setRunsSpan(begin, end, value);
+
+        if (value)
+        {
+            incrementTrueCount(new_count - old_count);
+        }
+        else
+        {
+            decrementTrueCount(old_count);
+        }
+
+        if (std::size(runs_) > maxRunCount())
+        {
+            useFlags();
+        }
+
+        return;
+    }
+
     --end;
     if (!ensureNthBitAlloced(end))
     {
@@ -428,3 +798,198 @@ void tr_bitfield::setSpan(size_t begin, size_t end, bool value)
         decrementTrueCount(old_count);
     }
 }
+
+/***
+****
+***/
+
+// the dense form of this bitfield's bits, using `scratch` if needed
+std::vector<uint8_t> const& tr_bitfield::flagsView(std::vector<uint8_t>& scratch) const
+{
+    if (std::empty(runs_))
+    {
+        return flags_;
+    }
+
+    scratch = raw();
+    return scratch;
+}
+
+// after flags_ have been modified in bulk, drop any bits past
+// the end of the bitfield and bring true_count_ back in sync
+void tr_bitfield::normalizeFlags()
+{
+    flags_.resize(usableBytes(flags_, bit_count_));
+
+    if (bit_count_ != 0 && std::size(flags_) == getBytesNeeded(bit_count_))
+    {
+        flags_.back() &= uint8_t(0xff << (std::size(flags_) * 8 - bit_count_));
+    }
+
+    rebuildTrueCount();
+    useRunsIfSmaller();
+}
+
+tr_bitfield& tr_bitfield::operator|=(tr_bitfield const& that)
+{
+    if (hasAll() || that.hasNone())
+    {
+        return *this;
+    }
+
+    if (that.hasAll())
+    {
+        setHasAll();
+        return *this;
+    }
+
+    auto scratch = std::vector<uint8_t>{};
+    auto const& that_flags = that.flagsView(scratch);
+    auto const n = usableBytes(that_flags, that.bit_count_);
+
+    useFlags();
+    if (std::size(flags_) < n)
+    {
+        flags_.resize(n);
+    }
+
+    transformBytes(std::data(flags_), std::data(that_flags), n, [](uint64_t a, uint64_t b) { return a | b; });
+    normalizeFlags();
+    return *this;
+}
+
+tr_bitfield& tr_bitfield::operator&=(tr_bitfield const& that)
+{
+    if (hasNone() || that.hasAll())
+    {
+        return *this;
+    }
+
+    if (that.hasNone())
+    {
+        setHasNone();
+        return *this;
+    }
+
+    if (hasAll())
+    {
+        flags_ = that.raw();
+        runs_ = std::vector<Span>{};
+        normalizeFlags();
+        return *this;
+    }
+
+    auto scratch = std::vector<uint8_t>{};
+    auto const& that_flags = that.flagsView(scratch);
+    useFlags();
+
+    // bits past the end of that's array are zero
+    auto const n = std::min(std::size(flags_), usableBytes(that_flags, that.bit_count_));
+    flags_.resize(n);
+    transformBytes(std::data(flags_), std::data(that_flags), n, [](uint64_t a, uint64_t b) { return a & b; });
+    normalizeFlags();
+    return *this;
+}
+
+tr_bitfield& tr_bitfield::andNot(tr_bitfield const& that)
+{
+    if (hasNone() || that.hasNone())
+    {
+        return *this;
+    }
+
+    if (that.hasAll())
+    {
+        setHasNone();
+        return *this;
+    }
+
+    if (hasAll())
+    {
+        // without a bit count there's no way to represent "all but these"
+        if (bit_count_ == 0)
+        {
+            return *this;
+        }
+
+        ensureBitsAlloced(bit_count_);
+    }
+
+    auto scratch = std::vector<uint8_t>{};
+    auto const& that_flags = that.flagsView(scratch);
+    useFlags();
+
+    auto const n = std::min(std::size(flags_), usableBytes(that_flags, that.bit_count_));
+    transformBytes(std::data(flags_), std::data(that_flags), n, [](uint64_t a, uint64_t b) { return a & ~b; });
+    normalizeFlags();
+    return *this;
+}
+
+bool tr_bitfield::intersects(tr_bitfield const& that) const
+{
+    if (hasNone() || that.hasNone())
+    {
+        return false;
+    }
+
+    if (hasAll())
+    {
+        return that.count() != 0;
+    }
+
+    if (that.hasAll())
+    {
+        return count() != 0;
+    }
+
+    if (!std::empty(runs_))
+    {
+        return std::any_of(
+            std::begin(runs_),
+            std::end(runs_),
+            [&that](Span const& run) { return that.count(run.begin, run.end) != 0; });
+    }
+
+    if (!std::empty(that.runs_))
+    {
+        return that.intersects(*this);
+    }
+
+    auto const n = std::min(usableBytes(flags_, bit_count_), usableBytes(that.flags_, that.bit_count_));
+    return anyBytes(std::data(flags_), std::data(that.flags_), n, [](uint64_t a, uint64_t b) { return a & b; });
+}
+
+bool tr_bitfield::hasAnyNotIn(tr_bitfield const& that) const
+{
+    if (hasNone() || that.hasAll())
+    {
+        return false;
+    }
+
+    if (that.hasNone())
+    {
+        return true;
+    }
+
+    if (hasAll())
+    {
+        return bit_count_ == 0 || that.count() < bit_count_;
+    }
+
+    if (!std::empty(runs_))
+    {
+        return std::any_of(
+            std::begin(runs_),
+            std::end(runs_),
+            [&that](Span const& run) { return that.count(run.begin, run.end) != run.end - run.begin; });
+    }
+
+    auto scratch = std::vector<uint8_t>{};
+    auto const& that_flags = that.flagsView(scratch);
+
+    // any bits set past the end of that's array are not in that
+    auto const n = usableBytes(flags_, bit_count_);
+    auto const that_n = std::min(n, usableBytes(that_flags, that.bit_count_));
+    return anyBytes(std::data(flags_), std::data(that_flags), that_n, [](uint64_t a, uint64_t b) { return a & ~b; }) ||
+        countBytes(std::data(flags_) + that_n, n - that_n) != 0;
+}
@@ -38,6 +38,12 @@
  *
  * - "Have none" is another special case that has the same advantages
  *   and motivations as "Have all".
+ *
+ * - Between those extremes, bits are kept either as a sorted list of
+ *   runs of set bits or as a dense bit array, whichever is smaller.
+ *   Runs suit bitfields that are filled in mostly-contiguous spans,
+ *   e.g. a torrent's blocks during a sequential download or a peer
+ *   that's nearly complete. The representation changes automatically.
  */
 class tr_bitfield
 {
@@ -98,16 +104,53 @@ public:
         return size() == 0;
     }
 
+    // set algebra against another bitfield of the same size.
+    // These work a machine word at a time rather than bit-by-bit.
+    tr_bitfield& operator|=(tr_bitfield const& that);
+    tr_bitfield& operator&=(tr_bitfield const& that);
+    tr_bitfield& andNot(tr_bitfield const& that); // this &= ~that
+
+    // true if any bit is set in both this and that
+    [[nodiscard]] bool intersects(tr_bitfield const& that) const;
+
+    // true if any bit is set in this but not in that
+    [[nodiscard]] bool hasAnyNotIn(tr_bitfield const& that) const;
+
+    // the number of bytes allocated to hold the bits
+    [[nodiscard]] size_t allocatedBytes() const
+    {
+        return flags_.capacity() + runs_.capacity() * sizeof(Span);
+    }
+
 #ifdef TR_ENABLE_ASSERTS
     bool assertValid() const;
 #endif
 
 private:
+    // a run of set bits, [begin, end)
+    struct Span
+    {
+        size_t begin;
+        size_t end;
+    };
+
+    // at most one of these is in use at a time
     std::vector<uint8_t> flags_;
+    std::vector<Span> runs_;
+
     [[nodiscard]] size_t countFlags() const;
     [[nodiscard]] size_t countFlags(size_t begin, size_t end) const;
+    [[nodiscard]] size_t countRuns(size_t begin, size_t end) const;
     [[nodiscard]] bool testFlag(size_t bit) const;
 
+    [[nodiscard]] size_t maxRunCount() const;
+    [[nodiscard]] bool canUseRuns(size_t end) const;
+    [[nodiscard]] std::vector<uint8_t> const& flagsView(std::vector<uint8_t>& scratch) const;
+    void setRunsSpan(size_t begin, size_t end, bool value);
+    void useFlags();
+    void useRunsIfSmaller();
+    void normalizeFlags();
+
     void ensureBitsAlloced(size_t n);
     [[nodiscard]] bool ensureNthBitAlloced(size_t nth);
     void freeArray();
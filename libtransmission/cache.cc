@@ -66,9 +66,19 @@ struct run_info
     time_t last_block_time;
     bool is_multi_piece;
     bool is_piece_done;
+    bool is_blocked;
     unsigned int len;
 };
 
+/* true if any of the files under these blocks are waiting to be preallocated */
+static bool isRunBlocked(struct cache_block const* first, struct cache_block const* last)
+{
+    auto const* const tor = first->tor;
+    auto const begin = tor->fileOffset(first->piece, first->offset).index;
+    auto const end = tor->fileOffset(last->piece, last->offset + last->length - 1).index;
+    return tor->session->preallocator.isPending(tor->uniqueId, begin, end);
+}
+
 /* return a count of how many contiguous blocks there are starting at this pos */
 static int getBlockRun(tr_cache const* cache, int pos, struct run_info* info)
 {
@@ -102,6 +112,7 @@ static int getBlockRun(tr_cache const* cache, int pos, struct run_info* info)
         info->last_block_time = b->time;
         info->is_piece_done = b->tor->hasPiece(b->piece);
         info->is_multi_piece = b->piece != blocks[pos]->piece;
+        info->is_blocked = isRunBlocked(blocks[pos], b);
         info->len = len;
         info->pos = pos;
     }
@@ -151,7 +162,8 @@ static int calcRuns(tr_cache const* cache, struct run_info* runs)
         /* Move the multi piece runs higher */
         rank |= runs[i].is_multi_piece ? MULTIFLAG : 0;
 
-        runs[i].rank = rank;
+        /* Runs that can't be written until their files are preallocated go last */
+        runs[i].rank = runs[i].is_blocked ? -1 : rank;
     }
 
     qsort(runs, i, sizeof(struct run_info), compareRuns);
@@ -222,9 +234,14 @@ static int cacheTrim(tr_cache* cache)
         int i = 0;
         int j = 0;
 
-        calcRuns(cache, runs);
+        int const n = calcRuns(cache, runs);
+
+        /* Keep the blocks of files that are waiting to be preallocated,
+         * unless the cache has grown too big to wait for them. Writing
+         * them takes their files out of the preallocation queue. */
+        bool const overfull = tr_ptrArraySize(&cache->blocks) > 2 * cache->max_blocks;
 
-        while (j < cacheCutoff)
+        while (i < n && j < cacheCutoff && (overfull || !runs[i].is_blocked))
         {
             j += runs[i++].len;
         }
@@ -412,7 +429,7 @@ int tr_cacheFlushDone(tr_cache* cache)
         int i = 0;
         int const n = calcRuns(cache, runs);
 
-        while (i < n && (runs[i].is_piece_done || runs[i].is_multi_piece))
+        while (i < n && !runs[i].is_blocked && (runs[i].is_piece_done || runs[i].is_multi_piece))
         {
             runs[i++].rank |= SESSIONFLAG;
         }
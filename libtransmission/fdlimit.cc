@@ -9,7 +9,12 @@
 #include <algorithm>
 #include <cerrno>
 #include <cinttypes>
-#include <cstring>
+#include <list>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/resource.h> /* getrlimit(), setrlimit() */
+#endif
 
 #include "transmission.h"
 #include "error.h"
@@ -17,98 +22,13 @@
 #include "fdlimit.h"
 #include "file.h"
 #include "log.h"
+#include "preallocator.h" /* tr_preallocateFile() */
 #include "session.h"
 #include "torrent.h" /* tr_isTorrent() */
 #include "tr-assert.h"
 
 #define dbgmsg(...) tr_logAddDeepNamed(nullptr, __VA_ARGS__)
 
-/***
-****
-****  Local Files
-****
-***/
-
-static bool preallocate_file_sparse(tr_sys_file_t fd, uint64_t length, tr_error** error)
-{
-    tr_error* my_error = nullptr;
-
-    if (length == 0)
-    {
-        return true;
-    }
-
-    if (tr_sys_file_preallocate(fd, length, TR_SYS_FILE_PREALLOC_SPARSE, &my_error))
-    {
-        return true;
-    }
-
-    dbgmsg("Preallocating (sparse, normal) failed (%d): %s", my_error->code, my_error->message);
-
-    if (!TR_ERROR_IS_ENOSPC(my_error->code))
-    {
-        char const zero = '\0';
-
-        tr_error_clear(&my_error);
-
-        /* fallback: the old-style seek-and-write */
-        if (tr_sys_file_write_at(fd, &zero, 1, length - 1, nullptr, &my_error) && tr_sys_file_truncate(fd, length, &my_error))
-        {
-            return true;
-        }
-
-        dbgmsg("Preallocating (sparse, fallback) failed (%d): %s", my_error->code, my_error->message);
-    }
-
-    tr_error_propagate(error, &my_error);
-    return false;
-}
-
-static bool preallocate_file_full(tr_sys_file_t fd, uint64_t length, tr_error** error)
-{
-    tr_error* my_error = nullptr;
-
-    if (length == 0)
-    {
-        return true;
-    }
-
-    if (tr_sys_file_preallocate(fd, length, 0, &my_error))
-    {
-        return true;
-    }
-
-    dbgmsg("Preallocating (full, normal) failed (%d): %s", my_error->code, my_error->message);
-
-    if (!TR_ERROR_IS_ENOSPC(my_error->code))
-    {
-        uint8_t buf[4096];
-        bool success = true;
-
-        memset(buf, 0, sizeof(buf));
-        tr_error_clear(&my_error);
-
-        /* fallback: the old-fashioned way */
-        while (success && length > 0)
-        {
-            uint64_t const thisPass = std::min(length, uint64_t{ sizeof(buf) });
-            uint64_t bytes_written = 0;
-            success = tr_sys_file_write(fd, buf, thisPass, &bytes_written, &my_error);
-            length -= bytes_written;
-        }
-
-        if (success)
-        {
-            return true;
-        }
-
-        dbgmsg("Preallocating (full, fallback) failed (%d): %s", my_error->code, my_error->message);
-    }
-
-    tr_error_propagate(error, &my_error);
-    return false;
-}
-
 /*****
 ******
 ******
@@ -117,31 +37,12 @@ static bool preallocate_file_full(tr_sys_file_t fd, uint64_t length, tr_error**
 
 struct tr_cached_file
 {
-    bool is_writable;
-    tr_sys_file_t fd;
     int torrent_id;
     tr_file_index_t file_index;
-    time_t used_at;
+    bool is_writable;
+    tr_sys_file_t fd;
 };
 
-static constexpr bool cached_file_is_open(struct tr_cached_file const* o)
-{
-    TR_ASSERT(o != nullptr);
-
-    return (o != nullptr) && (o->fd != TR_BAD_SYS_FILE);
-}
-
-static void cached_file_close(struct tr_cached_file* o)
-{
-    TR_ASSERT(cached_file_is_open(o));
-
-    if (o != nullptr)
-    {
-        tr_sys_file_close(o->fd, nullptr);
-        o->fd = TR_BAD_SYS_FILE;
-    }
-}
-
 /**
  * returns 0 on success, or an errno value on failure.
  * errno values include ENOENT if the parent folder doesn't exist,
@@ -202,23 +103,9 @@ static int cached_file_open(
 
     if (writable && !already_existed && allocation != TR_PREALLOCATE_NONE)
     {
-        bool success = false;
-        char const* type = nullptr;
-
-        if (allocation == TR_PREALLOCATE_FULL)
-        {
-            success = preallocate_file_full(fd, file_size, &error);
-            type = _("full");
-        }
-        else if (allocation == TR_PREALLOCATE_SPARSE)
-        {
-            success = preallocate_file_sparse(fd, file_size, &error);
-            type = _("sparse");
-        }
+        char const* const type = allocation == TR_PREALLOCATE_FULL ? _("full") : _("sparse");
 
-        TR_ASSERT(type != nullptr);
-
-        if (!success)
+        if (!tr_preallocateFile(fd, file_size, allocation, &error))
         {
             tr_logAddError(
                 _("Couldn't preallocate file \"%1$s\" (%2$s, size: %3$" PRIu64 "): %4$s"),
@@ -245,6 +132,7 @@ static int cached_file_open(
     }
 
     o->fd = fd;
+    o->is_writable = writable;
     return 0;
 
 FAIL:
@@ -265,103 +153,161 @@ FAIL:
 ****
 ***/
 
-struct tr_fileset
+/**
+ * The files we're holding open, most-recently-used first.
+ *
+ * A file can have a read-only handle and a writable one at the same time.
+ * Reads take whichever is open; writes need the writable one. Keeping them
+ * apart means that a file being written doesn't lose its read handle, and
+ * that only writable handles ever need to be flushed.
+ */
+class tr_open_files
 {
-    struct tr_cached_file* begin;
-    struct tr_cached_file const* end;
-};
+public:
+    explicit tr_open_files(size_t max_size)
+        : max_size_{ std::max(max_size, size_t{ 1 }) }
+    {
+    }
 
-static void fileset_construct(struct tr_fileset* set, int n)
-{
-    set->begin = tr_new(struct tr_cached_file, n);
-    set->end = set->begin + n;
+    tr_open_files(tr_open_files const&) = delete;
+    tr_open_files& operator=(tr_open_files const&) = delete;
 
-    for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+    ~tr_open_files()
     {
-        *o = { false, TR_BAD_SYS_FILE, 0, 0, 0 };
+        while (!std::empty(lru_))
+        {
+            erase(std::begin(lru_));
+        }
     }
-}
 
-static void fileset_close_all(struct tr_fileset* set)
-{
-    if (set != nullptr)
+    [[nodiscard]] size_t size() const
+    {
+        return std::size(lru_);
+    }
+
+    [[nodiscard]] size_t maxSize() const
+    {
+        return max_size_;
+    }
+
+    void setMaxSize(size_t max_size)
     {
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        max_size_ = std::max(max_size, size_t{ 1 });
+
+        while (size() > max_size_)
         {
-            if (cached_file_is_open(o))
-            {
-                cached_file_close(o);
-            }
+            erase(std::prev(std::end(lru_)));
         }
     }
-}
-
-static void fileset_destruct(struct tr_fileset* set)
-{
-    fileset_close_all(set);
-    tr_free(set->begin);
-    set->end = set->begin = nullptr;
-}
 
-static void fileset_close_torrent(struct tr_fileset* set, int torrent_id)
-{
-    if (set != nullptr)
+    /** @return an open handle that's good enough for reading (or writing), or nullptr if there isn't one */
+    tr_cached_file* get(int torrent_id, tr_file_index_t i, bool writable)
     {
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        auto it = std::end(map_);
+
+        if (!writable)
         {
-            if (o->torrent_id == torrent_id && cached_file_is_open(o))
-            {
-                cached_file_close(o);
-            }
+            it = map_.find(makeKey(torrent_id, i, false));
         }
+
+        if (it == std::end(map_))
+        {
+            it = map_.find(makeKey(torrent_id, i, true));
+        }
+
+        if (it == std::end(map_))
+        {
+            return nullptr;
+        }
+
+        lru_.splice(std::begin(lru_), lru_, it->second);
+        return &*it->second;
     }
-}
 
-static struct tr_cached_file* fileset_lookup(struct tr_fileset* set, int torrent_id, tr_file_index_t i)
-{
-    if (set != nullptr)
+    /** Close the least-recently-used files until there's room to open another */
+    void makeRoom()
     {
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        while (size() >= max_size_)
         {
-            if (torrent_id == o->torrent_id && i == o->file_index && cached_file_is_open(o))
-            {
-                return o;
-            }
+            erase(std::prev(std::end(lru_)));
         }
     }
 
-    return nullptr;
-}
+    /** Start holding a newly-opened file */
+    tr_cached_file* add(tr_cached_file const& o)
+    {
+        auto const key = makeKey(o.torrent_id, o.file_index, o.is_writable);
 
-static struct tr_cached_file* fileset_get_empty_slot(struct tr_fileset* set)
-{
-    struct tr_cached_file* cull = nullptr;
+        if (auto const it = map_.find(key); it != std::end(map_))
+        {
+            erase(it->second);
+        }
 
-    if (set != nullptr && set->begin != nullptr)
+        makeRoom();
+        lru_.push_front(o);
+        map_.emplace(key, std::begin(lru_));
+        ++n_opened_;
+        return &lru_.front();
+    }
+
+    /** Close a file's handles, flushing any changes so that its mtime is up-to-date */
+    void closeFile(int torrent_id, tr_file_index_t i)
     {
-        /* try to find an unused slot */
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+        for (bool const writable : { false, true })
         {
-            if (!cached_file_is_open(o))
+            if (auto const it = map_.find(makeKey(torrent_id, i, writable)); it != std::end(map_))
             {
-                return o;
+                if (writable)
+                {
+                    tr_sys_file_flush(it->second->fd, nullptr);
+                }
+
+                erase(it->second);
             }
         }
+    }
 
-        /* all slots are full... recycle the least recently used */
-        for (struct tr_cached_file* o = set->begin; o != set->end; ++o)
+    void closeTorrent(int torrent_id)
+    {
+        for (auto it = std::begin(lru_); it != std::end(lru_);)
         {
-            if (cull == nullptr || o->used_at < cull->used_at)
-            {
-                cull = o;
-            }
+            it = it->torrent_id == torrent_id ? erase(it) : std::next(it);
         }
+    }
+
+    [[nodiscard]] uint64_t nOpened() const
+    {
+        return n_opened_;
+    }
 
-        cached_file_close(cull);
+    [[nodiscard]] uint64_t nClosed() const
+    {
+        return n_closed_;
     }
 
-    return cull;
-}
+private:
+    using list_t = std::list<tr_cached_file>;
+
+    static constexpr uint64_t makeKey(int torrent_id, tr_file_index_t i, bool writable)
+    {
+        static_assert(sizeof(tr_file_index_t) == 4);
+        return (uint64_t(uint32_t(torrent_id)) << 33) | (uint64_t{ i } << 1) | (writable ? 1 : 0);
+    }
+
+    list_t::iterator erase(list_t::iterator it)
+    {
+        tr_sys_file_close(it->fd, nullptr);
+        ++n_closed_;
+        map_.erase(makeKey(it->torrent_id, it->file_index, it->is_writable));
+        return lru_.erase(it);
+    }
+
+    size_t max_size_;
+    list_t lru_;
+    std::unordered_map<uint64_t, list_t::iterator> map_;
+    uint64_t n_opened_ = 0;
+    uint64_t n_closed_ = 0;
+};
 
 /***
 ****
@@ -371,85 +317,156 @@ static struct tr_cached_file* fileset_get_empty_slot(struct tr_fileset* set)
 
 struct tr_fdInfo
 {
-    int peerCount;
-    struct tr_fileset fileset;
+    explicit tr_fdInfo(size_t file_limit_in)
+        : file_limit{ file_limit_in }
+        , files{ file_limit_in }
+    {
+    }
+
+    int peerCount = 0;
+
+    // the "open-file-limit" setting. files.maxSize() may be lower
+    size_t file_limit;
+
+    tr_open_files files;
 };
 
-static void ensureSessionFdInfoExists(tr_session* session)
+/**
+ * @return how many files we can hold open, given that we want `wanted`.
+ * This is less than the process' fd limit by enough to leave room for
+ * peer sockets and the files and sockets that aren't torrent data.
+ */
+#ifdef _WIN32
+
+static size_t getUsableFileLimit(tr_session const* /*session*/, size_t wanted)
+{
+    return wanted;
+}
+
+#else
+
+static size_t getUsableFileLimit(tr_session const* session, size_t wanted)
+{
+    // don't go lower than we always used to, unless asked to
+    auto constexpr MinFileLimit = size_t{ 32 };
+    // logs, .torrent and .resume files, the RPC and tracker sockets, etc.
+    auto constexpr OtherFds = size_t{ 64 };
+
+    auto const reserved = size_t{ session->peerLimit } + OtherFds;
+    auto rlim = rlimit{};
+
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0)
+    {
+        /* raise the soft limit if it's too low for what we want */
+        auto const needed = rlim_t(wanted + reserved);
+
+        if (rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur < needed)
+        {
+            auto raised = rlim;
+            raised.rlim_cur = rlim.rlim_max == RLIM_INFINITY ? needed : std::min(needed, rlim.rlim_max);
+
+            if (setrlimit(RLIMIT_NOFILE, &raised) == 0)
+            {
+                rlim = raised;
+            }
+        }
+
+        if (rlim.rlim_cur != RLIM_INFINITY)
+        {
+            auto const available = rlim.rlim_cur > reserved ? size_t(rlim.rlim_cur - reserved) : size_t{ 0 };
+            wanted = std::min(wanted, std::max(available, MinFileLimit));
+        }
+    }
+
+    return wanted;
+}
+
+#endif
+
+static tr_fdInfo* ensureSessionFdInfoExists(tr_session* session)
 {
     TR_ASSERT(tr_isSession(session));
 
     if (session->fdInfo == nullptr)
     {
-        int const FILE_CACHE_SIZE = 32;
-
-        /* Create the local file cache */
-        auto* const i = tr_new0(struct tr_fdInfo, 1);
-        fileset_construct(&i->fileset, FILE_CACHE_SIZE);
-        session->fdInfo = i;
+        session->fdInfo = new tr_fdInfo{ TR_DEFAULT_OPEN_FILE_LIMIT };
+        session->fdInfo->files.setMaxSize(getUsableFileLimit(session, TR_DEFAULT_OPEN_FILE_LIMIT));
     }
+
+    return session->fdInfo;
 }
 
 void tr_fdClose(tr_session* session)
 {
     if (session != nullptr && session->fdInfo != nullptr)
     {
-        struct tr_fdInfo* i = session->fdInfo;
-        fileset_destruct(&i->fileset);
-        tr_free(i);
+        delete session->fdInfo;
         session->fdInfo = nullptr;
     }
 }
 
+void tr_fdSetFileLimit(tr_session* session, size_t limit)
+{
+    auto* const i = ensureSessionFdInfoExists(session);
+    i->file_limit = limit;
+    i->files.setMaxSize(getUsableFileLimit(session, limit));
+    tr_logAddDebug("Holding up to %zu files open", i->files.maxSize());
+}
+
+size_t tr_fdGetFileLimit(tr_session* session)
+{
+    return ensureSessionFdInfoExists(session)->file_limit;
+}
+
+tr_fd_stats tr_fdGetStats(tr_session* session)
+{
+    auto const& files = ensureSessionFdInfoExists(session)->files;
+
+    auto ret = tr_fd_stats{};
+    ret.open_files = files.size();
+    ret.open_file_limit = files.maxSize();
+    ret.files_opened = files.nOpened();
+    ret.files_closed = files.nClosed();
+    return ret;
+}
+
 /***
 ****
 ***/
 
-static struct tr_fileset* get_fileset(tr_session* session)
+static tr_open_files* get_open_files(tr_session* session)
 {
     if (session == nullptr)
     {
         return nullptr;
     }
 
-    ensureSessionFdInfoExists(session);
-    return &session->fdInfo->fileset;
+    return &ensureSessionFdInfoExists(session)->files;
 }
 
 void tr_fdFileClose(tr_session* s, tr_torrent const* tor, tr_file_index_t i)
 {
-    tr_cached_file* const o = fileset_lookup(get_fileset(s), tr_torrentId(tor), i);
-    if (o != nullptr)
+    if (auto* const files = get_open_files(s); files != nullptr)
     {
-        /* flush writable files so that their mtimes will be
-         * up-to-date when this function returns to the caller... */
-        if (o->is_writable)
-        {
-            tr_sys_file_flush(o->fd, nullptr);
-        }
-
-        cached_file_close(o);
+        files->closeFile(tr_torrentId(tor), i);
     }
 }
 
 tr_sys_file_t tr_fdFileGetCached(tr_session* s, int torrent_id, tr_file_index_t i, bool writable)
 {
-    struct tr_cached_file* o = fileset_lookup(get_fileset(s), torrent_id, i);
-
-    if (o == nullptr || (writable && !o->is_writable))
-    {
-        return TR_BAD_SYS_FILE;
-    }
-
-    o->used_at = tr_time();
-    return o->fd;
+    auto* const files = get_open_files(s);
+    auto const* const o = files != nullptr ? files->get(torrent_id, i, writable) : nullptr;
+    return o != nullptr ? o->fd : TR_BAD_SYS_FILE;
 }
 
 void tr_fdTorrentClose(tr_session* session, int torrent_id)
 {
     auto const lock = session->unique_lock();
 
-    fileset_close_torrent(get_fileset(session), torrent_id);
+    if (auto* const files = get_open_files(session); files != nullptr)
+    {
+        files->closeTorrent(torrent_id);
+    }
 }
 
 /* returns an fd on success, or a TR_BAD_SYS_FILE on failure and sets errno */
@@ -462,37 +479,28 @@ tr_sys_file_t tr_fdFileCheckout(
     tr_preallocation_mode allocation,
     uint64_t file_size)
 {
-    struct tr_fileset* set = get_fileset(session);
-    struct tr_cached_file* o = fileset_lookup(set, torrent_id, i);
+    auto* const files = get_open_files(session);
 
-    if (o != nullptr && writable && !o->is_writable)
-    {
-        cached_file_close(o); /* close it so we can reopen in rw mode */
-    }
-    else if (o == nullptr)
+    if (auto const* const o = files->get(torrent_id, i, writable); o != nullptr)
     {
-        o = fileset_get_empty_slot(set);
+        dbgmsg("checking out '%s'", filename);
+        return o->fd;
     }
 
-    if (!cached_file_is_open(o))
-    {
-        int const err = cached_file_open(o, filename, writable, allocation, file_size);
+    /* close the least-recently-used file first so that we have an fd to spare */
+    files->makeRoom();
 
-        if (err != 0)
-        {
-            errno = err;
-            return TR_BAD_SYS_FILE;
-        }
+    auto o = tr_cached_file{ torrent_id, i, writable, TR_BAD_SYS_FILE };
+    int const err = cached_file_open(&o, filename, writable, allocation, file_size);
 
-        dbgmsg("opened '%s' writable %c", filename, writable ? 'y' : 'n');
-        o->is_writable = writable;
+    if (err != 0)
+    {
+        errno = err;
+        return TR_BAD_SYS_FILE;
     }
 
-    dbgmsg("checking out '%s'", filename);
-    o->torrent_id = torrent_id;
-    o->file_index = i;
-    o->used_at = tr_time();
-    return o->fd;
+    dbgmsg("opened '%s' writable %c", filename, o.is_writable ? 'y' : 'n');
+    return files->add(o)->fd;
 }
 
 /***
@@ -12,6 +12,9 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+
 #include "transmission.h"
 #include "file.h"
 #include "net.h"
@@ -25,12 +28,16 @@
 ****
 ***/
 
+/** The default "open-file-limit" setting */
+auto inline constexpr TR_DEFAULT_OPEN_FILE_LIMIT = size_t{ 256 };
+
 /**
  * Returns an fd to the specified filename.
  *
- * A small pool of open files is kept to avoid the overhead of
- * continually opening and closing the same files when downloading
- * piece data.
+ * A pool of open files is kept to avoid the overhead of
+ * continually opening and closing the same files when reading
+ * and writing piece data. When the pool is full, the least
+ * recently used file is closed.
  *
  * - if do_write is true, subfolders in torrentFile are created if necessary.
  * - if do_write is true, the target file is created if necessary.
@@ -66,6 +73,27 @@ void tr_fdFileClose(tr_session* session, tr_torrent const* tor, tr_file_index_t
  */
 void tr_fdTorrentClose(tr_session* session, int torrentId);
 
+/**
+ * Sets how many files to hold open at once.
+ *
+ * Fewer may be held open if the process' fd limit, less room
+ * for the peer sockets, isn't enough for that many.
+ */
+void tr_fdSetFileLimit(tr_session* session, size_t limit);
+
+/** @return the limit given to tr_fdSetFileLimit() */
+size_t tr_fdGetFileLimit(tr_session* session);
+
+struct tr_fd_stats
+{
+    size_t open_files; /* how many files are open now */
+    size_t open_file_limit; /* how many files can be open at once */
+    uint64_t files_opened; /* how many times a file has been opened */
+    uint64_t files_closed; /* how many times a file has been closed */
+};
+
+tr_fd_stats tr_fdGetStats(tr_session* session);
+
 /***********************************************************************
  * Sockets
  **********************************************************************/
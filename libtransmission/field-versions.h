@@ -0,0 +1,133 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <algorithm>
+#include <cstdint> // uint32_t, uint64_t
+#include <vector>
+
+#include "quark.h"
+
+/**
+ * Tracks when each of a torrent's RPC fields last changed, so that
+ * torrent-get can send a client only the fields that changed since
+ * the client's previous request.
+ *
+ * A field's value is summarized as a 64-bit fingerprint. Whenever a new
+ * fingerprint differs from the previous one, the field gets a new version
+ * from the session-wide clock. A client's change token is the clock's
+ * value when it was last answered, so it needs every field whose version
+ * is newer than its token.
+ *
+ * To avoid recomputing fields that can't have changed, the caller also
+ * gives a Stamp summarizing the torrent's state. While the stamp stays
+ * the same and is quiet, fields checked under it are still current.
+ */
+class tr_field_versions
+{
+public:
+    struct Stamp
+    {
+        uint32_t settings_version = 0;
+        uint32_t change_count = 0;
+        uint64_t queue_version = 0;
+
+        // true if nothing but the other members can change the torrent's fields
+        bool quiet = false;
+
+        [[nodiscard]] constexpr bool operator==(Stamp const& that) const
+        {
+            return settings_version == that.settings_version && change_count == that.change_count &&
+                queue_version == that.queue_version && quiet == that.quiet;
+        }
+
+        [[nodiscard]] constexpr bool operator!=(Stamp const& that) const
+        {
+            return !(*this == that);
+        }
+    };
+
+    struct Field
+    {
+        tr_quark key;
+        uint64_t fingerprint;
+        uint64_t version;
+
+        // the stamp's settings_version when this field was last checked
+        uint32_t settings_version;
+
+        // the generation when this field was last checked
+        uint32_t generation;
+    };
+
+    void setStamp(Stamp const& stamp)
+    {
+        if (stamp_ != stamp)
+        {
+            stamp_ = stamp;
+            ++generation_;
+        }
+    }
+
+    /** @return true if `field` was checked since the torrent last changed */
+    [[nodiscard]] bool isCurrent(Field const& field) const
+    {
+        return stamp_.quiet && field.generation == generation_;
+    }
+
+    [[nodiscard]] Field const* find(tr_quark key) const
+    {
+        auto const it = std::find_if(
+            std::begin(fields_),
+            std::end(fields_),
+            [key](auto const& field) { return field.key == key; });
+        return it != std::end(fields_) ? &*it : nullptr;
+    }
+
+    /**
+     * @brief note a field's current fingerprint
+     * @param clock the session-wide clock, bumped if the field changed
+     * @return the field's version
+     */
+    uint64_t update(tr_quark key, uint64_t fingerprint, uint64_t* clock)
+    {
+        auto const it = std::find_if(
+            std::begin(fields_),
+            std::end(fields_),
+            [key](auto const& field) { return field.key == key; });
+
+        if (it == std::end(fields_))
+        {
+            fields_.push_back({ key, fingerprint, ++*clock, stamp_.settings_version, generation_ });
+            return fields_.back().version;
+        }
+
+        auto* const field = &*it;
+        if (field->fingerprint != fingerprint)
+        {
+            field->fingerprint = fingerprint;
+            field->version = ++*clock;
+        }
+
+        field->settings_version = stamp_.settings_version;
+        field->generation = generation_;
+        return field->version;
+    }
+
+private:
+    // a torrent has a few dozen fields at most, so a flat vector is fine
+    std::vector<Field> fields_;
+
+    Stamp stamp_;
+    uint32_t generation_ = 0;
+};
@@ -14,30 +14,50 @@
 
 #include "block-info.h"
 #include "file-piece-map.h"
+#include "file-table.h"
+#include "tr-assert.h"
 
 void tr_file_piece_map::reset(tr_block_info const& block_info, uint64_t const* file_sizes, size_t n_files)
 {
-    files_.resize(n_files);
-    files_.shrink_to_fit();
+    block_info_ = block_info;
 
-    uint64_t offset = 0;
+    file_offsets_.resize(n_files + 1);
+    file_offsets_.shrink_to_fit();
+    file_offsets_[0] = 0;
     for (tr_file_index_t i = 0; i < n_files; ++i)
     {
-        auto const file_size = file_sizes[i];
-        auto const begin_piece = block_info.pieceOf(offset);
-        tr_piece_index_t end_piece = 0;
-        if (file_size != 0)
+        file_offsets_[i + 1] = file_offsets_[i] + file_sizes[i];
+    }
+
+    // walk the files once to build each piece's span of files.
+    // A piece with no files gets an empty span where they would be.
+    pieces_.assign(block_info.n_pieces, file_span_t{ 0, 0 });
+    pieces_.shrink_to_fit();
+    auto next_piece = tr_piece_index_t{ 0 };
+    for (tr_file_index_t i = 0; i < n_files; ++i)
+    {
+        auto const [begin, end] = pieceSpan(i);
+
+        for (; next_piece < begin && next_piece < std::size(pieces_); ++next_piece)
         {
-            auto const last_byte = offset + file_size - 1;
-            auto const final_piece = block_info.pieceOf(last_byte);
-            end_piece = final_piece + 1;
+            pieces_[next_piece] = { i, i };
         }
-        else
+
+        for (auto piece = begin; piece < end && piece < std::size(pieces_); ++piece)
         {
-            end_piece = begin_piece + 1;
+            if (piece >= next_piece)
+            {
+                pieces_[piece].begin = i;
+                next_piece = piece + 1;
+            }
+
+            pieces_[piece].end = i + 1;
         }
-        files_[i] = piece_span_t{ begin_piece, end_piece };
-        offset += file_size;
+    }
+
+    for (auto const n = tr_file_index_t(n_files); next_piece < std::size(pieces_); ++next_piece)
+    {
+        pieces_[next_piece] = { n, n };
     }
 }
 
@@ -45,53 +65,70 @@ void tr_file_piece_map::reset(tr_info const& info)
 {
     tr_file_index_t const n = info.fileCount;
     auto file_sizes = std::vector<uint64_t>(n);
-    std::transform(info.files, info.files + n, std::begin(file_sizes), [](tr_file const& file) { return file.length; });
+    for (tr_file_index_t i = 0; i < n; ++i)
+    {
+        file_sizes[i] = info.files->length(i);
+    }
+
     reset({ info.totalSize, info.pieceSize }, std::data(file_sizes), std::size(file_sizes));
 }
 
 tr_file_piece_map::piece_span_t tr_file_piece_map::pieceSpan(tr_file_index_t file) const
 {
-    return files_[file];
+    auto const offset = file_offsets_[file];
+    auto const file_size = file_offsets_[file + 1] - offset;
+    auto const begin_piece = block_info_.pieceOf(offset);
+
+    // an empty file is in the piece that it would begin in
+    auto const end_piece = file_size == 0 ? begin_piece + 1 : block_info_.pieceOf(offset + file_size - 1) + 1;
+
+    return { begin_piece, end_piece };
 }
 
 tr_file_piece_map::file_span_t tr_file_piece_map::fileSpan(tr_piece_index_t piece) const
 {
-    struct Compare
-    {
-        int compare(tr_piece_index_t piece, piece_span_t span) const // <=>
-        {
-            if (piece < span.begin)
-            {
-                return -1;
-            }
+    return pieces_[piece];
+}
 
-            if (piece >= span.end)
-            {
-                return 1;
-            }
+tr_file_piece_map::file_offset_t tr_file_piece_map::fileOffset(uint64_t offset) const
+{
+    TR_ASSERT(offset < file_offsets_.back());
 
-            return 0;
-        }
+    // only the files in the piece that holds `offset` need to be searched.
+    // An empty file begins where the next file does, so looking for
+    // the last file to begin at or before `offset` skips past it.
+    auto const [begin, end] = fileSpan(block_info_.pieceOf(offset));
+    auto const it = std::upper_bound(std::begin(file_offsets_) + begin, std::begin(file_offsets_) + end, offset);
+    auto const index = tr_file_index_t(std::distance(std::begin(file_offsets_), it) - 1);
 
-        bool operator()(tr_piece_index_t piece, piece_span_t span) const // <
-        {
-            return compare(piece, span) < 0;
-        }
+    return { index, offset - file_offsets_[index] };
+}
 
-        int compare(piece_span_t span, tr_piece_index_t piece) const // <=>
-        {
-            return -compare(piece, span);
-        }
+void tr_file_piece_map::segments(uint64_t offset, uint64_t length, std::vector<file_segment_t>& setme) const
+{
+    TR_ASSERT(offset + length <= file_offsets_.back());
 
-        bool operator()(piece_span_t span, tr_piece_index_t piece) const // <
+    setme.clear();
+
+    if (length == 0)
+    {
+        return;
+    }
+
+    auto const n_files = size();
+    auto [index, file_offset] = fileOffset(offset);
+    while (length > 0 && index < n_files)
+    {
+        auto const n = std::min(length, file_offsets_[index + 1] - file_offsets_[index] - file_offset);
+        if (n > 0)
         {
-            return compare(span, piece) < 0;
+            setme.push_back({ index, file_offset, n });
+            length -= n;
         }
-    };
 
-    auto const begin = std::begin(files_);
-    auto const& [equal_begin, equal_end] = std::equal_range(begin, std::end(files_), piece, Compare{});
-    return { tr_piece_index_t(std::distance(begin, equal_begin)), tr_piece_index_t(std::distance(begin, equal_end)) };
+        ++index;
+        file_offset = 0;
+    }
 }
 
 /***
@@ -12,13 +12,13 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstdint> // uint64_t
 #include <vector>
 
 #include "transmission.h"
 
 #include "bitfield.h"
-
-struct tr_block_info;
+#include "block-info.h"
 
 class tr_file_piece_map
 {
@@ -32,6 +32,21 @@ public:
     using file_span_t = index_span_t<tr_file_index_t>;
     using piece_span_t = index_span_t<tr_piece_index_t>;
 
+    // the nth byte of file `index`
+    struct file_offset_t
+    {
+        tr_file_index_t index;
+        uint64_t offset;
+    };
+
+    // `length` bytes of file `index`, starting at its `offset`th byte
+    struct file_segment_t
+    {
+        tr_file_index_t index;
+        uint64_t offset;
+        uint64_t length;
+    };
+
     explicit tr_file_piece_map(tr_info const& info)
     {
         reset(info);
@@ -47,11 +62,26 @@ public:
     [[nodiscard]] file_span_t fileSpan(tr_piece_index_t piece) const;
     [[nodiscard]] size_t size() const
     {
-        return std::size(files_);
+        return std::size(file_offsets_) - 1;
     }
 
+    /** @return the file holding the torrent's nth byte */
+    [[nodiscard]] file_offset_t fileOffset(uint64_t offset) const;
+
+    /**
+     * @brief list the files that hold the torrent's bytes [offset, offset + length).
+     * Empty files hold no bytes, so they're never listed.
+     */
+    void segments(uint64_t offset, uint64_t length, std::vector<file_segment_t>& setme) const;
+
 private:
-    std::vector<piece_span_t> files_;
+    tr_block_info block_info_;
+
+    // file_offsets_[i] is where file i begins; the last entry is the torrent's size
+    std::vector<uint64_t> file_offsets_ = { 0 };
+
+    // fileSpan() for each piece
+    std::vector<file_span_t> pieces_;
 };
 
 class tr_file_priorities
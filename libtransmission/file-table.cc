@@ -0,0 +1,56 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <iterator>
+#include <limits>
+
+#include "transmission.h"
+#include "file-table.h"
+#include "tr-assert.h"
+
+tr_file_table::tr_file_table(tr_file_index_t n_files, size_t n_name_bytes)
+    : renamed_{ n_files }
+{
+    names_.reserve(n_name_bytes);
+    name_offsets_.reserve(n_files);
+    offsets_.reserve(n_files + 1);
+    mtimes_.reserve(n_files);
+}
+
+bool tr_file_table::add(std::string_view name, uint64_t length, bool is_renamed)
+{
+    auto const name_offset = std::size(names_);
+    if (size() >= std::size(renamed_) || name_offset + std::size(name) >= std::numeric_limits<uint32_t>::max())
+    {
+        return false;
+    }
+
+    names_.insert(std::end(names_), std::begin(name), std::end(name));
+    names_.push_back('\0');
+    name_offsets_.push_back(static_cast<uint32_t>(name_offset));
+    offsets_.push_back(offsets_.back() + length);
+    mtimes_.push_back(0);
+    renamed_.set(size() - 1, is_renamed);
+    return true;
+}
+
+void tr_file_table::shrinkToFit()
+{
+    names_.shrink_to_fit();
+    name_offsets_.shrink_to_fit();
+    offsets_.shrink_to_fit();
+    mtimes_.shrink_to_fit();
+}
+
+void tr_file_table::rename(tr_file_index_t i, std::string_view name)
+{
+    TR_ASSERT(i < size());
+
+    renamed_names_.insert_or_assign(i, std::string{ name });
+    renamed_.set(i);
+}
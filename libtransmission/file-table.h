@@ -0,0 +1,118 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <ctime> // time_t
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "transmission.h"
+
+#include "bitfield.h"
+
+/**
+ * A torrent's files, laid out so that torrents with hundreds of
+ * thousands of them stay small and quick to build.
+ *
+ * Rather than an allocation per file, all the names share one arena
+ * and the other fields are kept in parallel arrays. The names are
+ * full paths, so that they can be handed out as C strings.
+ *
+ * A renamed file's new name is kept apart from the arena, so renaming
+ * one file never moves another's name.
+ */
+struct tr_file_table
+{
+public:
+    /* `n_name_bytes` is a hint of how long the names will be, all told */
+    explicit tr_file_table(tr_file_index_t n_files, size_t n_name_bytes = 0);
+
+    /** @brief add the next file. @return false if there's no room for its name */
+    bool add(std::string_view name, uint64_t length, bool is_renamed);
+
+    /* call once all the files have been added */
+    void shrinkToFit();
+
+    [[nodiscard]] tr_file_index_t size() const
+    {
+        return std::size(name_offsets_);
+    }
+
+    [[nodiscard]] char const* name(tr_file_index_t i) const
+    {
+        if (renamed_.test(i))
+        {
+            if (auto const it = renamed_names_.find(i); it != std::end(renamed_names_))
+            {
+                return it->second.c_str();
+            }
+        }
+
+        return std::data(names_) + name_offsets_[i];
+    }
+
+    [[nodiscard]] uint64_t length(tr_file_index_t i) const
+    {
+        return offsets_[i + 1] - offsets_[i];
+    }
+
+    // the file begins at the torrent's nth byte
+    [[nodiscard]] uint64_t offset(tr_file_index_t i) const
+    {
+        return offsets_[i];
+    }
+
+    [[nodiscard]] uint64_t totalSize() const
+    {
+        return offsets_.back();
+    }
+
+    // true if we're using a different path from the one in the metainfo
+    [[nodiscard]] bool isRenamed(tr_file_index_t i) const
+    {
+        return renamed_.test(i);
+    }
+
+    [[nodiscard]] time_t mtime(tr_file_index_t i) const
+    {
+        return mtimes_[i];
+    }
+
+    void setMtime(tr_file_index_t i, time_t mtime)
+    {
+        mtimes_[i] = mtime;
+    }
+
+    void rename(tr_file_index_t i, std::string_view name);
+
+    [[nodiscard]] tr_file get(tr_file_index_t i) const
+    {
+        return { name(i), length(i), { offset(i), mtime(i), isRenamed(i) } };
+    }
+
+private:
+    // NUL-terminated names, back to back
+    std::vector<char> names_;
+    std::vector<uint32_t> name_offsets_;
+
+    // offsets_[i] is where file i begins; offsets_[i + 1] is where it ends
+    std::vector<uint64_t> offsets_ = { 0 };
+
+    std::vector<time_t> mtimes_;
+    tr_bitfield renamed_;
+    std::unordered_map<tr_file_index_t, std::string> renamed_names_;
+};
@@ -21,6 +21,7 @@
 #include "peer-io.h"
 #include "peer-mgr.h"
 #include "session.h"
+#include "timer-wheel.h"
 #include "torrent.h"
 #include "tr-assert.h"
 #include "tr-dht.h"
@@ -118,7 +119,7 @@ struct tr_handshake
     uint32_t crypto_select;
     uint32_t crypto_provide;
     uint8_t myReq1[SHA_DIGEST_LENGTH];
-    struct event* timeout_timer;
+    tr_timer_wheel::Timer* timeout_timer;
 
     std::optional<tr_peer_id_t> peer_id;
 
@@ -1089,7 +1090,7 @@ static void tr_handshakeFree(tr_handshake* handshake)
         tr_peerIoUnref(handshake->io); /* balanced by the ref in tr_handshakeNew */
     }
 
-    event_free(handshake->timeout_timer);
+    delete handshake->timeout_timer;
     tr_free(handshake);
 }
 
@@ -1165,7 +1166,7 @@ static void gotError(tr_peerIo* io, short what, void* vhandshake)
 ***
 **/
 
-static void handshakeTimeout(evutil_socket_t /*s*/, short /*type*/, void* handshake)
+static void handshakeTimeout(void* handshake)
 {
     tr_handshakeAbort(static_cast<tr_handshake*>(handshake));
 }
@@ -1185,8 +1186,8 @@ tr_handshake* tr_handshakeNew(
     handshake->done_func = done_func;
     handshake->done_func_user_data = done_func_user_data;
     handshake->session = session;
-    handshake->timeout_timer = evtimer_new(session->event_base, handshakeTimeout, handshake);
-    tr_timerAdd(handshake->timeout_timer, HANDSHAKE_TIMEOUT_SEC, 0);
+    handshake->timeout_timer = new tr_timer_wheel::Timer{ *session->timer_wheel_, handshakeTimeout, handshake };
+    handshake->timeout_timer->start(HANDSHAKE_TIMEOUT_SEC * 1000U);
 
     tr_peerIoRef(io); /* balanced by the unref in tr_handshakeFree */
     tr_peerIoSetIOFuncs(handshake->io, canRead, nullptr, gotError, handshake);
@@ -12,15 +12,19 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <algorithm> // std::max
 #include <array>
 #include <cstddef> // size_t
 #include <ctime> // time_t
-#include <numeric> // std::accumulate
 
 /**
  * A short-term memory object that remembers how many times something
  * happened over the last N seconds. tr_peer uses it to count how many
  * bytes transferred to estimate the speed over the last N seconds.
+ *
+ * The history is a ring of one-second slices plus a running total of
+ * everything still in the ring, so counting over the whole window is O(1)
+ * and expiring old slices is amortized O(1) per second of elapsed time.
  */
 class tr_recentHistory
 {
@@ -32,41 +36,68 @@ public:
      */
     void add(time_t now, size_t n)
     {
-        if (slices[newest].time != now)
-        {
-            newest = (newest + 1) % TR_RECENT_HISTORY_PERIOD_SEC;
-            slices[newest].time = now;
-        }
+        now = std::max(now, newest_);
+        expire(now);
 
-        slices[newest].n += n;
+        slices_[now % Period] += n;
+        total_ += n;
     }
 
     /**
      * @brief count how many events have occurred in the last N seconds.
      * @param when the current time in sec, such as from tr_time()
      * @param seconds how many seconds to count back through.
+     *        Ages longer than the history's window are clamped to it.
      */
     size_t count(time_t now, unsigned int age_sec) const
     {
-        time_t const oldest = now - age_sec;
+        now = std::max(now, newest_);
+        expire(now);
+
+        if (age_sec + 1 >= Period)
+        {
+            return total_;
+        }
 
-        return std::accumulate(
-            std::begin(slices),
-            std::end(slices),
-            size_t{ 0 },
-            [&oldest](size_t sum, auto const& slice) { return slice.time >= oldest ? sum + slice.n : sum; });
+        auto sum = size_t{ 0 };
+        for (time_t t = std::max(now - static_cast<time_t>(age_sec), time_t{ 0 }); t <= now; ++t)
+        {
+            sum += slices_[t % Period];
+        }
+
+        return sum;
     }
 
 private:
-    inline auto static constexpr TR_RECENT_HISTORY_PERIOD_SEC = size_t{ 60 };
-
-    int newest = 0;
+    inline auto static constexpr Period = size_t{ 60 };
 
-    struct slice_t
+    // zero out the slices that fell out of the window since `newest_`
+    void expire(time_t now) const
     {
-        size_t n = 0;
-        time_t time = 0;
-    };
+        if (now == newest_)
+        {
+            return;
+        }
+
+        if (static_cast<size_t>(now - newest_) >= Period)
+        {
+            slices_.fill(0);
+            total_ = 0;
+        }
+        else
+        {
+            for (time_t t = newest_ + 1; t <= now; ++t)
+            {
+                auto& slice = slices_[t % Period];
+                total_ -= slice;
+                slice = 0;
+            }
+        }
+
+        newest_ = now;
+    }
 
-    std::array<slice_t, TR_RECENT_HISTORY_PERIOD_SEC> slices = {};
+    mutable std::array<size_t, Period> slices_ = {};
+    mutable size_t total_ = 0;
+    mutable time_t newest_ = 0;
 };
@@ -8,9 +8,9 @@
 
 #include <algorithm>
 #include <cerrno>
-#include <cstdlib> /* bsearch() */
 #include <cstring> /* memcmp() */
 #include <optional>
+#include <string>
 #include <vector>
 
 #include "transmission.h"
@@ -65,14 +65,18 @@ static int readOrWriteBytes(
     ****  Find the fd
     ***/
 
+    /* don't write a file while it's being preallocated in the background */
+    bool const claimed = doWrite && session->preallocator.claim(tor->uniqueId, fileIndex);
+
     tr_sys_file_t fd = tr_fdFileGetCached(session, tr_torrentId(tor), fileIndex, doWrite);
 
     if (fd == TR_BAD_SYS_FILE) /* it's not cached, so open/create it now */
     {
-        /* see if the file exists... */
-        char const* base = nullptr;
-        char* subpath = nullptr;
-        if (!tr_torrentFindFile2(tor, fileIndex, &base, &subpath, nullptr))
+        /* see if the file exists. If we're only reading, trust it to
+         * still be where we last found it, and look again if it's not */
+        auto filename = std::string{};
+        auto const found = doWrite ? tor->findFile(filename, fileIndex) : tor->findFileQuickly(filename, fileIndex);
+        if (!found)
         {
             /* we can't read a file that doesn't exist... */
             if (!doWrite)
@@ -81,23 +85,44 @@ static int readOrWriteBytes(
             }
 
             /* figure out where the file should go, so we can create it */
-            base = tr_torrentGetCurrentDir(tor);
-            subpath = tr_sessionIsIncompleteFileNamingEnabled(tor->session) ? tr_torrentBuildPartial(tor, fileIndex) :
-                                                                              tr_strdup(file.name);
+            char* const subpath = tr_sessionIsIncompleteFileNamingEnabled(tor->session) ?
+                tr_torrentBuildPartial(tor, fileIndex) :
+                tr_strdup(file.name);
+            filename = tr_strvPath(tr_torrentGetCurrentDir(tor), subpath);
+            tr_free(subpath);
         }
 
         if (err == 0)
         {
-            /* open (and maybe create) the file */
-            auto const filename = tr_strvPath(base, subpath);
-            tr_preallocation_mode const prealloc = (!doWrite || !tor->fileIsWanted(fileIndex)) ?
-                TR_PREALLOCATE_NONE :
-                tor->session->preallocationMode;
+            /* open (and maybe create) the file. If it was still waiting for
+             * the preallocator, don't fill it with zeroes here instead */
+            auto prealloc = (!doWrite || !tor->fileIsWanted(fileIndex)) ? TR_PREALLOCATE_NONE :
+                                                                            tor->session->preallocationMode;
+            if (claimed && prealloc == TR_PREALLOCATE_FULL)
+            {
+                prealloc = TR_PREALLOCATE_SPARSE;
+            }
 
             fd = tr_fdFileCheckout(session, tor->uniqueId, fileIndex, filename.c_str(), doWrite, prealloc, file.length);
             if (fd == TR_BAD_SYS_FILE)
             {
                 err = errno;
+            }
+
+            /* if it's moved since we last found it, look for it again */
+            if (err == ENOENT && !doWrite)
+            {
+                tor->forgetFileLocation(fileIndex);
+
+                if (tor->findFile(filename, fileIndex))
+                {
+                    fd = tr_fdFileCheckout(session, tor->uniqueId, fileIndex, filename.c_str(), false, prealloc, file.length);
+                    err = fd == TR_BAD_SYS_FILE ? errno : 0;
+                }
+            }
+
+            if (err != 0)
+            {
                 tr_logAddTorErr(tor, "tr_fdFileCheckout failed for \"%s\": %s", filename.c_str(), tr_strerror(err));
             }
             else if (doWrite)
@@ -106,8 +131,6 @@ static int readOrWriteBytes(
                 tr_statsFileCreated(tor->session);
             }
         }
-
-        tr_free(subpath);
     }
 
     /***
@@ -149,25 +172,6 @@ static int readOrWriteBytes(
     return err;
 }
 
-static int compareOffsetToFile(void const* a, void const* b)
-{
-    auto const offset = *static_cast<uint64_t const*>(a);
-    auto const* file = static_cast<tr_file const*>(b);
-
-    if (offset < file->priv.offset)
-    {
-        return -1;
-    }
-
-    if (offset >= file->priv.offset + file->length)
-    {
-        return 1;
-    }
-
-    return 0;
-}
-
-// TODO(ckerr) migrate to fpm
 void tr_ioFindFileLocation(
     tr_torrent const* tor,
     tr_piece_index_t pieceIndex,
@@ -176,23 +180,13 @@ void tr_ioFindFileLocation(
     uint64_t* fileOffset)
 {
     TR_ASSERT(tr_isTorrent(tor));
+    TR_ASSERT(tor->offset(pieceIndex, pieceOffset) < tor->info.totalSize);
 
-    uint64_t const offset = tr_pieceOffset(tor, pieceIndex, pieceOffset, 0);
-    TR_ASSERT(offset < tor->info.totalSize);
-
-    auto const n_files = tor->fileCount();
-    auto const* file = static_cast<tr_file const*>(
-        bsearch(&offset, tor->info.files, n_files, sizeof(tr_file), compareOffsetToFile));
-    TR_ASSERT(file != nullptr);
-
-    if (file != nullptr)
-    {
-        *fileIndex = file - tor->info.files;
-        *fileOffset = offset - file->priv.offset;
-        TR_ASSERT(*fileIndex < n_files);
-        TR_ASSERT(*fileOffset < file->length);
-        TR_ASSERT(tor->file(*fileIndex).priv.offset + *fileOffset == offset);
-    }
+    auto const [index, offset] = tor->fileOffset(pieceIndex, pieceOffset);
+    *fileIndex = index;
+    *fileOffset = offset;
+    TR_ASSERT(*fileIndex < tor->fileCount());
+    TR_ASSERT(*fileOffset < tor->file(*fileIndex).length);
 }
 
 /* returns 0 on success, or an errno on failure */
@@ -211,25 +205,28 @@ static int readOrWritePiece(
         return EINVAL;
     }
 
-    auto fileIndex = tr_file_index_t{};
-    auto fileOffset = uint64_t{};
-    tr_ioFindFileLocation(tor, pieceIndex, pieceOffset, &fileIndex, &fileOffset);
+    // reused from one call to the next, so that every block
+    // read or written doesn't cost a heap allocation
+    thread_local auto segments = std::vector<tr_file_piece_map::file_segment_t>{};
+    tor->fileSegments(pieceIndex, pieceOffset, buflen, segments);
 
-    while (buflen != 0 && err == 0)
+    for (auto const& segment : segments)
     {
-        auto const& file = tor->file(fileIndex);
-        uint64_t const bytesThisPass = std::min(uint64_t{ buflen }, uint64_t{ file.length - fileOffset });
+        err = readOrWriteBytes(tor->session, tor, ioMode, segment.index, segment.offset, buf, segment.length);
+        if (err != 0)
+        {
+            if (ioMode == TR_IO_WRITE && tor->error != TR_STAT_LOCAL_ERROR)
+            {
+                auto const path = tr_strvPath(tor->downloadDir, tor->file(segment.index).name);
+                tr_torrentSetLocalError(tor, "%s (%s)", tr_strerror(err), path.c_str());
+            }
 
-        err = readOrWriteBytes(tor->session, tor, ioMode, fileIndex, fileOffset, buf, bytesThisPass);
-        buf += bytesThisPass;
-        buflen -= bytesThisPass;
-        fileIndex++;
-        fileOffset = 0;
+            break;
+        }
 
-        if (err != 0 && ioMode == TR_IO_WRITE && tor->error != TR_STAT_LOCAL_ERROR)
+        if (buf != nullptr)
         {
-            auto const path = tr_strvPath(tor->downloadDir, file.name);
-            tr_torrentSetLocalError(tor, "%s (%s)", tr_strerror(err), path.c_str());
+            buf += segment.length;
         }
     }
 
@@ -0,0 +1,362 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <cfloat> /* DBL_DIG */
+#include <charconv>
+#include <cmath> /* fabs() */
+#include <cstdint>
+#include <cstring> /* memcpy() */
+#include <string_view>
+
+#include <utf8.h>
+
+#include "transmission.h"
+
+#include "json-writer.h"
+#include "staging-buffer.h"
+#include "tr-assert.h"
+#include "utils.h"
+#include "variant.h"
+
+using namespace std::literals;
+
+/***
+****
+***/
+
+void tr_jsonAddInt(tr_staging_buffer& out, int64_t i)
+{
+    auto constexpr MaxLen = size_t{ 24 };
+    auto* const begin = out.reserve(MaxLen);
+    auto const [end, ec] = std::to_chars(begin, begin + MaxLen, i);
+    out.commit(end - begin);
+}
+
+void tr_jsonAddReal(tr_staging_buffer& out, double d)
+{
+    if (fabs(d - (int)d) < 0.00001)
+    {
+        tr_jsonAddInt(out, (int)d);
+        return;
+    }
+
+    // Same output as "%.4f" of tr_truncd(d, 4), without the round trip through
+    // printf and atof: print it the way tr_truncd() does and keep four decimals.
+    // Past 1e9 that reparse can round differently, so leave those to printf.
+    if (fabs(d) < 1e9)
+    {
+        auto buf = std::array<char, 64>{};
+        auto* const begin = std::data(buf);
+        auto const [end, ec] = std::to_chars(begin, begin + std::size(buf), d, std::chars_format::fixed, DBL_DIG);
+        auto const sv = std::string_view{ begin, size_t(end - begin) };
+        out.append(sv.substr(0, sv.find('.') + 5));
+        return;
+    }
+
+    auto buf = std::array<char, 512>{};
+    auto const len = tr_snprintf(std::data(buf), std::size(buf), "%.4f", tr_truncd(d, 4));
+    out.append({ std::data(buf), std::min(size_t(len), std::size(buf) - 1) });
+}
+
+namespace
+{
+
+// the bytes that tr_jsonAddString() copies as-is
+[[nodiscard]] constexpr bool isPlain(unsigned char ch)
+{
+    return 0x20 <= ch && ch < 0x7F && ch != '"' && ch != '\\';
+}
+
+/**
+ * @return how many leading bytes of `sv` need no escaping.
+ *
+ * Most strings need no escaping at all, so this checks eight bytes
+ * at a time with word-wide bit tricks and only falls back to looking
+ * at single bytes near the first one that might need escaping.
+ */
+[[nodiscard]] size_t countPlain(std::string_view sv)
+{
+    auto constexpr Ones = uint64_t{ 0x0101010101010101 };
+    auto constexpr Highs = Ones * 0x80;
+
+    auto const has_less_than = [](uint64_t word, uint64_t n)
+    {
+        return (word - Ones * n) & ~word & Highs;
+    };
+
+    auto const has_byte = [has_less_than](uint64_t word, uint64_t n)
+    {
+        return has_less_than(word ^ (Ones * n), 1);
+    };
+
+    auto const* const data = std::data(sv);
+    auto const n = std::size(sv);
+    auto i = size_t{};
+
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t))
+    {
+        auto word = uint64_t{};
+        std::memcpy(&word, data + i, sizeof(word));
+
+        if (((word & Highs) | has_less_than(word, 0x20) | has_byte(word, '"') | has_byte(word, '\\') |
+             has_byte(word, 0x7F)) != 0)
+        {
+            break;
+        }
+    }
+
+    while (i < n && isPlain(data[i]))
+    {
+        ++i;
+    }
+
+    return i;
+}
+
+} // namespace
+
+void tr_jsonAddString(tr_staging_buffer& out, std::string_view sv)
+{
+    out.push_back('"');
+
+    for (;;)
+    {
+        auto const n_plain = countPlain(sv);
+        out.append(sv.substr(0, n_plain));
+        sv.remove_prefix(n_plain);
+
+        if (std::empty(sv))
+        {
+            break;
+        }
+
+        switch (sv.front())
+        {
+        case '\b':
+            out.append("\\b"sv);
+            break;
+
+        case '\f':
+            out.append("\\f"sv);
+            break;
+
+        case '\n':
+            out.append("\\n"sv);
+            break;
+
+        case '\r':
+            out.append("\\r"sv);
+            break;
+
+        case '\t':
+            out.append("\\t"sv);
+            break;
+
+        case '"':
+            out.append("\\\""sv);
+            break;
+
+        case '\\':
+            out.append("\\\\"sv);
+            break;
+
+        default:
+            try
+            {
+                auto* begin8 = std::data(sv);
+                auto* end8 = begin8 + std::size(sv);
+                auto* walk8 = begin8;
+                auto const uch32 = utf8::next(walk8, end8);
+
+                auto constexpr MaxLen = size_t{ 16 };
+                auto* const walk = out.reserve(MaxLen);
+                out.commit(tr_snprintf(walk, MaxLen, "\\u%04x", uch32));
+                sv.remove_prefix(walk8 - begin8 - 1);
+            }
+            catch (utf8::exception const&)
+            {
+                out.push_back('?');
+            }
+            break;
+        }
+
+        sv.remove_prefix(1);
+    }
+
+    out.push_back('"');
+}
+
+/***
+****
+***/
+
+void tr_json_writer::beginValue()
+{
+    if (after_key_)
+    {
+        after_key_ = false;
+        return;
+    }
+
+    if (need_comma_)
+    {
+        out_.push_back(',');
+    }
+
+    need_comma_ = true;
+}
+
+void tr_json_writer::startObject(size_t /*size_hint*/)
+{
+    beginValue();
+    out_.push_back('{');
+    need_comma_ = false;
+}
+
+void tr_json_writer::endObject()
+{
+    TR_ASSERT(!after_key_);
+
+    out_.push_back('}');
+    need_comma_ = true;
+}
+
+void tr_json_writer::startArray(size_t /*size_hint*/)
+{
+    beginValue();
+    out_.push_back('[');
+    need_comma_ = false;
+}
+
+void tr_json_writer::endArray()
+{
+    TR_ASSERT(!after_key_);
+
+    out_.push_back(']');
+    need_comma_ = true;
+}
+
+void tr_json_writer::key(std::string_view key)
+{
+    TR_ASSERT(!after_key_);
+
+    beginValue();
+    tr_jsonAddString(out_, key);
+    out_.push_back(':');
+    after_key_ = true;
+}
+
+void tr_json_writer::key(tr_quark key)
+{
+    auto len = size_t{};
+    auto const* const str = tr_quark_get_string(key, &len);
+    this->key(std::string_view{ str, len });
+}
+
+void tr_json_writer::addInt(int64_t i)
+{
+    beginValue();
+    tr_jsonAddInt(out_, i);
+}
+
+void tr_json_writer::addBool(bool b)
+{
+    beginValue();
+
+    if (b)
+    {
+        out_.append("true"sv);
+    }
+    else
+    {
+        out_.append("false"sv);
+    }
+}
+
+void tr_json_writer::addReal(double d)
+{
+    beginValue();
+    tr_jsonAddReal(out_, d);
+}
+
+void tr_json_writer::addStr(std::string_view str)
+{
+    beginValue();
+    tr_jsonAddString(out_, str);
+}
+
+void tr_json_writer::addQuark(tr_quark q)
+{
+    auto len = size_t{};
+    auto const* const str = tr_quark_get_string(q, &len);
+    addStr(std::string_view{ str, len });
+}
+
+void tr_json_writer::addJson(std::string_view json)
+{
+    beginValue();
+    out_.append(json);
+}
+
+void tr_json_writer::writeVariant(tr_variant const* v)
+{
+    auto sv = std::string_view{};
+
+    if (tr_variantIsInt(v))
+    {
+        addInt(v->val.i);
+    }
+    else if (tr_variantIsBool(v))
+    {
+        addBool(v->val.b);
+    }
+    else if (tr_variantIsReal(v))
+    {
+        addReal(v->val.d);
+    }
+    else if (tr_variantGetStrView(v, &sv))
+    {
+        addStr(sv);
+    }
+    else if (tr_variantIsList(v))
+    {
+        startArray();
+
+        for (size_t i = 0, n = tr_variantListSize(v); i < n; ++i)
+        {
+            writeVariant(&v->val.l.vals[i]);
+        }
+
+        endArray();
+    }
+    else if (tr_variantIsDict(v))
+    {
+        startObject();
+
+        for (size_t i = 0, n = v->val.l.count; i < n; ++i)
+        {
+            auto const& child = v->val.l.vals[i];
+            key(child.key);
+            writeVariant(&child);
+        }
+
+        endObject();
+    }
+}
+
+void tr_json_writer::addVariant(tr_variant* v)
+{
+    writeVariant(v);
+    tr_variantFree(v);
+
+    // `v` may be a child of a dict or list that's freed later,
+    // so leave a value there rather than an uninitialized one
+    tr_variantInitBool(v, false);
+}
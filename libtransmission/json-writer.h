@@ -0,0 +1,91 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // int64_t
+#include <string_view>
+
+#include "quark.h"
+#include "staging-buffer.h"
+
+struct evbuffer;
+struct tr_variant;
+
+/***
+****  JSON primitives, shared with the tr_variant serializer
+****  so that both produce the same output
+***/
+
+void tr_jsonAddInt(tr_staging_buffer& out, int64_t i);
+
+void tr_jsonAddReal(tr_staging_buffer& out, double d);
+
+void tr_jsonAddString(tr_staging_buffer& out, std::string_view str);
+
+/**
+ * Writes lean JSON straight into an evbuffer as it's generated,
+ * so that large responses needn't be built as a tr_variant first.
+ *
+ * Commas are added automatically. Inside an object, every value
+ * must be preceded by a call to key().
+ *
+ * The size hints passed to startObject() and startArray() are
+ * ignored; they're there so that code can be written once for
+ * this and for writers that build a tr_variant.
+ *
+ * Output is staged and reaches `out` in chunks; call flush()
+ * or destroy the writer before reading `out`.
+ */
+class tr_json_writer
+{
+public:
+    explicit tr_json_writer(struct evbuffer* out)
+        : out_{ out }
+    {
+    }
+
+    void startObject(size_t size_hint = 0);
+    void endObject();
+
+    void startArray(size_t size_hint = 0);
+    void endArray();
+
+    void key(tr_quark key);
+    void key(std::string_view key);
+
+    void addInt(int64_t i);
+    void addBool(bool b);
+    void addReal(double d);
+    void addStr(std::string_view str);
+    void addQuark(tr_quark q);
+
+    /** @brief write `json`, which must already be a single lean JSON value */
+    void addJson(std::string_view json);
+
+    void flush()
+    {
+        out_.flush();
+    }
+
+    /** @brief write `v`, then free it and leave `false` in its place */
+    void addVariant(tr_variant* v);
+
+private:
+    void beginValue();
+    void writeVariant(tr_variant const* v);
+
+    tr_staging_buffer out_;
+    bool need_comma_ = false;
+    bool after_key_ = false;
+};
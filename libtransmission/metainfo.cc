@@ -19,6 +19,7 @@
 #include "error.h"
 #include "error-types.h"
 #include "file.h"
+#include "file-table.h"
 #include "log.h"
 #include "metainfo.h"
 #include "platform.h" /* tr_getTorrentDir() */
@@ -111,11 +112,10 @@ bool tr_metainfoAppendSanitizedPathComponent(std::string& out, std::string_view
     return std::size(out) > original_out_len;
 }
 
-static bool getfile(char** setme, bool* is_adjusted, std::string_view root, tr_variant* path, std::string& buf)
+static bool getfile(bool* is_adjusted, std::string_view root, tr_variant* path, std::string& buf)
 {
     bool success = false;
 
-    *setme = nullptr;
     *is_adjusted = false;
 
     if (tr_variantIsList(path))
@@ -151,10 +151,10 @@ static bool getfile(char** setme, bool* is_adjusted, std::string_view root, tr_v
         success = false;
     }
 
-    if (success)
+    if (success && !tr_utf8_validate(buf, nullptr))
     {
-        *setme = tr_utf8clean(buf);
-        *is_adjusted |= buf != *setme;
+        buf = tr_strvUtf8Clean(buf);
+        *is_adjusted = true;
     }
 
     return success;
@@ -181,7 +181,7 @@ static char const* parseFiles(tr_info* inf, tr_variant* files, tr_variant const*
 
         inf->isFolder = true;
         inf->fileCount = tr_variantListSize(files);
-        inf->files = tr_new0(tr_file, inf->fileCount);
+        inf->files = new tr_file_table{ inf->fileCount };
 
         for (tr_file_index_t i = 0; i < inf->fileCount; i++)
         {
@@ -201,7 +201,7 @@ static char const* parseFiles(tr_info* inf, tr_variant* files, tr_variant const*
             }
 
             bool is_file_adjusted = false;
-            if (!getfile(&inf->files[i].name, &is_file_adjusted, root_name, path, buf))
+            if (!getfile(&is_file_adjusted, root_name, path, buf))
             {
                 errstr = "path";
                 break;
@@ -213,19 +213,23 @@ static char const* parseFiles(tr_info* inf, tr_variant* files, tr_variant const*
                 break;
             }
 
-            inf->files[i].length = len;
-            inf->files[i].priv.is_renamed = is_root_adjusted || is_file_adjusted;
+            if (!inf->files->add(buf, len, is_root_adjusted || is_file_adjusted))
+            {
+                errstr = "files";
+                break;
+            }
+
             inf->totalSize += len;
         }
+
+        inf->files->shrinkToFit();
     }
     else if (tr_variantGetInt(length, &len)) /* single-file mode */
     {
         inf->isFolder = false;
         inf->fileCount = 1;
-        inf->files = tr_new0(tr_file, 1);
-        inf->files[0].name = tr_strndup(root_name.c_str(), std::size(root_name));
-        inf->files[0].length = len;
-        inf->files[0].priv.is_renamed = is_root_adjusted;
+        inf->files = new tr_file_table{ 1, std::size(root_name) + 1 };
+        inf->files->add(root_name, len, is_root_adjusted);
         inf->totalSize += len;
     }
     else
@@ -617,7 +621,8 @@ std::optional<tr_metainfo_parsed> tr_metainfoParse(tr_session const* session, tr
 {
     auto out = tr_metainfo_parsed{};
 
-    char const* bad_tag = tr_metainfoParseImpl(session, &out.info, &out.pieces, &out.info_dict_length, meta_in);
+    auto pieces = std::vector<tr_sha1_digest_t>{};
+    char const* bad_tag = tr_metainfoParseImpl(session, &out.info, &pieces, &out.info_dict_length, meta_in);
     if (bad_tag != nullptr)
     {
         tr_error_set(error, TR_ERROR_EINVAL, _("Error parsing metainfo: %s"), bad_tag);
@@ -625,6 +630,8 @@ std::optional<tr_metainfo_parsed> tr_metainfoParse(tr_session const* session, tr
         return {};
     }
 
+    out.pieces = tr_piece_checksums{ std::move(pieces) };
+
     return std::optional<tr_metainfo_parsed>{ std::move(out) };
 }
 
@@ -635,13 +642,8 @@ void tr_metainfoFree(tr_info* inf)
         tr_free(inf->webseeds[i]);
     }
 
-    for (tr_file_index_t ff = 0; ff < inf->fileCount; ff++)
-    {
-        tr_free(inf->files[ff].name);
-    }
-
     tr_free(inf->webseeds);
-    tr_free(inf->files);
+    delete inf->files;
     tr_free(inf->comment);
     tr_free(inf->creator);
     tr_free(inf->source);
@@ -659,6 +661,14 @@ void tr_metainfoFree(tr_info* inf)
     memset(inf, '\0', sizeof(tr_info));
 }
 
+tr_file tr_infoFile(tr_info const* inf, tr_file_index_t i)
+{
+    TR_ASSERT(inf != nullptr);
+    TR_ASSERT(i < inf->fileCount);
+
+    return inf->files->get(i);
+}
+
 void tr_metainfoRemoveSaved(tr_session const* session, tr_info const* inf)
 {
     auto filename = getTorrentFilename(session, inf, TR_METAINFO_BASENAME_HASH);
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "transmission.h"
+#include "piece-checksums.h"
 
 struct tr_error;
 struct tr_variant;
@@ -33,14 +34,14 @@ struct tr_metainfo_parsed
 {
     tr_info info = {};
     uint64_t info_dict_length = 0;
-    std::vector<tr_sha1_digest_t> pieces;
+    tr_piece_checksums pieces;
 
     tr_metainfo_parsed() = default;
 
     tr_metainfo_parsed(tr_metainfo_parsed&& that) noexcept
     {
         std::swap(this->info, that.info);
-        std::swap(this->pieces, that.pieces);
+        this->pieces.swap(that.pieces);
         std::swap(this->info_dict_length, that.info_dict_length);
     }
 
@@ -13,6 +13,7 @@
 #include <cstring> /* memcpy, memcmp, strstr */
 #include <iostream>
 #include <iterator>
+#include <numeric> // std::accumulate
 #include <set>
 #include <vector>
 
@@ -96,6 +97,9 @@ static auto constexpr RequestTtlSecs = int{ 90 };
 
 static auto constexpr CancelHistorySec = int{ 60 };
 
+// how long a swarm's PEX snapshot is shared before it's rebuilt
+static auto constexpr PexSnapshotIntervalSecs = int{ 30 };
+
 /**
 ***
 **/
@@ -186,6 +190,13 @@ public:
     ActiveRequests active_requests;
     Wishlist wishlist;
 
+    tr_pex_snapshot pex_snapshot;
+
+    // While the torrent's stopped, the swarm hibernates: its atoms and webseeds
+    // are freed and the peers worth remembering are kept here, sorted by
+    // tr_pexCompare(), until the torrent starts again.
+    std::vector<tr_pex> hibernating_pool;
+
     int interestedCount = 0;
     int maxPeers = 0;
     time_t lastCancel = 0;
@@ -366,11 +377,8 @@ static void rebuildWebseedArray(tr_swarm* s, tr_torrent* tor)
 
 static tr_swarm* swarmNew(tr_peerMgr* manager, tr_torrent* tor)
 {
-    auto* swarm = new tr_swarm{ manager, tor };
-
-    rebuildWebseedArray(swarm, tor);
-
-    return swarm;
+    // swarms hibernate until their torrent starts
+    return new tr_swarm{ manager, tor };
 }
 
 static void ensureMgrTimersExist(struct tr_peerMgr* m);
@@ -1159,6 +1167,25 @@ void tr_peerMgrSetSwarmIsAllSeeds(tr_torrent* tor)
     swarm->poolIsAllSeedsDirty = false;
 }
 
+static void addHibernatingPex(tr_swarm* s, tr_pex const& pex)
+{
+    auto& pool = s->hibernating_pool;
+    auto const it = std::lower_bound(
+        std::begin(pool),
+        std::end(pool),
+        pex,
+        [](auto const& a, auto const& b) { return tr_pexCompare(&a, &b) < 0; });
+
+    if (it != std::end(pool) && tr_pexCompare(&*it, &pex) == 0)
+    {
+        it->flags |= pex.flags;
+    }
+    else
+    {
+        pool.insert(it, pex);
+    }
+}
+
 size_t tr_peerMgrAddPex(tr_torrent* tor, uint8_t from, tr_pex const* pex, size_t n_pex)
 {
     size_t n_used = 0;
@@ -1171,7 +1198,15 @@ size_t tr_peerMgrAddPex(tr_torrent* tor, uint8_t from, tr_pex const* pex, size_t
             !tr_sessionIsAddressBlocked(s->manager->session, &pex->addr) &&
             tr_address_is_valid_for_peers(&pex->addr, pex->port))
         {
-            ensureAtomExists(s, &pex->addr, pex->port, pex->flags, from);
+            if (s->isRunning)
+            {
+                ensureAtomExists(s, &pex->addr, pex->port, pex->flags, from);
+            }
+            else
+            {
+                addHibernatingPex(s, *pex);
+            }
+
             ++n_used;
         }
     }
@@ -1352,6 +1387,22 @@ int tr_peerMgrGetPeers(tr_torrent const* tor, tr_pex** setme_pex, uint8_t af, ui
 
     tr_swarm const* s = tor->swarm;
 
+    // a hibernating swarm has no atoms, just the peers it's remembering
+    if (list_mode == TR_PEERS_INTERESTING && !s->isRunning)
+    {
+        auto pex = std::vector<tr_pex>{};
+        std::copy_if(
+            std::begin(s->hibernating_pool),
+            std::end(s->hibernating_pool),
+            std::back_inserter(pex),
+            [af](auto const& p) { return p.addr.type == af; });
+        pex.resize(std::min(std::size(pex), static_cast<size_t>(std::max(maxCount, 0))));
+
+        *setme_pex = tr_new(tr_pex, std::size(pex));
+        std::copy(std::begin(pex), std::end(pex), *setme_pex);
+        return std::size(pex);
+    }
+
     /**
     ***  build a list of atoms
     **/
@@ -1421,6 +1472,99 @@ int tr_peerMgrGetPeers(tr_torrent const* tor, tr_pex** setme_pex, uint8_t af, ui
     return count;
 }
 
+static void buildCompactPex(
+    std::vector<tr_pex> const& pex,
+    size_t addr_len,
+    std::vector<uint8_t>& setme_compact,
+    std::vector<uint8_t>& setme_flags)
+{
+    setme_compact.resize(std::size(pex) * (addr_len + 2));
+    setme_flags.resize(std::size(pex));
+
+    auto* walk = std::data(setme_compact);
+    for (size_t i = 0, n = std::size(pex); i < n; ++i)
+    {
+        memcpy(walk, &pex[i].addr.addr, addr_len);
+        walk += addr_len;
+        memcpy(walk, &pex[i].port, 2);
+        walk += 2;
+        setme_flags[i] = pex[i].flags & ~ADDED_F_HOLEPUNCH;
+    }
+}
+
+tr_pex_snapshot const& tr_peerMgrGetPexSnapshot(tr_torrent const* tor, size_t max_peer_count)
+{
+    TR_ASSERT(tr_isTorrent(tor));
+    auto const lock = tor->unique_lock();
+
+    auto& snapshot = tor->swarm->pex_snapshot;
+    auto const now = tr_time();
+    if (snapshot.generation != 0 && now < snapshot.built_at + PexSnapshotIntervalSecs)
+    {
+        return snapshot;
+    }
+
+    snapshot.built_at = now;
+
+    // same selection as tr_peerMgrGetPeers(TR_PEERS_CONNECTED),
+    // but both address families are built from a single sort
+    tr_swarm const* const s = tor->swarm;
+    auto const** const peers = (tr_peer const**)tr_ptrArrayBase(&s->peers);
+    auto atoms = std::vector<peer_atom const*>{};
+    atoms.reserve(tr_ptrArraySize(&s->peers));
+    std::transform(
+        peers,
+        peers + tr_ptrArraySize(&s->peers),
+        std::back_inserter(atoms),
+        [](auto const* peer) { return peer->atom; });
+
+    std::sort(
+        std::begin(atoms),
+        std::end(atoms),
+        [](auto const* a, auto const* b) { return compareAtomsByUsefulness(&a, &b) < 0; });
+
+    auto pex = std::vector<tr_pex>{};
+    auto pex6 = std::vector<tr_pex>{};
+    for (auto const* atom : atoms)
+    {
+        TR_ASSERT(tr_address_is_valid(&atom->addr));
+
+        auto& list = atom->addr.type == TR_AF_INET ? pex : pex6;
+        if (std::size(list) < max_peer_count)
+        {
+            list.push_back({ atom->addr, atom->port, atom->flags });
+        }
+    }
+
+    auto const compare = [](auto const& a, auto const& b)
+    {
+        return tr_pexCompare(&a, &b) < 0;
+    };
+    std::sort(std::begin(pex), std::end(pex), compare);
+    std::sort(std::begin(pex6), std::end(pex6), compare);
+
+    auto const equals = [](std::vector<tr_pex> const& a, std::vector<tr_pex> const& b)
+    {
+        return std::equal(
+            std::begin(a),
+            std::end(a),
+            std::begin(b),
+            std::end(b),
+            [](auto const& pa, auto const& pb) { return tr_pexCompare(&pa, &pb) == 0 && pa.flags == pb.flags; });
+    };
+
+    if (snapshot.generation == 0 || !equals(pex, snapshot.pex) || !equals(pex6, snapshot.pex6))
+    {
+        snapshot.pex = std::move(pex);
+        snapshot.pex6 = std::move(pex6);
+        buildCompactPex(snapshot.pex, 4, snapshot.compact, snapshot.flags);
+        buildCompactPex(snapshot.pex6, 16, snapshot.compact6, snapshot.flags6);
+        ++snapshot.generation;
+    }
+
+    return snapshot;
+}
+
 static void atomPulse(evutil_socket_t, short, void*);
 static void bandwidthPulse(evutil_socket_t, short, void*);
 static void rechokePulse(evutil_socket_t, short, void*);
@@ -1456,6 +1600,50 @@ static void ensureMgrTimersExist(struct tr_peerMgr* m)
     }
 }
 
+static void swarmWake(tr_swarm* s)
+{
+    TR_ASSERT(tr_ptrArrayEmpty(&s->pool));
+
+    // the atoms' histories were lost in hibernation, so treat them as new
+    for (auto const& pex : s->hibernating_pool)
+    {
+        ensureAtomExists(s, &pex.addr, pex.port, pex.flags, TR_PEER_FROM_RESUME);
+    }
+
+    s->hibernating_pool = {};
+    rebuildWebseedArray(s, s->tor);
+}
+
+static void swarmHibernate(tr_swarm* s)
+{
+    TR_ASSERT(!s->isRunning);
+    TR_ASSERT(tr_ptrArrayEmpty(&s->outgoingHandshakes));
+    TR_ASSERT(tr_ptrArrayEmpty(&s->peers));
+
+    // keep the same peers that the .resume file would
+    auto** const atoms = reinterpret_cast<peer_atom**>(tr_ptrArrayBase(&s->pool));
+    for (int i = 0, n = tr_ptrArraySize(&s->pool); i < n; ++i)
+    {
+        if (isAtomInteresting(s->tor, atoms[i]))
+        {
+            addHibernatingPex(s, { atoms[i]->addr, atoms[i]->port, atoms[i]->flags });
+        }
+    }
+
+    tr_ptrArrayDestruct(&s->pool, (PtrArrayForeachFunc)tr_free);
+    s->pool = {};
+    s->poolIsAllSeedsDirty = true;
+
+    tr_ptrArrayDestruct(&s->webseeds, [](void* peer) { delete static_cast<tr_peer*>(peer); });
+    s->webseeds = {};
+    s->stats.activeWebseedCount = 0;
+
+    // keep the generation so that it keeps moving forward
+    auto const generation = s->pex_snapshot.generation;
+    s->pex_snapshot = {};
+    s->pex_snapshot.generation = generation;
+}
+
 void tr_peerMgrStartTorrent(tr_torrent* tor)
 {
     TR_ASSERT(tr_isTorrent(tor));
@@ -1465,6 +1653,11 @@ void tr_peerMgrStartTorrent(tr_torrent* tor)
 
     ensureMgrTimersExist(s->manager);
 
+    if (!s->isRunning)
+    {
+        swarmWake(s);
+    }
+
     s->isRunning = true;
     s->maxPeers = tor->maxConnectedPeers;
 
@@ -1476,6 +1669,7 @@ static void removeAllPeers(tr_swarm*);
 
 static void stopSwarm(tr_swarm* swarm)
 {
+    auto const was_running = swarm->isRunning;
     swarm->isRunning = false;
 
     removeAllPeers(swarm);
@@ -1486,6 +1680,11 @@ static void stopSwarm(tr_swarm* swarm)
     {
         tr_handshakeAbort(static_cast<tr_handshake*>(tr_ptrArrayNth(&swarm->outgoingHandshakes, 0)));
     }
+
+    if (was_running)
+    {
+        swarmHibernate(swarm);
+    }
 }
 
 void tr_peerMgrStopTorrent(tr_torrent* tor)
@@ -1551,7 +1750,10 @@ void tr_peerUpdateProgress(tr_torrent* tor, tr_peer* peer)
 void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor)
 {
     /* the webseed list may have changed... */
-    rebuildWebseedArray(tor->swarm, tor);
+    if (tor->swarm->isRunning)
+    {
+        rebuildWebseedArray(tor->swarm, tor);
+    }
 
     /* some peer_msgs' progress fields may not be accurate if we
        didn't have the metadata before now... so refresh them all... */
@@ -1678,23 +1880,17 @@ uint64_t tr_peerMgrGetDesiredAvailable(tr_torrent const* tor)
 
     auto desired_available = uint64_t{};
     auto const n_pieces = tor->info.pieceCount;
-    auto have = std::vector<bool>(n_pieces);
+    auto have = tr_bitfield{ n_pieces };
+    have.setHasNone();
 
-    for (size_t i = 0; i < n_peers; ++i)
+    for (size_t i = 0; i < n_peers && !have.hasAll(); ++i)
     {
-        auto* peer = peers[i];
-        for (size_t j = 0; j < n_pieces; ++j)
-        {
-            if (peer->have.test(j))
-            {
-                have[j] = true;
-            }
-        }
+        have |= peers[i]->have;
     }
 
     for (size_t i = 0; i < n_pieces; ++i)
     {
-        if (tor->pieceIsWanted(i) && have.at(i))
+        if (tor->pieceIsWanted(i) && have.test(i))
         {
             desired_available += tor->countMissingBytesInPiece(i);
         }
@@ -1708,6 +1904,13 @@ tr_webseed_view tr_peerMgrWebseed(tr_torrent const* tor, size_t i)
 {
     TR_ASSERT(tr_isTorrent(tor));
     TR_ASSERT(tor->swarm != nullptr);
+
+    // hibernating swarms let their webseeds go
+    if (!tor->swarm->isRunning)
+    {
+        return i < tor->info.webseedCount ? tr_webseed_view{ tor->info.webseeds[i], false, 0 } : tr_webseed_view{};
+    }
+
     size_t const n = tr_ptrArraySize(&tor->swarm->webseeds);
     TR_ASSERT(i < n);
 
@@ -1849,7 +2052,7 @@ void tr_peerMgrClearInterest(tr_torrent* tor)
 }
 
 /* does this peer have any pieces that we want? */
-static bool isPeerInteresting(tr_torrent* const tor, bool const* const piece_is_interesting, tr_peer const* const peer)
+static bool isPeerInteresting(tr_torrent* const tor, tr_bitfield const& interesting_pieces, tr_peer const* const peer)
 {
     /* these cases should have already been handled by the calling code... */
     TR_ASSERT(!tr_torrentIsSeed(tor));
@@ -1860,15 +2063,7 @@ static bool isPeerInteresting(tr_torrent* const tor, bool const* const piece_is_
         return true;
     }
 
-    for (tr_piece_index_t i = 0; i < tor->info.pieceCount; ++i)
-    {
-        if (piece_is_interesting[i] && peer->have.test(i))
-        {
-            return true;
-        }
-    }
-
-    return false;
+    return peer->have.intersects(interesting_pieces);
 }
 
 enum tr_rechoke_state
@@ -1996,11 +2191,13 @@ static void rechokeDownloads(tr_swarm* s)
         int const n = tor->info.pieceCount;
 
         /* build a bitfield of interesting pieces... */
-        bool* const piece_is_interesting = tr_new(bool, n);
-
+        auto interesting_pieces = tr_bitfield{ size_t(n) };
         for (int i = 0; i < n; ++i)
         {
-            piece_is_interesting[i] = tor->pieceIsWanted(i) && !tor->hasPiece(i);
+            if (tor->pieceIsWanted(i) && !tor->hasPiece(i))
+            {
+                interesting_pieces.set(i);
+            }
         }
 
         /* decide WHICH peers to be interested in (based on their cancel-to-block ratio) */
@@ -2008,7 +2205,7 @@ static void rechokeDownloads(tr_swarm* s)
         {
             auto* const peer = static_cast<tr_peerMsgs*>(tr_ptrArrayNth(&s->peers, i));
 
-            if (!isPeerInteresting(s->tor, piece_is_interesting, peer))
+            if (!isPeerInteresting(s->tor, interesting_pieces, peer))
             {
                 peer->set_interested(false);
             }
@@ -2050,8 +2247,6 @@ static void rechokeDownloads(tr_swarm* s)
                 rechoke_count++;
             }
         }
-
-        tr_free(piece_is_interesting);
     }
 
     if ((rechoke != nullptr) && (rechoke_count > 0))
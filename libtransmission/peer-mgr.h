@@ -12,7 +12,9 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <ctime> // time_t
 #include <inttypes.h> /* uint16_t */
+#include <vector>
 
 #ifdef _WIN32
 #include <winsock2.h> /* struct in_addr */
@@ -120,6 +122,34 @@ int tr_peerMgrGetPeers(
     uint8_t peer_list_mode,
     int max_peer_count);
 
+/**
+ * The connected peers that we tell a swarm about in PEX messages.
+ *
+ * It's shared by every peer in the swarm and rebuilt at most once per
+ * snapshot interval, so sending PEX to each peer is just a delta against
+ * the same sorted lists and their precomputed compact encodings.
+ */
+struct tr_pex_snapshot
+{
+    // changes whenever the lists' contents change
+    uint64_t generation = 0;
+    time_t built_at = 0;
+
+    // sorted by tr_pexCompare()
+    std::vector<tr_pex> pex;
+    std::vector<tr_pex> pex6;
+
+    // the compact encoding of each entry: 6 bytes for IPv4, 18 for IPv6
+    std::vector<uint8_t> compact;
+    std::vector<uint8_t> compact6;
+
+    // the added.f flags of each entry, minus the holepunch flag we don't support
+    std::vector<uint8_t> flags;
+    std::vector<uint8_t> flags6;
+};
+
+tr_pex_snapshot const& tr_peerMgrGetPexSnapshot(tr_torrent const* tor, size_t max_peer_count);
+
 void tr_peerMgrStartTorrent(tr_torrent* tor);
 
 void tr_peerMgrStopTorrent(tr_torrent* tor);
@@ -7,6 +7,7 @@
  */
 
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cstdarg>
 #include <cstdlib>
@@ -14,6 +15,8 @@
 #include <iostream>
 #include <memory> // std::unique_ptr
 #include <optional>
+#include <string_view>
+#include <vector>
 
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
@@ -30,6 +33,7 @@
 #include "peer-msgs.h"
 #include "ptrarray.h"
 #include "session.h"
+#include "timer-wheel.h"
 #include "torrent-magnet.h"
 #include "torrent.h"
 #include "tr-assert.h"
@@ -42,6 +46,8 @@
 #define EBADMSG EINVAL
 #endif
 
+using namespace std::literals;
+
 /**
 ***
 **/
@@ -186,7 +192,7 @@ static void cancelAllRequestsToClient(tr_peerMsgsImpl* msgs);
 static void didWrite(tr_peerIo* io, size_t bytesWritten, bool wasPieceData, void* vmsgs);
 static void gotError(tr_peerIo* io, short what, void* vmsgs);
 static void peerPulse(void* vmsgs);
-static void pexPulse(evutil_socket_t fd, short what, void* vmsgs);
+static void pexPulse(void* vmsgs);
 static void protocolSendCancel(tr_peerMsgsImpl* msgs, struct peer_request const& req);
 static void protocolSendChoke(tr_peerMsgsImpl* msgs, bool choke);
 static void protocolSendHave(tr_peerMsgsImpl* msgs, tr_piece_index_t index);
@@ -197,16 +203,6 @@ static void tellPeerWhatWeHave(tr_peerMsgsImpl* msgs);
 static void updateDesiredRequestCount(tr_peerMsgsImpl* msgs);
 //zzz
 
-struct EventDeleter
-{
-    void operator()(struct event* ev) const
-    {
-        event_free(ev);
-    }
-};
-
-using UniqueTimer = std::unique_ptr<struct event, EventDeleter>;
-
 /**
  * Low-level communication state information about a connected peer.
  *
@@ -229,14 +225,14 @@ public:
         , outMessagesBatchPeriod{ LowPriorityIntervalSecs }
         , torrent{ torrent_in }
         , outMessages{ evbuffer_new() }
+        , pex_timer{ *torrent_in->session->timer_wheel_, pexPulse, this }
         , io{ io_in }
         , callback_{ callback }
         , callbackData_{ callbackData }
     {
         if (tr_torrentAllowsPex(torrent))
         {
-            pex_timer.reset(evtimer_new(torrent->session->event_base, pexPulse, this));
-            tr_timerAdd(pex_timer.get(), PexIntervalSecs, 0);
+            pex_timer.start(PexIntervalSecs * 1000U);
         }
 
         if (tr_peerIoSupportsUTP(io))
@@ -285,8 +281,6 @@ public:
         }
 
         evbuffer_free(this->outMessages);
-        tr_free(this->pex6);
-        tr_free(this->pex);
     }
 
     bool is_transferring_pieces(uint64_t now, tr_direction direction, unsigned int* setme_Bps) const override
@@ -595,8 +589,6 @@ public:
     uint8_t state = AwaitingBtLength;
     uint8_t ut_pex_id = 0;
     uint8_t ut_metadata_id = 0;
-    uint16_t pexCount = 0;
-    uint16_t pexCount6 = 0;
 
     tr_port dht_port = 0;
 
@@ -619,8 +611,11 @@ public:
     int peerAskedForMetadata[MetadataReqQ] = {};
     int peerAskedForMetadataCount = 0;
 
-    tr_pex* pex = nullptr;
-    tr_pex* pex6 = nullptr;
+    // the peers we've told this peer about, and the
+    // swarm's PEX snapshot generation they came from
+    std::vector<tr_pex> pex;
+    std::vector<tr_pex> pex6;
+    uint64_t pex_generation = 0;
 
     time_t clientSentAnythingAt = 0;
 
@@ -635,7 +630,7 @@ public:
        supplied a reqq argument, it's stored here. */
     std::optional<size_t> reqq;
 
-    UniqueTimer pex_timer;
+    tr_timer_wheel::Timer pex_timer;
 
     tr_peerIo* io = nullptr;
 
@@ -2368,324 +2363,215 @@ static void tellPeerWhatWeHave(tr_peerMsgsImpl* msgs)
 #define MAX_PEX_ADDED 50
 #define MAX_PEX_DROPPED 50
 
+namespace
+{
+
 struct PexDiffs
 {
-    tr_pex* added;
-    tr_pex* dropped;
-    tr_pex* elements;
-    int addedCount;
-    int droppedCount;
-    int elementCount;
+    std::vector<size_t> added; // indices into the snapshot's list
+    std::vector<tr_pex> dropped;
+    std::vector<tr_pex> elements; // what the peer will know after this message
+    bool truncated = false; // true if there were more changes than fit in one message
 };
 
-static void pexAddedCb(void const* vpex, void* userData)
+/* walk the peer's current list and the snapshot's list, both sorted, to find their differences */
+PexDiffs diffPex(std::vector<tr_pex> const& old_pex, std::vector<tr_pex> const& new_pex)
 {
-    auto* diffs = static_cast<PexDiffs*>(userData);
-    auto const* pex = static_cast<tr_pex const*>(vpex);
+    auto diffs = PexDiffs{};
+    diffs.elements.reserve(std::max(std::size(old_pex), std::size(new_pex)));
 
-    if (diffs->addedCount < MAX_PEX_ADDED)
+    auto const on_added = [&diffs, &new_pex](size_t i)
     {
-        diffs->added[diffs->addedCount++] = *pex;
-        diffs->elements[diffs->elementCount++] = *pex;
-    }
-}
-
-static constexpr void pexDroppedCb(void const* vpex, void* userData)
-{
-    auto* diffs = static_cast<PexDiffs*>(userData);
-    auto const* pex = static_cast<tr_pex const*>(vpex);
+        if (std::size(diffs.added) < MAX_PEX_ADDED)
+        {
+            diffs.added.push_back(i);
+            diffs.elements.push_back(new_pex[i]);
+        }
+        else
+        {
+            diffs.truncated = true;
+        }
+    };
 
-    if (diffs->droppedCount < MAX_PEX_DROPPED)
+    auto const on_dropped = [&diffs](tr_pex const& pex)
     {
-        diffs->dropped[diffs->droppedCount++] = *pex;
-    }
-}
-
-static constexpr void pexElementCb(void const* vpex, void* userData)
-{
-    auto* diffs = static_cast<PexDiffs*>(userData);
-    auto const* pex = static_cast<tr_pex const*>(vpex);
-
-    diffs->elements[diffs->elementCount++] = *pex;
-}
+        if (std::size(diffs.dropped) < MAX_PEX_DROPPED)
+        {
+            diffs.dropped.push_back(pex);
+        }
+        else
+        {
+            // keep it so that it's dropped in a later message
+            diffs.elements.push_back(pex);
+            diffs.truncated = true;
+        }
+    };
 
-using tr_set_func = void (*)(void const* element, void* userData);
+    size_t a = 0;
+    size_t b = 0;
+    size_t const a_end = std::size(old_pex);
+    size_t const b_end = std::size(new_pex);
 
-/**
- * @brief find the differences and commonalities in two sorted sets
- * @param a the first set
- * @param aCount the number of elements in the set 'a'
- * @param b the second set
- * @param bCount the number of elements in the set 'b'
- * @param compare the sorting method for both sets
- * @param elementSize the sizeof the element in the two sorted sets
- * @param in_a called for items in set 'a' but not set 'b'
- * @param in_b called for items in set 'b' but not set 'a'
- * @param in_both called for items that are in both sets
- * @param userData user data passed along to in_a, in_b, and in_both
- */
-static void tr_set_compare(
-    void const* va,
-    size_t aCount,
-    void const* vb,
-    size_t bCount,
-    tr_voidptr_compare_func compare,
-    size_t elementSize,
-    tr_set_func in_a_cb,
-    tr_set_func in_b_cb,
-    tr_set_func in_both_cb,
-    void* userData)
-{
-    auto* a = static_cast<uint8_t const*>(va);
-    auto* b = static_cast<uint8_t const*>(vb);
-    uint8_t const* aend = a + elementSize * aCount;
-    uint8_t const* bend = b + elementSize * bCount;
-
-    while (a != aend || b != bend)
+    while (a != a_end || b != b_end)
     {
-        if (a == aend)
+        int const val = a == a_end ? 1 : b == b_end ? -1 : tr_pexCompare(&old_pex[a], &new_pex[b]);
+
+        if (val == 0)
         {
-            (*in_b_cb)(b, userData);
-            b += elementSize;
+            diffs.elements.push_back(old_pex[a]);
+            ++a;
+            ++b;
         }
-        else if (b == bend)
+        else if (val < 0)
         {
-            (*in_a_cb)(a, userData);
-            a += elementSize;
+            on_dropped(old_pex[a++]);
         }
         else
         {
-            int const val = (*compare)(a, b);
-
-            if (val == 0)
-            {
-                (*in_both_cb)(a, userData);
-                a += elementSize;
-                b += elementSize;
-            }
-            else if (val < 0)
-            {
-                (*in_a_cb)(a, userData);
-                a += elementSize;
-            }
-            else if (val > 0)
-            {
-                (*in_b_cb)(b, userData);
-                b += elementSize;
-            }
+            on_added(b++);
         }
     }
+
+    return diffs;
 }
 
-static void sendPex(tr_peerMsgsImpl* msgs)
+void addBencString(evbuffer* out, std::string_view key, void const* data, size_t len)
 {
-    if (msgs->peerSupportsPex && tr_torrentAllowsPex(msgs->torrent))
-    {
-        PexDiffs diffs;
-        PexDiffs diffs6;
-        tr_pex* newPex = nullptr;
-        tr_pex* newPex6 = nullptr;
-        int const newCount = tr_peerMgrGetPeers(msgs->torrent, &newPex, TR_AF_INET, TR_PEERS_CONNECTED, MAX_PEX_PEER_COUNT);
-        int const newCount6 = tr_peerMgrGetPeers(msgs->torrent, &newPex6, TR_AF_INET6, TR_PEERS_CONNECTED, MAX_PEX_PEER_COUNT);
-
-        /* build the diffs */
-        diffs.added = tr_new(tr_pex, newCount);
-        diffs.addedCount = 0;
-        diffs.dropped = tr_new(tr_pex, msgs->pexCount);
-        diffs.droppedCount = 0;
-        diffs.elements = tr_new(tr_pex, newCount + msgs->pexCount);
-        diffs.elementCount = 0;
-        tr_set_compare(
-            msgs->pex,
-            msgs->pexCount,
-            newPex,
-            newCount,
-            tr_pexCompare,
-            sizeof(tr_pex),
-            pexDroppedCb,
-            pexAddedCb,
-            pexElementCb,
-            &diffs);
-        diffs6.added = tr_new(tr_pex, newCount6);
-        diffs6.addedCount = 0;
-        diffs6.dropped = tr_new(tr_pex, msgs->pexCount6);
-        diffs6.droppedCount = 0;
-        diffs6.elements = tr_new(tr_pex, newCount6 + msgs->pexCount6);
-        diffs6.elementCount = 0;
-        tr_set_compare(
-            msgs->pex6,
-            msgs->pexCount6,
-            newPex6,
-            newCount6,
-            tr_pexCompare,
-            sizeof(tr_pex),
-            pexDroppedCb,
-            pexAddedCb,
-            pexElementCb,
-            &diffs6);
-        dbgmsg(
-            msgs,
-            "pex: old peer count %d+%d, new peer count %d+%d, added %d+%d, removed %d+%d",
-            msgs->pexCount,
-            msgs->pexCount6,
-            newCount,
-            newCount6,
-            diffs.addedCount,
-            diffs6.addedCount,
-            diffs.droppedCount,
-            diffs6.droppedCount);
-
-        if (diffs.addedCount == 0 && diffs.droppedCount == 0 && diffs6.addedCount == 0 && diffs6.droppedCount == 0)
-        {
-            tr_free(diffs.elements);
-            tr_free(diffs6.elements);
-        }
-        else
-        {
-            uint8_t* tmp = nullptr;
-            uint8_t* walk = nullptr;
-            evbuffer* const out = msgs->outMessages;
-
-            /* update peer */
-            tr_free(msgs->pex);
-            msgs->pex = diffs.elements;
-            msgs->pexCount = diffs.elementCount;
-            tr_free(msgs->pex6);
-            msgs->pex6 = diffs6.elements;
-            msgs->pexCount6 = diffs6.elementCount;
-
-            /* build the pex payload */
-            auto val = tr_variant{};
-            tr_variantInitDict(&val, 3); /* ipv6 support: left as 3: speed vs. likelihood? */
-
-            if (diffs.addedCount > 0)
-            {
-                /* "added" */
-                tmp = walk = tr_new(uint8_t, diffs.addedCount * 6);
-
-                for (int i = 0; i < diffs.addedCount; ++i)
-                {
-                    memcpy(walk, &diffs.added[i].addr.addr, 4);
-                    walk += 4;
-                    memcpy(walk, &diffs.added[i].port, 2);
-                    walk += 2;
-                }
+    evbuffer_add_printf(out, "%zu:", std::size(key));
+    evbuffer_add(out, std::data(key), std::size(key));
+    evbuffer_add_printf(out, "%zu:", len);
+    evbuffer_add(out, data, len);
+}
 
-                TR_ASSERT(walk - tmp == diffs.addedCount * 6);
-                tr_variantDictAddRaw(&val, TR_KEY_added, tmp, walk - tmp);
-                tr_free(tmp);
+/* add the compact form and flags of each added peer, copied from the snapshot's precomputed encodings */
+void addPexAdded(
+    evbuffer* out,
+    std::string_view key,
+    std::string_view flags_key,
+    std::vector<size_t> const& added,
+    std::vector<uint8_t> const& compact,
+    std::vector<uint8_t> const& flags,
+    size_t compact_len)
+{
+    if (std::empty(added))
+    {
+        return;
+    }
 
-                /* "added.f"
-                 * unset each holepunch flag because we don't support it. */
-                tmp = walk = tr_new(uint8_t, diffs.addedCount);
+    auto const n = std::size(added);
 
-                for (int i = 0; i < diffs.addedCount; ++i)
-                {
-                    *walk++ = diffs.added[i].flags & ~ADDED_F_HOLEPUNCH;
-                }
-
-                TR_ASSERT(walk - tmp == diffs.addedCount);
-                tr_variantDictAddRaw(&val, TR_KEY_added_f, tmp, walk - tmp);
-                tr_free(tmp);
-            }
+    // common case: a peer that's new to PEX gets the first N of the snapshot
+    if (added.back() - added.front() + 1 == n)
+    {
+        addBencString(out, key, &compact[added.front() * compact_len], n * compact_len);
+        addBencString(out, flags_key, &flags[added.front()], n);
+        return;
+    }
 
-            if (diffs.droppedCount > 0)
-            {
-                /* "dropped" */
-                tmp = walk = tr_new(uint8_t, diffs.droppedCount * 6);
+    auto compact_buf = std::array<uint8_t, MAX_PEX_ADDED * 18>{};
+    auto flags_buf = std::array<uint8_t, MAX_PEX_ADDED>{};
+    for (size_t i = 0; i < n; ++i)
+    {
+        memcpy(&compact_buf[i * compact_len], &compact[added[i] * compact_len], compact_len);
+        flags_buf[i] = flags[added[i]];
+    }
 
-                for (int i = 0; i < diffs.droppedCount; ++i)
-                {
-                    memcpy(walk, &diffs.dropped[i].addr.addr, 4);
-                    walk += 4;
-                    memcpy(walk, &diffs.dropped[i].port, 2);
-                    walk += 2;
-                }
+    addBencString(out, key, std::data(compact_buf), n * compact_len);
+    addBencString(out, flags_key, std::data(flags_buf), n);
+}
 
-                TR_ASSERT(walk - tmp == diffs.droppedCount * 6);
-                tr_variantDictAddRaw(&val, TR_KEY_dropped, tmp, walk - tmp);
-                tr_free(tmp);
-            }
+void addPexDropped(evbuffer* out, std::string_view key, std::vector<tr_pex> const& dropped, size_t addr_len)
+{
+    if (std::empty(dropped))
+    {
+        return;
+    }
 
-            if (diffs6.addedCount > 0)
-            {
-                /* "added6" */
-                tmp = walk = tr_new(uint8_t, diffs6.addedCount * 18);
+    auto buf = std::array<uint8_t, MAX_PEX_DROPPED * 18>{};
+    auto* walk = std::data(buf);
+    for (auto const& pex : dropped)
+    {
+        memcpy(walk, &pex.addr.addr, addr_len);
+        walk += addr_len;
+        memcpy(walk, &pex.port, 2);
+        walk += 2;
+    }
 
-                for (int i = 0; i < diffs6.addedCount; ++i)
-                {
-                    memcpy(walk, &diffs6.added[i].addr.addr.addr6.s6_addr, 16);
-                    walk += 16;
-                    memcpy(walk, &diffs6.added[i].port, 2);
-                    walk += 2;
-                }
+    addBencString(out, key, std::data(buf), walk - std::data(buf));
+}
 
-                TR_ASSERT(walk - tmp == diffs6.addedCount * 18);
-                tr_variantDictAddRaw(&val, TR_KEY_added6, tmp, walk - tmp);
-                tr_free(tmp);
+} // namespace
 
-                /* "added6.f"
-                 * unset each holepunch flag because we don't support it. */
-                tmp = walk = tr_new(uint8_t, diffs6.addedCount);
+static void sendPex(tr_peerMsgsImpl* msgs)
+{
+    if (!msgs->peerSupportsPex || !tr_torrentAllowsPex(msgs->torrent))
+    {
+        return;
+    }
 
-                for (int i = 0; i < diffs6.addedCount; ++i)
-                {
-                    *walk++ = diffs6.added[i].flags & ~ADDED_F_HOLEPUNCH;
-                }
+    auto const& snapshot = tr_peerMgrGetPexSnapshot(msgs->torrent, MAX_PEX_PEER_COUNT);
+    if (snapshot.generation == msgs->pex_generation)
+    {
+        return; // we've already told this peer everything in this snapshot
+    }
 
-                TR_ASSERT(walk - tmp == diffs6.addedCount);
-                tr_variantDictAddRaw(&val, TR_KEY_added6_f, tmp, walk - tmp);
-                tr_free(tmp);
-            }
+    auto diffs = diffPex(msgs->pex, snapshot.pex);
+    auto diffs6 = diffPex(msgs->pex6, snapshot.pex6);
+    dbgmsg(
+        msgs,
+        "pex: old peer count %zu+%zu, new peer count %zu+%zu, added %zu+%zu, removed %zu+%zu",
+        std::size(msgs->pex),
+        std::size(msgs->pex6),
+        std::size(snapshot.pex),
+        std::size(snapshot.pex6),
+        std::size(diffs.added),
+        std::size(diffs6.added),
+        std::size(diffs.dropped),
+        std::size(diffs6.dropped));
 
-            if (diffs6.droppedCount > 0)
-            {
-                /* "dropped6" */
-                tmp = walk = tr_new(uint8_t, diffs6.droppedCount * 18);
+    // if everything fit, the peer is now up-to-date with this generation.
+    // otherwise, the rest of the changes go out in the next message.
+    if (!diffs.truncated && !diffs6.truncated)
+    {
+        msgs->pex_generation = snapshot.generation;
+    }
 
-                for (int i = 0; i < diffs6.droppedCount; ++i)
-                {
-                    memcpy(walk, &diffs6.dropped[i].addr.addr.addr6.s6_addr, 16);
-                    walk += 16;
-                    memcpy(walk, &diffs6.dropped[i].port, 2);
-                    walk += 2;
-                }
+    if (std::empty(diffs.added) && std::empty(diffs.dropped) && std::empty(diffs6.added) && std::empty(diffs6.dropped))
+    {
+        return;
+    }
 
-                TR_ASSERT(walk - tmp == diffs6.droppedCount * 18);
-                tr_variantDictAddRaw(&val, TR_KEY_dropped6, tmp, walk - tmp);
-                tr_free(tmp);
-            }
+    /* update peer */
+    msgs->pex = std::move(diffs.elements);
+    msgs->pex6 = std::move(diffs6.elements);
 
-            /* write the pex message */
-            auto* const payload = tr_variantToBuf(&val, TR_VARIANT_FMT_BENC);
-            evbuffer_add_uint32(out, 2 * sizeof(uint8_t) + evbuffer_get_length(payload));
-            evbuffer_add_uint8(out, BtLtep);
-            evbuffer_add_uint8(out, msgs->ut_pex_id);
-            evbuffer_add_buffer(out, payload);
-            pokeBatchPeriod(msgs, HighPriorityIntervalSecs);
-            dbgmsg(msgs, "sending a pex message; outMessage size is now %zu", evbuffer_get_length(out));
-            dbgOutMessageLen(msgs);
+    /* build the pex payload. This is a bencoded dict, so its keys are in sorted order. */
+    evbuffer* const payload = evbuffer_new();
+    evbuffer_add(payload, "d", 1);
+    addPexAdded(payload, "added"sv, "added.f"sv, diffs.added, snapshot.compact, snapshot.flags, 6);
+    addPexAdded(payload, "added6"sv, "added6.f"sv, diffs6.added, snapshot.compact6, snapshot.flags6, 18);
+    addPexDropped(payload, "dropped"sv, diffs.dropped, 4);
+    addPexDropped(payload, "dropped6"sv, diffs6.dropped, 16);
+    evbuffer_add(payload, "e", 1);
 
-            evbuffer_free(payload);
-            tr_variantFree(&val);
-        }
+    /* write the pex message */
+    evbuffer* const out = msgs->outMessages;
+    evbuffer_add_uint32(out, 2 * sizeof(uint8_t) + evbuffer_get_length(payload));
+    evbuffer_add_uint8(out, BtLtep);
+    evbuffer_add_uint8(out, msgs->ut_pex_id);
+    evbuffer_add_buffer(out, payload);
+    pokeBatchPeriod(msgs, HighPriorityIntervalSecs);
+    dbgmsg(msgs, "sending a pex message; outMessage size is now %zu", evbuffer_get_length(out));
+    dbgOutMessageLen(msgs);
 
-        /* cleanup */
-        tr_free(diffs.added);
-        tr_free(diffs.dropped);
-        tr_free(newPex);
-        tr_free(diffs6.added);
-        tr_free(diffs6.dropped);
-        tr_free(newPex6);
-    }
+    evbuffer_free(payload);
 }
 
-static void pexPulse(evutil_socket_t /*fd*/, short /*what*/, void* vmsgs)
+static void pexPulse(void* vmsgs)
 {
     auto* msgs = static_cast<tr_peerMsgsImpl*>(vmsgs);
 
     sendPex(msgs);
 
-    TR_ASSERT(msgs->pex_timer);
-    tr_timerAdd(msgs->pex_timer.get(), PexIntervalSecs, 0);
+    msgs->pex_timer.start(PexIntervalSecs * 1000U);
 }
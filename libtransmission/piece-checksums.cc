@@ -0,0 +1,217 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <string_view>
+#include <utility>
+
+#include "transmission.h"
+#include "crypto-utils.h"
+#include "file.h"
+#include "log.h"
+#include "piece-checksums.h"
+#include "tr-assert.h"
+#include "utils.h"
+#include "variant.h"
+
+// mmap() offsets have to be page-aligned, and Windows wants
+// them aligned to its 64 KiB allocation granularity
+static auto constexpr MapAlignment = uint64_t{ 64 * 1024 };
+
+static tr_sha1_digest_t digestOf(void const* data, size_t len)
+{
+    auto* const sha = tr_sha1_init();
+    tr_sha1_update(sha, data, len);
+    return tr_sha1_final(sha).value_or(tr_sha1_digest_t{});
+}
+
+tr_piece_checksums::tr_piece_checksums(std::vector<tr_sha1_digest_t>&& checksums)
+    : checksums_{ std::move(checksums) }
+    , n_pieces_{ std::size(checksums_) }
+{
+}
+
+tr_piece_checksums::~tr_piece_checksums()
+{
+    auto const lock = std::lock_guard(mutex_);
+    unmapLocked();
+}
+
+tr_piece_checksums::tr_piece_checksums(tr_piece_checksums&& that) noexcept
+{
+    swap(that);
+}
+
+tr_piece_checksums& tr_piece_checksums::operator=(tr_piece_checksums&& that) noexcept
+{
+    if (this != &that)
+    {
+        swap(that);
+    }
+
+    return *this;
+}
+
+void tr_piece_checksums::swap(tr_piece_checksums& that) noexcept
+{
+    auto const lock = std::scoped_lock(mutex_, that.mutex_);
+
+    std::swap(checksums_, that.checksums_);
+    std::swap(n_pieces_, that.n_pieces_);
+    std::swap(filename_, that.filename_);
+    std::swap(offset_, that.offset_);
+    std::swap(digest_, that.digest_);
+    std::swap(map_, that.map_);
+    std::swap(map_size_, that.map_size_);
+    std::swap(view_, that.view_);
+    std::swap(last_used_, that.last_used_);
+    std::swap(warned_, that.warned_);
+}
+
+tr_sha1_digest_t tr_piece_checksums::get(tr_piece_index_t i) const
+{
+    TR_ASSERT(i < n_pieces_);
+
+    auto const lock = std::lock_guard(mutex_);
+
+    if (!hasSource())
+    {
+        return checksums_[i];
+    }
+
+    if (view_ == nullptr && !mapLocked())
+    {
+        return {};
+    }
+
+    last_used_ = tr_time();
+    return view_[i];
+}
+
+void tr_piece_checksums::setSource(std::string filename, uint64_t offset)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    digest_ = digestOf(std::data(checksums_), std::size(checksums_) * sizeof(tr_sha1_digest_t));
+    filename_ = std::move(filename);
+    offset_ = offset;
+    std::vector<tr_sha1_digest_t>{}.swap(checksums_);
+}
+
+bool tr_piece_checksums::releaseIfIdle(time_t idle_since)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (view_ == nullptr || last_used_ >= idle_since)
+    {
+        return false;
+    }
+
+    unmapLocked();
+    return true;
+}
+
+bool tr_piece_checksums::isLoaded() const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return !hasSource() || view_ != nullptr;
+}
+
+bool tr_piece_checksums::mapLocked() const
+{
+    auto const n_bytes = n_pieces_ * sizeof(tr_sha1_digest_t);
+
+    // try where they were; failing that, look for them
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (attempt > 0 && !findPieces(&offset_))
+        {
+            break;
+        }
+
+        auto const fd = tr_sys_file_open(filename_.c_str(), TR_SYS_FILE_READ, 0, nullptr);
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            break;
+        }
+
+        // mapping past the end of a file that's been truncated would crash on first touch
+        auto info = tr_sys_path_info{};
+        auto const aligned_offset = offset_ - offset_ % MapAlignment;
+        auto const map_size = offset_ - aligned_offset + n_bytes;
+        auto* map = tr_sys_file_get_info(fd, &info, nullptr) && info.size >= offset_ + n_bytes ?
+            tr_sys_file_map_for_reading(fd, aligned_offset, map_size, nullptr) :
+            nullptr;
+        tr_sys_file_close(fd, nullptr);
+
+        if (map == nullptr)
+        {
+            continue;
+        }
+
+        auto const* const view = static_cast<char const*>(map) + (offset_ - aligned_offset);
+        if (digestOf(view, n_bytes) == digest_)
+        {
+            map_ = map;
+            map_size_ = map_size;
+            view_ = reinterpret_cast<tr_sha1_digest_t const*>(view);
+            warned_ = false;
+            return true;
+        }
+
+        tr_sys_file_unmap(map, map_size, nullptr);
+    }
+
+    if (!warned_)
+    {
+        tr_logAddError("Couldn't read piece hashes from \"%s\"", filename_.c_str());
+        warned_ = true;
+    }
+
+    return false;
+}
+
+void tr_piece_checksums::unmapLocked() const
+{
+    if (map_ != nullptr)
+    {
+        tr_sys_file_unmap(map_, map_size_, nullptr);
+        map_ = nullptr;
+        map_size_ = 0;
+        view_ = nullptr;
+    }
+}
+
+// find the `pieces` string in a .torrent file that's been rewritten
+bool tr_piece_checksums::findPieces(uint64_t* setme_offset) const
+{
+    auto buf = std::vector<char>{};
+    if (!tr_loadFile(buf, filename_.c_str()))
+    {
+        return false;
+    }
+
+    auto top = tr_variant{};
+    auto const benc = std::string_view{ std::data(buf), std::size(buf) };
+    if (!tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, benc))
+    {
+        return false;
+    }
+
+    auto pieces = std::string_view{};
+    tr_variant* info = nullptr;
+    auto const found = tr_variantDictFindDict(&top, TR_KEY_info, &info) &&
+        tr_variantDictFindStrView(info, TR_KEY_pieces, &pieces) &&
+        std::size(pieces) == n_pieces_ * sizeof(tr_sha1_digest_t);
+    if (found)
+    {
+        *setme_offset = std::data(pieces) - std::data(buf);
+    }
+
+    tr_variantFree(&top);
+    return found;
+}
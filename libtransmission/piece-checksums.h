@@ -0,0 +1,99 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "transmission.h" // tr_piece_index_t
+#include "tr-macros.h" // tr_sha1_digest_t
+
+/**
+ * A torrent's piece hashes.
+ *
+ * They're only needed when a piece is checked, and a large library can
+ * hold hundreds of MiB of them, so once setSource() says where they are
+ * in the torrent's .torrent file, they're dropped from memory. They're
+ * read back from a memory-mapped view of the file when a piece needs
+ * checking, and unmapped again by releaseIfIdle().
+ *
+ * If the hashes have moved within the file, e.g. because the file was
+ * rewritten with different trackers, they're found again by parsing it.
+ *
+ * Since pieces are checked on the verify thread, this is thread-safe.
+ */
+class tr_piece_checksums
+{
+public:
+    tr_piece_checksums() = default;
+    explicit tr_piece_checksums(std::vector<tr_sha1_digest_t>&& checksums);
+    ~tr_piece_checksums();
+
+    tr_piece_checksums(tr_piece_checksums&& that) noexcept;
+    tr_piece_checksums& operator=(tr_piece_checksums&& that) noexcept;
+    tr_piece_checksums(tr_piece_checksums const&) = delete;
+    tr_piece_checksums& operator=(tr_piece_checksums const&) = delete;
+
+    void swap(tr_piece_checksums& that) noexcept;
+
+    [[nodiscard]] size_t size() const
+    {
+        return n_pieces_;
+    }
+
+    /** @return piece `i`'s hash, or all zeroes if it can't be read */
+    [[nodiscard]] tr_sha1_digest_t get(tr_piece_index_t i) const;
+
+    /**
+     * @brief say that the `pieces` string starts at `offset` in `filename`.
+     * The in-memory copy of the hashes is dropped.
+     */
+    void setSource(std::string filename, uint64_t offset);
+
+    [[nodiscard]] bool hasSource() const
+    {
+        return !std::empty(filename_);
+    }
+
+    /** @brief unmap the hashes if they haven't been used since `idle_since` */
+    bool releaseIfIdle(time_t idle_since);
+
+    /** @return true if the hashes are in memory or mapped */
+    [[nodiscard]] bool isLoaded() const;
+
+private:
+    bool mapLocked() const;
+    void unmapLocked() const;
+    bool findPieces(uint64_t* setme_offset) const;
+
+    mutable std::mutex mutex_;
+
+    // when there's no source
+    std::vector<tr_sha1_digest_t> checksums_;
+    size_t n_pieces_ = 0;
+
+    // the file that holds them, where, and the hash of the whole `pieces` string
+    std::string filename_;
+    mutable uint64_t offset_ = 0;
+    tr_sha1_digest_t digest_ = {};
+
+    mutable void* map_ = nullptr;
+    mutable uint64_t map_size_ = 0;
+    mutable tr_sha1_digest_t const* view_ = nullptr;
+    mutable time_t last_used_ = 0;
+    mutable bool warned_ = false;
+};
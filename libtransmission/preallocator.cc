@@ -0,0 +1,389 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+#include "error.h"
+#include "error-types.h"
+#include "file.h"
+#include "log.h"
+#include "preallocator.h"
+#include "tr-assert.h"
+#include "utils.h"
+
+#define dbgmsg(...) tr_logAddDeepNamed(nullptr, __VA_ARGS__)
+
+/***
+****
+***/
+
+static bool preallocate_file_sparse(tr_sys_file_t fd, uint64_t length, tr_error** error)
+{
+    tr_error* my_error = nullptr;
+
+    if (length == 0)
+    {
+        return true;
+    }
+
+    if (tr_sys_file_preallocate(fd, length, TR_SYS_FILE_PREALLOC_SPARSE, &my_error))
+    {
+        return true;
+    }
+
+    dbgmsg("Preallocating (sparse, normal) failed (%d): %s", my_error->code, my_error->message);
+
+    if (!TR_ERROR_IS_ENOSPC(my_error->code))
+    {
+        char const zero = '\0';
+
+        tr_error_clear(&my_error);
+
+        /* fallback: the old-style seek-and-write */
+        if (tr_sys_file_write_at(fd, &zero, 1, length - 1, nullptr, &my_error) && tr_sys_file_truncate(fd, length, &my_error))
+        {
+            return true;
+        }
+
+        dbgmsg("Preallocating (sparse, fallback) failed (%d): %s", my_error->code, my_error->message);
+    }
+
+    tr_error_propagate(error, &my_error);
+    return false;
+}
+
+static bool preallocate_file_full(
+    tr_sys_file_t fd,
+    uint64_t length,
+    tr_error** error,
+    std::function<bool(uint64_t)> const& progress)
+{
+    tr_error* my_error = nullptr;
+
+    if (length == 0)
+    {
+        return true;
+    }
+
+    if (tr_sys_file_preallocate(fd, length, 0, &my_error))
+    {
+        return true;
+    }
+
+    dbgmsg("Preallocating (full, normal) failed (%d): %s", my_error->code, my_error->message);
+
+    if (!TR_ERROR_IS_ENOSPC(my_error->code))
+    {
+        auto const buf = std::vector<uint8_t>(64 * 1024);
+        auto bytes_done = uint64_t{};
+        bool success = true;
+
+        tr_error_clear(&my_error);
+
+        /* fallback: the old-fashioned way */
+        while (success && bytes_done < length)
+        {
+            uint64_t const thisPass = std::min(length - bytes_done, uint64_t{ std::size(buf) });
+            uint64_t bytes_written = 0;
+            success = tr_sys_file_write(fd, std::data(buf), thisPass, &bytes_written, &my_error);
+            bytes_done += bytes_written;
+
+            if (success && progress && !progress(bytes_done))
+            {
+                tr_error_set_literal(&my_error, ECANCELED, tr_strerror(ECANCELED));
+                success = false;
+            }
+        }
+
+        if (success)
+        {
+            return true;
+        }
+
+        dbgmsg("Preallocating (full, fallback) failed (%d): %s", my_error->code, my_error->message);
+    }
+
+    tr_error_propagate(error, &my_error);
+    return false;
+}
+
+bool tr_preallocateFile(
+    tr_sys_file_t fd,
+    uint64_t length,
+    tr_preallocation_mode mode,
+    tr_error** error,
+    std::function<bool(uint64_t)> const& progress)
+{
+    TR_ASSERT(mode == TR_PREALLOCATE_SPARSE || mode == TR_PREALLOCATE_FULL);
+
+    return mode == TR_PREALLOCATE_FULL ? preallocate_file_full(fd, length, error, progress) :
+                                         preallocate_file_sparse(fd, length, error);
+}
+
+/***
+****
+***/
+
+/* true if `file` is already at one of the places it might be */
+static bool fileExists(tr_preallocator::File const& file)
+{
+    auto const exists = [](std::string const& filename)
+    {
+        return tr_sys_path_exists(filename.c_str(), nullptr);
+    };
+
+    return exists(file.filename) || std::any_of(std::begin(file.elsewhere), std::end(file.elsewhere), exists);
+}
+
+/* create `file` and preallocate it */
+static bool createFile(
+    tr_preallocator::File const& file,
+    tr_preallocation_mode mode,
+    tr_error** error,
+    std::function<bool(uint64_t)> const& progress)
+{
+    char* const dir = tr_sys_path_dirname(file.filename, error);
+
+    if (dir == nullptr || !tr_sys_dir_create(dir, TR_SYS_DIR_CREATE_PARENTS, 0777, error))
+    {
+        tr_free(dir);
+        return false;
+    }
+
+    tr_free(dir);
+
+    // TR_SYS_FILE_CREATE_NEW, in case the file was written since it was queued
+    auto const fd = tr_sys_file_open(
+        file.filename.c_str(),
+        TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE_NEW | TR_SYS_FILE_SEQUENTIAL,
+        0666,
+        error);
+
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    bool const success = tr_preallocateFile(fd, file.length, mode, error, progress);
+    tr_sys_file_close(fd, nullptr);
+    return success;
+}
+
+tr_preallocator::~tr_preallocator()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+
+        for (auto& [torrent_id, job] : jobs_)
+        {
+            job.cancelled = true;
+            job.pending.clear();
+        }
+    }
+
+    pool_.wait();
+}
+
+void tr_preallocator::add(int torrent_id, tr_preallocation_mode mode, std::vector<File> files)
+{
+    TR_ASSERT(mode == TR_PREALLOCATE_SPARSE || mode == TR_PREALLOCATE_FULL);
+
+    if (std::empty(files))
+    {
+        return;
+    }
+
+    auto const lock = std::lock_guard(mutex_);
+
+    auto& job = jobs_[torrent_id];
+    job.mode = mode;
+    job.cancelled = false;
+
+    for (auto& file : files)
+    {
+        if (job.pending.count(file.index) == 0)
+        {
+            job.bytes_total += file.length;
+            job.pending.emplace(file.index, std::move(file));
+        }
+    }
+
+    pool_.run([this, torrent_id]() { run(torrent_id); });
+}
+
+void tr_preallocator::waitUntil(
+    std::unique_lock<std::mutex>& lock,
+    int torrent_id,
+    std::function<bool(Job const&)> const& test)
+{
+    changed_.wait(
+        lock,
+        [this, torrent_id, &test]()
+        {
+            auto const it = jobs_.find(torrent_id);
+            return it == std::end(jobs_) || test(it->second);
+        });
+}
+
+void tr_preallocator::cancel(int torrent_id)
+{
+    auto lock = std::unique_lock(mutex_);
+
+    auto const it = jobs_.find(torrent_id);
+    if (it == std::end(jobs_))
+    {
+        return;
+    }
+
+    it->second.cancelled = true;
+    it->second.pending.clear();
+    waitUntil(lock, torrent_id, [](Job const& job) { return !job.current; });
+
+    // if it hasn't been started, don't wait for the worker to get to it
+    jobs_.erase(torrent_id);
+    changed_.notify_all();
+}
+
+bool tr_preallocator::claim(int torrent_id, tr_file_index_t i)
+{
+    auto lock = std::unique_lock(mutex_);
+
+    auto const it = jobs_.find(torrent_id);
+    if (it == std::end(jobs_) || it->second.pending.count(i) == 0)
+    {
+        return false;
+    }
+
+    auto& job = it->second;
+
+    // don't make the caller wait for the whole file to be zeroed,
+    // just for the worker to finish the chunk it's writing
+    if (job.current == i)
+    {
+        job.current_claimed = true;
+        waitUntil(lock, torrent_id, [i](Job const& j) { return j.current != i; });
+        return false;
+    }
+
+    // count the file as done, so that progress still reaches 100%
+    auto const file = job.pending.find(i);
+    job.bytes_done += file->second.length;
+    job.pending.erase(file);
+    return true;
+}
+
+bool tr_preallocator::isPending(int torrent_id, tr_file_index_t begin, tr_file_index_t end) const
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const it = jobs_.find(torrent_id);
+    if (it == std::end(jobs_))
+    {
+        return false;
+    }
+
+    auto const& pending = it->second.pending;
+    auto const pit = pending.lower_bound(begin);
+    return pit != std::end(pending) && pit->first <= end;
+}
+
+std::optional<double> tr_preallocator::progress(int torrent_id) const
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const it = jobs_.find(torrent_id);
+    if (it == std::end(jobs_) || it->second.bytes_total == 0)
+    {
+        return {};
+    }
+
+    return std::min(1.0, double(it->second.bytes_done) / double(it->second.bytes_total));
+}
+
+void tr_preallocator::run(int torrent_id)
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        auto const it = jobs_.find(torrent_id);
+        if (it == std::end(jobs_))
+        {
+            return;
+        }
+
+        // unordered_map's elements stay put, so `job` is good until we erase it
+        auto& job = it->second;
+
+        if (job.cancelled || std::empty(job.pending))
+        {
+            jobs_.erase(it);
+            changed_.notify_all();
+            return;
+        }
+
+        auto const [index, file] = *std::begin(job.pending);
+        auto const mode = job.mode;
+        auto const bytes_before = job.bytes_done;
+        job.current = index;
+        job.current_claimed = false;
+        lock.unlock();
+
+        tr_error* error = nullptr;
+        auto const progress = [this, &job, bytes_before](uint64_t bytes_done)
+        {
+            auto const progress_lock = std::lock_guard(mutex_);
+            job.bytes_done = bytes_before + bytes_done;
+            return !job.cancelled && !job.current_claimed;
+        };
+
+        // looked for here rather than when it's queued, since
+        // that's a handful of stat() calls for each of a torrent's files
+        if (fileExists(file))
+        {
+            tr_logAddDebug("Not preallocating file \"%s\", which already exists", file.filename.c_str());
+        }
+        else if (createFile(file, mode, &error, progress))
+        {
+            tr_logAddDebug(
+                "Preallocated file \"%s\" (%s, size: %" PRIu64 ")",
+                file.filename.c_str(),
+                mode == TR_PREALLOCATE_FULL ? "full" : "sparse",
+                file.length);
+        }
+        else if (error->code != ECANCELED)
+        {
+            tr_logAddError(
+                _("Couldn't preallocate file \"%1$s\" (%2$s, size: %3$" PRIu64 "): %4$s"),
+                file.filename.c_str(),
+                mode == TR_PREALLOCATE_FULL ? _("full") : _("sparse"),
+                file.length,
+                error->message);
+        }
+
+        lock.lock();
+
+        // the disk is full, so the other files won't fit either
+        if (error != nullptr && TR_ERROR_IS_ENOSPC(error->code))
+        {
+            job.cancelled = true;
+        }
+
+        tr_error_free(error);
+
+        job.pending.erase(index);
+        job.current.reset();
+        job.bytes_done = bytes_before + file.length;
+        changed_.notify_all();
+    }
+}
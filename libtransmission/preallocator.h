@@ -0,0 +1,126 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstdint> // uint64_t
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "transmission.h"
+#include "file.h"
+#include "worker-pool.h"
+
+struct tr_error;
+
+/**
+ * @brief preallocate an open file to `length` bytes.
+ *
+ * If the filesystem can't do that quickly, a full preallocation falls
+ * back to writing zeroes. `progress` is then called with the number of
+ * bytes written so far, and the preallocation stops if it returns false.
+ */
+bool tr_preallocateFile(
+    tr_sys_file_t fd,
+    uint64_t length,
+    tr_preallocation_mode mode,
+    tr_error** error,
+    std::function<bool(uint64_t)> const& progress = {});
+
+/**
+ * Creates and preallocates torrents' files on a worker thread, so that
+ * starting a big torrent doesn't stall the event thread while the disk
+ * fills a 100 GB file with zeroes.
+ *
+ * While a file is waiting to be preallocated, the cache holds on to the
+ * blocks written to it. Writing a file takes it out of the queue, or
+ * stops its preallocation if that's under way.
+ */
+class tr_preallocator
+{
+public:
+    struct File
+    {
+        tr_file_index_t index;
+        std::string filename;
+        uint64_t length;
+
+        // the other places the file might already be, e.g. in the
+        // download dir instead of the incomplete dir. If it's at any
+        // of them, or at `filename`, it's left alone.
+        std::vector<std::string> elsewhere;
+    };
+
+    tr_preallocator() = default;
+    ~tr_preallocator();
+
+    tr_preallocator(tr_preallocator const&) = delete;
+    tr_preallocator& operator=(tr_preallocator const&) = delete;
+
+    /** @brief queue `files` to be created and preallocated, unless they already exist */
+    void add(int torrent_id, tr_preallocation_mode mode, std::vector<File> files);
+
+    /** @brief drop the torrent's queued files, and wait for the one being preallocated */
+    void cancel(int torrent_id);
+
+    /**
+     * @brief take file `i` out of the queue. If it's being preallocated,
+     * stop that and wait for the worker to let go of the file, which
+     * takes at most one chunk of zeroes.
+     * @return true if the file was taken out of the queue before it was created
+     */
+    bool claim(int torrent_id, tr_file_index_t i);
+
+    /** @return true if any of the files [begin..end] are waiting to be preallocated */
+    [[nodiscard]] bool isPending(int torrent_id, tr_file_index_t begin, tr_file_index_t end) const;
+
+    /** @return how much of the torrent's queued preallocation is done, or nullopt if there's none */
+    [[nodiscard]] std::optional<double> progress(int torrent_id) const;
+
+private:
+    struct Job
+    {
+        tr_preallocation_mode mode = TR_PREALLOCATE_NONE;
+
+        // the files that are queued or being preallocated, keyed by index
+        std::map<tr_file_index_t, File> pending;
+
+        // the file being preallocated right now
+        std::optional<tr_file_index_t> current;
+
+        // true if `current` was claimed, so its preallocation should stop
+        bool current_claimed = false;
+
+        bool cancelled = false;
+        uint64_t bytes_total = 0;
+        uint64_t bytes_done = 0;
+    };
+
+    void run(int torrent_id);
+    void waitUntil(std::unique_lock<std::mutex>& lock, int torrent_id, std::function<bool(Job const&)> const& test);
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+
+    // keyed by torrent id
+    std::unordered_map<int, Job> jobs_;
+
+    // one thread, since the files share a disk.
+    // Declared last so that it's the first to go.
+    tr_worker_pool pool_{ 1 };
+};
@@ -10,6 +10,7 @@
 #include <array>
 #include <cstring> // strlen()
 #include <iterator>
+#include <mutex>
 #include <string_view>
 #include <vector>
 
@@ -23,9 +24,10 @@ using namespace std::literals;
 namespace
 {
 
-auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
+auto constexpr my_static = std::array<std::string_view, 409>{ ""sv,
                                                               "activeTorrentCount"sv,
                                                               "activity-date"sv,
+                                                              "activity-sequence"sv,
                                                               "activityDate"sv,
                                                               "added"sv,
                                                               "added-date"sv,
@@ -60,6 +62,7 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "blocks"sv,
                                                               "bytesCompleted"sv,
                                                               "cache-size-mb"sv,
+                                                              "change-token"sv,
                                                               "clientIsChoked"sv,
                                                               "clientIsInterested"sv,
                                                               "clientName"sv,
@@ -124,6 +127,9 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "files-unwanted"sv,
                                                               "files-wanted"sv,
                                                               "filesAdded"sv,
+                                                              "filesClosed"sv,
+                                                              "filesOpened"sv,
+                                                              "filter"sv,
                                                               "filter-mode"sv,
                                                               "filter-text"sv,
                                                               "filter-trackers"sv,
@@ -185,6 +191,7 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "leecherCount"sv,
                                                               "leftUntilDone"sv,
                                                               "length"sv,
+                                                              "limit"sv,
                                                               "location"sv,
                                                               "lpd-enabled"sv,
                                                               "m"sv,
@@ -197,6 +204,7 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "main-window-x"sv,
                                                               "main-window-y"sv,
                                                               "manualAnnounceTime"sv,
+                                                              "match-count"sv,
                                                               "max-peers"sv,
                                                               "maxConnectedPeers"sv,
                                                               "memory-bytes"sv,
@@ -217,7 +225,11 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "nextScrapeTime"sv,
                                                               "nodes"sv,
                                                               "nodes6"sv,
+                                                              "offset"sv,
                                                               "open-dialog-dir"sv,
+                                                              "open-file-limit"sv,
+                                                              "openFileCount"sv,
+                                                              "openFileLimit"sv,
                                                               "p"sv,
                                                               "path"sv,
                                                               "path.utf-8"sv,
@@ -255,6 +267,7 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "port-forwarding-enabled"sv,
                                                               "port-is-open"sv,
                                                               "preallocation"sv,
+                                                              "preallocationProgress"sv,
                                                               "prefetch-enabled"sv,
                                                               "primary-mime-type"sv,
                                                               "priorities"sv,
@@ -294,9 +307,11 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "rename-partial-files"sv,
                                                               "reqq"sv,
                                                               "result"sv,
+                                                              "resume-journal-enabled"sv,
                                                               "rpc-authentication-required"sv,
                                                               "rpc-bind-address"sv,
                                                               "rpc-enabled"sv,
+                                                              "rpc-event-interval"sv,
                                                               "rpc-host-whitelist"sv,
                                                               "rpc-host-whitelist-enabled"sv,
                                                               "rpc-password"sv,
@@ -330,6 +345,7 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "seeding-time-seconds"sv,
                                                               "session-count"sv,
                                                               "session-id"sv,
+                                                              "session-stats"sv,
                                                               "sessionCount"sv,
                                                               "show-backup-trackers"sv,
                                                               "show-extra-peer-details"sv,
@@ -342,6 +358,7 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "size-bytes"sv,
                                                               "size-units"sv,
                                                               "sizeWhenDone"sv,
+                                                              "sort"sv,
                                                               "sort-mode"sv,
                                                               "sort-reversed"sv,
                                                               "source"sv,
@@ -377,6 +394,7 @@ auto constexpr my_static = std::array<std::string_view, 392>{ ""sv,
                                                               "torrents"sv,
                                                               "totalSize"sv,
                                                               "total_size"sv,
+                                                              "tracker"sv,
                                                               "tracker id"sv,
                                                               "trackerAdd"sv,
                                                               "trackerRemove"sv,
@@ -433,13 +451,14 @@ size_t constexpr quarks_are_sorted = ( //
 static_assert(quarks_are_sorted, "Predefined quarks must be sorted by their string value");
 static_assert(std::size(my_static) == TR_N_KEYS);
 
+// quarks added at runtime. The parsers add them from worker threads too,
+// e.g. when torrents are loaded at startup, so guard them with a mutex.
+// The strings themselves are never freed or moved.
 auto& my_runtime{ *new std::vector<std::string_view>{} };
+auto& my_runtime_mutex{ *new std::mutex{} };
 
-} // namespace
-
-std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+std::optional<tr_quark> lookup_static(std::string_view key)
 {
-    // is it in our static array?
     auto constexpr sbegin = std::begin(my_static), send = std::end(my_static);
     auto const sit = std::lower_bound(sbegin, send, key);
     if (sit != send && *sit == key)
@@ -447,7 +466,12 @@ std::optional<tr_quark> tr_quark_lookup(std::string_view key)
         return std::distance(sbegin, sit);
     }
 
-    /* was it added during runtime? */
+    return {};
+}
+
+// the caller must hold my_runtime_mutex
+std::optional<tr_quark> lookup_runtime(std::string_view key)
+{
     auto const rbegin = std::begin(my_runtime), rend = std::end(my_runtime);
     auto const rit = std::find(rbegin, rend, key);
     if (rit != rend)
@@ -458,9 +482,29 @@ std::optional<tr_quark> tr_quark_lookup(std::string_view key)
     return {};
 }
 
+} // namespace
+
+std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+{
+    if (auto const q = lookup_static(key); q)
+    {
+        return q;
+    }
+
+    auto const lock = std::lock_guard(my_runtime_mutex);
+    return lookup_runtime(key);
+}
+
 tr_quark tr_quark_new(std::string_view str)
 {
-    if (auto const prior = tr_quark_lookup(str); prior)
+    if (auto const q = lookup_static(str); q)
+    {
+        return *q;
+    }
+
+    auto const lock = std::lock_guard(my_runtime_mutex);
+
+    if (auto const prior = lookup_runtime(str); prior)
     {
         return *prior;
     }
@@ -472,7 +516,13 @@ tr_quark tr_quark_new(std::string_view str)
 
 std::string_view tr_quark_get_string_view(tr_quark q)
 {
-    return q < TR_N_KEYS ? my_static[q] : my_runtime[q - TR_N_KEYS];
+    if (q < TR_N_KEYS)
+    {
+        return my_static[q];
+    }
+
+    auto const lock = std::lock_guard(my_runtime_mutex);
+    return my_runtime[q - TR_N_KEYS];
 }
 
 char const* tr_quark_get_string(tr_quark q, size_t* len)
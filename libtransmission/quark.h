@@ -29,6 +29,7 @@ enum
     TR_KEY_NONE, /* represented as an empty string */
     TR_KEY_activeTorrentCount, /* rpc */
     TR_KEY_activity_date, /* resume file */
+    TR_KEY_activity_sequence, /* rpc */
     TR_KEY_activityDate, /* rpc */
     TR_KEY_added, /* pex */
     TR_KEY_added_date, /* rpc */
@@ -63,6 +64,7 @@ enum
     TR_KEY_blocks,
     TR_KEY_bytesCompleted,
     TR_KEY_cache_size_mb,
+    TR_KEY_change_token, /* rpc */
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
     TR_KEY_clientName,
@@ -127,6 +129,9 @@ enum
     TR_KEY_files_unwanted,
     TR_KEY_files_wanted,
     TR_KEY_filesAdded,
+    TR_KEY_filesClosed,
+    TR_KEY_filesOpened,
+    TR_KEY_filter,
     TR_KEY_filter_mode,
     TR_KEY_filter_text,
     TR_KEY_filter_trackers,
@@ -188,6 +193,7 @@ enum
     TR_KEY_leecherCount,
     TR_KEY_leftUntilDone,
     TR_KEY_length,
+    TR_KEY_limit,
     TR_KEY_location,
     TR_KEY_lpd_enabled,
     TR_KEY_m,
@@ -200,6 +206,7 @@ enum
     TR_KEY_main_window_x,
     TR_KEY_main_window_y,
     TR_KEY_manualAnnounceTime,
+    TR_KEY_match_count,
     TR_KEY_max_peers,
     TR_KEY_maxConnectedPeers,
     TR_KEY_memory_bytes,
@@ -220,7 +227,11 @@ enum
     TR_KEY_nextScrapeTime,
     TR_KEY_nodes,
     TR_KEY_nodes6,
+    TR_KEY_offset,
     TR_KEY_open_dialog_dir,
+    TR_KEY_open_file_limit,
+    TR_KEY_openFileCount,
+    TR_KEY_openFileLimit,
     TR_KEY_p,
     TR_KEY_path,
     TR_KEY_path_utf_8,
@@ -258,6 +269,7 @@ enum
     TR_KEY_port_forwarding_enabled,
     TR_KEY_port_is_open,
     TR_KEY_preallocation,
+    TR_KEY_preallocationProgress,
     TR_KEY_prefetch_enabled,
     TR_KEY_primary_mime_type,
     TR_KEY_priorities,
@@ -297,9 +309,11 @@ enum
     TR_KEY_rename_partial_files,
     TR_KEY_reqq,
     TR_KEY_result,
+    TR_KEY_resume_journal_enabled,
     TR_KEY_rpc_authentication_required,
     TR_KEY_rpc_bind_address,
     TR_KEY_rpc_enabled,
+    TR_KEY_rpc_event_interval,
     TR_KEY_rpc_host_whitelist,
     TR_KEY_rpc_host_whitelist_enabled,
     TR_KEY_rpc_password,
@@ -333,6 +347,7 @@ enum
     TR_KEY_seeding_time_seconds,
     TR_KEY_session_count,
     TR_KEY_session_id,
+    TR_KEY_session_stats,
     TR_KEY_sessionCount,
     TR_KEY_show_backup_trackers,
     TR_KEY_show_extra_peer_details,
@@ -345,6 +360,7 @@ enum
     TR_KEY_size_bytes,
     TR_KEY_size_units,
     TR_KEY_sizeWhenDone,
+    TR_KEY_sort,
     TR_KEY_sort_mode,
     TR_KEY_sort_reversed,
     TR_KEY_source,
@@ -380,6 +396,7 @@ enum
     TR_KEY_torrents,
     TR_KEY_totalSize,
     TR_KEY_total_size,
+    TR_KEY_tracker,
     TR_KEY_tracker_id,
     TR_KEY_trackerAdd,
     TR_KEY_trackerRemove,
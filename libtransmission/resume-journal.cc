@@ -0,0 +1,684 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <cctype> // isxdigit()
+#include <cinttypes> // PRIu64
+#include <functional> // std::hash
+#include <iterator>
+#include <utility>
+
+#include "transmission.h"
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "resume-journal.h"
+#include "tr-assert.h"
+#include "tr-macros.h" // SHA_DIGEST_LENGTH
+#include "utils.h"
+#include "variant.h"
+
+using namespace std::literals;
+
+/**
+ * The file is `Magic` followed by records. Each record is
+ *
+ *   u32 body size | u32 crc32 of body | body
+ *
+ * where the body is a RecordType byte, the torrent's hash string, and,
+ * for a Set record, the changed fields as
+ *
+ *   u16 key size | key | u32 value size | value
+ *
+ * Values are benc strings, which are never empty, so a value size of 0
+ * means the field was removed. All integers are little-endian.
+ */
+
+static auto constexpr Magic = "TRJ1"sv;
+
+static auto constexpr HashStringLen = size_t{ SHA_DIGEST_LENGTH * 2 };
+
+static auto constexpr RecordHeaderBytes = size_t{ 8 };
+
+// don't bother compacting journals smaller than this
+static auto constexpr MinCompactBytes = uint64_t{ 1024 * 1024 };
+
+enum RecordType : uint8_t
+{
+    RECORD_SET = 1,
+    RECORD_REMOVE = 2
+};
+
+static uint32_t crc32(std::string_view data)
+{
+    static auto const table = []()
+    {
+        auto ret = std::array<uint32_t, 256>{};
+        for (uint32_t i = 0; i < std::size(ret); ++i)
+        {
+            auto c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) != 0 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            }
+            ret[i] = c;
+        }
+        return ret;
+    }();
+
+    auto crc = ~uint32_t{};
+    for (auto const ch : data)
+    {
+        crc = table[(crc ^ uint8_t(ch)) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void appendUint(std::string& out, uint64_t val, size_t n_bytes)
+{
+    for (size_t i = 0; i < n_bytes; ++i)
+    {
+        out += char((val >> (8 * i)) & 0xFF);
+    }
+}
+
+static bool readUint(std::string_view& in, size_t n_bytes, uint64_t* setme)
+{
+    if (std::size(in) < n_bytes)
+    {
+        return false;
+    }
+
+    *setme = 0;
+    for (size_t i = 0; i < n_bytes; ++i)
+    {
+        *setme |= uint64_t(uint8_t(in[i])) << (8 * i);
+    }
+
+    in.remove_prefix(n_bytes);
+    return true;
+}
+
+static bool readStr(std::string_view& in, size_t n_bytes, std::string_view* setme)
+{
+    if (std::size(in) < n_bytes)
+    {
+        return false;
+    }
+
+    *setme = in.substr(0, n_bytes);
+    in.remove_prefix(n_bytes);
+    return true;
+}
+
+static void appendField(std::string& body, std::string_view key, std::string_view val)
+{
+    appendUint(body, std::size(key), 2);
+    body += key;
+    appendUint(body, std::size(val), 4);
+    body += val;
+}
+
+static void appendRecord(std::string& out, std::string_view body)
+{
+    appendUint(out, std::size(body), 4);
+    appendUint(out, crc32(body), 4);
+    out += body;
+}
+
+static std::string makeBody(RecordType type, std::string_view hash_string)
+{
+    auto body = std::string{};
+    body += char(type);
+    body += hash_string;
+    return body;
+}
+
+static size_t fieldBytes(std::string_view key, std::string_view val)
+{
+    return 2 + std::size(key) + 4 + std::size(val);
+}
+
+static bool isHashString(std::string_view str)
+{
+    return std::size(str) == HashStringLen &&
+        std::all_of(std::begin(str), std::end(str), [](unsigned char ch) { return isxdigit(ch) != 0; });
+}
+
+static bool toVariant(tr_variant* setme, std::map<std::string, std::string, std::less<>> const& fields)
+{
+    auto benc = std::string{ "d" };
+    for (auto const& [key, val] : fields)
+    {
+        benc += std::to_string(std::size(key));
+        benc += ':';
+        benc += key;
+        benc += val;
+    }
+    benc += 'e';
+
+    return tr_variantFromBuf(setme, TR_VARIANT_PARSE_BENC, benc);
+}
+
+static bool writeFile(std::string const& filename, std::string_view contents, int flags, tr_error** error)
+{
+    auto const fd = tr_sys_file_open(filename.c_str(), TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE | flags, 0600, error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto const ok = tr_sys_file_write(fd, std::data(contents), std::size(contents), nullptr, error) &&
+        tr_sys_file_flush(fd, error);
+    tr_sys_file_close(fd, nullptr);
+    return ok;
+}
+
+/***
+****
+***/
+
+tr_resume_journal::Batch::Batch(tr_resume_journal* journal)
+    : journal_{ journal }
+{
+    if (journal_ != nullptr)
+    {
+        auto const lock = std::lock_guard(journal_->mutex_);
+        ++journal_->batch_depth_;
+    }
+}
+
+tr_resume_journal::Batch::~Batch()
+{
+    if (journal_ == nullptr)
+    {
+        return;
+    }
+
+    auto const lock = std::lock_guard(journal_->mutex_);
+
+    if (--journal_->batch_depth_ == 0)
+    {
+        tr_error* error = nullptr;
+        if (!journal_->flushLocked(&error))
+        {
+            tr_logAddError("Couldn't save \"%s\": %s", journal_->filename_.c_str(), error->message);
+            tr_error_free(error);
+        }
+    }
+}
+
+/***
+****
+***/
+
+tr_resume_journal::tr_resume_journal(std::string filename)
+    : filename_{ std::move(filename) }
+{
+    auto torrents = Torrents{};
+    tr_error* error = nullptr;
+    if (!read(torrents, &error))
+    {
+        tr_logAddError("Couldn't read \"%s\": %s", filename_.c_str(), error->message);
+        tr_error_free(error);
+    }
+
+    live_bytes_ = std::size(Magic);
+    for (auto const& [hash_string, fields] : torrents)
+    {
+        setEntry(hash_string, fields);
+    }
+
+    loaded_ = std::move(torrents);
+}
+
+tr_resume_journal::~tr_resume_journal()
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    tr_error* error = nullptr;
+    if (!flushLocked(&error))
+    {
+        tr_logAddError("Couldn't save \"%s\": %s", filename_.c_str(), error->message);
+        tr_error_free(error);
+    }
+}
+
+// read the whole journal, dropping any damaged tail
+bool tr_resume_journal::read(Torrents& setme, tr_error** error)
+{
+    if (!tr_sys_path_exists(filename_.c_str(), nullptr))
+    {
+        file_bytes_ = 0;
+        return true;
+    }
+
+    auto buf = std::vector<char>{};
+    if (!tr_loadFile(buf, filename_.c_str(), error))
+    {
+        return false;
+    }
+
+    auto in = std::string_view{ std::data(buf), std::size(buf) };
+    auto good_bytes = size_t{};
+
+    if (tr_strvStartsWith(in, Magic))
+    {
+        in.remove_prefix(std::size(Magic));
+        good_bytes = std::size(Magic);
+
+        for (;;)
+        {
+            auto body_len = uint64_t{};
+            auto crc = uint64_t{};
+            auto body = std::string_view{};
+            auto type = uint64_t{};
+            auto hash_string = std::string_view{};
+            if (!readUint(in, 4, &body_len) || !readUint(in, 4, &crc) || !readStr(in, body_len, &body) ||
+                crc32(body) != crc || !readUint(body, 1, &type) || !readStr(body, HashStringLen, &hash_string))
+            {
+                break;
+            }
+
+            auto const key = std::string{ hash_string };
+
+            if (type == RECORD_REMOVE)
+            {
+                setme.erase(key);
+            }
+            else if (type == RECORD_SET)
+            {
+                auto& fields = setme[key];
+                auto key_len = uint64_t{};
+                auto field = std::string_view{};
+                auto val_len = uint64_t{};
+                auto val = std::string_view{};
+                while (readUint(body, 2, &key_len) && readStr(body, key_len, &field) && readUint(body, 4, &val_len) &&
+                       readStr(body, val_len, &val))
+                {
+                    if (std::empty(val))
+                    {
+                        if (auto const it = fields.find(field); it != std::end(fields))
+                        {
+                            fields.erase(it);
+                        }
+                    }
+                    else
+                    {
+                        fields.insert_or_assign(std::string{ field }, std::string{ val });
+                    }
+                }
+            }
+
+            good_bytes += RecordHeaderBytes + body_len;
+        }
+    }
+
+    if (good_bytes < std::size(buf))
+    {
+        tr_logAddError(
+            "Resume journal \"%s\" is damaged after byte %zu; ignoring the rest",
+            filename_.c_str(),
+            good_bytes);
+
+        // drop the tail so that new records don't get lost behind it
+        if (auto const fd = tr_sys_file_open(filename_.c_str(), TR_SYS_FILE_WRITE, 0, nullptr); fd != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_truncate(fd, good_bytes, nullptr);
+            tr_sys_file_close(fd, nullptr);
+        }
+    }
+
+    file_bytes_ = good_bytes;
+    return true;
+}
+
+void tr_resume_journal::setEntry(std::string const& hash_string, Fields const& fields)
+{
+    auto& entry = entries_[hash_string];
+    live_bytes_ -= entry.bytes;
+
+    entry.fingerprints.clear();
+    entry.bytes = RecordHeaderBytes + 1 + HashStringLen;
+    for (auto const& [key, val] : fields)
+    {
+        entry.fingerprints.emplace_back(tr_quark_new(key), std::hash<std::string_view>{}(val));
+        entry.bytes += fieldBytes(key, val);
+    }
+
+    std::sort(std::begin(entry.fingerprints), std::end(entry.fingerprints));
+    live_bytes_ += entry.bytes;
+}
+
+bool tr_resume_journal::put(std::string_view hash_string, tr_variant const* dict, tr_error** error)
+{
+    TR_ASSERT(isHashString(hash_string));
+    TR_ASSERT(tr_variantIsDict(dict));
+
+    // serialize the fields outside of the lock
+    auto fields = std::vector<std::pair<tr_quark, std::string>>{};
+    auto key = tr_quark{};
+    tr_variant* child = nullptr;
+    for (size_t i = 0; tr_variantDictChild(const_cast<tr_variant*>(dict), i, &key, &child); ++i)
+    {
+        auto len = size_t{};
+        auto* const benc = tr_variantToStr(child, TR_VARIANT_FMT_BENC, &len);
+        fields.emplace_back(key, std::string{ benc, len });
+        tr_free(benc);
+    }
+
+    std::sort(
+        std::begin(fields),
+        std::end(fields),
+        [](auto const& a, auto const& b) { return a.first < b.first; });
+
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const hash_key = std::string{ hash_string };
+    loaded_.erase(hash_key);
+
+    auto const [it, is_new] = entries_.try_emplace(hash_key);
+    auto& entry = it->second;
+    auto const& old = entry.fingerprints;
+
+    // write the fields that are new or changed, and zero-length
+    // values for the ones that are gone
+    auto body = makeBody(RECORD_SET, hash_string);
+    auto fingerprints = std::vector<std::pair<tr_quark, size_t>>{};
+    fingerprints.reserve(std::size(fields));
+    auto bytes = RecordHeaderBytes + 1 + HashStringLen;
+    auto old_it = std::begin(old);
+    for (auto const& [field_key, val] : fields)
+    {
+        for (; old_it != std::end(old) && old_it->first < field_key; ++old_it)
+        {
+            appendField(body, tr_quark_get_string_view(old_it->first), ""sv);
+        }
+
+        auto const fingerprint = std::hash<std::string_view>{}(val);
+        auto const field_name = tr_quark_get_string_view(field_key);
+        if (old_it == std::end(old) || old_it->first != field_key || old_it->second != fingerprint)
+        {
+            appendField(body, field_name, val);
+        }
+
+        if (old_it != std::end(old) && old_it->first == field_key)
+        {
+            ++old_it;
+        }
+
+        fingerprints.emplace_back(field_key, fingerprint);
+        bytes += fieldBytes(field_name, val);
+    }
+
+    for (; old_it != std::end(old); ++old_it)
+    {
+        appendField(body, tr_quark_get_string_view(old_it->first), ""sv);
+    }
+
+    if (is_new || std::size(body) > 1 + HashStringLen)
+    {
+        appendRecord(pending_, body);
+    }
+
+    live_bytes_ = live_bytes_ - entry.bytes + bytes;
+    entry.fingerprints = std::move(fingerprints);
+    entry.bytes = bytes;
+
+    return batch_depth_ > 0 || flushLocked(error);
+}
+
+bool tr_resume_journal::get(std::string_view hash_string, tr_variant* setme)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const hash_key = std::string{ hash_string };
+    auto fields = Fields{};
+
+    if (auto node = loaded_.extract(hash_key); node)
+    {
+        fields = std::move(node.mapped());
+    }
+    else if (entries_.count(hash_key) != 0)
+    {
+        // not kept in memory, so read the journal again
+        auto torrents = Torrents{};
+        if (!flushLocked(nullptr) || !read(torrents, nullptr))
+        {
+            return false;
+        }
+
+        fields = std::move(torrents[hash_key]);
+    }
+    else
+    {
+        return false;
+    }
+
+    return toVariant(setme, fields);
+}
+
+void tr_resume_journal::remove(std::string_view hash_string)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const hash_key = std::string{ hash_string };
+    loaded_.erase(hash_key);
+
+    auto const it = entries_.find(hash_key);
+    if (it == std::end(entries_))
+    {
+        return;
+    }
+
+    live_bytes_ -= it->second.bytes;
+    entries_.erase(it);
+    appendRecord(pending_, makeBody(RECORD_REMOVE, hash_string));
+
+    if (batch_depth_ == 0)
+    {
+        flushLocked(nullptr);
+    }
+}
+
+bool tr_resume_journal::contains(std::string_view hash_string) const
+{
+    auto const lock = std::lock_guard(mutex_);
+    return entries_.count(std::string{ hash_string }) != 0;
+}
+
+bool tr_resume_journal::flush(tr_error** error)
+{
+    auto const lock = std::lock_guard(mutex_);
+    return flushLocked(error);
+}
+
+bool tr_resume_journal::flushLocked(tr_error** error)
+{
+    if (std::empty(pending_))
+    {
+        return true;
+    }
+
+    // a new or emptied journal starts with the magic
+    auto flags = int{ TR_SYS_FILE_APPEND };
+    if (file_bytes_ == 0)
+    {
+        pending_.insert(0, Magic);
+        flags = TR_SYS_FILE_TRUNCATE;
+    }
+
+    if (!writeFile(filename_, pending_, flags, error))
+    {
+        // don't leave a partial record for later ones to hide behind
+        if (auto const fd = tr_sys_file_open(filename_.c_str(), TR_SYS_FILE_WRITE, 0, nullptr); fd != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_truncate(fd, file_bytes_, nullptr);
+            tr_sys_file_close(fd, nullptr);
+        }
+
+        if (file_bytes_ == 0)
+        {
+            pending_.erase(0, std::size(Magic));
+        }
+
+        return false;
+    }
+
+    file_bytes_ += std::size(pending_);
+    pending_.clear();
+
+    if (file_bytes_ > MinCompactBytes && file_bytes_ > 2 * live_bytes_)
+    {
+        tr_error* compact_error = nullptr;
+        if (!compact(&compact_error))
+        {
+            tr_logAddError("Couldn't compact \"%s\": %s", filename_.c_str(), compact_error->message);
+            tr_error_free(compact_error);
+        }
+    }
+
+    return true;
+}
+
+// rewrite the journal with one record per torrent
+bool tr_resume_journal::compact(tr_error** error)
+{
+    auto torrents = Torrents{};
+    if (!read(torrents, error))
+    {
+        return false;
+    }
+
+    auto out = std::string{ Magic };
+    out.reserve(live_bytes_);
+    for (auto const& [hash_string, fields] : torrents)
+    {
+        auto body = makeBody(RECORD_SET, hash_string);
+        for (auto const& [key, val] : fields)
+        {
+            appendField(body, key, val);
+        }
+
+        appendRecord(out, body);
+    }
+
+    auto const tmp = filename_ + ".tmp";
+    if (!writeFile(tmp, out, TR_SYS_FILE_TRUNCATE, error) || !tr_sys_path_rename(tmp.c_str(), filename_.c_str(), error))
+    {
+        tr_sys_path_remove(tmp.c_str(), nullptr);
+        return false;
+    }
+
+    tr_logAddDebug("Compacted \"%s\" from %" PRIu64 " to %zu bytes", filename_.c_str(), file_bytes_, std::size(out));
+    file_bytes_ = std::size(out);
+    return true;
+}
+
+/***
+****
+***/
+
+size_t tr_resume_journal::importFiles(std::string_view dirname)
+{
+    auto const dirname_str = std::string{ dirname };
+    auto const odir = tr_sys_dir_open(dirname_str.c_str(), nullptr);
+    if (odir == TR_BAD_SYS_DIR)
+    {
+        return 0;
+    }
+
+    auto filenames = std::vector<std::string>{};
+    auto hash_strings = std::vector<std::string>{};
+    for (char const* name = nullptr; (name = tr_sys_dir_read_name(odir, nullptr)) != nullptr;)
+    {
+        auto const sv = std::string_view{ name };
+        if (!tr_strvEndsWith(sv, ".resume"sv))
+        {
+            continue;
+        }
+
+        auto const hash_string = sv.substr(0, std::size(sv) - std::size(".resume"sv));
+        if (isHashString(hash_string) && !contains(hash_string))
+        {
+            filenames.push_back(tr_strvPath(dirname, sv));
+            hash_strings.emplace_back(hash_string);
+        }
+    }
+
+    tr_sys_dir_close(odir, nullptr);
+
+    {
+        auto const lock = std::lock_guard(mutex_);
+        ++batch_depth_;
+    }
+
+    auto imported = std::vector<std::string>{};
+    for (size_t i = 0, n = std::size(filenames); i < n; ++i)
+    {
+        auto top = tr_variant{};
+        if (tr_variantFromFile(&top, TR_VARIANT_PARSE_BENC, filenames[i].c_str()) && tr_variantIsDict(&top))
+        {
+            put(hash_strings[i], &top);
+            imported.push_back(filenames[i]);
+        }
+
+        tr_variantFree(&top);
+    }
+
+    auto const lock = std::lock_guard(mutex_);
+    --batch_depth_;
+
+    tr_error* error = nullptr;
+    if (!flushLocked(&error))
+    {
+        tr_logAddError("Couldn't save \"%s\": %s", filename_.c_str(), error->message);
+        tr_error_free(error);
+        return 0;
+    }
+
+    for (auto const& filename : imported)
+    {
+        tr_sys_path_remove(filename.c_str(), nullptr);
+    }
+
+    return std::size(imported);
+}
+
+bool tr_resume_journal::exportFiles(std::string_view dirname, tr_error** error)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto torrents = Torrents{};
+    if (!flushLocked(error) || !read(torrents, error))
+    {
+        return false;
+    }
+
+    for (auto const& [hash_string, fields] : torrents)
+    {
+        auto top = tr_variant{};
+        if (!toVariant(&top, fields))
+        {
+            continue;
+        }
+
+        auto const filename = tr_strvPath(dirname, hash_string + ".resume");
+        auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, filename.c_str());
+        tr_variantFree(&top);
+
+        if (err != 0)
+        {
+            tr_error_set(error, err, "Couldn't save \"%s\": %s", filename.c_str(), tr_strerror(err));
+            return false;
+        }
+    }
+
+    return true;
+}
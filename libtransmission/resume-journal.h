@@ -0,0 +1,149 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional> // std::less
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility> // std::pair
+#include <vector>
+
+#include "transmission.h"
+#include "quark.h"
+
+struct tr_error;
+struct tr_variant;
+
+/**
+ * Every torrent's resume data in a single append-only file, for sessions
+ * with so many torrents that a .resume file apiece is too much I/O.
+ *
+ * Saving a torrent appends a record holding only the fields that changed
+ * since its last save, and a batch of saves is written with one write
+ * and one fsync. Each record is checksummed; on load, a torn or damaged
+ * tail is dropped. When most of the file is stale, it is rewritten with
+ * one record per torrent.
+ *
+ * Torrents are keyed by their info hash string. It is safe to use from
+ * any thread.
+ */
+class tr_resume_journal
+{
+public:
+    /**
+     * While a Batch is alive, the journal's changes are held in memory
+     * and written together when the last Batch ends.
+     * `journal` may be null, which makes the Batch a no-op.
+     */
+    class Batch
+    {
+    public:
+        explicit Batch(tr_resume_journal* journal);
+        ~Batch();
+
+        Batch(Batch const&) = delete;
+        Batch& operator=(Batch const&) = delete;
+
+    private:
+        tr_resume_journal* const journal_;
+    };
+
+    /* reads `filename`, if it exists */
+    explicit tr_resume_journal(std::string filename);
+    ~tr_resume_journal();
+
+    tr_resume_journal(tr_resume_journal const&) = delete;
+    tr_resume_journal& operator=(tr_resume_journal const&) = delete;
+
+    /** @brief save `dict`, a torrent's resume dict. Written at once unless a Batch is alive */
+    bool put(std::string_view hash_string, tr_variant const* dict, tr_error** error = nullptr);
+
+    /** @brief read a torrent's resume dict into `setme` */
+    bool get(std::string_view hash_string, tr_variant* setme);
+
+    void remove(std::string_view hash_string);
+
+    [[nodiscard]] bool contains(std::string_view hash_string) const;
+
+    /** @brief write the changes that are waiting for a Batch to end */
+    bool flush(tr_error** error = nullptr);
+
+    /**
+     * @brief move `<hash>.resume` files in `dirname` into the journal.
+     * The files are removed once the journal has them.
+     * @return the number of files moved
+     */
+    size_t importFiles(std::string_view dirname);
+
+    /** @brief write a `<hash>.resume` file in `dirname` for every torrent */
+    bool exportFiles(std::string_view dirname, tr_error** error = nullptr);
+
+    [[nodiscard]] size_t size() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return std::size(entries_);
+    }
+
+    [[nodiscard]] std::string const& filename() const
+    {
+        return filename_;
+    }
+
+    /** @brief the journal's size on disk, not counting changes waiting for a Batch */
+    [[nodiscard]] uint64_t fileSize() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return file_bytes_;
+    }
+
+private:
+    // a torrent's fields, keyed by name, as benc strings
+    using Fields = std::map<std::string, std::string, std::less<>>;
+    using Torrents = std::unordered_map<std::string, Fields>;
+
+    // what we need to know about a torrent to write its next delta
+    struct Entry
+    {
+        // a hash of each field's benc string, sorted by key
+        std::vector<std::pair<tr_quark, size_t>> fingerprints;
+
+        // the size of a record holding all of the torrent's fields
+        size_t bytes = 0;
+    };
+
+    bool read(Torrents& setme, tr_error** error);
+    bool compact(tr_error** error);
+    bool flushLocked(tr_error** error);
+    void setEntry(std::string const& hash_string, Fields const& fields);
+
+    std::string const filename_;
+
+    mutable std::mutex mutex_;
+
+    std::unordered_map<std::string, Entry> entries_;
+
+    // what was read at startup, until someone asks for it
+    Torrents loaded_;
+
+    // records that haven't been written yet
+    std::string pending_;
+
+    uint64_t file_bytes_ = 0;
+    uint64_t live_bytes_ = 0;
+    size_t batch_depth_ = 0;
+};
@@ -0,0 +1,178 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+#include "error.h"
+#include "log.h"
+#include "resume-journal.h"
+#include "resume-writer.h"
+#include "torrent.h"
+#include "trevent.h" // tr_runInEventThread()
+#include "utils.h"
+
+namespace
+{
+
+struct save_error
+{
+    tr_session* session;
+    int torrent_id;
+    std::string message;
+};
+
+} // unnamed namespace
+
+static void onSaveError(void* verror)
+{
+    auto* const error = static_cast<save_error*>(verror);
+
+    if (auto* const tor = tr_torrentFindFromId(error->session, error->torrent_id); tor != nullptr)
+    {
+        tr_torrentSetLocalError(tor, "Unable to save resume file: %s", error->message.c_str());
+    }
+    else
+    {
+        tr_logAddError("Unable to save resume file: %s", error->message.c_str());
+    }
+
+    delete error;
+}
+
+tr_resume_writer::tr_resume_writer(tr_session* session, tr_resume_journal* journal)
+    : session_{ session }
+    , journal_{ journal }
+{
+}
+
+tr_resume_writer::~tr_resume_writer()
+{
+    wait();
+
+    for (auto& [hash_string, save] : pending_)
+    {
+        tr_variantFree(&save.dict);
+    }
+}
+
+void tr_resume_writer::save(int torrent_id, std::string_view hash_string, std::string filename, tr_variant* dict)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto& save = pending_[std::string{ hash_string }];
+    tr_variantFree(&save.dict);
+    save.torrent_id = torrent_id;
+    save.filename = std::move(filename);
+    save.dict = *dict;
+    *dict = {};
+
+    if (!scheduled_)
+    {
+        scheduled_ = true;
+        pool_.run([this]() { writeBatch(); });
+    }
+}
+
+void tr_resume_writer::cancel(std::string_view hash_string)
+{
+    auto lock = std::unique_lock(mutex_);
+    auto const key = std::string{ hash_string };
+
+    for (auto* const batch : { &pending_, &writing_ })
+    {
+        if (auto const it = batch->find(key); it != std::end(*batch))
+        {
+            tr_variantFree(&it->second.dict);
+            batch->erase(it);
+        }
+    }
+
+    current_changed_.wait(lock, [this, &key]() { return current_ != key; });
+}
+
+void tr_resume_writer::wait()
+{
+    pool_.wait();
+}
+
+void tr_resume_writer::writeBatch()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        std::swap(writing_, pending_);
+        scheduled_ = false;
+    }
+
+    auto errors = std::vector<save_error*>{};
+    auto torrent_ids = std::vector<int>{};
+
+    {
+        auto const journal_batch = tr_resume_journal::Batch{ journal_ };
+
+        for (;;)
+        {
+            // take the saves one at a time, so that cancel() can drop the rest
+            auto hash_string = std::string{};
+            auto save = Save{};
+
+            {
+                auto const lock = std::lock_guard(mutex_);
+
+                if (std::empty(writing_))
+                {
+                    current_.clear();
+                    current_changed_.notify_all();
+                    break;
+                }
+
+                auto node = writing_.extract(std::begin(writing_));
+                hash_string = node.key();
+                save = std::move(node.mapped());
+                current_ = hash_string;
+                current_changed_.notify_all();
+            }
+
+            torrent_ids.push_back(save.torrent_id);
+
+            if (journal_ != nullptr)
+            {
+                tr_error* error = nullptr;
+                if (!journal_->put(hash_string, &save.dict, &error))
+                {
+                    errors.push_back(new save_error{ session_, save.torrent_id, error->message });
+                    tr_error_free(error);
+                }
+            }
+            else if (auto const err = tr_variantToFile(&save.dict, TR_VARIANT_FMT_BENC, save.filename.c_str()); err != 0)
+            {
+                errors.push_back(new save_error{ session_, save.torrent_id, tr_strerror(err) });
+            }
+
+            tr_variantFree(&save.dict);
+        }
+
+        // write the batch now rather than when it ends, so that a
+        // failure reaches the torrents whose saves were in it
+        if (tr_error* error = nullptr; journal_ != nullptr && !journal_->flush(&error))
+        {
+            for (auto const torrent_id : torrent_ids)
+            {
+                errors.push_back(new save_error{ session_, torrent_id, error->message });
+            }
+
+            tr_error_free(error);
+        }
+    }
+
+    for (auto* error : errors)
+    {
+        tr_runInEventThread(session_, onSaveError, error);
+    }
+}
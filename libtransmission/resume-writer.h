@@ -0,0 +1,104 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "transmission.h"
+#include "variant.h"
+#include "worker-pool.h"
+
+class tr_resume_journal;
+
+/**
+ * Writes torrents' resume data on a worker thread, so that saving
+ * thousands of torrents doesn't stall the event thread.
+ *
+ * The event thread builds a torrent's resume dict, which is cheap,
+ * and hands it to save(). Serializing and writing it happen later.
+ * If a torrent is saved again before its last save was written, only
+ * the newer one is written. Whatever has piled up is written as one
+ * batch, through the resume journal if the session has one.
+ */
+class tr_resume_writer
+{
+public:
+    /* `journal` may be null, in which case each torrent gets its own file */
+    tr_resume_writer(tr_session* session, tr_resume_journal* journal);
+    ~tr_resume_writer();
+
+    tr_resume_writer(tr_resume_writer const&) = delete;
+    tr_resume_writer& operator=(tr_resume_writer const&) = delete;
+
+    /**
+     * @brief queue `dict` to be written to `filename`, or to the journal.
+     * `dict`'s contents are taken, leaving it empty.
+     */
+    void save(int torrent_id, std::string_view hash_string, std::string filename, tr_variant* dict);
+
+    /**
+     * @brief drop `hash_string`'s unwritten save, and wait for any that's being written.
+     * Other torrents' saves aren't waited for.
+     */
+    void cancel(std::string_view hash_string);
+
+    /** @brief block until everything saved so far has been written */
+    void wait();
+
+    [[nodiscard]] size_t pending() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return std::size(pending_);
+    }
+
+private:
+    struct Save
+    {
+        int torrent_id = 0;
+        std::string filename;
+        tr_variant dict = {};
+    };
+
+    using Batch = std::unordered_map<std::string, Save>;
+
+    void writeBatch();
+
+    tr_session* const session_;
+    tr_resume_journal* const journal_;
+
+    mutable std::mutex mutex_;
+
+    // keyed by hash string
+    Batch pending_;
+
+    // the batch that's being written, less the saves that have been
+    Batch writing_;
+
+    // the hash string of the save that's being written, if any
+    std::string current_;
+
+    // notified when `current_` changes
+    std::condition_variable current_changed_;
+
+    // true if a job to write `pending_` is queued
+    bool scheduled_ = false;
+
+    // one thread, so that batches are written in order.
+    // Declared last so that it's the first to go.
+    tr_worker_pool pool_{ 1 };
+};
@@ -8,7 +8,9 @@
 
 #include <algorithm>
 #include <cstring>
+#include <memory>
 #include <string_view>
+#include <utility> // std::swap()
 #include <vector>
 
 #include "transmission.h"
@@ -18,6 +20,8 @@
 #include "metainfo.h" /* tr_metainfoGetBasename() */
 #include "peer-mgr.h" /* pex */
 #include "platform.h" /* tr_getResumeDir() */
+#include "resume-journal.h"
+#include "resume-writer.h"
 #include "resume.h"
 #include "session.h"
 #include "torrent.h"
@@ -364,7 +368,7 @@ static uint64_t loadIdleLimits(tr_variant* dict, tr_torrent* tor)
 
 static void saveName(tr_variant* dict, tr_torrent const* tor)
 {
-    tr_variantDictAddStrView(dict, TR_KEY_name, tr_torrentName(tor));
+    tr_variantDictAddStr(dict, TR_KEY_name, tr_torrentName(tor));
 }
 
 static uint64_t loadName(tr_variant* dict, tr_torrent* tor)
@@ -412,7 +416,7 @@ static void saveFilenames(tr_variant* dict, tr_torrent const* tor)
         for (tr_file_index_t i = 0; i < n; ++i)
         {
             auto const& file = tor->file(i);
-            tr_variantListAddStrView(list, file.priv.is_renamed ? file.name : "");
+            tr_variantListAddStr(list, file.priv.is_renamed ? file.name : "");
         }
     }
 }
@@ -432,10 +436,7 @@ static uint64_t loadFilenames(tr_variant* dict, tr_torrent* tor)
         auto sv = std::string_view{};
         if (tr_variantGetStrView(tr_variantListChild(list, i), &sv) && !std::empty(sv))
         {
-            auto& file = tor->file(i);
-            tr_free(file.name);
-            file.name = tr_strvDup(sv);
-            file.priv.is_renamed = true;
+            tor->fileTable().rename(i, sv);
         }
     }
 
@@ -677,7 +678,7 @@ void tr_torrentSaveResume(tr_torrent* tor)
     tr_variantDictAddInt(&top, TR_KEY_added_date, tor->addedDate);
     tr_variantDictAddInt(&top, TR_KEY_corrupt, tor->corruptPrev + tor->corruptCur);
     tr_variantDictAddInt(&top, TR_KEY_done_date, tor->doneDate);
-    tr_variantDictAddStrView(&top, TR_KEY_destination, tor->downloadDir);
+    tr_variantDictAddStr(&top, TR_KEY_destination, tor->downloadDir);
 
     if (tor->incompleteDir != nullptr)
     {
@@ -705,17 +706,16 @@ void tr_torrentSaveResume(tr_torrent* tor)
     saveName(&top, tor);
     saveLabels(&top, tor);
 
-    std::string const filename = getResumeFilename(tor, TR_METAINFO_BASENAME_HASH);
-    int const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, filename.c_str());
-    if (err != 0)
-    {
-        tr_torrentSetLocalError(tor, "Unable to save resume file: %s", tr_strerror(err));
-    }
-
-    tr_variantFree(&top);
+    // serializing and writing happen on the writer's thread, so
+    // `top` mustn't hold views of anything the torrent owns
+    tor->session->resume_writer_->save(
+        tor->uniqueId,
+        tor->info.hashString,
+        getResumeFilename(tor, TR_METAINFO_BASENAME_HASH),
+        &top);
 }
 
-static uint64_t loadFromFile(tr_torrent* tor, uint64_t fieldsToLoad, bool* didRenameToHashOnlyName)
+static uint64_t loadFromFile(tr_torrent* tor, uint64_t fieldsToLoad, tr_variant* preloaded, bool* didRenameToHashOnlyName)
 {
     TR_ASSERT(tr_isTorrent(tor));
 
@@ -733,9 +733,24 @@ static uint64_t loadFromFile(tr_torrent* tor, uint64_t fieldsToLoad, bool* didRe
     }
 
     std::string const filename = getResumeFilename(tor, TR_METAINFO_BASENAME_HASH);
+    auto* const journal = tor->session->resume_journal_.get();
+
+    // don't read anything older than what's waiting to be written
+    if (preloaded == nullptr)
+    {
+        tor->session->resume_writer_->wait();
+    }
 
     auto buf = std::vector<char>{};
-    if (!tr_loadFile(buf, filename.c_str(), &error) ||
+    if (preloaded != nullptr)
+    {
+        std::swap(top, *preloaded);
+    }
+    else if (journal != nullptr && journal->get(tor->info.hashString, &top))
+    {
+        tr_logAddTorDbg(tor, "Read resume data from \"%s\"", journal->filename().c_str());
+    }
+    else if (!tr_loadFile(buf, filename.c_str(), &error) ||
         !tr_variantFromBuf(
             &top,
             TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE,
@@ -970,7 +985,28 @@ static uint64_t useFallbackFields(tr_torrent* tor, uint64_t fields, tr_ctor cons
     return setFromCtor(tor, fields, ctor, TR_FALLBACK);
 }
 
-uint64_t tr_torrentLoadResume(tr_torrent* tor, uint64_t fieldsToLoad, tr_ctor const* ctor, bool* didRenameToHashOnlyName)
+bool tr_torrentReadResume(tr_session const* session, tr_info const* info, tr_variant* setme)
+{
+    session->resume_writer_->wait();
+
+    if (auto* const journal = session->resume_journal_.get(); journal != nullptr && journal->get(info->hashString, setme))
+    {
+        return true;
+    }
+
+    auto const filename = tr_buildTorrentFilename(tr_getResumeDir(session), info, TR_METAINFO_BASENAME_HASH, ".resume"sv);
+
+    auto buf = std::vector<char>{};
+    return tr_loadFile(buf, filename.c_str(), nullptr) &&
+        tr_variantFromBuf(setme, TR_VARIANT_PARSE_BENC, { std::data(buf), std::size(buf) });
+}
+
+uint64_t tr_torrentLoadResume(
+    tr_torrent* tor,
+    uint64_t fieldsToLoad,
+    tr_ctor const* ctor,
+    tr_variant* preloaded,
+    bool* didRenameToHashOnlyName)
 {
     TR_ASSERT(tr_isTorrent(tor));
 
@@ -978,7 +1014,7 @@ uint64_t tr_torrentLoadResume(tr_torrent* tor, uint64_t fieldsToLoad, tr_ctor co
 
     ret |= useManditoryFields(tor, fieldsToLoad, ctor);
     fieldsToLoad &= ~ret;
-    ret |= loadFromFile(tor, fieldsToLoad, didRenameToHashOnlyName);
+    ret |= loadFromFile(tor, fieldsToLoad, preloaded, didRenameToHashOnlyName);
     fieldsToLoad &= ~ret;
     ret |= useFallbackFields(tor, fieldsToLoad, ctor);
 
@@ -987,9 +1023,49 @@ uint64_t tr_torrentLoadResume(tr_torrent* tor, uint64_t fieldsToLoad, tr_ctor co
 
 void tr_torrentRemoveResume(tr_torrent const* tor)
 {
+    tor->session->resume_writer_->cancel(tor->info.hashString);
+
+    if (auto* const journal = tor->session->resume_journal_.get(); journal != nullptr)
+    {
+        journal->remove(tor->info.hashString);
+    }
+
     std::string filename = getResumeFilename(tor, TR_METAINFO_BASENAME_HASH);
     tr_sys_path_remove(filename.c_str(), nullptr);
 
     filename = getResumeFilename(tor, TR_METAINFO_BASENAME_NAME_AND_PARTIAL_HASH);
     tr_sys_path_remove(filename.c_str(), nullptr);
 }
+
+void tr_resumeInit(tr_session* session, bool use_journal)
+{
+    auto const filename = tr_strvPath(session->configDir, "resume.journal"sv);
+    auto const* const resume_dir = tr_getResumeDir(session);
+
+    if (use_journal)
+    {
+        session->resume_journal_ = std::make_unique<tr_resume_journal>(filename);
+
+        if (auto const n = session->resume_journal_->importFiles(resume_dir); n > 0)
+        {
+            tr_logAddInfo(_("Moved %zu resume files into \"%s\""), n, filename.c_str());
+        }
+    }
+    else if (tr_sys_path_exists(filename.c_str(), nullptr))
+    {
+        // the journal was turned off, so give each torrent its own file again
+        auto journal = tr_resume_journal{ filename };
+        tr_error* error = nullptr;
+        if (journal.exportFiles(resume_dir, &error) && tr_sys_path_remove(filename.c_str(), &error))
+        {
+            tr_logAddInfo(_("Moved \"%s\" into resume files"), filename.c_str());
+        }
+        else
+        {
+            tr_logAddError(_("Couldn't move \"%s\" into resume files: %s"), filename.c_str(), error->message);
+            tr_error_free(error);
+        }
+    }
+
+    session->resume_writer_ = std::make_unique<tr_resume_writer>(session, session->resume_journal_.get());
+}
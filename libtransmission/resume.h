@@ -14,6 +14,8 @@
 
 #include "tr-macros.h"
 
+struct tr_variant;
+
 enum
 {
     TR_FR_DOWNLOADED = (1 << 0),
@@ -42,9 +44,33 @@ enum
 };
 
 /**
- * Returns a bitwise-or'ed set of the loaded resume data
+ * @brief use the resume journal at `<configDir>/resume.journal` instead of
+ * per-torrent .resume files, moving the data from one form to the other if
+ * `use_journal` has changed since the last session. Also starts the
+ * thread that tr_torrentSaveResume() hands its writes to.
+ */
+void tr_resumeInit(tr_session* session, bool use_journal);
+
+/**
+ * @brief read `info`'s resume file into `setme`.
+ *
+ * This doesn't touch any torrent, so it's safe to call from any thread
+ * and to pass the result to tr_torrentLoadResume() later.
+ */
+bool tr_torrentReadResume(tr_session const* session, tr_info const* info, tr_variant* setme);
+
+/**
+ * Returns a bitwise-or'ed set of the loaded resume data.
+ *
+ * `preloaded`, if not null, is a resume file from tr_torrentReadResume()
+ * to use instead of reading it again.
  */
-uint64_t tr_torrentLoadResume(tr_torrent* tor, uint64_t fieldsToLoad, tr_ctor const* ctor, bool* didRenameToHashOnlyName);
+uint64_t tr_torrentLoadResume(
+    tr_torrent* tor,
+    uint64_t fieldsToLoad,
+    tr_ctor const* ctor,
+    tr_variant* preloaded,
+    bool* didRenameToHashOnlyName);
 
 void tr_torrentSaveResume(tr_torrent* tor);
 
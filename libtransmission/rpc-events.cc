@@ -0,0 +1,195 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <utility>
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+
+#include "transmission.h"
+#include "rpc-events.h"
+#include "session.h"
+#include "utils.h" // tr_timerAddMsec()
+
+// the fields that clients' torrent lists refresh
+static auto constexpr DefaultFields = std::array<tr_quark, 27>{
+    TR_KEY_downloadedEver,
+    TR_KEY_editDate,
+    TR_KEY_error,
+    TR_KEY_errorString,
+    TR_KEY_eta,
+    TR_KEY_haveUnchecked,
+    TR_KEY_haveValid,
+    TR_KEY_id,
+    TR_KEY_isFinished,
+    TR_KEY_leftUntilDone,
+    TR_KEY_manualAnnounceTime,
+    TR_KEY_metadataPercentComplete,
+    TR_KEY_name,
+    TR_KEY_peersConnected,
+    TR_KEY_peersGettingFromUs,
+    TR_KEY_peersSendingToUs,
+    TR_KEY_percentDone,
+    TR_KEY_queuePosition,
+    TR_KEY_rateDownload,
+    TR_KEY_rateUpload,
+    TR_KEY_recheckProgress,
+    TR_KEY_seedRatioLimit,
+    TR_KEY_seedRatioMode,
+    TR_KEY_sizeWhenDone,
+    TR_KEY_status,
+    TR_KEY_uploadedEver,
+    TR_KEY_webseedsSendingToUs,
+};
+
+static auto constexpr MinIntervalMsec = int{ 100 };
+
+static void onEventTimer(evutil_socket_t /*fd*/, short /*what*/, void* vself)
+{
+    static_cast<tr_rpc_events*>(vself)->publish();
+}
+
+// write the changes after `cursor` and hand them to `func`
+template<typename Func>
+static void writeEvent(tr_session* session, tr_rpc_event_cursor& cursor, std::vector<tr_quark> const& fields, Func func)
+{
+    struct evbuffer* const buf = evbuffer_new();
+    tr_rpc_write_event(session, cursor, std::data(fields), std::size(fields), buf);
+
+    func(std::string_view{ reinterpret_cast<char const*>(evbuffer_pullup(buf, -1)), evbuffer_get_length(buf) });
+
+    evbuffer_free(buf);
+}
+
+tr_rpc_events::tr_rpc_events(tr_session* session, int interval_msec)
+    : session_{ session }
+    , timer_{ evtimer_new(session->event_base, onEventTimer, this) }
+    , interval_msec_{ std::max(interval_msec, MinIntervalMsec) }
+{
+}
+
+tr_rpc_events::~tr_rpc_events()
+{
+    event_free(timer_);
+}
+
+tr_rpc_events::Id tr_rpc_events::subscribe(std::vector<tr_quark> fields, Callback callback)
+{
+    if (std::empty(fields))
+    {
+        fields.assign(std::begin(DefaultFields), std::end(DefaultFields));
+    }
+
+    std::sort(std::begin(fields), std::end(fields));
+    fields.erase(std::unique(std::begin(fields), std::end(fields)), std::end(fields));
+
+    // a default cursor gets every torrent
+    auto cursor = tr_rpc_event_cursor{};
+    writeEvent(session_, cursor, fields, callback);
+
+    // with no one else subscribed, the shared cursor is stale
+    if (std::empty(subscribers_))
+    {
+        cursor_ = cursor;
+    }
+
+    auto const id = next_id_++;
+    subscribers_.try_emplace(id, Subscriber{ std::move(fields), std::move(callback) });
+    updateFields();
+
+    if (std::size(subscribers_) == 1)
+    {
+        restartTimer();
+    }
+
+    return id;
+}
+
+void tr_rpc_events::unsubscribe(Id id)
+{
+    if (subscribers_.erase(id) == 0)
+    {
+        return;
+    }
+
+    updateFields();
+
+    if (std::empty(subscribers_))
+    {
+        evtimer_del(timer_);
+    }
+}
+
+void tr_rpc_events::publish()
+{
+    if (std::empty(subscribers_))
+    {
+        return;
+    }
+
+    writeEvent(
+        session_,
+        cursor_,
+        fields_,
+        [this](std::string_view line)
+        {
+            // callbacks may unsubscribe, so don't walk the map itself
+            auto ids = std::vector<Id>{};
+            ids.reserve(std::size(subscribers_));
+            for (auto const& [id, subscriber] : subscribers_)
+            {
+                ids.push_back(id);
+            }
+
+            for (auto const id : ids)
+            {
+                if (auto const it = subscribers_.find(id); it != std::end(subscribers_))
+                {
+                    auto const callback = it->second.callback;
+                    callback(line);
+                }
+            }
+        });
+
+    restartTimer();
+}
+
+void tr_rpc_events::setInterval(int msec)
+{
+    interval_msec_ = std::max(msec, MinIntervalMsec);
+    restartTimer();
+}
+
+void tr_rpc_events::updateFields()
+{
+    fields_.clear();
+
+    for (auto const& [id, subscriber] : subscribers_)
+    {
+        auto merged = std::vector<tr_quark>{};
+        merged.reserve(std::size(fields_) + std::size(subscriber.fields));
+        std::set_union(
+            std::begin(fields_),
+            std::end(fields_),
+            std::begin(subscriber.fields),
+            std::end(subscriber.fields),
+            std::back_inserter(merged));
+        fields_ = std::move(merged);
+    }
+}
+
+void tr_rpc_events::restartTimer()
+{
+    if (!std::empty(subscribers_))
+    {
+        tr_timerAddMsec(timer_, interval_msec_);
+    }
+}
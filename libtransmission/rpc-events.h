@@ -0,0 +1,98 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h"
+#include "quark.h"
+#include "rpcimpl.h" // tr_rpc_event_cursor
+
+struct event;
+
+/**
+ * Pushes torrent and session changes to RPC clients so that they
+ * needn't poll torrent-get and session-stats.
+ *
+ * Once per interval the changes since the previous batch are written
+ * as a single line of JSON, and that same line is handed to every
+ * subscriber. A new subscriber first gets a line holding every torrent.
+ *
+ * Batches hold every field that any subscriber asked for.
+ */
+class tr_rpc_events
+{
+public:
+    using Id = uint64_t;
+    using Callback = std::function<void(std::string_view line)>;
+
+    static auto constexpr DefaultIntervalMsec = int{ 1000 };
+
+    tr_rpc_events(tr_session* session, int interval_msec);
+    ~tr_rpc_events();
+
+    tr_rpc_events(tr_rpc_events const&) = delete;
+    tr_rpc_events& operator=(tr_rpc_events const&) = delete;
+
+    /**
+     * @brief start sending batches to `callback`.
+     *
+     * `callback` is called with the first, full batch before this returns.
+     * An empty `fields` gets the fields that clients' torrent lists use.
+     */
+    Id subscribe(std::vector<tr_quark> fields, Callback callback);
+
+    void unsubscribe(Id id);
+
+    /** @brief send the changes since the last batch to every subscriber */
+    void publish();
+
+    void setInterval(int msec);
+
+    [[nodiscard]] int interval() const
+    {
+        return interval_msec_;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return std::size(subscribers_);
+    }
+
+private:
+    struct Subscriber
+    {
+        std::vector<tr_quark> fields;
+        Callback callback;
+    };
+
+    void updateFields();
+    void restartTimer();
+
+    tr_session* const session_;
+    struct event* timer_ = nullptr;
+    int interval_msec_;
+
+    std::map<Id, Subscriber> subscribers_;
+    Id next_id_ = 1;
+
+    // the union of the subscribers' fields, sorted
+    std::vector<tr_quark> fields_;
+
+    tr_rpc_event_cursor cursor_;
+};
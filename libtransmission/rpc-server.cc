@@ -11,14 +11,17 @@
 #include <cstring> /* memcpy */
 #include <list>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <zlib.h>
 
 #include <event2/buffer.h>
+#include <event2/bufferevent.h>
 #include <event2/event.h>
 #include <event2/http.h>
 #include <event2/http_struct.h> /* TODO: eventually remove this */
+#include <event2/keyvalq_struct.h>
 
 #include "transmission.h"
 
@@ -440,10 +443,9 @@ struct rpc_response_data
     tr_rpc_server* server;
 };
 
-static void rpc_response_func(tr_session* /*session*/, tr_variant* response, void* user_data)
+static void rpc_response_buf_func(tr_session* /*session*/, struct evbuffer* response_buf, void* user_data)
 {
     auto* data = static_cast<struct rpc_response_data*>(user_data);
-    struct evbuffer* response_buf = tr_variantToBuf(response, TR_VARIANT_FMT_JSON_LEAN);
     struct evbuffer* buf = evbuffer_new();
 
     add_response(data->req, data->server, buf, response_buf);
@@ -451,21 +453,31 @@ static void rpc_response_func(tr_session* /*session*/, tr_variant* response, voi
     evhttp_send_reply(data->req, HTTP_OK, "OK", buf);
 
     evbuffer_free(buf);
-    evbuffer_free(response_buf);
     tr_free(data);
 }
 
+static void rpc_response_func(tr_session* session, tr_variant* response, void* user_data)
+{
+    struct evbuffer* response_buf = tr_variantToBuf(response, TR_VARIANT_FMT_JSON_LEAN);
+    rpc_response_buf_func(session, response_buf, user_data);
+    evbuffer_free(response_buf);
+}
+
 static void handle_rpc_from_json(struct evhttp_request* req, tr_rpc_server* server, std::string_view json)
 {
+    // the request only lives as long as this function,
+    // so parse it into an arena and drop it all at once
+    auto arena = tr_variant_arena{};
     auto top = tr_variant{};
-    auto const have_content = tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json);
+    auto const have_content = tr_variantFromBuf(&top, arena, TR_VARIANT_PARSE_JSON, json);
 
     auto* const data = tr_new0(struct rpc_response_data, 1);
     data->req = req;
     data->server = server;
 
-    tr_rpc_request_exec_json(server->session, have_content ? &top : nullptr, rpc_response_func, data);
+    tr_rpc_request_exec_json_buf_async(server->session, have_content ? &top : nullptr, rpc_response_buf_func, data);
 
+    // in case a method added heap-backed values to the request
     if (have_content)
     {
         tr_variantFree(&top);
@@ -499,6 +511,90 @@ static void handle_rpc(struct evhttp_request* req, tr_rpc_server* server)
     send_simple_response(req, 405, nullptr);
 }
 
+/***
+****  Event stream
+***/
+
+// a subscriber that falls this far behind is dropped rather than buffered for
+static auto constexpr MaxPendingEventBytes = size_t{ 4 * 1024 * 1024 };
+
+struct rpc_event_subscriber
+{
+    tr_rpc_server* server;
+    tr_rpc_events::Id id;
+};
+
+static void on_event_connection_closed(struct evhttp_connection* /*evcon*/, void* vsubscriber)
+{
+    auto* const subscriber = static_cast<rpc_event_subscriber*>(vsubscriber);
+    subscriber->server->events->unsubscribe(subscriber->id);
+    delete subscriber;
+}
+
+static std::vector<tr_quark> get_event_fields(char const* uri)
+{
+    auto fields = std::vector<tr_quark>{};
+
+    char const* const q = strchr(uri, '?');
+    if (q == nullptr)
+    {
+        return fields;
+    }
+
+    auto params = evkeyvalq{};
+    evhttp_parse_query_str(q + 1, &params);
+
+    if (char const* const str = evhttp_find_header(&params, "fields"); str != nullptr)
+    {
+        auto list = std::string_view{ str };
+        while (!std::empty(list))
+        {
+            if (auto const key = tr_quark_lookup(tr_strvSep(&list, ',')); key)
+            {
+                fields.push_back(*key);
+            }
+        }
+    }
+
+    evhttp_clear_headers(&params);
+    return fields;
+}
+
+static void handle_events(struct evhttp_request* req, tr_rpc_server* server)
+{
+    if (req->type != EVHTTP_REQ_GET)
+    {
+        send_simple_response(req, 405, nullptr);
+        return;
+    }
+
+    evhttp_add_header(req->output_headers, "Content-Type", "application/x-ndjson; charset=UTF-8");
+    evhttp_add_header(req->output_headers, "Cache-Control", "no-cache");
+    evhttp_send_reply_start(req, HTTP_OK, "OK");
+
+    struct evhttp_connection* const evcon = evhttp_request_get_connection(req);
+    auto* const subscriber = new rpc_event_subscriber{ server, {} };
+
+    subscriber->id = server->events->subscribe(
+        get_event_fields(req->uri),
+        [req, evcon](std::string_view line)
+        {
+            auto const* const output = bufferevent_get_output(evhttp_connection_get_bufferevent(evcon));
+            if (evbuffer_get_length(output) > MaxPendingEventBytes)
+            {
+                evhttp_connection_free(evcon);
+                return;
+            }
+
+            struct evbuffer* const chunk = evbuffer_new();
+            evbuffer_add(chunk, std::data(line), std::size(line));
+            evhttp_send_reply_chunk(req, chunk);
+            evbuffer_free(chunk);
+        });
+
+    evhttp_connection_set_closecb(evcon, on_event_connection_closed, subscriber);
+}
+
 static bool isAddressAllowed(tr_rpc_server const* server, char const* address)
 {
     auto const& src = server->whitelist;
@@ -708,6 +804,10 @@ static void handle_request(struct evhttp_request* req, void* arg)
             tr_free(tmp);
         }
 #endif
+        else if (tr_strvStartsWith(location, "events"sv))
+        {
+            handle_events(req, server);
+        }
         else if (tr_strvStartsWith(location, "rpc"sv))
         {
             handle_rpc(req, server);
@@ -1024,6 +1124,16 @@ void tr_rpcSetAntiBruteForceThreshold(tr_rpc_server* server, int badRequests)
     server->antiBruteForceThreshold = badRequests;
 }
 
+void tr_rpcSetEventInterval(tr_rpc_server* server, int msec)
+{
+    server->events->setInterval(msec);
+}
+
+int tr_rpcGetEventInterval(tr_rpc_server const* server)
+{
+    return server->events->interval();
+}
+
 /****
 *****  LIFE CYCLE
 ****/
@@ -1178,6 +1288,16 @@ tr_rpc_server::tr_rpc_server(tr_session* session_in, tr_variant* settings)
         tr_rpcSetAntiBruteForceThreshold(this, i);
     }
 
+    key = TR_KEY_rpc_event_interval;
+
+    if (!tr_variantDictFindInt(settings, key, &i))
+    {
+        missing_settings_key(key);
+        i = tr_rpc_events::DefaultIntervalMsec;
+    }
+
+    this->events = std::make_unique<tr_rpc_events>(session, i);
+
     key = TR_KEY_rpc_bind_address;
 
     if (!tr_variantDictFindStrView(settings, key, &sv))
@@ -13,6 +13,7 @@
 #endif
 
 #include <list>
+#include <memory>
 #include <string>
 #include <string_view>
 
@@ -26,6 +27,7 @@
 #include "transmission.h"
 
 #include "net.h"
+#include "rpc-events.h"
 
 struct tr_variant;
 
@@ -51,6 +53,8 @@ public:
 
     struct tr_address bindAddress;
 
+    std::unique_ptr<tr_rpc_events> events;
+
     struct event* start_retry_timer = nullptr;
     struct evhttp* httpd = nullptr;
     tr_session* const session;
@@ -112,3 +116,7 @@ int tr_rpcGetAntiBruteForceThreshold(tr_rpc_server const* server);
 void tr_rpcSetAntiBruteForceThreshold(tr_rpc_server* server, int badRequests);
 
 char const* tr_rpcGetBindAddress(tr_rpc_server const* server);
+
+void tr_rpcSetEventInterval(tr_rpc_server* server, int msec);
+
+int tr_rpcGetEventInterval(tr_rpc_server const* server);
@@ -8,13 +8,20 @@
 
 #include <algorithm>
 #include <array>
+#include <bitset>
 #include <cctype> /* isdigit */
 #include <cerrno>
 #include <cstdlib> /* strtol */
 #include <cstring> /* strcmp */
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifndef ZLIB_CONST
@@ -22,12 +29,15 @@
 #endif
 #include <zlib.h>
 
+#include <event2/buffer.h>
+
 #include "transmission.h"
 #include "completion.h"
 #include "crypto-utils.h"
 #include "error.h"
 #include "fdlimit.h"
 #include "file.h"
+#include "json-writer.h"
 #include "log.h"
 #include "platform-quota.h" /* tr_device_info_get_disk_space() */
 #include "rpcimpl.h"
@@ -37,11 +47,13 @@
 #include "torrent.h"
 #include "tr-assert.h"
 #include "tr-macros.h"
+#include "trevent.h" /* tr_runInEventThread() */
 #include "utils.h"
 #include "variant.h"
 #include "version.h"
 #include "web.h"
 #include "web-utils.h"
+#include "worker-pool.h"
 
 #define RPC_VERSION 17
 #define RPC_VERSION_MIN 14
@@ -115,6 +127,59 @@ static void tr_idle_function_done(struct tr_rpc_idle_data* data, char const* res
 ****
 ***/
 
+/**
+ * The torrents that changed since the client's last "recently-active"
+ * request, if it passed back that request's "activity-sequence",
+ * or in the last RECENTLY_ACTIVE_SECONDS if it didn't.
+ * Returns nullopt if the journal doesn't reach back that far.
+ */
+static std::optional<tr_activity_journal::Changes> getRecentChanges(tr_session* session, tr_variant* args)
+{
+    auto& journal = session->activity_journal;
+
+    auto changes = std::optional<tr_activity_journal::Changes>{};
+    if (auto seq = int64_t{}; tr_variantDictFindInt(args, TR_KEY_activity_sequence, &seq))
+    {
+        // a client that's starting fresh, or that's fallen too far behind, gets everything
+        if (seq > 0)
+        {
+            changes = journal.changesSince(seq);
+        }
+    }
+    else
+    {
+        changes = journal.changesAfter(tr_time() - RECENTLY_ACTIVE_SECONDS);
+    }
+
+    return changes;
+}
+
+static std::vector<tr_torrent*> getRecentlyActiveTorrents(
+    tr_session* session,
+    std::optional<tr_activity_journal::Changes> const& changes)
+{
+    auto torrents = std::vector<tr_torrent*>{};
+
+    // `changes->removed` still holds when every torrent changed
+    if (!changes || changes->all)
+    {
+        torrents.reserve(std::size(session->torrents));
+        std::copy(std::begin(session->torrents), std::end(session->torrents), std::back_inserter(torrents));
+        return torrents;
+    }
+
+    torrents.reserve(std::size(changes->changed));
+    for (auto const id : changes->changed)
+    {
+        if (auto* const tor = tr_torrentFindFromId(session, id); tor != nullptr)
+        {
+            torrents.push_back(tor);
+        }
+    }
+
+    return torrents;
+}
+
 static auto getTorrents(tr_session* session, tr_variant* args)
 {
     auto torrents = std::vector<tr_torrent*>{};
@@ -160,14 +225,7 @@ static auto getTorrents(tr_session* session, tr_variant* args)
     {
         if (sv == "recently-active"sv)
         {
-            time_t const cutoff = tr_time() - RECENTLY_ACTIVE_SECONDS;
-
-            torrents.reserve(std::size(session->torrents));
-            std::copy_if(
-                std::begin(session->torrents),
-                std::end(session->torrents),
-                std::back_inserter(torrents),
-                [&cutoff](tr_torrent* tor) { return tor->anyDate >= cutoff; });
+            torrents = getRecentlyActiveTorrents(session, getRecentChanges(session, args));
         }
         else
         {
@@ -249,7 +307,7 @@ struct CompareTorrentByQueuePosition
 {
     bool operator()(tr_torrent const* a, tr_torrent const* b) const
     {
-        return a->queuePosition < b->queuePosition;
+        return tr_torrentGetQueuePosition(a) < tr_torrentGetQueuePosition(b);
     }
 };
 
@@ -489,15 +547,9 @@ static void addPeers(tr_torrent* tor, tr_variant* list)
     tr_torrentPeersFree(peers, peerCount);
 }
 
-static void initField(
-    tr_torrent* const tor,
-    tr_info const* const inf,
-    tr_stat const* const st,
-    tr_variant* const initme,
-    tr_quark key)
+/** @brief like initField(), for the fields that are just copied from `st` */
+static void initStatField(tr_stat const* const st, tr_variant* const initme, tr_quark key)
 {
-    char* str = nullptr;
-
     switch (key)
     {
     case TR_KEY_activityDate:
@@ -508,26 +560,10 @@ static void initField(
         tr_variantInitInt(initme, st->addedDate);
         break;
 
-    case TR_KEY_bandwidthPriority:
-        tr_variantInitInt(initme, tr_torrentGetPriority(tor));
-        break;
-
-    case TR_KEY_comment:
-        tr_variantInitStr(initme, std::string_view{ inf->comment != nullptr ? inf->comment : "" });
-        break;
-
     case TR_KEY_corruptEver:
         tr_variantInitInt(initme, st->corruptEver);
         break;
 
-    case TR_KEY_creator:
-        tr_variantInitStr(initme, std::string_view{ inf->creator != nullptr ? inf->creator : "" });
-        break;
-
-    case TR_KEY_dateCreated:
-        tr_variantInitInt(initme, inf->dateCreated);
-        break;
-
     case TR_KEY_desiredAvailable:
         tr_variantInitInt(initme, st->desiredAvailable);
         break;
@@ -536,22 +572,10 @@ static void initField(
         tr_variantInitInt(initme, st->doneDate);
         break;
 
-    case TR_KEY_downloadDir:
-        tr_variantInitStrView(initme, tr_torrentGetDownloadDir(tor));
-        break;
-
     case TR_KEY_downloadedEver:
         tr_variantInitInt(initme, st->downloadedEver);
         break;
 
-    case TR_KEY_downloadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
-        break;
-
-    case TR_KEY_downloadLimited:
-        tr_variantInitBool(initme, tr_torrentUsesSpeedLimit(tor, TR_DOWN));
-        break;
-
     case TR_KEY_error:
         tr_variantInitInt(initme, st->error);
         break;
@@ -564,24 +588,6 @@ static void initField(
         tr_variantInitInt(initme, st->eta);
         break;
 
-    case TR_KEY_file_count:
-        tr_variantInitInt(initme, tor->fileCount());
-        break;
-
-    case TR_KEY_files:
-        tr_variantInitList(initme, tor->fileCount());
-        addFiles(tor, initme);
-        break;
-
-    case TR_KEY_fileStats:
-        tr_variantInitList(initme, tor->fileCount());
-        addFileStats(tor, initme);
-        break;
-
-    case TR_KEY_hashString:
-        tr_variantInitStrView(initme, tor->info.hashString);
-        break;
-
     case TR_KEY_haveUnchecked:
         tr_variantInitInt(initme, st->haveUnchecked);
         break;
@@ -590,10 +596,6 @@ static void initField(
         tr_variantInitInt(initme, st->haveValid);
         break;
 
-    case TR_KEY_honorsSessionLimits:
-        tr_variantInitBool(initme, tr_torrentUsesSessionLimits(tor));
-        break;
-
     case TR_KEY_id:
         tr_variantInitInt(initme, st->id);
         break;
@@ -606,18 +608,10 @@ static void initField(
         tr_variantInitBool(initme, st->finished);
         break;
 
-    case TR_KEY_isPrivate:
-        tr_variantInitBool(initme, tr_torrentIsPrivate(tor));
-        break;
-
     case TR_KEY_isStalled:
         tr_variantInitBool(initme, st->isStalled);
         break;
 
-    case TR_KEY_labels:
-        addLabels(tor, initme);
-        break;
-
     case TR_KEY_leftUntilDone:
         tr_variantInitInt(initme, st->leftUntilDone);
         break;
@@ -626,36 +620,14 @@ static void initField(
         tr_variantInitInt(initme, st->manualAnnounceTime);
         break;
 
-    case TR_KEY_maxConnectedPeers:
-        tr_variantInitInt(initme, tr_torrentGetPeerLimit(tor));
-        break;
-
-    case TR_KEY_magnetLink:
-        str = tr_torrentGetMagnetLink(tor);
-        tr_variantInitStr(initme, str);
-        tr_free(str);
-        break;
-
     case TR_KEY_metadataPercentComplete:
         tr_variantInitReal(initme, st->metadataPercentComplete);
         break;
 
-    case TR_KEY_name:
-        tr_variantInitStrView(initme, tr_torrentName(tor));
-        break;
-
     case TR_KEY_percentDone:
         tr_variantInitReal(initme, st->percentDone);
         break;
 
-    case TR_KEY_peer_limit:
-        tr_variantInitInt(initme, tr_torrentGetPeerLimit(tor));
-        break;
-
-    case TR_KEY_peers:
-        addPeers(tor, initme);
-        break;
-
     case TR_KEY_peersConnected:
         tr_variantInitInt(initme, st->peersConnected);
         break;
@@ -682,42 +654,8 @@ static void initField(
         tr_variantInitInt(initme, st->peersSendingToUs);
         break;
 
-    case TR_KEY_pieces:
-        if (tr_torrentHasMetadata(tor))
-        {
-            auto const bytes = tor->createPieceBitfield();
-            auto* enc = static_cast<char*>(tr_base64_encode(bytes.data(), std::size(bytes), nullptr));
-            tr_variantInitStr(initme, enc != nullptr ? std::string_view{ enc } : ""sv);
-            tr_free(enc);
-        }
-        else
-        {
-            tr_variantInitStrView(initme, ""sv);
-        }
-
-        break;
-
-    case TR_KEY_pieceCount:
-        tr_variantInitInt(initme, inf->pieceCount);
-        break;
-
-    case TR_KEY_pieceSize:
-        tr_variantInitInt(initme, inf->pieceSize);
-        break;
-
-    case TR_KEY_primary_mime_type:
-        tr_variantInitStrView(initme, tr_torrentPrimaryMimeType(tor));
-        break;
-
-    case TR_KEY_priorities:
-        {
-            auto const n = tor->fileCount();
-            tr_variantInitList(initme, n);
-            for (tr_file_index_t i = 0; i < n; ++i)
-            {
-                tr_variantListAddInt(initme, tr_torrentFile(tor, i).priority);
-            }
-        }
+    case TR_KEY_preallocationProgress:
+        tr_variantInitReal(initme, st->preallocationProgress);
         break;
 
     case TR_KEY_queuePosition:
@@ -740,30 +678,10 @@ static void initField(
         tr_variantInitReal(initme, st->recheckProgress);
         break;
 
-    case TR_KEY_seedIdleLimit:
-        tr_variantInitInt(initme, tr_torrentGetIdleLimit(tor));
-        break;
-
-    case TR_KEY_seedIdleMode:
-        tr_variantInitInt(initme, tr_torrentGetIdleMode(tor));
-        break;
-
-    case TR_KEY_seedRatioLimit:
-        tr_variantInitReal(initme, tr_torrentGetRatioLimit(tor));
-        break;
-
-    case TR_KEY_seedRatioMode:
-        tr_variantInitInt(initme, tr_torrentGetRatioMode(tor));
-        break;
-
     case TR_KEY_sizeWhenDone:
         tr_variantInitInt(initme, st->sizeWhenDone);
         break;
 
-    case TR_KEY_source:
-        tr_variantDictAddStr(initme, key, inf->source);
-        break;
-
     case TR_KEY_startDate:
         tr_variantInitInt(initme, st->startDate);
         break;
@@ -780,63 +698,14 @@ static void initField(
         tr_variantInitInt(initme, st->secondsSeeding);
         break;
 
-    case TR_KEY_trackers:
-        tr_variantInitList(initme, inf->trackerCount);
-        addTrackers(inf, initme);
-        break;
-
-    case TR_KEY_trackerStats:
-        {
-            auto const n = tr_torrentTrackerCount(tor);
-            tr_variantInitList(initme, n);
-            for (size_t i = 0; i < n; ++i)
-            {
-                auto const& tracker = tr_torrentTracker(tor, i);
-                addTrackerStats(tracker, initme);
-            }
-            break;
-        }
-
-    case TR_KEY_torrentFile:
-        tr_variantInitStr(initme, inf->torrent);
-        break;
-
-    case TR_KEY_totalSize:
-        tr_variantInitInt(initme, inf->totalSize);
-        break;
-
     case TR_KEY_uploadedEver:
         tr_variantInitInt(initme, st->uploadedEver);
         break;
 
-    case TR_KEY_uploadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
-        break;
-
-    case TR_KEY_uploadLimited:
-        tr_variantInitBool(initme, tr_torrentUsesSpeedLimit(tor, TR_UP));
-        break;
-
     case TR_KEY_uploadRatio:
         tr_variantInitReal(initme, st->ratio);
         break;
 
-    case TR_KEY_wanted:
-        {
-            auto const n = tor->fileCount();
-            tr_variantInitList(initme, n);
-            for (tr_file_index_t i = 0; i < n; ++i)
-            {
-                tr_variantListAddInt(initme, tr_torrentFile(tor, i).wanted);
-            }
-        }
-        break;
-
-    case TR_KEY_webseeds:
-        tr_variantInitList(initme, inf->webseedCount);
-        addWebseeds(inf, initme);
-        break;
-
     case TR_KEY_webseedsSendingToUs:
         tr_variantInitInt(initme, st->webseedsSendingToUs);
         break;
@@ -846,1773 +715,3748 @@ static void initField(
     }
 }
 
-static void addTorrentInfo(tr_torrent* tor, tr_format format, tr_variant* entry, tr_quark const* fields, size_t fieldCount)
+static void initField(
+    tr_torrent* const tor,
+    tr_info const* const inf,
+    tr_stat const* const st,
+    tr_variant* const initme,
+    tr_quark key)
 {
-    if (format == TR_FORMAT_TABLE)
-    {
-        tr_variantInitList(entry, fieldCount);
-    }
-    else
-    {
-        tr_variantInitDict(entry, fieldCount);
-    }
+    char* str = nullptr;
 
-    if (fieldCount > 0)
+    switch (key)
     {
-        tr_info const* const inf = tr_torrentInfo(tor);
-        tr_stat const* const st = tr_torrentStat(tor);
-
-        for (size_t i = 0; i < fieldCount; ++i)
-        {
-            tr_variant* child = format == TR_FORMAT_TABLE ? tr_variantListAdd(entry) : tr_variantDictAdd(entry, fields[i]);
+    case TR_KEY_bandwidthPriority:
+        tr_variantInitInt(initme, tr_torrentGetPriority(tor));
+        break;
 
-            initField(tor, inf, st, child, fields[i]);
-        }
-    }
-}
+    case TR_KEY_comment:
+        tr_variantInitStr(initme, std::string_view{ inf->comment != nullptr ? inf->comment : "" });
+        break;
 
-static char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
-{
-    auto const torrents = getTorrents(session, args_in);
-    tr_variant* const list = tr_variantDictAddList(args_out, TR_KEY_torrents, std::size(torrents) + 1);
+    case TR_KEY_creator:
+        tr_variantInitStr(initme, std::string_view{ inf->creator != nullptr ? inf->creator : "" });
+        break;
 
-    auto sv = std::string_view{};
-    tr_format const format = tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TR_FORMAT_TABLE :
-                                                                                                         TR_FORMAT_OBJECT;
+    case TR_KEY_dateCreated:
+        tr_variantInitInt(initme, inf->dateCreated);
+        break;
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
-    {
-        time_t const now = tr_time();
-        int const interval = RECENTLY_ACTIVE_SECONDS;
+    case TR_KEY_downloadDir:
+        tr_variantInitStrView(initme, tr_torrentGetDownloadDir(tor));
+        break;
 
-        auto const& removed = session->removed_torrents;
-        tr_variant* removed_out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(removed));
-        for (auto const& [id, time_removed] : removed)
-        {
-            if (time_removed >= now - interval)
-            {
-                tr_variantListAddInt(removed_out, id);
-            }
-        }
-    }
+    case TR_KEY_downloadLimit:
+        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
+        break;
 
-    tr_variant* fields = nullptr;
-    char const* errmsg = nullptr;
-    if (!tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
-    {
-        errmsg = "no fields specified";
-    }
-    else
-    {
-        /* make an array of property name quarks */
-        size_t keyCount = 0;
-        size_t const n = tr_variantListSize(fields);
-        tr_quark* keys = tr_new(tr_quark, n);
-        for (size_t i = 0; i < n; ++i)
-        {
-            if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
-            {
-                continue;
-            }
+    case TR_KEY_downloadLimited:
+        tr_variantInitBool(initme, tr_torrentUsesSpeedLimit(tor, TR_DOWN));
+        break;
 
-            auto const key = tr_quark_lookup(sv);
-            if (!key)
-            {
-                continue;
-            }
+    case TR_KEY_file_count:
+        tr_variantInitInt(initme, tor->fileCount());
+        break;
 
-            keys[keyCount++] = *key;
-        }
+    case TR_KEY_files:
+        tr_variantInitList(initme, tor->fileCount());
+        addFiles(tor, initme);
+        break;
 
-        if (format == TR_FORMAT_TABLE)
-        {
-            /* first entry is an array of property names */
-            tr_variant* names = tr_variantListAddList(list, keyCount);
-            for (size_t i = 0; i < keyCount; ++i)
-            {
-                tr_variantListAddQuark(names, keys[i]);
-            }
-        }
+    case TR_KEY_fileStats:
+        tr_variantInitList(initme, tor->fileCount());
+        addFileStats(tor, initme);
+        break;
 
-        for (auto* tor : torrents)
-        {
-            addTorrentInfo(tor, format, tr_variantListAdd(list), keys, keyCount);
-        }
+    case TR_KEY_hashString:
+        tr_variantInitStrView(initme, tor->info.hashString);
+        break;
 
-        tr_free(keys);
-    }
+    case TR_KEY_honorsSessionLimits:
+        tr_variantInitBool(initme, tr_torrentUsesSessionLimits(tor));
+        break;
 
-    return errmsg;
-}
+    case TR_KEY_isPrivate:
+        tr_variantInitBool(initme, tr_torrentIsPrivate(tor));
+        break;
 
-/***
-****
-***/
+    case TR_KEY_labels:
+        addLabels(tor, initme);
+        break;
 
-static char const* setLabels(tr_torrent* tor, tr_variant* list)
-{
-    auto labels = tr_labels_t{};
+    case TR_KEY_maxConnectedPeers:
+        tr_variantInitInt(initme, tr_torrentGetPeerLimit(tor));
+        break;
 
-    size_t const n = tr_variantListSize(list);
-    for (size_t i = 0; i < n; ++i)
-    {
-        auto label = std::string_view{};
-        if (!tr_variantGetStrView(tr_variantListChild(list, i), &label))
-        {
-            continue;
-        }
+    case TR_KEY_magnetLink:
+        str = tr_torrentGetMagnetLink(tor);
+        tr_variantInitStr(initme, str);
+        tr_free(str);
+        break;
 
-        label = tr_strvStrip(label);
-        if (std::empty(label))
+    case TR_KEY_name:
+        tr_variantInitStrView(initme, tr_torrentName(tor));
+        break;
+
+    case TR_KEY_peer_limit:
+        tr_variantInitInt(initme, tr_torrentGetPeerLimit(tor));
+        break;
+
+    case TR_KEY_peers:
+        addPeers(tor, initme);
+        break;
+
+    case TR_KEY_pieces:
+        if (tr_torrentHasMetadata(tor))
         {
-            return "labels cannot be empty";
+            auto const bytes = tor->createPieceBitfield();
+            auto* enc = static_cast<char*>(tr_base64_encode(bytes.data(), std::size(bytes), nullptr));
+            tr_variantInitStr(initme, enc != nullptr ? std::string_view{ enc } : ""sv);
+            tr_free(enc);
         }
-
-        if (tr_strvContains(label, ','))
+        else
         {
-            return "labels cannot contain comma (,) character";
+            tr_variantInitStrView(initme, ""sv);
         }
 
-        labels.emplace(label);
-    }
+        break;
 
-    tr_torrentSetLabels(tor, std::move(labels));
-    return nullptr;
-}
+    case TR_KEY_pieceCount:
+        tr_variantInitInt(initme, inf->pieceCount);
+        break;
 
-static char const* setFilePriorities(tr_torrent* tor, tr_priority_t priority, tr_variant* list)
-{
-    char const* errmsg = nullptr;
-    auto const n_files = tor->fileCount();
+    case TR_KEY_pieceSize:
+        tr_variantInitInt(initme, inf->pieceSize);
+        break;
 
-    auto files = std::vector<tr_file_index_t>{};
-    files.reserve(n_files);
+    case TR_KEY_primary_mime_type:
+        tr_variantInitStrView(initme, tr_torrentPrimaryMimeType(tor));
+        break;
 
-    if (size_t const n = tr_variantListSize(list); n != 0)
-    {
-        for (size_t i = 0; i < n; ++i)
+    case TR_KEY_priorities:
         {
-            auto tmp = int64_t{};
-            if (tr_variantGetInt(tr_variantListChild(list, i), &tmp))
+            auto const n = tor->fileCount();
+            tr_variantInitList(initme, n);
+            for (tr_file_index_t i = 0; i < n; ++i)
             {
-                if (0 <= tmp && tmp < n_files)
-                {
-                    files.push_back(tr_file_index_t(tmp));
-                }
-                else
-                {
-                    errmsg = "file index out of range";
-                }
+                tr_variantListAddInt(initme, tr_torrentFile(tor, i).priority);
             }
         }
-    }
-    else // if empty set, apply to all
-    {
-        files.resize(n_files);
-        std::iota(std::begin(files), std::end(files), 0);
-    }
+        break;
 
-    tor->setFilePriorities(std::data(files), std::size(files), priority);
+    case TR_KEY_seedIdleLimit:
+        tr_variantInitInt(initme, tr_torrentGetIdleLimit(tor));
+        break;
 
-    return errmsg;
-}
+    case TR_KEY_seedIdleMode:
+        tr_variantInitInt(initme, tr_torrentGetIdleMode(tor));
+        break;
 
-static char const* setFileDLs(tr_torrent* tor, bool wanted, tr_variant* list)
-{
-    char const* errmsg = nullptr;
+    case TR_KEY_seedRatioLimit:
+        tr_variantInitReal(initme, tr_torrentGetRatioLimit(tor));
+        break;
 
-    auto const n_files = tor->fileCount();
-    size_t const n_items = tr_variantListSize(list);
+    case TR_KEY_seedRatioMode:
+        tr_variantInitInt(initme, tr_torrentGetRatioMode(tor));
+        break;
 
-    auto files = std::vector<tr_file_index_t>{};
-    files.reserve(n_files);
+    case TR_KEY_source:
+        tr_variantDictAddStr(initme, key, inf->source);
+        break;
 
-    if (n_items != 0) // if argument list, process them
-    {
-        for (size_t i = 0; i < n_items; ++i)
+    case TR_KEY_trackers:
+        tr_variantInitList(initme, inf->trackerCount);
+        addTrackers(inf, initme);
+        break;
+
+    case TR_KEY_trackerStats:
         {
-            auto tmp = int64_t{};
-            if (tr_variantGetInt(tr_variantListChild(list, i), &tmp))
+            auto const n = tr_torrentTrackerCount(tor);
+            tr_variantInitList(initme, n);
+            for (size_t i = 0; i < n; ++i)
             {
-                if (0 <= tmp && tmp < n_files)
-                {
-                    files.push_back(tmp);
-                }
-                else
-                {
-                    errmsg = "file index out of range";
-                }
+                auto const& tracker = tr_torrentTracker(tor, i);
+                addTrackerStats(tracker, initme);
             }
+            break;
         }
-    }
-    else // if empty set, apply to all
-    {
-        files.resize(n_files);
-        std::iota(std::begin(files), std::end(files), 0);
-    }
 
-    tor->setFilesWanted(std::data(files), std::size(files), wanted);
+    case TR_KEY_torrentFile:
+        tr_variantInitStr(initme, inf->torrent);
+        break;
 
-    return errmsg;
-}
+    case TR_KEY_totalSize:
+        tr_variantInitInt(initme, inf->totalSize);
+        break;
 
-static bool hasAnnounceUrl(tr_tracker_info const* t, int n, std::string_view url)
-{
-    return std::any_of(t, t + n, [&url](auto const& row) { return row.announce == url; });
-}
+    case TR_KEY_uploadLimit:
+        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
+        break;
 
-static int copyTrackers(tr_tracker_info* tgt, tr_tracker_info const* src, int n)
+    case TR_KEY_uploadLimited:
+        tr_variantInitBool(initme, tr_torrentUsesSpeedLimit(tor, TR_UP));
+        break;
+
+    case TR_KEY_wanted:
+        {
+            auto const n = tor->fileCount();
+            tr_variantInitList(initme, n);
+            for (tr_file_index_t i = 0; i < n; ++i)
+            {
+                tr_variantListAddInt(initme, tr_torrentFile(tor, i).wanted);
+            }
+        }
+        break;
+
+    case TR_KEY_webseeds:
+        tr_variantInitList(initme, inf->webseedCount);
+        addWebseeds(inf, initme);
+        break;
+
+    default:
+        initStatField(st, initme, key);
+        break;
+    }
+}
+
+/**
+ * Builds a tr_variant with the same calls that tr_json_writer takes,
+ * so that torrent-get and session-get can be written once for both.
+ */
+class VariantWriter
 {
-    int maxTier = -1;
+public:
+    explicit VariantWriter(tr_variant* top)
+        : stack_{ top }
+    {
+    }
 
-    for (int i = 0; i < n; ++i)
+    void startObject(size_t size_hint = 0)
     {
-        tgt[i].tier = src[i].tier;
-        tgt[i].announce = tr_strdup(src[i].announce);
-        maxTier = std::max(maxTier, src[i].tier);
+        auto* const v = add();
+        tr_variantInitDict(v, size_hint);
+        stack_.push_back(v);
     }
 
-    return maxTier;
-}
+    void endObject()
+    {
+        stack_.pop_back();
+    }
 
-static void freeTrackers(tr_tracker_info* trackers, int n)
-{
-    for (int i = 0; i < n; ++i)
+    void startArray(size_t size_hint = 0)
     {
-        tr_free(trackers[i].announce);
+        auto* const v = add();
+        tr_variantInitList(v, size_hint);
+        stack_.push_back(v);
     }
 
-    tr_free(trackers);
-}
+    void endArray()
+    {
+        stack_.pop_back();
+    }
 
-static char const* addTrackerUrls(tr_torrent* tor, tr_variant* urls)
-{
-    char const* errmsg = nullptr;
+    void key(tr_quark key)
+    {
+        key_ = key;
+    }
 
-    /* make a working copy of the existing announce list */
-    auto const* const inf = tr_torrentInfo(tor);
-    int n = inf->trackerCount;
-    auto* const trackers = tr_new0(tr_tracker_info, n + tr_variantListSize(urls));
-    int tier = copyTrackers(trackers, inf->trackers, n);
+    void addInt(int64_t i)
+    {
+        tr_variantInitInt(add(), i);
+    }
 
-    /* and add the new ones */
-    auto i = int{ 0 };
-    auto changed = bool{ false };
-    tr_variant const* val = nullptr;
-    while ((val = tr_variantListChild(urls, i)) != nullptr)
+    void addBool(bool b)
     {
-        auto announce = std::string_view{};
+        tr_variantInitBool(add(), b);
+    }
 
-        if (tr_variantGetStrView(val, &announce) && tr_urlIsValidTracker(announce) && !hasAnnounceUrl(trackers, n, announce))
-        {
-            trackers[n].tier = ++tier; /* add a new tier */
-            trackers[n].announce = tr_strvDup(announce);
-            ++n;
-            changed = true;
-        }
+    void addStr(std::string_view str)
+    {
+        tr_variantInitStr(add(), str);
+    }
 
-        ++i;
+    void addQuark(tr_quark q)
+    {
+        tr_variantInitQuark(add(), q);
     }
 
-    if (!changed)
+    // move `v` into the tree, leaving `false` in its place in case
+    // it's the child of a dict or list that's freed later
+    void addVariant(tr_variant* v)
     {
-        errmsg = "invalid argument";
+        auto* const child = add();
+        auto const key = child->key;
+        *child = *v;
+        child->key = key;
+        tr_variantInitBool(v, false);
     }
-    else if (!tr_torrentSetAnnounceList(tor, trackers, n))
+
+private:
+    tr_variant* add()
     {
-        errmsg = "error setting announce list";
+        auto* const parent = stack_.back();
+        return tr_variantIsDict(parent) ? tr_variantDictAdd(parent, key_) : tr_variantListAdd(parent);
     }
 
-    freeTrackers(trackers, n);
-    return errmsg;
-}
+    std::vector<tr_variant*> stack_;
+    tr_quark key_ = TR_KEY_NONE;
+};
 
-static char const* replaceTrackers(tr_torrent* tor, tr_variant* urls)
+template<typename Writer>
+static void addTorrentInfo(tr_torrent* tor, tr_format format, Writer& out, tr_quark const* fields, size_t fieldCount)
 {
-    char const* errmsg = nullptr;
-
-    /* make a working copy of the existing announce list */
-    auto const* const inf = tr_torrentInfo(tor);
-    int const n = inf->trackerCount;
-    auto* const trackers = tr_new0(tr_tracker_info, n);
-    copyTrackers(trackers, inf->trackers, n);
+    if (format == TR_FORMAT_TABLE)
+    {
+        out.startArray(fieldCount);
+    }
+    else
+    {
+        out.startObject(fieldCount);
+    }
 
-    /* make the substitutions... */
-    bool changed = false;
-    for (size_t i = 0, url_count = tr_variantListSize(urls); i + 1 < url_count; i += 2)
+    if (fieldCount > 0)
     {
-        auto pos = int64_t{};
-        auto newval = std::string_view{};
+        tr_info const* const inf = tr_torrentInfo(tor);
+        tr_stat const* const st = tr_torrentStat(tor);
 
-        if (tr_variantGetInt(tr_variantListChild(urls, i), &pos) &&
-            tr_variantGetStrView(tr_variantListChild(urls, i + 1), &newval) && tr_urlIsValidTracker(newval) && pos < n &&
-            pos >= 0)
+        for (size_t i = 0; i < fieldCount; ++i)
         {
-            tr_free(trackers[pos].announce);
-            trackers[pos].announce = tr_strvDup(newval);
-            changed = true;
+            if (format != TR_FORMAT_TABLE)
+            {
+                out.key(fields[i]);
+            }
+
+            auto child = tr_variant{};
+            tr_variantInitInt(&child, 0);
+            initField(tor, inf, st, &child, fields[i]);
+            out.addVariant(&child);
         }
     }
 
-    if (!changed)
+    if (format == TR_FORMAT_TABLE)
     {
-        errmsg = "invalid argument";
+        out.endArray();
     }
-    else if (!tr_torrentSetAnnounceList(tor, trackers, n))
+    else
     {
-        errmsg = "error setting announce list";
+        out.endObject();
     }
-
-    freeTrackers(trackers, n);
-    return errmsg;
 }
 
-static char const* removeTrackers(tr_torrent* tor, tr_variant* ids)
+/**
+ * Fields whose values only change when tr_torrent::settings_version
+ * does, so they needn't be recomputed to see if they've changed.
+ */
+static bool isSettingsField(tr_quark key)
 {
-    /* make a working copy of the existing announce list */
-    tr_info const* inf = tr_torrentInfo(tor);
-    int n = inf->trackerCount;
-    int* tids = tr_new0(int, n);
-    tr_tracker_info* trackers = tr_new0(tr_tracker_info, n);
-    copyTrackers(trackers, inf->trackers, n);
-
-    /* remove the ones specified in the urls list */
-    int i = 0;
-    int t = 0;
-    tr_variant const* val = nullptr;
-    while ((val = tr_variantListChild(ids, i)) != nullptr)
+    switch (key)
     {
-        auto pos = int64_t{};
-
-        if (tr_variantGetInt(val, &pos) && 0 <= pos && pos < n)
-        {
-            tids[t++] = (int)pos;
-        }
+    case TR_KEY_bandwidthPriority:
+    case TR_KEY_comment:
+    case TR_KEY_creator:
+    case TR_KEY_dateCreated:
+    case TR_KEY_downloadDir:
+    case TR_KEY_downloadLimit:
+    case TR_KEY_downloadLimited:
+    case TR_KEY_file_count:
+    case TR_KEY_hashString:
+    case TR_KEY_honorsSessionLimits:
+    case TR_KEY_isPrivate:
+    case TR_KEY_labels:
+    case TR_KEY_magnetLink:
+    case TR_KEY_maxConnectedPeers:
+    case TR_KEY_name:
+    case TR_KEY_peer_limit:
+    case TR_KEY_pieceCount:
+    case TR_KEY_pieceSize:
+    case TR_KEY_primary_mime_type:
+    case TR_KEY_priorities:
+    case TR_KEY_seedIdleLimit:
+    case TR_KEY_seedIdleMode:
+    case TR_KEY_seedRatioLimit:
+    case TR_KEY_seedRatioMode:
+    case TR_KEY_source:
+    case TR_KEY_torrentFile:
+    case TR_KEY_totalSize:
+    case TR_KEY_trackers:
+    case TR_KEY_uploadLimit:
+    case TR_KEY_uploadLimited:
+    case TR_KEY_wanted:
+    case TR_KEY_webseeds:
+        return true;
 
-        ++i;
+    default:
+        return false;
     }
+}
 
-    /* sort trackerIds and remove from largest to smallest so there is no need to recalculate array indicies */
-    std::sort(tids, tids + t);
+static uint64_t hashBytes(std::string_view sv)
+{
+    // FNV-1a
+    auto hash = uint64_t{ 0xCBF29CE484222325ULL };
 
-    bool changed = false;
-    int dup = -1;
-    while (t-- != 0)
+    for (auto const ch : sv)
     {
-        /* check for duplicates */
-        if (tids[t] == dup)
-        {
-            continue;
-        }
+        hash ^= static_cast<uint8_t>(ch);
+        hash *= 0x100000001B3ULL;
+    }
 
-        tr_removeElementFromArray(trackers, tids[t], sizeof(tr_tracker_info), n);
-        --n;
+    return hash;
+}
 
-        dup = tids[t];
-        changed = true;
+static uint64_t fingerprint(tr_variant const* v)
+{
+    auto sv = std::string_view{};
+
+    if (tr_variantIsInt(v))
+    {
+        return static_cast<uint64_t>(v->val.i);
     }
 
-    char const* errmsg = nullptr;
-    if (!changed)
+    if (tr_variantIsBool(v))
     {
-        errmsg = "invalid argument";
+        return v->val.b ? 1 : 0;
     }
-    else if (!tr_torrentSetAnnounceList(tor, trackers, n))
+
+    if (tr_variantIsReal(v))
     {
-        errmsg = "error setting announce list";
+        auto bits = uint64_t{};
+        memcpy(&bits, &v->val.d, sizeof(bits));
+        return bits;
     }
 
-    freeTrackers(trackers, n);
-    tr_free(tids);
-    return errmsg;
+    if (tr_variantGetStrView(v, &sv))
+    {
+        return hashBytes(sv);
+    }
+
+    auto len = size_t{};
+    auto* const benc = tr_variantToStr(v, TR_VARIANT_FMT_BENC, &len);
+    auto const hash = hashBytes({ benc, len });
+    tr_free(benc);
+    return hash;
 }
 
-static char const* torrentSet(
-    tr_session* session,
-    tr_variant* args_in,
-    tr_variant* /*args_out*/,
-    tr_rpc_idle_data* /*idle_data*/)
+/**
+ * True if nothing but the things in tr_field_versions::Stamp can change
+ * the torrent's fields: it's stopped and its transfer rates have decayed.
+ */
+static bool isQuiet(tr_torrent const* tor)
 {
-    char const* errmsg = nullptr;
-
-    for (auto* tor : getTorrents(session, args_in))
+    if (tor->isRunning || tor->isStopping || tor->isQueued || tor->verifyState != TR_VERIFY_NONE)
     {
-        auto tmp = int64_t{};
-        auto d = double{};
-        auto boolVal = bool{};
-        tr_variant* tmp_variant = nullptr;
+        return false;
+    }
 
-        if (tr_variantDictFindInt(args_in, TR_KEY_bandwidthPriority, &tmp))
-        {
-            tr_priority_t const priority = (tr_priority_t)tmp;
+    auto const now = tr_time_msec();
+    return tor->bandwidth->getPieceSpeedBytesPerSecond(now, TR_UP) == 0 &&
+        tor->bandwidth->getPieceSpeedBytesPerSecond(now, TR_DOWN) == 0;
+}
 
-            if (tr_isPriority(priority))
-            {
-                tr_torrentSetPriority(tor, priority);
-            }
-        }
+static tr_field_versions::Stamp getStamp(tr_torrent const* tor)
+{
+    return { tor->settings_version, tor->change_count, tor->session->torrent_queue.version(), isQuiet(tor) };
+}
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_labels, &tmp_variant))
-        {
-            errmsg = setLabels(tor, tmp_variant);
-        }
+/**
+ * Like addTorrentInfo(), but only adds the torrent if one of
+ * its fields changed after the client's change token `token`.
+ *
+ * Objects hold the torrent's id and its changed fields. Table rows can't
+ * leave out fields, so they hold all of them.
+ */
+template<typename Writer>
+static void addChangedTorrentInfo(
+    tr_torrent* tor,
+    tr_format format,
+    Writer& out,
+    tr_quark const* fields,
+    size_t fieldCount,
+    uint64_t token)
+{
+    auto& versions = tor->field_versions;
+    versions.setStamp(getStamp(tor));
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_files_unwanted, &tmp_variant))
+    auto const might_have_changed = [tor, &versions, token](tr_quark key)
+    {
+        auto const* const field = versions.find(key);
+
+        if (field == nullptr || field->version > token)
         {
-            errmsg = setFileDLs(tor, false, tmp_variant);
+            return true;
         }
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_files_wanted, &tmp_variant))
+        if (isSettingsField(key))
         {
-            errmsg = setFileDLs(tor, true, tmp_variant);
+            return field->settings_version != tor->settings_version;
         }
 
-        if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit, &tmp))
-        {
-            tr_torrentSetPeerLimit(tor, tmp);
-        }
+        // announce and scrape times keep changing even when the torrent is quiet
+        return key == TR_KEY_trackerStats || !versions.isCurrent(*field);
+    };
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_high, &tmp_variant))
-        {
-            errmsg = setFilePriorities(tor, TR_PRI_HIGH, tmp_variant);
-        }
+    if (std::none_of(fields, fields + fieldCount, might_have_changed))
+    {
+        return;
+    }
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_low, &tmp_variant))
-        {
-            errmsg = setFilePriorities(tor, TR_PRI_LOW, tmp_variant);
-        }
+    tr_info const* const inf = tr_torrentInfo(tor);
+    tr_stat const* const st = tr_torrentStat(tor);
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_normal, &tmp_variant))
+    enum class State
+    {
+        Skipped,
+        Unchanged,
+        Changed
+    };
+
+    auto values = std::vector<tr_variant>(fieldCount);
+    auto states = std::vector<State>(fieldCount, State::Skipped);
+    auto any_changed = false;
+
+    for (size_t i = 0; i < fieldCount; ++i)
+    {
+        auto const key = fields[i];
+
+        if ((key == TR_KEY_id && format != TR_FORMAT_TABLE) || !might_have_changed(key))
         {
-            errmsg = setFilePriorities(tor, TR_PRI_NORMAL, tmp_variant);
+            continue;
         }
 
-        if (tr_variantDictFindInt(args_in, TR_KEY_downloadLimit, &tmp))
+        tr_variantInitInt(&values[i], 0);
+        initField(tor, inf, st, &values[i], key);
+        bool const changed = versions.update(key, fingerprint(&values[i]), &tor->session->field_version_clock) > token;
+        states[i] = changed ? State::Changed : State::Unchanged;
+        any_changed |= changed;
+    }
+
+    if (!any_changed)
+    {
+        std::for_each(std::begin(values), std::end(values), [](auto& v) { tr_variantFree(&v); });
+        return;
+    }
+
+    if (format == TR_FORMAT_TABLE)
+    {
+        out.startArray(fieldCount);
+
+        for (size_t i = 0; i < fieldCount; ++i)
         {
-            tr_torrentSetSpeedLimit_KBps(tor, TR_DOWN, tmp);
+            if (states[i] == State::Skipped)
+            {
+                tr_variantInitInt(&values[i], 0);
+                initField(tor, inf, st, &values[i], fields[i]);
+            }
+
+            out.addVariant(&values[i]);
         }
 
-        if (tr_variantDictFindBool(args_in, TR_KEY_downloadLimited, &boolVal))
+        out.endArray();
+    }
+    else
+    {
+        out.startObject(fieldCount + 1);
+        out.key(TR_KEY_id);
+        out.addInt(tor->uniqueId);
+
+        for (size_t i = 0; i < fieldCount; ++i)
         {
-            tr_torrentUseSpeedLimit(tor, TR_DOWN, boolVal);
+            if (states[i] == State::Changed)
+            {
+                out.key(fields[i]);
+                out.addVariant(&values[i]);
+            }
+            else
+            {
+                tr_variantFree(&values[i]);
+            }
         }
 
-        if (tr_variantDictFindBool(args_in, TR_KEY_honorsSessionLimits, &boolVal))
+        out.endObject();
+    }
+}
+
+/***
+****  torrent-get's "filter", "sort", "offset" and "limit"
+***/
+
+struct TorrentSelection
+{
+    // tr_torrent_activity bits
+    std::optional<uint32_t> activities;
+
+    // torrents with any of these labels
+    std::vector<std::string_view> labels;
+
+    std::optional<std::string_view> tracker;
+    std::optional<std::string_view> name;
+    std::optional<bool> error;
+
+    std::optional<tr_quark> sort;
+    bool sort_reversed = false;
+
+    size_t offset = 0;
+    std::optional<size_t> limit;
+};
+
+// fields whose values are lists or dicts, or that are too costly to make for every torrent
+static auto constexpr UnsortableFields = std::array<tr_quark, 13>{
+    TR_KEY_files,
+    TR_KEY_fileStats,
+    TR_KEY_labels,
+    TR_KEY_magnetLink,
+    TR_KEY_peers,
+    TR_KEY_peersFrom,
+    TR_KEY_pieces,
+    TR_KEY_priorities,
+    TR_KEY_source,
+    TR_KEY_trackerStats,
+    TR_KEY_trackers,
+    TR_KEY_wanted,
+    TR_KEY_webseeds,
+};
+
+static bool hasSelection(tr_variant* args_in)
+{
+    static auto constexpr Keys = std::array<tr_quark, 4>{ TR_KEY_filter, TR_KEY_sort, TR_KEY_offset, TR_KEY_limit };
+
+    return std::any_of(
+        std::begin(Keys),
+        std::end(Keys),
+        [args_in](auto key) { return tr_variantDictFind(args_in, key) != nullptr; });
+}
+
+static char const* parseSelection(tr_variant* args_in, TorrentSelection& sel)
+{
+    auto i = int64_t{};
+    auto b = bool{};
+    auto sv = std::string_view{};
+
+    if (tr_variant* filter = nullptr; tr_variantDictFindDict(args_in, TR_KEY_filter, &filter))
+    {
+        auto const add_activity = [&sel](int64_t activity)
         {
-            tr_torrentUseSessionLimits(tor, boolVal);
-        }
+            if (activity < TR_STATUS_STOPPED || activity > TR_STATUS_SEED)
+            {
+                return false;
+            }
 
-        if (tr_variantDictFindInt(args_in, TR_KEY_uploadLimit, &tmp))
+            sel.activities = sel.activities.value_or(0) | (1U << activity);
+            return true;
+        };
+
+        if (tr_variant* list = nullptr; tr_variantDictFindList(filter, TR_KEY_status, &list))
         {
-            tr_torrentSetSpeedLimit_KBps(tor, TR_UP, tmp);
+            sel.activities = 0;
+            for (size_t j = 0, n = tr_variantListSize(list); j < n; ++j)
+            {
+                if (!tr_variantGetInt(tr_variantListChild(list, j), &i) || !add_activity(i))
+                {
+                    return "invalid status filter";
+                }
+            }
         }
-
-        if (tr_variantDictFindBool(args_in, TR_KEY_uploadLimited, &boolVal))
+        else if (tr_variantDictFindInt(filter, TR_KEY_status, &i) && !add_activity(i))
         {
-            tr_torrentUseSpeedLimit(tor, TR_UP, boolVal);
+            return "invalid status filter";
         }
 
-        if (tr_variantDictFindInt(args_in, TR_KEY_seedIdleLimit, &tmp))
+        if (tr_variant* list = nullptr; tr_variantDictFindList(filter, TR_KEY_labels, &list))
         {
-            tr_torrentSetIdleLimit(tor, (uint16_t)tmp);
+            for (size_t j = 0, n = tr_variantListSize(list); j < n; ++j)
+            {
+                if (tr_variantGetStrView(tr_variantListChild(list, j), &sv))
+                {
+                    sel.labels.push_back(sv);
+                }
+            }
         }
-
-        if (tr_variantDictFindInt(args_in, TR_KEY_seedIdleMode, &tmp))
+        else if (tr_variantDictFindStrView(filter, TR_KEY_labels, &sv))
         {
-            tr_torrentSetIdleMode(tor, (tr_idlelimit)tmp);
+            sel.labels.push_back(sv);
         }
 
-        if (tr_variantDictFindReal(args_in, TR_KEY_seedRatioLimit, &d))
+        if (tr_variantDictFindStrView(filter, TR_KEY_tracker, &sv))
         {
-            tr_torrentSetRatioLimit(tor, d);
+            sel.tracker = sv;
         }
 
-        if (tr_variantDictFindInt(args_in, TR_KEY_seedRatioMode, &tmp))
+        if (tr_variantDictFindStrView(filter, TR_KEY_name, &sv))
         {
-            tr_torrentSetRatioMode(tor, (tr_ratiolimit)tmp);
+            sel.name = sv;
         }
 
-        if (tr_variantDictFindInt(args_in, TR_KEY_queuePosition, &tmp))
+        if (tr_variantDictFindBool(filter, TR_KEY_error, &b))
         {
-            tr_torrentSetQueuePosition(tor, (int)tmp);
+            sel.error = b;
         }
+    }
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_trackerAdd, &tmp_variant))
+    if (tr_variantDictFindStrView(args_in, TR_KEY_sort, &sv))
+    {
+        auto const key = tr_quark_lookup(sv);
+        if (!key || std::find(std::begin(UnsortableFields), std::end(UnsortableFields), *key) != std::end(UnsortableFields))
         {
-            errmsg = addTrackerUrls(tor, tmp_variant);
+            return "invalid sort field";
         }
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_trackerRemove, &tmp_variant))
+        sel.sort = *key;
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_sort_reversed, &b))
+    {
+        sel.sort_reversed = b;
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_offset, &i))
+    {
+        if (i < 0)
         {
-            errmsg = removeTrackers(tor, tmp_variant);
+            return "invalid offset";
         }
 
-        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_trackerReplace, &tmp_variant))
+        sel.offset = size_t(i);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_limit, &i))
+    {
+        if (i < 0)
         {
-            errmsg = replaceTrackers(tor, tmp_variant);
+            return "invalid limit";
         }
 
-        notify(session, TR_RPC_TORRENT_CHANGED, tor);
+        sel.limit = size_t(i);
     }
 
-    return errmsg;
+    return nullptr;
 }
 
-static char const* torrentSetLocation(
-    tr_session* session,
-    tr_variant* args_in,
-    tr_variant* /*args_out*/,
-    tr_rpc_idle_data* /*idle_data*/)
+static bool hostMatches(std::string_view host, std::string_view wanted)
 {
-    auto location = std::string_view{};
+    // "example.org" matches "tracker.example.org" too
+    if (std::size(host) > std::size(wanted) && host[std::size(host) - std::size(wanted) - 1] == '.')
+    {
+        host.remove_prefix(std::size(host) - std::size(wanted));
+    }
 
-    if (!tr_variantDictFindStrView(args_in, TR_KEY_location, &location))
+    return CaseInsensitiveStringCompare{}.compare(host, wanted) == 0;
+}
+
+static bool nameContains(std::string_view name, std::string_view wanted)
+{
+    auto const it = std::search(
+        std::begin(name),
+        std::end(name),
+        std::begin(wanted),
+        std::end(wanted),
+        [](char a, char b) { return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b)); });
+    return it != std::end(name);
+}
+
+static bool isSelected(tr_torrent const* tor, TorrentSelection const& sel)
+{
+    if (sel.activities && (*sel.activities & (1U << tr_torrentGetActivity(tor))) == 0)
     {
-        return "no location";
+        return false;
     }
 
-    if (tr_sys_path_is_relative(location))
+    if (!std::empty(sel.labels) &&
+        std::none_of(
+            std::begin(sel.labels),
+            std::end(sel.labels),
+            [tor](auto const& label) { return tor->labels.count(std::string{ label }) != 0; }))
     {
-        return "new location path is not absolute";
+        return false;
     }
 
-    auto move = bool{};
-    (void)tr_variantDictFindBool(args_in, TR_KEY_move, &move);
+    if (sel.error && (tor->error != TR_STAT_OK) != *sel.error)
+    {
+        return false;
+    }
 
-    for (auto* tor : getTorrents(session, args_in))
+    if (sel.name && !nameContains(tr_torrentName(tor), *sel.name))
     {
-        tor->setLocation(location, move, nullptr, nullptr);
-        notify(session, TR_RPC_TORRENT_MOVED, tor);
+        return false;
     }
 
-    return nullptr;
+    if (sel.tracker)
+    {
+        auto const* const begin = tor->info.trackers;
+        auto const* const end = begin + tor->info.trackerCount;
+        auto const matches = [&sel](auto const& tracker)
+        {
+            auto const parsed = tr_urlParse(tracker.announce);
+            return parsed && hostMatches(parsed->host, *sel.tracker);
+        };
+
+        if (std::none_of(begin, end, matches))
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
 
-/***
-****
-***/
+static bool isIdsRequest(tr_variant* args_in)
+{
+    return tr_variantDictFind(args_in, TR_KEY_ids) != nullptr || tr_variantDictFind(args_in, TR_KEY_id) != nullptr;
+}
 
-static void torrentRenamePathDone(tr_torrent* tor, char const* oldpath, char const* newname, int error, void* user_data)
+static void sortTorrents(std::vector<tr_torrent*>& torrents, tr_quark key, bool reversed)
 {
-    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
+    struct Row
+    {
+        tr_torrent* tor;
+        tr_variant value;
+    };
 
-    tr_variantDictAddInt(data->args_out, TR_KEY_id, tr_torrentId(tor));
-    tr_variantDictAddStr(data->args_out, TR_KEY_path, oldpath);
-    tr_variantDictAddStr(data->args_out, TR_KEY_name, newname);
+    auto rows = std::vector<Row>{};
+    rows.reserve(std::size(torrents));
+    for (auto* tor : torrents)
+    {
+        auto& row = rows.emplace_back(Row{ tor, {} });
+        tr_variantInitInt(&row.value, 0);
+        initField(tor, tr_torrentInfo(tor), tr_torrentStatCached(tor), &row.value, key);
+    }
 
-    char const* const result = error == 0 ? nullptr : tr_strerror(error);
-    tr_idle_function_done(data, result);
+    // strings sort before numbers; torrents with the same value sort by id
+    auto const compare = [](tr_variant const& a, tr_variant const& b)
+    {
+        auto sva = std::string_view{};
+        auto svb = std::string_view{};
+        bool const a_is_str = tr_variantGetStrView(&a, &sva);
+        bool const b_is_str = tr_variantGetStrView(&b, &svb);
+
+        if (a_is_str || b_is_str)
+        {
+            return a_is_str != b_is_str ? (a_is_str ? -1 : 1) : CaseInsensitiveStringCompare{}.compare(sva, svb);
+        }
+
+        auto const number = [](tr_variant const& v)
+        {
+            auto d = double{};
+            auto flag = bool{};
+            if (tr_variantGetReal(&v, &d))
+            {
+                return d;
+            }
+
+            return tr_variantGetBool(&v, &flag) && flag ? 1.0 : 0.0;
+        };
+
+        auto const da = number(a);
+        auto const db = number(b);
+        return da < db ? -1 : (da > db ? 1 : 0);
+    };
+
+    std::sort(
+        std::begin(rows),
+        std::end(rows),
+        [&compare, reversed](Row const& a, Row const& b)
+        {
+            if (auto const i = compare(a.value, b.value); i != 0)
+            {
+                return reversed ? i > 0 : i < 0;
+            }
+
+            return a.tor->uniqueId < b.tor->uniqueId;
+        });
+
+    std::transform(std::begin(rows), std::end(rows), std::begin(torrents), [](Row& row) { return row.tor; });
+    std::for_each(std::begin(rows), std::end(rows), [](Row& row) { tr_variantFree(&row.value); });
 }
 
-static char const* torrentRenamePath(
+/**
+ * Pick the torrents that torrent-get's "filter" selects, in the order
+ * given by "sort" -- or by id, if there's no "sort" -- then apply
+ * "offset" and "limit".
+ *
+ * When there are no "ids", the activity and label indexes give the
+ * candidates so that the rest of the session's torrents aren't visited.
+ * Only the sort field is computed for each candidate; the requested
+ * fields are left for the torrents that make it onto the page.
+ */
+static char const* getSelectedTorrents(
     tr_session* session,
     tr_variant* args_in,
-    tr_variant* /*args_out*/,
-    struct tr_rpc_idle_data* idle_data)
+    std::vector<tr_torrent*>* setme,
+    size_t* setme_match_count)
 {
-    char const* errmsg = nullptr;
+    auto sel = TorrentSelection{};
+    if (char const* const errmsg = parseSelection(args_in, sel); errmsg != nullptr)
+    {
+        return errmsg;
+    }
 
-    auto oldpath = std::string_view{};
-    (void)tr_variantDictFindStrView(args_in, TR_KEY_path, &oldpath);
-    auto newname = std::string_view{};
-    (void)tr_variantDictFindStrView(args_in, TR_KEY_name, &newname);
+    auto& torrents = *setme;
 
-    auto const torrents = getTorrents(session, args_in);
-    if (std::size(torrents) == 1)
+    if (isIdsRequest(args_in))
     {
-        torrents[0]->renamePath(oldpath, newname, torrentRenamePathDone, idle_data);
+        torrents = getTorrents(session, args_in);
+    }
+    else if (sel.activities)
+    {
+        for (int activity = TR_STATUS_STOPPED; activity <= TR_STATUS_SEED; ++activity)
+        {
+            if ((*sel.activities & (1U << activity)) != 0)
+            {
+                auto const found = session->torrent_index.withActivity(tr_torrent_activity(activity));
+                torrents.insert(std::end(torrents), std::begin(found), std::end(found));
+            }
+        }
+    }
+    else if (std::size(sel.labels) == 1)
+    {
+        torrents = session->torrent_index.withLabel(sel.labels.front());
     }
     else
     {
-        errmsg = "torrent-rename-path requires 1 torrent";
+        torrents = getTorrents(session, args_in);
     }
 
-    /* cleanup */
-    return errmsg;
-}
-
-/***
-****
-***/
-
-static void portTested(
-    tr_session* /*session*/,
-    bool /*did_connect*/,
-    bool /*did_timeout*/,
-    long response_code,
-    std::string_view response,
-    void* user_data)
-{
-    char result[1024];
-    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
+    torrents.erase(
+        std::remove_if(std::begin(torrents), std::end(torrents), [&sel](auto const* tor) { return !isSelected(tor, sel); }),
+        std::end(torrents));
 
-    if (response_code != 200)
+    if (sel.sort)
     {
-        tr_snprintf(
-            result,
-            sizeof(result),
-            "portTested: http error %ld: %s",
-            response_code,
-            tr_webGetResponseStr(response_code));
+        sortTorrents(torrents, *sel.sort, sel.sort_reversed);
     }
-    else /* success */
+    else
     {
-        bool const isOpen = tr_strvStartsWith(response, '1');
-        tr_variantDictAddBool(data->args_out, TR_KEY_port_is_open, isOpen);
-        tr_snprintf(result, sizeof(result), "success");
+        std::sort(
+            std::begin(torrents),
+            std::end(torrents),
+            [](auto const* a, auto const* b) { return a->uniqueId < b->uniqueId; });
     }
 
-    tr_idle_function_done(data, result);
+    *setme_match_count = std::size(torrents);
+
+    auto const begin = std::min(sel.offset, std::size(torrents));
+    auto const end = sel.limit ? std::min(begin + *sel.limit, std::size(torrents)) : std::size(torrents);
+    torrents.erase(std::begin(torrents) + end, std::end(torrents));
+    torrents.erase(std::begin(torrents), std::begin(torrents) + begin);
+
+    return nullptr;
 }
 
-static char const* portTest(
-    tr_session* session,
-    tr_variant* /*args_in*/,
-    tr_variant* /*args_out*/,
-    struct tr_rpc_idle_data* idle_data)
+template<typename Writer>
+static char const* torrentGetImpl(tr_session* session, tr_variant* args_in, Writer& args_out)
 {
-    int const port = tr_sessionGetPeerPort(session);
-    char* url = tr_strdup_printf("https://portcheck.transmissionbt.com/%d", port);
-    tr_webRun(session, url, portTested, idle_data);
-    tr_free(url);
-    return nullptr;
-}
-
-/***
-****
-***/
+    auto sv = std::string_view{};
+    auto torrents = std::vector<tr_torrent*>{};
+    char const* select_errmsg = nullptr;
+    auto match_count = std::optional<size_t>{};
 
-static void gotNewBlocklist(
-    tr_session* session,
-    bool /*did_connect*/,
-    bool /*did_timeout*/,
-    long response_code,
-    std::string_view response,
-    void* user_data)
-{
-    char result[1024];
-    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
+    if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
+    {
+        // read the sequence number first so that nothing
+        // that changes while we're reading the journal is missed
+        args_out.key(TR_KEY_activity_sequence);
+        args_out.addInt(session->activity_journal.markRead());
 
-    *result = '\0';
+        auto const changes = getRecentChanges(session, args_in);
+        torrents = getRecentlyActiveTorrents(session, changes);
 
-    if (response_code != 200)
+        auto const n_removed = changes ? std::size(changes->removed) : 0;
+        args_out.key(TR_KEY_removed);
+        args_out.startArray(n_removed);
+        for (size_t i = 0; i < n_removed; ++i)
+        {
+            args_out.addInt(changes->removed[i]);
+        }
+        args_out.endArray();
+    }
+    else if (hasSelection(args_in))
     {
-        tr_snprintf(
-            result,
-            sizeof(result),
-            "gotNewBlocklist: http error %ld: %s",
-            response_code,
-            tr_webGetResponseStr(response_code));
+        select_errmsg = getSelectedTorrents(session, args_in, &torrents, &match_count.emplace());
     }
-    else /* successfully fetched the blocklist... */
+    else
     {
-        auto stream = z_stream{};
-        char const* configDir = tr_sessionGetConfigDir(session);
-        size_t const buflen = 1024 * 128; /* 128 KiB buffer */
-        auto* const buf = static_cast<uint8_t*>(tr_malloc(buflen));
-        tr_error* error = nullptr;
+        torrents = getTorrents(session, args_in);
+    }
 
-        /* this is an odd Magic Number required by zlib to enable gz support.
-           See zlib's inflateInit2() documentation for a full description */
-        int const windowBits = 15 + 32;
+    args_out.key(TR_KEY_torrents);
+    args_out.startArray(std::size(torrents) + 1);
 
-        stream.zalloc = (alloc_func)Z_NULL;
-        stream.zfree = (free_func)Z_NULL;
-        stream.opaque = (voidpf)Z_NULL;
-        stream.next_in = reinterpret_cast<Bytef const*>(std::data(response));
-        stream.avail_in = std::size(response);
-        if (inflateInit2(&stream, windowBits) != Z_OK)
+    tr_format const format = tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TR_FORMAT_TABLE :
+                                                                                                         TR_FORMAT_OBJECT;
+
+    tr_variant* fields = nullptr;
+    char const* errmsg = nullptr;
+    auto change_token = std::optional<uint64_t>{};
+    if (!tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
+    {
+        errmsg = "no fields specified";
+    }
+    else
+    {
+        /* make an array of property name quarks */
+        size_t keyCount = 0;
+        size_t const n = tr_variantListSize(fields);
+        tr_quark* keys = tr_new(tr_quark, n);
+        for (size_t i = 0; i < n; ++i)
         {
-            // If stream init fails, log an error but keep going forward
-            // since the file may be uncompressed anyway.
-            tr_logAddError("inflateInit2 failed: %s", stream.msg ? stream.msg : "unknown");
-        }
+            if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
+            {
+                continue;
+            }
 
-        auto filename = tr_strvPath(configDir, "blocklist.tmp.XXXXXX");
-        tr_sys_file_t const fd = tr_sys_file_open_temp(std::data(filename), &error);
+            auto const key = tr_quark_lookup(sv);
+            if (!key)
+            {
+                continue;
+            }
 
-        if (fd == TR_BAD_SYS_FILE)
+            keys[keyCount++] = *key;
+        }
+
+        if (format == TR_FORMAT_TABLE)
         {
-            tr_snprintf(result, sizeof(result), _("Couldn't save file \"%1$s\": %2$s"), filename.c_str(), error->message);
-            tr_error_clear(&error);
+            /* first entry is an array of property names */
+            args_out.startArray(keyCount);
+            for (size_t i = 0; i < keyCount; ++i)
+            {
+                args_out.addQuark(keys[i]);
+            }
+            args_out.endArray();
         }
 
-        auto err = int{};
-        for (;;)
+        if (auto token = int64_t{}; tr_variantDictFindInt(args_in, TR_KEY_change_token, &token))
         {
-            stream.next_out = static_cast<Bytef*>(buf);
-            stream.avail_out = buflen;
-            err = inflate(&stream, Z_NO_FLUSH);
+            auto const& clock = session->field_version_clock;
 
-            if ((stream.avail_out < buflen) && (!tr_sys_file_write(fd, buf, buflen - stream.avail_out, nullptr, &error)))
+            // a token we didn't hand out gets everything
+            if (token < 0 || uint64_t(token) > clock)
             {
-                tr_snprintf(result, sizeof(result), _("Couldn't save file \"%1$s\": %2$s"), filename.c_str(), error->message);
-                tr_error_clear(&error);
-                break;
+                token = 0;
             }
 
-            if (err != Z_OK)
+            for (auto* tor : torrents)
             {
-                if (err != Z_STREAM_END && err != Z_DATA_ERROR)
-                {
-                    tr_snprintf(result, sizeof(result), _("Error uncompressing blocklist: %s (%d)"), zError(err), err);
-                }
-
-                break;
+                addChangedTorrentInfo(tor, format, args_out, keys, keyCount, token);
             }
-        }
-
-        inflateEnd(&stream);
-
-        if ((err == Z_DATA_ERROR) && // couldn't inflate it... it's probably already uncompressed
-            !tr_sys_file_write(fd, std::data(response), std::size(response), nullptr, &error))
-        {
-            tr_snprintf(result, sizeof(result), _("Couldn't save file \"%1$s\": %2$s"), filename.c_str(), error->message);
-            tr_error_clear(&error);
-        }
-
-        tr_sys_file_close(fd, nullptr);
 
-        if (!tr_str_is_empty(result))
-        {
-            tr_logAddError("%s", result);
+            change_token = clock;
         }
         else
         {
-            /* feed it to the session and give the client a response */
-            int const rule_count = tr_blocklistSetContent(session, filename.c_str());
-            tr_variantDictAddInt(data->args_out, TR_KEY_blocklist_size, rule_count);
-            tr_snprintf(result, sizeof(result), "success");
+            for (auto* tor : torrents)
+            {
+                addTorrentInfo(tor, format, args_out, keys, keyCount);
+            }
         }
 
-        tr_sys_path_remove(filename.c_str(), nullptr);
-        tr_free(buf);
+        tr_free(keys);
     }
 
-    tr_idle_function_done(data, result);
+    args_out.endArray();
+
+    if (change_token)
+    {
+        args_out.key(TR_KEY_change_token);
+        args_out.addInt(*change_token);
+    }
+
+    if (match_count)
+    {
+        args_out.key(TR_KEY_match_count);
+        args_out.addInt(*match_count);
+    }
+
+    return select_errmsg != nullptr ? select_errmsg : errmsg;
 }
 
-static char const* blocklistUpdate(
-    tr_session* session,
-    tr_variant* /*args_in*/,
-    tr_variant* /*args_out*/,
-    struct tr_rpc_idle_data* idle_data)
+static char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
 {
-    tr_webRun(session, session->blocklistUrl().c_str(), gotNewBlocklist, idle_data);
-    return nullptr;
+    auto out = VariantWriter{ args_out };
+    return torrentGetImpl(session, args_in, out);
+}
+
+static char const* torrentGetStreamed(tr_session* session, tr_variant* args_in, tr_json_writer& args_out)
+{
+    return torrentGetImpl(session, args_in, args_out);
 }
 
 /***
 ****
 ***/
 
-static void addTorrentImpl(struct tr_rpc_idle_data* data, tr_ctor* ctor)
+static char const* setLabels(tr_torrent* tor, tr_variant* list)
 {
-    auto err = int{};
-    auto duplicate_id = int{};
-    tr_torrent* tor = tr_torrentNew(ctor, &err, &duplicate_id);
-    tr_ctorFree(ctor);
-
-    auto key = tr_quark{};
-    char const* result = "invalid or corrupt torrent file";
-    if (err == 0)
-    {
-        key = TR_KEY_torrent_added;
-        result = nullptr;
-    }
-    else if (err == TR_PARSE_DUPLICATE)
-    {
-        tor = tr_torrentFindFromId(data->session, duplicate_id);
-        key = TR_KEY_torrent_duplicate;
-        result = "duplicate torrent";
-    }
+    auto labels = tr_labels_t{};
 
-    if (tor != nullptr && key != 0)
+    size_t const n = tr_variantListSize(list);
+    for (size_t i = 0; i < n; ++i)
     {
-        tr_quark const fields[] = {
-            TR_KEY_id,
-            TR_KEY_name,
-            TR_KEY_hashString,
-        };
+        auto label = std::string_view{};
+        if (!tr_variantGetStrView(tr_variantListChild(list, i), &label))
+        {
+            continue;
+        }
 
-        addTorrentInfo(tor, TR_FORMAT_OBJECT, tr_variantDictAdd(data->args_out, key), fields, TR_N_ELEMENTS(fields));
+        label = tr_strvStrip(label);
+        if (std::empty(label))
+        {
+            return "labels cannot be empty";
+        }
 
-        if (result == nullptr)
+        if (tr_strvContains(label, ','))
         {
-            notify(data->session, TR_RPC_TORRENT_ADDED, tor);
+            return "labels cannot contain comma (,) character";
         }
 
-        result = nullptr;
+        labels.emplace(label);
     }
 
-    tr_idle_function_done(data, result);
+    tr_torrentSetLabels(tor, std::move(labels));
+    return nullptr;
 }
 
-struct add_torrent_idle_data
-{
-    struct tr_rpc_idle_data* data;
-    tr_ctor* ctor;
-};
-
-static void gotMetadataFromURL(
-    tr_session* /*session*/,
-    bool /*did_connect*/,
-    bool /*did_timeout*/,
-    long response_code,
-    std::string_view response,
-    void* user_data)
+static char const* setFilePriorities(tr_torrent* tor, tr_priority_t priority, tr_variant* list)
 {
-    auto* data = static_cast<struct add_torrent_idle_data*>(user_data);
+    char const* errmsg = nullptr;
+    auto const n_files = tor->fileCount();
 
-    dbgmsg(
-        "torrentAdd: HTTP response code was %ld (%s); response length was %zu bytes",
-        response_code,
-        tr_webGetResponseStr(response_code),
-        std::size(response));
+    auto files = std::vector<tr_file_index_t>{};
+    files.reserve(n_files);
 
-    if (response_code == 200 || response_code == 221) /* http or ftp success.. */
+    if (size_t const n = tr_variantListSize(list); n != 0)
     {
-        tr_ctorSetMetainfo(data->ctor, std::data(response), std::size(response));
-        addTorrentImpl(data->data, data->ctor);
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto tmp = int64_t{};
+            if (tr_variantGetInt(tr_variantListChild(list, i), &tmp))
+            {
+                if (0 <= tmp && tmp < n_files)
+                {
+                    files.push_back(tr_file_index_t(tmp));
+                }
+                else
+                {
+                    errmsg = "file index out of range";
+                }
+            }
+        }
     }
-    else
+    else // if empty set, apply to all
     {
-        char result[1024];
-        tr_snprintf(
-            result,
-            sizeof(result),
-            "gotMetadataFromURL: http error %ld: %s",
-            response_code,
-            tr_webGetResponseStr(response_code));
-        tr_idle_function_done(data->data, result);
+        files.resize(n_files);
+        std::iota(std::begin(files), std::end(files), 0);
     }
 
-    tr_free(data);
-}
+    tor->setFilePriorities(std::data(files), std::size(files), priority);
 
-static bool isCurlURL(std::string_view url)
-{
-    auto constexpr Schemes = std::array<std::string_view, 4>{ "http"sv, "https"sv, "ftp"sv, "sftp"sv };
-    auto const parsed = tr_urlParse(url);
-    return parsed && std::find(std::begin(Schemes), std::end(Schemes), parsed->scheme) != std::end(Schemes);
+    return errmsg;
 }
 
-static auto fileListFromList(tr_variant* list)
+static char const* setFileDLs(tr_torrent* tor, bool wanted, tr_variant* list)
 {
-    size_t const n = tr_variantListSize(list);
+    char const* errmsg = nullptr;
+
+    auto const n_files = tor->fileCount();
+    size_t const n_items = tr_variantListSize(list);
 
     auto files = std::vector<tr_file_index_t>{};
-    files.reserve(n);
+    files.reserve(n_files);
 
-    auto file_index = int64_t{};
-    for (size_t i = 0; i < n; ++i)
+    if (n_items != 0) // if argument list, process them
     {
-        if (tr_variantGetInt(tr_variantListChild(list, i), &file_index))
+        for (size_t i = 0; i < n_items; ++i)
         {
-            files.push_back(file_index);
+            auto tmp = int64_t{};
+            if (tr_variantGetInt(tr_variantListChild(list, i), &tmp))
+            {
+                if (0 <= tmp && tmp < n_files)
+                {
+                    files.push_back(tmp);
+                }
+                else
+                {
+                    errmsg = "file index out of range";
+                }
+            }
         }
     }
+    else // if empty set, apply to all
+    {
+        files.resize(n_files);
+        std::iota(std::begin(files), std::end(files), 0);
+    }
 
-    return files;
+    tor->setFilesWanted(std::data(files), std::size(files), wanted);
+
+    return errmsg;
 }
 
-static char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*args_out*/, tr_rpc_idle_data* idle_data)
+static bool hasAnnounceUrl(tr_tracker_info const* t, int n, std::string_view url)
 {
-    TR_ASSERT(idle_data != nullptr);
+    return std::any_of(t, t + n, [&url](auto const& row) { return row.announce == url; });
+}
 
-    auto filename = std::string_view{};
-    (void)tr_variantDictFindStrView(args_in, TR_KEY_filename, &filename);
+static int copyTrackers(tr_tracker_info* tgt, tr_tracker_info const* src, int n)
+{
+    int maxTier = -1;
 
-    auto metainfo_base64 = std::string_view{};
-    (void)tr_variantDictFindStrView(args_in, TR_KEY_metainfo, &metainfo_base64);
+    for (int i = 0; i < n; ++i)
+    {
+        tgt[i].tier = src[i].tier;
+        tgt[i].announce = tr_strdup(src[i].announce);
+        maxTier = std::max(maxTier, src[i].tier);
+    }
 
-    if (std::empty(filename) && std::empty(metainfo_base64))
+    return maxTier;
+}
+
+static void freeTrackers(tr_tracker_info* trackers, int n)
+{
+    for (int i = 0; i < n; ++i)
     {
-        return "no filename or metainfo specified";
+        tr_free(trackers[i].announce);
     }
 
-    auto download_dir = std::string_view{};
-    if (tr_variantDictFindStrView(args_in, TR_KEY_download_dir, &download_dir) && tr_sys_path_is_relative(download_dir))
+    tr_free(trackers);
+}
+
+static char const* addTrackerUrls(tr_torrent* tor, tr_variant* urls)
+{
+    char const* errmsg = nullptr;
+
+    /* make a working copy of the existing announce list */
+    auto const* const inf = tr_torrentInfo(tor);
+    int n = inf->trackerCount;
+    auto* const trackers = tr_new0(tr_tracker_info, n + tr_variantListSize(urls));
+    int tier = copyTrackers(trackers, inf->trackers, n);
+
+    /* and add the new ones */
+    auto i = int{ 0 };
+    auto changed = bool{ false };
+    tr_variant const* val = nullptr;
+    while ((val = tr_variantListChild(urls, i)) != nullptr)
     {
-        return "download directory path is not absolute";
+        auto announce = std::string_view{};
+
+        if (tr_variantGetStrView(val, &announce) && tr_urlIsValidTracker(announce) && !hasAnnounceUrl(trackers, n, announce))
+        {
+            trackers[n].tier = ++tier; /* add a new tier */
+            trackers[n].announce = tr_strvDup(announce);
+            ++n;
+            changed = true;
+        }
+
+        ++i;
     }
 
-    auto i = int64_t{};
-    auto boolVal = bool{};
-    tr_variant* l = nullptr;
-    tr_ctor* ctor = tr_ctorNew(session);
+    if (!changed)
+    {
+        errmsg = "invalid argument";
+    }
+    else if (!tr_torrentSetAnnounceList(tor, trackers, n))
+    {
+        errmsg = "error setting announce list";
+    }
 
-    /* set the optional arguments */
+    freeTrackers(trackers, n);
+    return errmsg;
+}
 
-    auto cookies = std::string_view{};
-    (void)tr_variantDictFindStrView(args_in, TR_KEY_cookies, &cookies);
+static char const* replaceTrackers(tr_torrent* tor, tr_variant* urls)
+{
+    char const* errmsg = nullptr;
 
-    if (!std::empty(download_dir))
+    /* make a working copy of the existing announce list */
+    auto const* const inf = tr_torrentInfo(tor);
+    int const n = inf->trackerCount;
+    auto* const trackers = tr_new0(tr_tracker_info, n);
+    copyTrackers(trackers, inf->trackers, n);
+
+    /* make the substitutions... */
+    bool changed = false;
+    for (size_t i = 0, url_count = tr_variantListSize(urls); i + 1 < url_count; i += 2)
     {
-        auto const sz_download_dir = std::string{ download_dir };
-        tr_ctorSetDownloadDir(ctor, TR_FORCE, sz_download_dir.c_str());
+        auto pos = int64_t{};
+        auto newval = std::string_view{};
+
+        if (tr_variantGetInt(tr_variantListChild(urls, i), &pos) &&
+            tr_variantGetStrView(tr_variantListChild(urls, i + 1), &newval) && tr_urlIsValidTracker(newval) && pos < n &&
+            pos >= 0)
+        {
+            tr_free(trackers[pos].announce);
+            trackers[pos].announce = tr_strvDup(newval);
+            changed = true;
+        }
     }
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_paused, &boolVal))
+    if (!changed)
     {
-        tr_ctorSetPaused(ctor, TR_FORCE, boolVal);
+        errmsg = "invalid argument";
+    }
+    else if (!tr_torrentSetAnnounceList(tor, trackers, n))
+    {
+        errmsg = "error setting announce list";
     }
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit, &i))
+    freeTrackers(trackers, n);
+    return errmsg;
+}
+
+static char const* removeTrackers(tr_torrent* tor, tr_variant* ids)
+{
+    /* make a working copy of the existing announce list */
+    tr_info const* inf = tr_torrentInfo(tor);
+    int n = inf->trackerCount;
+    int* tids = tr_new0(int, n);
+    tr_tracker_info* trackers = tr_new0(tr_tracker_info, n);
+    copyTrackers(trackers, inf->trackers, n);
+
+    /* remove the ones specified in the urls list */
+    int i = 0;
+    int t = 0;
+    tr_variant const* val = nullptr;
+    while ((val = tr_variantListChild(ids, i)) != nullptr)
     {
-        tr_ctorSetPeerLimit(ctor, TR_FORCE, (uint16_t)i);
+        auto pos = int64_t{};
+
+        if (tr_variantGetInt(val, &pos) && 0 <= pos && pos < n)
+        {
+            tids[t++] = (int)pos;
+        }
+
+        ++i;
     }
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_bandwidthPriority, &i))
+    /* sort trackerIds and remove from largest to smallest so there is no need to recalculate array indicies */
+    std::sort(tids, tids + t);
+
+    bool changed = false;
+    int dup = -1;
+    while (t-- != 0)
     {
-        tr_ctorSetBandwidthPriority(ctor, (tr_priority_t)i);
+        /* check for duplicates */
+        if (tids[t] == dup)
+        {
+            continue;
+        }
+
+        tr_removeElementFromArray(trackers, tids[t], sizeof(tr_tracker_info), n);
+        --n;
+
+        dup = tids[t];
+        changed = true;
     }
 
-    if (tr_variantDictFindList(args_in, TR_KEY_files_unwanted, &l))
+    char const* errmsg = nullptr;
+    if (!changed)
     {
-        auto const files = fileListFromList(l);
-        tr_ctorSetFilesWanted(ctor, std::data(files), std::size(files), false);
+        errmsg = "invalid argument";
+    }
+    else if (!tr_torrentSetAnnounceList(tor, trackers, n))
+    {
+        errmsg = "error setting announce list";
     }
 
-    if (tr_variantDictFindList(args_in, TR_KEY_files_wanted, &l))
-    {
-        auto const files = fileListFromList(l);
-        tr_ctorSetFilesWanted(ctor, std::data(files), std::size(files), true);
+    freeTrackers(trackers, n);
+    tr_free(tids);
+    return errmsg;
+}
+
+static char const* torrentSet(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* /*args_out*/,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    char const* errmsg = nullptr;
+
+    for (auto* tor : getTorrents(session, args_in))
+    {
+        auto tmp = int64_t{};
+        auto d = double{};
+        auto boolVal = bool{};
+        tr_variant* tmp_variant = nullptr;
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_bandwidthPriority, &tmp))
+        {
+            tr_priority_t const priority = (tr_priority_t)tmp;
+
+            if (tr_isPriority(priority))
+            {
+                tr_torrentSetPriority(tor, priority);
+            }
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_labels, &tmp_variant))
+        {
+            errmsg = setLabels(tor, tmp_variant);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_files_unwanted, &tmp_variant))
+        {
+            errmsg = setFileDLs(tor, false, tmp_variant);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_files_wanted, &tmp_variant))
+        {
+            errmsg = setFileDLs(tor, true, tmp_variant);
+        }
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit, &tmp))
+        {
+            tr_torrentSetPeerLimit(tor, tmp);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_high, &tmp_variant))
+        {
+            errmsg = setFilePriorities(tor, TR_PRI_HIGH, tmp_variant);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_low, &tmp_variant))
+        {
+            errmsg = setFilePriorities(tor, TR_PRI_LOW, tmp_variant);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_priority_normal, &tmp_variant))
+        {
+            errmsg = setFilePriorities(tor, TR_PRI_NORMAL, tmp_variant);
+        }
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_downloadLimit, &tmp))
+        {
+            tr_torrentSetSpeedLimit_KBps(tor, TR_DOWN, tmp);
+        }
+
+        if (tr_variantDictFindBool(args_in, TR_KEY_downloadLimited, &boolVal))
+        {
+            tr_torrentUseSpeedLimit(tor, TR_DOWN, boolVal);
+        }
+
+        if (tr_variantDictFindBool(args_in, TR_KEY_honorsSessionLimits, &boolVal))
+        {
+            tr_torrentUseSessionLimits(tor, boolVal);
+        }
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_uploadLimit, &tmp))
+        {
+            tr_torrentSetSpeedLimit_KBps(tor, TR_UP, tmp);
+        }
+
+        if (tr_variantDictFindBool(args_in, TR_KEY_uploadLimited, &boolVal))
+        {
+            tr_torrentUseSpeedLimit(tor, TR_UP, boolVal);
+        }
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_seedIdleLimit, &tmp))
+        {
+            tr_torrentSetIdleLimit(tor, (uint16_t)tmp);
+        }
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_seedIdleMode, &tmp))
+        {
+            tr_torrentSetIdleMode(tor, (tr_idlelimit)tmp);
+        }
+
+        if (tr_variantDictFindReal(args_in, TR_KEY_seedRatioLimit, &d))
+        {
+            tr_torrentSetRatioLimit(tor, d);
+        }
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_seedRatioMode, &tmp))
+        {
+            tr_torrentSetRatioMode(tor, (tr_ratiolimit)tmp);
+        }
+
+        if (tr_variantDictFindInt(args_in, TR_KEY_queuePosition, &tmp))
+        {
+            tr_torrentSetQueuePosition(tor, (int)tmp);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_trackerAdd, &tmp_variant))
+        {
+            errmsg = addTrackerUrls(tor, tmp_variant);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_trackerRemove, &tmp_variant))
+        {
+            errmsg = removeTrackers(tor, tmp_variant);
+        }
+
+        if (errmsg == nullptr && tr_variantDictFindList(args_in, TR_KEY_trackerReplace, &tmp_variant))
+        {
+            errmsg = replaceTrackers(tor, tmp_variant);
+        }
+
+        notify(session, TR_RPC_TORRENT_CHANGED, tor);
+    }
+
+    return errmsg;
+}
+
+static char const* torrentSetLocation(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* /*args_out*/,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    auto location = std::string_view{};
+
+    if (!tr_variantDictFindStrView(args_in, TR_KEY_location, &location))
+    {
+        return "no location";
+    }
+
+    if (tr_sys_path_is_relative(location))
+    {
+        return "new location path is not absolute";
+    }
+
+    auto move = bool{};
+    (void)tr_variantDictFindBool(args_in, TR_KEY_move, &move);
+
+    for (auto* tor : getTorrents(session, args_in))
+    {
+        tor->setLocation(location, move, nullptr, nullptr);
+        notify(session, TR_RPC_TORRENT_MOVED, tor);
+    }
+
+    return nullptr;
+}
+
+/***
+****
+***/
+
+static void torrentRenamePathDone(tr_torrent* tor, char const* oldpath, char const* newname, int error, void* user_data)
+{
+    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
+
+    tr_variantDictAddInt(data->args_out, TR_KEY_id, tr_torrentId(tor));
+    tr_variantDictAddStr(data->args_out, TR_KEY_path, oldpath);
+    tr_variantDictAddStr(data->args_out, TR_KEY_name, newname);
+
+    char const* const result = error == 0 ? nullptr : tr_strerror(error);
+    tr_idle_function_done(data, result);
+}
+
+static char const* torrentRenamePath(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* /*args_out*/,
+    struct tr_rpc_idle_data* idle_data)
+{
+    char const* errmsg = nullptr;
+
+    auto oldpath = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_path, &oldpath);
+    auto newname = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_name, &newname);
+
+    auto const torrents = getTorrents(session, args_in);
+    if (std::size(torrents) == 1)
+    {
+        torrents[0]->renamePath(oldpath, newname, torrentRenamePathDone, idle_data);
+    }
+    else
+    {
+        errmsg = "torrent-rename-path requires 1 torrent";
+    }
+
+    /* cleanup */
+    return errmsg;
+}
+
+/***
+****
+***/
+
+static void portTested(
+    tr_session* /*session*/,
+    bool /*did_connect*/,
+    bool /*did_timeout*/,
+    long response_code,
+    std::string_view response,
+    void* user_data)
+{
+    char result[1024];
+    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
+
+    if (response_code != 200)
+    {
+        tr_snprintf(
+            result,
+            sizeof(result),
+            "portTested: http error %ld: %s",
+            response_code,
+            tr_webGetResponseStr(response_code));
+    }
+    else /* success */
+    {
+        bool const isOpen = tr_strvStartsWith(response, '1');
+        tr_variantDictAddBool(data->args_out, TR_KEY_port_is_open, isOpen);
+        tr_snprintf(result, sizeof(result), "success");
+    }
+
+    tr_idle_function_done(data, result);
+}
+
+static char const* portTest(
+    tr_session* session,
+    tr_variant* /*args_in*/,
+    tr_variant* /*args_out*/,
+    struct tr_rpc_idle_data* idle_data)
+{
+    int const port = tr_sessionGetPeerPort(session);
+    char* url = tr_strdup_printf("https://portcheck.transmissionbt.com/%d", port);
+    tr_webRun(session, url, portTested, idle_data);
+    tr_free(url);
+    return nullptr;
+}
+
+/***
+****
+***/
+
+static void gotNewBlocklist(
+    tr_session* session,
+    bool /*did_connect*/,
+    bool /*did_timeout*/,
+    long response_code,
+    std::string_view response,
+    void* user_data)
+{
+    char result[1024];
+    auto* data = static_cast<struct tr_rpc_idle_data*>(user_data);
+
+    *result = '\0';
+
+    if (response_code != 200)
+    {
+        tr_snprintf(
+            result,
+            sizeof(result),
+            "gotNewBlocklist: http error %ld: %s",
+            response_code,
+            tr_webGetResponseStr(response_code));
+    }
+    else /* successfully fetched the blocklist... */
+    {
+        auto stream = z_stream{};
+        char const* configDir = tr_sessionGetConfigDir(session);
+        size_t const buflen = 1024 * 128; /* 128 KiB buffer */
+        auto* const buf = static_cast<uint8_t*>(tr_malloc(buflen));
+        tr_error* error = nullptr;
+
+        /* this is an odd Magic Number required by zlib to enable gz support.
+           See zlib's inflateInit2() documentation for a full description */
+        int const windowBits = 15 + 32;
+
+        stream.zalloc = (alloc_func)Z_NULL;
+        stream.zfree = (free_func)Z_NULL;
+        stream.opaque = (voidpf)Z_NULL;
+        stream.next_in = reinterpret_cast<Bytef const*>(std::data(response));
+        stream.avail_in = std::size(response);
+        if (inflateInit2(&stream, windowBits) != Z_OK)
+        {
+            // If stream init fails, log an error but keep going forward
+            // since the file may be uncompressed anyway.
+            tr_logAddError("inflateInit2 failed: %s", stream.msg ? stream.msg : "unknown");
+        }
+
+        auto filename = tr_strvPath(configDir, "blocklist.tmp.XXXXXX");
+        tr_sys_file_t const fd = tr_sys_file_open_temp(std::data(filename), &error);
+
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            tr_snprintf(result, sizeof(result), _("Couldn't save file \"%1$s\": %2$s"), filename.c_str(), error->message);
+            tr_error_clear(&error);
+        }
+
+        auto err = int{};
+        for (;;)
+        {
+            stream.next_out = static_cast<Bytef*>(buf);
+            stream.avail_out = buflen;
+            err = inflate(&stream, Z_NO_FLUSH);
+
+            if ((stream.avail_out < buflen) && (!tr_sys_file_write(fd, buf, buflen - stream.avail_out, nullptr, &error)))
+            {
+                tr_snprintf(result, sizeof(result), _("Couldn't save file \"%1$s\": %2$s"), filename.c_str(), error->message);
+                tr_error_clear(&error);
+                break;
+            }
+
+            if (err != Z_OK)
+            {
+                if (err != Z_STREAM_END && err != Z_DATA_ERROR)
+                {
+                    tr_snprintf(result, sizeof(result), _("Error uncompressing blocklist: %s (%d)"), zError(err), err);
+                }
+
+                break;
+            }
+        }
+
+        inflateEnd(&stream);
+
+        if ((err == Z_DATA_ERROR) && // couldn't inflate it... it's probably already uncompressed
+            !tr_sys_file_write(fd, std::data(response), std::size(response), nullptr, &error))
+        {
+            tr_snprintf(result, sizeof(result), _("Couldn't save file \"%1$s\": %2$s"), filename.c_str(), error->message);
+            tr_error_clear(&error);
+        }
+
+        tr_sys_file_close(fd, nullptr);
+
+        if (!tr_str_is_empty(result))
+        {
+            tr_logAddError("%s", result);
+        }
+        else
+        {
+            /* feed it to the session and give the client a response */
+            int const rule_count = tr_blocklistSetContent(session, filename.c_str());
+            tr_variantDictAddInt(data->args_out, TR_KEY_blocklist_size, rule_count);
+            tr_snprintf(result, sizeof(result), "success");
+        }
+
+        tr_sys_path_remove(filename.c_str(), nullptr);
+        tr_free(buf);
+    }
+
+    tr_idle_function_done(data, result);
+}
+
+static char const* blocklistUpdate(
+    tr_session* session,
+    tr_variant* /*args_in*/,
+    tr_variant* /*args_out*/,
+    struct tr_rpc_idle_data* idle_data)
+{
+    tr_webRun(session, session->blocklistUrl().c_str(), gotNewBlocklist, idle_data);
+    return nullptr;
+}
+
+/***
+****
+***/
+
+static void addTorrentImpl(struct tr_rpc_idle_data* data, tr_ctor* ctor)
+{
+    auto err = int{};
+    auto duplicate_id = int{};
+    tr_torrent* tor = tr_torrentNew(ctor, &err, &duplicate_id);
+    tr_ctorFree(ctor);
+
+    auto key = tr_quark{};
+    char const* result = "invalid or corrupt torrent file";
+    if (err == 0)
+    {
+        key = TR_KEY_torrent_added;
+        result = nullptr;
+    }
+    else if (err == TR_PARSE_DUPLICATE)
+    {
+        tor = tr_torrentFindFromId(data->session, duplicate_id);
+        key = TR_KEY_torrent_duplicate;
+        result = "duplicate torrent";
+    }
+
+    if (tor != nullptr && key != 0)
+    {
+        tr_quark const fields[] = {
+            TR_KEY_id,
+            TR_KEY_name,
+            TR_KEY_hashString,
+        };
+
+        auto out = VariantWriter{ data->args_out };
+        out.key(key);
+        addTorrentInfo(tor, TR_FORMAT_OBJECT, out, fields, TR_N_ELEMENTS(fields));
+
+        if (result == nullptr)
+        {
+            notify(data->session, TR_RPC_TORRENT_ADDED, tor);
+        }
+
+        result = nullptr;
+    }
+
+    tr_idle_function_done(data, result);
+}
+
+struct add_torrent_idle_data
+{
+    struct tr_rpc_idle_data* data;
+    tr_ctor* ctor;
+};
+
+static void gotMetadataFromURL(
+    tr_session* /*session*/,
+    bool /*did_connect*/,
+    bool /*did_timeout*/,
+    long response_code,
+    std::string_view response,
+    void* user_data)
+{
+    auto* data = static_cast<struct add_torrent_idle_data*>(user_data);
+
+    dbgmsg(
+        "torrentAdd: HTTP response code was %ld (%s); response length was %zu bytes",
+        response_code,
+        tr_webGetResponseStr(response_code),
+        std::size(response));
+
+    if (response_code == 200 || response_code == 221) /* http or ftp success.. */
+    {
+        tr_ctorSetMetainfo(data->ctor, std::data(response), std::size(response));
+        addTorrentImpl(data->data, data->ctor);
+    }
+    else
+    {
+        char result[1024];
+        tr_snprintf(
+            result,
+            sizeof(result),
+            "gotMetadataFromURL: http error %ld: %s",
+            response_code,
+            tr_webGetResponseStr(response_code));
+        tr_idle_function_done(data->data, result);
+    }
+
+    tr_free(data);
+}
+
+static bool isCurlURL(std::string_view url)
+{
+    auto constexpr Schemes = std::array<std::string_view, 4>{ "http"sv, "https"sv, "ftp"sv, "sftp"sv };
+    auto const parsed = tr_urlParse(url);
+    return parsed && std::find(std::begin(Schemes), std::end(Schemes), parsed->scheme) != std::end(Schemes);
+}
+
+static auto fileListFromList(tr_variant* list)
+{
+    size_t const n = tr_variantListSize(list);
+
+    auto files = std::vector<tr_file_index_t>{};
+    files.reserve(n);
+
+    auto file_index = int64_t{};
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (tr_variantGetInt(tr_variantListChild(list, i), &file_index))
+        {
+            files.push_back(file_index);
+        }
+    }
+
+    return files;
+}
+
+static char const* torrentAdd(tr_session* session, tr_variant* args_in, tr_variant* /*args_out*/, tr_rpc_idle_data* idle_data)
+{
+    TR_ASSERT(idle_data != nullptr);
+
+    auto filename = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_filename, &filename);
+
+    auto metainfo_base64 = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_metainfo, &metainfo_base64);
+
+    if (std::empty(filename) && std::empty(metainfo_base64))
+    {
+        return "no filename or metainfo specified";
+    }
+
+    auto download_dir = std::string_view{};
+    if (tr_variantDictFindStrView(args_in, TR_KEY_download_dir, &download_dir) && tr_sys_path_is_relative(download_dir))
+    {
+        return "download directory path is not absolute";
+    }
+
+    auto i = int64_t{};
+    auto boolVal = bool{};
+    tr_variant* l = nullptr;
+    tr_ctor* ctor = tr_ctorNew(session);
+
+    /* set the optional arguments */
+
+    auto cookies = std::string_view{};
+    (void)tr_variantDictFindStrView(args_in, TR_KEY_cookies, &cookies);
+
+    if (!std::empty(download_dir))
+    {
+        auto const sz_download_dir = std::string{ download_dir };
+        tr_ctorSetDownloadDir(ctor, TR_FORCE, sz_download_dir.c_str());
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_paused, &boolVal))
+    {
+        tr_ctorSetPaused(ctor, TR_FORCE, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit, &i))
+    {
+        tr_ctorSetPeerLimit(ctor, TR_FORCE, (uint16_t)i);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_bandwidthPriority, &i))
+    {
+        tr_ctorSetBandwidthPriority(ctor, (tr_priority_t)i);
+    }
+
+    if (tr_variantDictFindList(args_in, TR_KEY_files_unwanted, &l))
+    {
+        auto const files = fileListFromList(l);
+        tr_ctorSetFilesWanted(ctor, std::data(files), std::size(files), false);
+    }
+
+    if (tr_variantDictFindList(args_in, TR_KEY_files_wanted, &l))
+    {
+        auto const files = fileListFromList(l);
+        tr_ctorSetFilesWanted(ctor, std::data(files), std::size(files), true);
+    }
+
+    if (tr_variantDictFindList(args_in, TR_KEY_priority_low, &l))
+    {
+        auto const files = fileListFromList(l);
+        tr_ctorSetFilePriorities(ctor, std::data(files), std::size(files), TR_PRI_LOW);
+    }
+
+    if (tr_variantDictFindList(args_in, TR_KEY_priority_normal, &l))
+    {
+        auto const files = fileListFromList(l);
+        tr_ctorSetFilePriorities(ctor, std::data(files), std::size(files), TR_PRI_NORMAL);
+    }
+
+    if (tr_variantDictFindList(args_in, TR_KEY_priority_high, &l))
+    {
+        auto const files = fileListFromList(l);
+        tr_ctorSetFilePriorities(ctor, std::data(files), std::size(files), TR_PRI_HIGH);
+    }
+
+    dbgmsg("torrentAdd: filename is \"%" TR_PRIsv "\"", TR_PRIsv_ARG(filename));
+
+    if (isCurlURL(filename))
+    {
+        auto* const d = tr_new0(struct add_torrent_idle_data, 1);
+        d->data = idle_data;
+        d->ctor = ctor;
+        tr_webRunWithCookies(session, filename, cookies, gotMetadataFromURL, d);
+    }
+    else
+    {
+        if (std::empty(filename))
+        {
+            std::string const metainfo = tr_base64_decode_str(metainfo_base64);
+            tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo));
+        }
+        else
+        {
+            // these two tr_ctorSet*() functions require zero-terminated strings
+            auto const filename_str = std::string{ filename };
+
+            if (tr_strvStartsWith(filename, "magnet:?"sv))
+            {
+                tr_ctorSetMetainfoFromMagnetLink(ctor, filename_str.c_str());
+            }
+            else
+            {
+                tr_ctorSetMetainfoFromFile(ctor, filename_str.c_str());
+            }
+        }
+
+        addTorrentImpl(idle_data, ctor);
+    }
+
+    return nullptr;
+}
+
+/***
+****
+***/
+
+static char const* sessionSet(
+    tr_session* session,
+    tr_variant* args_in,
+    tr_variant* /*args_out*/,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    auto download_dir = std::string_view{};
+    auto incomplete_dir = std::string_view{};
+
+    if (tr_variantDictFindStrView(args_in, TR_KEY_download_dir, &download_dir) && tr_sys_path_is_relative(download_dir))
+    {
+        return "download directory path is not absolute";
+    }
+
+    if (tr_variantDictFindStrView(args_in, TR_KEY_incomplete_dir, &incomplete_dir) && tr_sys_path_is_relative(incomplete_dir))
+    {
+        return "incomplete torrents directory path is not absolute";
+    }
+
+    auto boolVal = bool{};
+    auto d = double{};
+    auto i = int64_t{};
+    auto sv = std::string_view{};
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_cache_size_mb, &i))
+    {
+        tr_sessionSetCacheLimit_MB(session, i);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_up, &i))
+    {
+        tr_sessionSetAltSpeed_KBps(session, TR_UP, i);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_down, &i))
+    {
+        tr_sessionSetAltSpeed_KBps(session, TR_DOWN, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_alt_speed_enabled, &boolVal))
+    {
+        tr_sessionUseAltSpeed(session, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_time_begin, &i))
+    {
+        tr_sessionSetAltSpeedBegin(session, i);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_time_end, &i))
+    {
+        tr_sessionSetAltSpeedEnd(session, i);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_time_day, &i))
+    {
+        tr_sessionSetAltSpeedDay(session, tr_sched_day(i));
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_alt_speed_time_enabled, &boolVal))
+    {
+        tr_sessionUseAltSpeedTime(session, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_blocklist_enabled, &boolVal))
+    {
+        session->useBlocklist(boolVal);
+    }
+
+    if (tr_variantDictFindStrView(args_in, TR_KEY_blocklist_url, &sv))
+    {
+        session->setBlocklistUrl(sv);
+    }
+
+    if (!std::empty(download_dir))
+    {
+        session->setDownloadDir(download_dir);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_queue_stalled_minutes, &i))
+    {
+        tr_sessionSetQueueStalledMinutes(session, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_queue_stalled_enabled, &boolVal))
+    {
+        tr_sessionSetQueueStalledEnabled(session, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_download_queue_size, &i))
+    {
+        tr_sessionSetQueueSize(session, TR_DOWN, (int)i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_download_queue_enabled, &boolVal))
+    {
+        tr_sessionSetQueueEnabled(session, TR_DOWN, boolVal);
+    }
+
+    if (!std::empty(incomplete_dir))
+    {
+        session->setIncompleteDir(incomplete_dir);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_incomplete_dir_enabled, &boolVal))
+    {
+        session->useIncompleteDir(boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit_global, &i))
+    {
+        tr_sessionSetPeerLimit(session, i);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit_per_torrent, &i))
+    {
+        tr_sessionSetPeerLimitPerTorrent(session, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_pex_enabled, &boolVal))
+    {
+        tr_sessionSetPexEnabled(session, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_dht_enabled, &boolVal))
+    {
+        tr_sessionSetDHTEnabled(session, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_utp_enabled, &boolVal))
+    {
+        tr_sessionSetUTPEnabled(session, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_lpd_enabled, &boolVal))
+    {
+        tr_sessionSetLPDEnabled(session, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_peer_port_random_on_start, &boolVal))
+    {
+        tr_sessionSetPeerPortRandomOnStart(session, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_peer_port, &i))
+    {
+        tr_sessionSetPeerPort(session, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_port_forwarding_enabled, &boolVal))
+    {
+        tr_sessionSetPortForwardingEnabled(session, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_rename_partial_files, &boolVal))
+    {
+        tr_sessionSetIncompleteFileNamingEnabled(session, boolVal);
+    }
+
+    if (tr_variantDictFindReal(args_in, TR_KEY_seedRatioLimit, &d))
+    {
+        tr_sessionSetRatioLimit(session, d);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_seedRatioLimited, &boolVal))
+    {
+        tr_sessionSetRatioLimited(session, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_idle_seeding_limit, &i))
+    {
+        tr_sessionSetIdleLimit(session, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_idle_seeding_limit_enabled, &boolVal))
+    {
+        tr_sessionSetIdleLimited(session, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_start_added_torrents, &boolVal))
+    {
+        tr_sessionSetPaused(session, !boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_seed_queue_enabled, &boolVal))
+    {
+        tr_sessionSetQueueEnabled(session, TR_UP, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_seed_queue_size, &i))
+    {
+        tr_sessionSetQueueSize(session, TR_UP, (int)i);
+    }
+
+    if (tr_variantDictFindStrView(args_in, TR_KEY_script_torrent_added_filename, &sv))
+    {
+        session->setScript(TR_SCRIPT_ON_TORRENT_ADDED, sv);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_script_torrent_added_enabled, &boolVal))
+    {
+        session->useScript(TR_SCRIPT_ON_TORRENT_ADDED, boolVal);
+    }
+
+    if (tr_variantDictFindStrView(args_in, TR_KEY_script_torrent_done_filename, &sv))
+    {
+        session->setScript(TR_SCRIPT_ON_TORRENT_DONE, sv);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_script_torrent_done_enabled, &boolVal))
+    {
+        session->useScript(TR_SCRIPT_ON_TORRENT_DONE, boolVal);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_trash_original_torrent_files, &boolVal))
+    {
+        tr_sessionSetDeleteSource(session, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_speed_limit_down, &i))
+    {
+        tr_sessionSetSpeedLimit_KBps(session, TR_DOWN, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_speed_limit_down_enabled, &boolVal))
+    {
+        tr_sessionLimitSpeed(session, TR_DOWN, boolVal);
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_speed_limit_up, &i))
+    {
+        tr_sessionSetSpeedLimit_KBps(session, TR_UP, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_speed_limit_up_enabled, &boolVal))
+    {
+        tr_sessionLimitSpeed(session, TR_UP, boolVal);
+    }
+
+    if (tr_variantDictFindStrView(args_in, TR_KEY_encryption, &sv))
+    {
+        if (sv == "required"sv)
+        {
+            tr_sessionSetEncryption(session, TR_ENCRYPTION_REQUIRED);
+        }
+        else if (sv == "tolerated"sv)
+        {
+            tr_sessionSetEncryption(session, TR_CLEAR_PREFERRED);
+        }
+        else
+        {
+            tr_sessionSetEncryption(session, TR_ENCRYPTION_PREFERRED);
+        }
+    }
+
+    if (tr_variantDictFindInt(args_in, TR_KEY_anti_brute_force_threshold, &i))
+    {
+        tr_sessionSetAntiBruteForceThreshold(session, i);
+    }
+
+    if (tr_variantDictFindBool(args_in, TR_KEY_anti_brute_force_enabled, &boolVal))
+    {
+        tr_sessionSetAntiBruteForceEnabled(session, boolVal);
+    }
+
+    notify(session, TR_RPC_SESSION_CHANGED, nullptr);
+
+    return nullptr;
+}
+
+static char const* sessionStats(
+    tr_session* session,
+    tr_variant* /*args_in*/,
+    tr_variant* args_out,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    auto currentStats = tr_session_stats{};
+    auto cumulativeStats = tr_session_stats{};
+
+    int const total = std::size(session->torrents);
+    int const running = std::count_if(
+        std::begin(session->torrents),
+        std::end(session->torrents),
+        [](auto const* tor) { return tor->isRunning; });
+
+    tr_sessionGetStats(session, &currentStats);
+    tr_sessionGetCumulativeStats(session, &cumulativeStats);
+
+    tr_variantDictAddInt(args_out, TR_KEY_activeTorrentCount, running);
+    tr_variantDictAddReal(args_out, TR_KEY_downloadSpeed, tr_sessionGetPieceSpeed_Bps(session, TR_DOWN));
+    tr_variantDictAddInt(args_out, TR_KEY_pausedTorrentCount, total - running);
+    tr_variantDictAddInt(args_out, TR_KEY_torrentCount, total);
+    tr_variantDictAddReal(args_out, TR_KEY_uploadSpeed, tr_sessionGetPieceSpeed_Bps(session, TR_UP));
+
+    auto const fd_stats = tr_fdGetStats(session);
+    tr_variantDictAddInt(args_out, TR_KEY_filesClosed, fd_stats.files_closed);
+    tr_variantDictAddInt(args_out, TR_KEY_filesOpened, fd_stats.files_opened);
+    tr_variantDictAddInt(args_out, TR_KEY_openFileCount, fd_stats.open_files);
+    tr_variantDictAddInt(args_out, TR_KEY_openFileLimit, fd_stats.open_file_limit);
+
+    tr_variant* d = tr_variantDictAddDict(args_out, TR_KEY_cumulative_stats, 5);
+    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, cumulativeStats.downloadedBytes);
+    tr_variantDictAddInt(d, TR_KEY_filesAdded, cumulativeStats.filesAdded);
+    tr_variantDictAddInt(d, TR_KEY_secondsActive, cumulativeStats.secondsActive);
+    tr_variantDictAddInt(d, TR_KEY_sessionCount, cumulativeStats.sessionCount);
+    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, cumulativeStats.uploadedBytes);
+
+    d = tr_variantDictAddDict(args_out, TR_KEY_current_stats, 5);
+    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, currentStats.downloadedBytes);
+    tr_variantDictAddInt(d, TR_KEY_filesAdded, currentStats.filesAdded);
+    tr_variantDictAddInt(d, TR_KEY_secondsActive, currentStats.secondsActive);
+    tr_variantDictAddInt(d, TR_KEY_sessionCount, currentStats.sessionCount);
+    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, currentStats.uploadedBytes);
+
+    return nullptr;
+}
+
+static constexpr std::string_view getEncryptionModeString(tr_encryption_mode mode)
+{
+    switch (mode)
+    {
+    case TR_CLEAR_PREFERRED:
+        return "tolerated"sv;
+
+    case TR_ENCRYPTION_REQUIRED:
+        return "required"sv;
+
+    default:
+        return "preferred"sv;
+    }
+}
+
+static void addSessionField(tr_session* s, tr_variant* d, tr_quark key)
+{
+    switch (key)
+    {
+    case TR_KEY_alt_speed_up:
+        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeed_KBps(s, TR_UP));
+        break;
+
+    case TR_KEY_alt_speed_down:
+        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeed_KBps(s, TR_DOWN));
+        break;
+
+    case TR_KEY_alt_speed_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionUsesAltSpeed(s));
+        break;
+
+    case TR_KEY_alt_speed_time_begin:
+        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeedBegin(s));
+        break;
+
+    case TR_KEY_alt_speed_time_end:
+        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeedEnd(s));
+        break;
+
+    case TR_KEY_alt_speed_time_day:
+        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeedDay(s));
+        break;
+
+    case TR_KEY_alt_speed_time_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionUsesAltSpeedTime(s));
+        break;
+
+    case TR_KEY_blocklist_enabled:
+        tr_variantDictAddBool(d, key, s->useBlocklist());
+        break;
+
+    case TR_KEY_blocklist_url:
+        tr_variantDictAddStr(d, key, s->blocklistUrl());
+        break;
+
+    case TR_KEY_cache_size_mb:
+        tr_variantDictAddInt(d, key, tr_sessionGetCacheLimit_MB(s));
+        break;
+
+    case TR_KEY_blocklist_size:
+        tr_variantDictAddInt(d, key, tr_blocklistGetRuleCount(s));
+        break;
+
+    case TR_KEY_config_dir:
+        tr_variantDictAddStr(d, key, tr_sessionGetConfigDir(s));
+        break;
+
+    case TR_KEY_download_dir:
+        tr_variantDictAddStr(d, key, s->downloadDir());
+        break;
+
+    case TR_KEY_download_dir_free_space:
+        tr_variantDictAddInt(d, key, tr_dirSpace(s->downloadDir()).free);
+        break;
+
+    case TR_KEY_download_queue_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionGetQueueEnabled(s, TR_DOWN));
+        break;
+
+    case TR_KEY_download_queue_size:
+        tr_variantDictAddInt(d, key, tr_sessionGetQueueSize(s, TR_DOWN));
+        break;
+
+    case TR_KEY_peer_limit_global:
+        tr_variantDictAddInt(d, key, tr_sessionGetPeerLimit(s));
+        break;
+
+    case TR_KEY_peer_limit_per_torrent:
+        tr_variantDictAddInt(d, key, tr_sessionGetPeerLimitPerTorrent(s));
+        break;
+
+    case TR_KEY_incomplete_dir:
+        tr_variantDictAddStr(d, key, s->incompleteDir());
+        break;
+
+    case TR_KEY_incomplete_dir_enabled:
+        tr_variantDictAddBool(d, key, s->useIncompleteDir());
+        break;
+
+    case TR_KEY_pex_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsPexEnabled(s));
+        break;
+
+    case TR_KEY_utp_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsUTPEnabled(s));
+        break;
+
+    case TR_KEY_dht_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsDHTEnabled(s));
+        break;
+
+    case TR_KEY_lpd_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsLPDEnabled(s));
+        break;
+
+    case TR_KEY_peer_port:
+        tr_variantDictAddInt(d, key, tr_sessionGetPeerPort(s));
+        break;
+
+    case TR_KEY_peer_port_random_on_start:
+        tr_variantDictAddBool(d, key, tr_sessionGetPeerPortRandomOnStart(s));
+        break;
+
+    case TR_KEY_port_forwarding_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsPortForwardingEnabled(s));
+        break;
+
+    case TR_KEY_rename_partial_files:
+        tr_variantDictAddBool(d, key, tr_sessionIsIncompleteFileNamingEnabled(s));
+        break;
+
+    case TR_KEY_rpc_version:
+        tr_variantDictAddInt(d, key, RPC_VERSION);
+        break;
+
+    case TR_KEY_rpc_version_semver:
+        tr_variantDictAddStrView(d, key, RPC_VERSION_SEMVER);
+        break;
+
+    case TR_KEY_rpc_version_minimum:
+        tr_variantDictAddInt(d, key, RPC_VERSION_MIN);
+        break;
+
+    case TR_KEY_seedRatioLimit:
+        tr_variantDictAddReal(d, key, tr_sessionGetRatioLimit(s));
+        break;
+
+    case TR_KEY_seedRatioLimited:
+        tr_variantDictAddBool(d, key, tr_sessionIsRatioLimited(s));
+        break;
+
+    case TR_KEY_idle_seeding_limit:
+        tr_variantDictAddInt(d, key, tr_sessionGetIdleLimit(s));
+        break;
+
+    case TR_KEY_idle_seeding_limit_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsIdleLimited(s));
+        break;
+
+    case TR_KEY_seed_queue_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionGetQueueEnabled(s, TR_UP));
+        break;
+
+    case TR_KEY_seed_queue_size:
+        tr_variantDictAddInt(d, key, tr_sessionGetQueueSize(s, TR_UP));
+        break;
+
+    case TR_KEY_start_added_torrents:
+        tr_variantDictAddBool(d, key, !tr_sessionGetPaused(s));
+        break;
+
+    case TR_KEY_trash_original_torrent_files:
+        tr_variantDictAddBool(d, key, tr_sessionGetDeleteSource(s));
+        break;
+
+    case TR_KEY_speed_limit_up:
+        tr_variantDictAddInt(d, key, tr_sessionGetSpeedLimit_KBps(s, TR_UP));
+        break;
+
+    case TR_KEY_speed_limit_up_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsSpeedLimited(s, TR_UP));
+        break;
+
+    case TR_KEY_speed_limit_down:
+        tr_variantDictAddInt(d, key, tr_sessionGetSpeedLimit_KBps(s, TR_DOWN));
+        break;
+
+    case TR_KEY_speed_limit_down_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsSpeedLimited(s, TR_DOWN));
+        break;
+
+    case TR_KEY_script_torrent_added_filename:
+        tr_variantDictAddStr(d, key, tr_sessionGetScript(s, TR_SCRIPT_ON_TORRENT_ADDED));
+        break;
+
+    case TR_KEY_script_torrent_added_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsScriptEnabled(s, TR_SCRIPT_ON_TORRENT_ADDED));
+        break;
+
+    case TR_KEY_script_torrent_done_filename:
+        tr_variantDictAddStr(d, key, tr_sessionGetScript(s, TR_SCRIPT_ON_TORRENT_DONE));
+        break;
+
+    case TR_KEY_script_torrent_done_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionIsScriptEnabled(s, TR_SCRIPT_ON_TORRENT_DONE));
+        break;
+
+    case TR_KEY_queue_stalled_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionGetQueueStalledEnabled(s));
+        break;
+
+    case TR_KEY_queue_stalled_minutes:
+        tr_variantDictAddInt(d, key, tr_sessionGetQueueStalledMinutes(s));
+        break;
+
+    case TR_KEY_anti_brute_force_enabled:
+        tr_variantDictAddBool(d, key, tr_sessionGetAntiBruteForceEnabled(s));
+        break;
+
+    case TR_KEY_anti_brute_force_threshold:
+        tr_variantDictAddInt(d, key, tr_sessionGetAntiBruteForceThreshold(s));
+        break;
+
+    case TR_KEY_units:
+        tr_formatter_get_units(tr_variantDictAddDict(d, key, 0));
+        break;
+
+    case TR_KEY_version:
+        tr_variantDictAddStrView(d, key, LONG_VERSION_STRING);
+        break;
+
+    case TR_KEY_encryption:
+        tr_variantDictAddStr(d, key, getEncryptionModeString(tr_sessionGetEncryption(s)));
+        break;
+
+    case TR_KEY_session_id:
+        tr_variantDictAddStr(d, key, tr_session_id_get_current(s->session_id));
+        break;
     }
+}
 
-    if (tr_variantDictFindList(args_in, TR_KEY_priority_low, &l))
-    {
-        auto const files = fileListFromList(l);
-        tr_ctorSetFilePriorities(ctor, std::data(files), std::size(files), TR_PRI_LOW);
-    }
+template<typename Writer>
+static void writeSessionField(tr_session* s, Writer& args_out, tr_quark key)
+{
+    auto scratch = tr_variant{};
+    tr_variantInitDict(&scratch, 1);
+    addSessionField(s, &scratch, key);
 
-    if (tr_variantDictFindList(args_in, TR_KEY_priority_normal, &l))
+    if (auto* const child = tr_variantDictFind(&scratch, key); child != nullptr)
     {
-        auto const files = fileListFromList(l);
-        tr_ctorSetFilePriorities(ctor, std::data(files), std::size(files), TR_PRI_NORMAL);
+        args_out.key(key);
+        args_out.addVariant(child);
     }
 
-    if (tr_variantDictFindList(args_in, TR_KEY_priority_high, &l))
+    tr_variantFree(&scratch);
+}
+
+template<typename Writer>
+static char const* sessionGetImpl(tr_session* s, tr_variant* args_in, Writer& args_out)
+{
+    tr_variant* fields = nullptr;
+    if (tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
     {
-        auto const files = fileListFromList(l);
-        tr_ctorSetFilePriorities(ctor, std::data(files), std::size(files), TR_PRI_HIGH);
-    }
+        size_t const field_count = tr_variantListSize(fields);
 
-    dbgmsg("torrentAdd: filename is \"%" TR_PRIsv "\"", TR_PRIsv_ARG(filename));
+        for (size_t i = 0; i < field_count; ++i)
+        {
+            auto field_name = std::string_view{};
+            if (tr_variantGetStrView(tr_variantListChild(fields, i), &field_name))
+            {
+                continue;
+            }
 
-    if (isCurlURL(filename))
-    {
-        auto* const d = tr_new0(struct add_torrent_idle_data, 1);
-        d->data = idle_data;
-        d->ctor = ctor;
-        tr_webRunWithCookies(session, filename, cookies, gotMetadataFromURL, d);
+            auto const field_id = tr_quark_lookup(field_name);
+            if (field_id)
+            {
+                writeSessionField(s, args_out, *field_id);
+            }
+        }
     }
     else
     {
-        if (std::empty(filename))
+        for (tr_quark field_id = TR_KEY_NONE + 1; field_id < TR_N_KEYS; ++field_id)
         {
-            std::string const metainfo = tr_base64_decode_str(metainfo_base64);
-            tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo));
+            writeSessionField(s, args_out, field_id);
         }
-        else
-        {
-            // these two tr_ctorSet*() functions require zero-terminated strings
-            auto const filename_str = std::string{ filename };
+    }
 
-            if (tr_strvStartsWith(filename, "magnet:?"sv))
-            {
-                tr_ctorSetMetainfoFromMagnetLink(ctor, filename_str.c_str());
-            }
-            else
-            {
-                tr_ctorSetMetainfoFromFile(ctor, filename_str.c_str());
-            }
-        }
+    return nullptr;
+}
 
-        addTorrentImpl(idle_data, ctor);
+static char const* sessionGet(tr_session* s, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto out = VariantWriter{ args_out };
+    return sessionGetImpl(s, args_in, out);
+}
+
+static char const* sessionGetStreamed(tr_session* s, tr_variant* args_in, tr_json_writer& args_out)
+{
+    return sessionGetImpl(s, args_in, args_out);
+}
+
+static char const* freeSpace(
+    tr_session* /*session*/,
+    tr_variant* args_in,
+    tr_variant* args_out,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    auto path = std::string_view{};
+
+    if (!tr_variantDictFindStrView(args_in, TR_KEY_path, &path))
+    {
+        return "directory path argument is missing";
     }
 
-    return nullptr;
+    if (tr_sys_path_is_relative(path))
+    {
+        return "directory path is not absolute";
+    }
+
+    /* get the free space */
+    auto const old_errno = errno;
+    errno = 0;
+    auto const dir_space = tr_dirSpace(path);
+    char const* const err = dir_space.free < 0 || dir_space.total < 0 ? tr_strerror(errno) : nullptr;
+    errno = old_errno;
+
+    /* response */
+    tr_variantDictAddStr(args_out, TR_KEY_path, path);
+    tr_variantDictAddInt(args_out, TR_KEY_size_bytes, dir_space.free);
+    tr_variantDictAddInt(args_out, TR_KEY_total_size, dir_space.total);
+    return err;
 }
 
 /***
 ****
 ***/
 
-static char const* sessionSet(
+static char const* sessionClose(
     tr_session* session,
-    tr_variant* args_in,
+    tr_variant* /*args_in*/,
     tr_variant* /*args_out*/,
     tr_rpc_idle_data* /*idle_data*/)
 {
-    auto download_dir = std::string_view{};
-    auto incomplete_dir = std::string_view{};
+    notify(session, TR_RPC_SESSION_CLOSE, nullptr);
+    return nullptr;
+}
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_download_dir, &download_dir) && tr_sys_path_is_relative(download_dir))
-    {
-        return "download directory path is not absolute";
-    }
+/***
+****
+***/
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_incomplete_dir, &incomplete_dir) && tr_sys_path_is_relative(incomplete_dir))
-    {
-        return "incomplete torrents directory path is not absolute";
-    }
+using handler = char const* (*)(tr_session*, tr_variant*, tr_variant*, struct tr_rpc_idle_data*);
 
-    auto boolVal = bool{};
-    auto d = double{};
-    auto i = int64_t{};
-    auto sv = std::string_view{};
+struct rpc_method
+{
+    std::string_view name;
+    bool immediate;
+    handler func;
+};
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_cache_size_mb, &i))
-    {
-        tr_sessionSetCacheLimit_MB(session, i);
-    }
+static auto constexpr Methods = std::array<rpc_method, 22>{ {
+    { "blocklist-update"sv, false, blocklistUpdate },
+    { "free-space"sv, true, freeSpace },
+    { "port-test"sv, false, portTest },
+    { "queue-move-bottom"sv, true, queueMoveBottom },
+    { "queue-move-down"sv, true, queueMoveDown },
+    { "queue-move-top"sv, true, queueMoveTop },
+    { "queue-move-up"sv, true, queueMoveUp },
+    { "session-close"sv, true, sessionClose },
+    { "session-get"sv, true, sessionGet },
+    { "session-set"sv, true, sessionSet },
+    { "session-stats"sv, true, sessionStats },
+    { "torrent-add"sv, false, torrentAdd },
+    { "torrent-get"sv, true, torrentGet },
+    { "torrent-reannounce"sv, true, torrentReannounce },
+    { "torrent-remove"sv, true, torrentRemove },
+    { "torrent-rename-path"sv, false, torrentRenamePath },
+    { "torrent-set"sv, true, torrentSet },
+    { "torrent-set-location"sv, true, torrentSetLocation },
+    { "torrent-start"sv, true, torrentStart },
+    { "torrent-start-now"sv, true, torrentStartNow },
+    { "torrent-stop"sv, true, torrentStop },
+    { "torrent-verify"sv, true, torrentVerify },
+} };
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_up, &i))
+static void noop_response_callback(tr_session* /*session*/, tr_variant* /*response*/, void* /*user_data*/)
+{
+}
+
+void tr_rpc_request_exec_json(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_response_func callback,
+    void* callback_user_data)
+{
+    auto* const mutable_request = const_cast<tr_variant*>(request);
+    tr_variant* args_in = tr_variantDictFind(mutable_request, TR_KEY_arguments);
+    char const* result = nullptr;
+
+    if (callback == nullptr)
     {
-        tr_sessionSetAltSpeed_KBps(session, TR_UP, i);
+        callback = noop_response_callback;
     }
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_down, &i))
+    // parse the request's method name
+    auto sv = std::string_view{};
+    rpc_method const* method = nullptr;
+    if (!tr_variantDictFindStrView(mutable_request, TR_KEY_method, &sv))
     {
-        tr_sessionSetAltSpeed_KBps(session, TR_DOWN, i);
+        result = "no method name";
     }
-
-    if (tr_variantDictFindBool(args_in, TR_KEY_alt_speed_enabled, &boolVal))
+    else
     {
-        tr_sessionUseAltSpeed(session, boolVal);
+        auto const it = std::find_if(std::begin(Methods), std::end(Methods), [&sv](auto const& row) { return row.name == sv; });
+        if (it == std::end(Methods))
+        {
+            result = "method name not recognized";
+        }
+        else
+        {
+            method = &*it;
+        }
     }
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_time_begin, &i))
+    /* if we couldn't figure out which method to use, return an error */
+    if (result != nullptr)
     {
-        tr_sessionSetAltSpeedBegin(session, i);
-    }
+        auto response = tr_variant{};
+        tr_variantInitDict(&response, 3);
+        tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
+        tr_variantDictAddStr(&response, TR_KEY_result, result);
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_time_end, &i))
+        auto tag = int64_t{};
+        if (tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
+        {
+            tr_variantDictAddInt(&response, TR_KEY_tag, tag);
+        }
+
+        (*callback)(session, &response, callback_user_data);
+
+        tr_variantFree(&response);
+    }
+    else if (method->immediate)
     {
-        tr_sessionSetAltSpeedEnd(session, i);
+        auto response = tr_variant{};
+        tr_variantInitDict(&response, 3);
+        tr_variant* const args_out = tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
+        result = (*method->func)(session, args_in, args_out, nullptr);
+
+        if (result == nullptr)
+        {
+            result = "success";
+        }
+
+        tr_variantDictAddStr(&response, TR_KEY_result, result);
+
+        auto tag = int64_t{};
+        if (tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
+        {
+            tr_variantDictAddInt(&response, TR_KEY_tag, tag);
+        }
+
+        (*callback)(session, &response, callback_user_data);
+
+        tr_variantFree(&response);
     }
+    else
+    {
+        struct tr_rpc_idle_data* data = tr_new0(struct tr_rpc_idle_data, 1);
+        data->session = session;
+        data->response = tr_new0(tr_variant, 1);
+        tr_variantInitDict(data->response, 3);
+
+        auto tag = int64_t{};
+        if (tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
+        {
+            tr_variantDictAddInt(data->response, TR_KEY_tag, tag);
+        }
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_alt_speed_time_day, &i))
-    {
-        tr_sessionSetAltSpeedDay(session, tr_sched_day(i));
-    }
+        data->args_out = tr_variantDictAddDict(data->response, TR_KEY_arguments, 0);
+        data->callback = callback;
+        data->callback_user_data = callback_user_data;
+        result = (*method->func)(session, args_in, data->args_out, data);
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_alt_speed_time_enabled, &boolVal))
-    {
-        tr_sessionUseAltSpeedTime(session, boolVal);
+        /* Async operation failed prematurely? Invoke callback or else client will not get a reply */
+        if (result != nullptr)
+        {
+            tr_idle_function_done(data, result);
+        }
     }
+}
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_blocklist_enabled, &boolVal))
-    {
-        session->useBlocklist(boolVal);
-    }
+/***
+****  Methods whose large responses are streamed straight to JSON
+***/
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_blocklist_url, &sv))
-    {
-        session->setBlocklistUrl(sv);
-    }
+using stream_handler = char const* (*)(tr_session*, tr_variant*, tr_json_writer&);
 
-    if (!std::empty(download_dir))
-    {
-        session->setDownloadDir(download_dir);
-    }
+struct rpc_stream_method
+{
+    std::string_view name;
+    stream_handler func;
+};
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_queue_stalled_minutes, &i))
-    {
-        tr_sessionSetQueueStalledMinutes(session, i);
-    }
+static auto constexpr StreamMethods = std::array<rpc_stream_method, 2>{ {
+    { "session-get"sv, sessionGetStreamed },
+    { "torrent-get"sv, torrentGetStreamed },
+} };
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_queue_stalled_enabled, &boolVal))
-    {
-        tr_sessionSetQueueStalledEnabled(session, boolVal);
-    }
+struct rpc_buf_adapter
+{
+    tr_rpc_response_buf_func callback;
+    void* callback_user_data;
+};
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_download_queue_size, &i))
-    {
-        tr_sessionSetQueueSize(session, TR_DOWN, (int)i);
-    }
+static void rpc_buf_adapter_func(tr_session* session, tr_variant* response, void* user_data)
+{
+    auto* const adapter = static_cast<rpc_buf_adapter*>(user_data);
+    struct evbuffer* const buf = tr_variantToBuf(response, TR_VARIANT_FMT_JSON_LEAN);
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_download_queue_enabled, &boolVal))
-    {
-        tr_sessionSetQueueEnabled(session, TR_DOWN, boolVal);
-    }
+    (*adapter->callback)(session, buf, adapter->callback_user_data);
 
-    if (!std::empty(incomplete_dir))
-    {
-        session->setIncompleteDir(incomplete_dir);
-    }
+    evbuffer_free(buf);
+    delete adapter;
+}
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_incomplete_dir_enabled, &boolVal))
-    {
-        session->useIncompleteDir(boolVal);
-    }
+void tr_rpc_request_exec_json_buf(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_response_buf_func callback,
+    void* callback_user_data)
+{
+    auto* const mutable_request = const_cast<tr_variant*>(request);
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit_global, &i))
-    {
-        tr_sessionSetPeerLimit(session, i);
-    }
+    auto sv = std::string_view{};
+    auto const* const method = tr_variantDictFindStrView(mutable_request, TR_KEY_method, &sv) ?
+        std::find_if(std::begin(StreamMethods), std::end(StreamMethods), [&sv](auto const& row) { return row.name == sv; }) :
+        std::end(StreamMethods);
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_peer_limit_per_torrent, &i))
+    if (method == std::end(StreamMethods))
     {
-        tr_sessionSetPeerLimitPerTorrent(session, i);
+        auto* const adapter = new rpc_buf_adapter{ callback, callback_user_data };
+        tr_rpc_request_exec_json(session, request, rpc_buf_adapter_func, adapter);
+        return;
     }
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_pex_enabled, &boolVal))
-    {
-        tr_sessionSetPexEnabled(session, boolVal);
-    }
+    // same output as tr_variantToBuf(TR_VARIANT_FMT_JSON_LEAN) would give,
+    // but without building the whole response in memory first
+    struct evbuffer* const buf = evbuffer_new();
+    auto out = tr_json_writer{ buf };
+    out.startObject();
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_dht_enabled, &boolVal))
-    {
-        tr_sessionSetDHTEnabled(session, boolVal);
-    }
+    out.key(TR_KEY_arguments);
+    out.startObject();
+    char const* const result = (*method->func)(session, tr_variantDictFind(mutable_request, TR_KEY_arguments), out);
+    out.endObject();
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_utp_enabled, &boolVal))
-    {
-        tr_sessionSetUTPEnabled(session, boolVal);
-    }
+    out.key(TR_KEY_result);
+    out.addStr(result != nullptr ? result : "success");
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_lpd_enabled, &boolVal))
+    auto tag = int64_t{};
+    if (tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
     {
-        tr_sessionSetLPDEnabled(session, boolVal);
+        out.key(TR_KEY_tag);
+        out.addInt(tag);
     }
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_peer_port_random_on_start, &boolVal))
-    {
-        tr_sessionSetPeerPortRandomOnStart(session, boolVal);
-    }
+    out.endObject();
+    out.flush();
+    evbuffer_add(buf, "\n", 1);
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_peer_port, &i))
+    if (callback != nullptr)
     {
-        tr_sessionSetPeerPort(session, i);
+        (*callback)(session, buf, callback_user_data);
     }
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_port_forwarding_enabled, &boolVal))
-    {
-        tr_sessionSetPortForwardingEnabled(session, boolVal);
-    }
+    evbuffer_free(buf);
+}
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_rename_partial_files, &boolVal))
-    {
-        tr_sessionSetIncompleteFileNamingEnabled(session, boolVal);
-    }
+/***
+****  The event stream
+***/
 
-    if (tr_variantDictFindReal(args_in, TR_KEY_seedRatioLimit, &d))
+void tr_rpc_write_event(
+    tr_session* session,
+    tr_rpc_event_cursor& cursor,
+    tr_quark const* fields,
+    size_t n_fields,
+    struct evbuffer* buf)
+{
+    // the same request as a client polling with a "change-token" would make.
+    // The activity journal only tracks activity, not e.g. settings changes,
+    // so it's just used to learn which torrents were removed.
+    auto args = tr_variant{};
+    tr_variantInitDict(&args, 2);
+    tr_variantDictAddInt(&args, TR_KEY_change_token, cursor.change_token);
+    tr_variant* const list = tr_variantDictAddList(&args, TR_KEY_fields, n_fields);
+    for (size_t i = 0; i < n_fields; ++i)
     {
-        tr_sessionSetRatioLimit(session, d);
+        tr_variantListAddQuark(list, fields[i]);
     }
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_seedRatioLimited, &boolVal))
+    auto& journal = session->activity_journal;
+    auto const sequence = journal.markRead();
+    auto removed = std::vector<int>{};
+    if (cursor.change_token != 0) // a new stream has nothing to remove
     {
-        tr_sessionSetRatioLimited(session, boolVal);
+        if (auto changes = journal.changesSince(cursor.activity_sequence); changes)
+        {
+            removed = std::move(changes->removed);
+        }
     }
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_idle_seeding_limit, &i))
-    {
-        tr_sessionSetIdleLimit(session, i);
-    }
+    auto out = tr_json_writer{ buf };
+    out.startObject(2);
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_idle_seeding_limit_enabled, &boolVal))
+    out.key(TR_KEY_torrent_get);
+    out.startObject();
+    torrentGetStreamed(session, &args, out);
+    out.key(TR_KEY_removed);
+    out.startArray(std::size(removed));
+    for (auto const id : removed)
     {
-        tr_sessionSetIdleLimited(session, boolVal);
+        out.addInt(id);
     }
+    out.endArray();
+    out.endObject();
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_start_added_torrents, &boolVal))
-    {
-        tr_sessionSetPaused(session, !boolVal);
-    }
+    auto stats = tr_variant{};
+    tr_variantInitDict(&stats, 11);
+    sessionStats(session, nullptr, &stats, nullptr);
+    out.key(TR_KEY_session_stats);
+    out.addVariant(&stats);
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_seed_queue_enabled, &boolVal))
-    {
-        tr_sessionSetQueueEnabled(session, TR_UP, boolVal);
-    }
+    out.endObject();
+    out.flush();
+    evbuffer_add(buf, "\n", 1);
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_seed_queue_size, &i))
-    {
-        tr_sessionSetQueueSize(session, TR_UP, (int)i);
-    }
+    tr_variantFree(&args);
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_script_torrent_added_filename, &sv))
-    {
-        session->setScript(TR_SCRIPT_ON_TORRENT_ADDED, sv);
-    }
+    cursor.activity_sequence = sequence;
+    cursor.change_token = session->field_version_clock;
+}
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_script_torrent_added_enabled, &boolVal))
-    {
-        session->useScript(TR_SCRIPT_ON_TORRENT_ADDED, boolVal);
-    }
+/***
+****  Read-only methods, answered on worker threads from a snapshot
+***/
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_script_torrent_done_filename, &sv))
-    {
-        session->setScript(TR_SCRIPT_ON_TORRENT_DONE, sv);
-    }
+// torrent-get fields that are kept in the snapshot. The big per-file,
+// per-piece and per-peer lists aren't, so asking for any of LiveFields
+// runs the request in the event thread instead.
+static auto constexpr SnapshotFields = std::array<tr_quark, 65>{
+    TR_KEY_activityDate,
+    TR_KEY_addedDate,
+    TR_KEY_bandwidthPriority,
+    TR_KEY_comment,
+    TR_KEY_corruptEver,
+    TR_KEY_creator,
+    TR_KEY_dateCreated,
+    TR_KEY_desiredAvailable,
+    TR_KEY_doneDate,
+    TR_KEY_downloadDir,
+    TR_KEY_downloadedEver,
+    TR_KEY_downloadLimit,
+    TR_KEY_downloadLimited,
+    TR_KEY_error,
+    TR_KEY_errorString,
+    TR_KEY_eta,
+    TR_KEY_file_count,
+    TR_KEY_hashString,
+    TR_KEY_haveUnchecked,
+    TR_KEY_haveValid,
+    TR_KEY_honorsSessionLimits,
+    TR_KEY_id,
+    TR_KEY_editDate,
+    TR_KEY_isFinished,
+    TR_KEY_isPrivate,
+    TR_KEY_isStalled,
+    TR_KEY_labels,
+    TR_KEY_leftUntilDone,
+    TR_KEY_manualAnnounceTime,
+    TR_KEY_maxConnectedPeers,
+    TR_KEY_metadataPercentComplete,
+    TR_KEY_name,
+    TR_KEY_percentDone,
+    TR_KEY_peer_limit,
+    TR_KEY_peersConnected,
+    TR_KEY_peersFrom,
+    TR_KEY_peersGettingFromUs,
+    TR_KEY_peersSendingToUs,
+    TR_KEY_pieceCount,
+    TR_KEY_pieceSize,
+    TR_KEY_preallocationProgress,
+    TR_KEY_primary_mime_type,
+    TR_KEY_queuePosition,
+    TR_KEY_etaIdle,
+    TR_KEY_rateDownload,
+    TR_KEY_rateUpload,
+    TR_KEY_recheckProgress,
+    TR_KEY_seedIdleLimit,
+    TR_KEY_seedIdleMode,
+    TR_KEY_seedRatioLimit,
+    TR_KEY_seedRatioMode,
+    TR_KEY_sizeWhenDone,
+    TR_KEY_startDate,
+    TR_KEY_status,
+    TR_KEY_secondsDownloading,
+    TR_KEY_secondsSeeding,
+    TR_KEY_trackers,
+    TR_KEY_torrentFile,
+    TR_KEY_totalSize,
+    TR_KEY_uploadedEver,
+    TR_KEY_uploadLimit,
+    TR_KEY_uploadLimited,
+    TR_KEY_uploadRatio,
+    TR_KEY_webseeds,
+    TR_KEY_webseedsSendingToUs,
+};
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_script_torrent_done_enabled, &boolVal))
-    {
-        session->useScript(TR_SCRIPT_ON_TORRENT_DONE, boolVal);
-    }
+static auto constexpr LiveFields = std::array<tr_quark, 9>{
+    TR_KEY_files,
+    TR_KEY_fileStats,
+    TR_KEY_magnetLink,
+    TR_KEY_peers,
+    TR_KEY_pieces,
+    TR_KEY_priorities,
+    TR_KEY_source,
+    TR_KEY_trackerStats,
+    TR_KEY_wanted,
+};
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_trash_original_torrent_files, &boolVal))
-    {
-        tr_sessionSetDeleteSource(session, boolVal);
-    }
+using SnapshotFieldSet = std::bitset<std::size(SnapshotFields)>;
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_speed_limit_down, &i))
-    {
-        tr_sessionSetSpeedLimit_KBps(session, TR_DOWN, i);
-    }
+// how stale a snapshot's answers may be
+static auto constexpr SnapshotMaxAgeMsec = uint64_t{ 1000 };
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_speed_limit_down_enabled, &boolVal))
-    {
-        tr_sessionLimitSpeed(session, TR_DOWN, boolVal);
-    }
+// how long a settings field stays in snapshots after torrent-get last asked for it
+static auto constexpr WantedFieldMaxAgeMsec = uint64_t{ 5 * 60 * 1000 };
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_speed_limit_up, &i))
+/**
+ * An immutable copy of everything that the read-only methods report,
+ * made in the event thread and shared with the workers.
+ *
+ * Making it only copies each torrent's tr_stat. The workers pick out
+ * the fields and write the JSON. The settings fields are the exception,
+ * since they'd take more than a copy: they're kept as ready-made JSON,
+ * and carried over from the previous snapshot until the torrent's
+ * settings_version changes. A quiet torrent's tr_stat can't change while
+ * its tr_field_versions::Stamp stays the same, so it's carried over too.
+ */
+struct tr_rpc_snapshot
+{
+    struct Settings
     {
-        tr_sessionSetSpeedLimit_KBps(session, TR_UP, i);
-    }
+        uint32_t settings_version = 0;
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_speed_limit_up_enabled, &boolVal))
-    {
-        tr_sessionLimitSpeed(session, TR_UP, boolVal);
-    }
+        // which settings fields there are values for
+        SnapshotFieldSet fields;
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_encryption, &sv))
-    {
-        if (sv == "required"sv)
-        {
-            tr_sessionSetEncryption(session, TR_ENCRYPTION_REQUIRED);
-        }
-        else if (sv == "tolerated"sv)
-        {
-            tr_sessionSetEncryption(session, TR_CLEAR_PREFERRED);
-        }
-        else
+        // the values of those fields, back to back
+        std::string json;
+        std::array<uint32_t, std::size(SnapshotFields) + 1> offsets = {};
+
+        [[nodiscard]] std::string_view value(size_t i) const
         {
-            tr_sessionSetEncryption(session, TR_ENCRYPTION_PREFERRED);
+            return std::string_view{ json }.substr(offsets[i], offsets[i + 1] - offsets[i]);
         }
-    }
+    };
 
-    if (tr_variantDictFindInt(args_in, TR_KEY_anti_brute_force_threshold, &i))
+    struct Torrent
     {
-        tr_sessionSetAntiBruteForceThreshold(session, i);
-    }
+        int id = 0;
+        std::string hash_string;
+        tr_field_versions::Stamp stamp;
+        std::shared_ptr<Settings const> settings;
 
-    if (tr_variantDictFindBool(args_in, TR_KEY_anti_brute_force_enabled, &boolVal))
-    {
-        tr_sessionSetAntiBruteForceEnabled(session, boolVal);
-    }
+        // a copy of tr_torrentStat(), whose errorString points to `error_string`
+        tr_stat stat = {};
+        std::string error_string;
+    };
 
-    notify(session, TR_RPC_SESSION_CHANGED, nullptr);
+    uint64_t time_msec = 0;
 
-    return nullptr;
-}
+    // which settings fields the torrents have values for
+    SnapshotFieldSet fields;
 
-static char const* sessionStats(
-    tr_session* session,
-    tr_variant* /*args_in*/,
-    tr_variant* args_out,
-    tr_rpc_idle_data* /*idle_data*/)
-{
-    auto currentStats = tr_session_stats{};
-    auto cumulativeStats = tr_session_stats{};
+    // in the same order as tr_session::torrents
+    std::vector<std::shared_ptr<Torrent const>> torrents;
+    std::unordered_map<int, size_t> by_id;
+    std::unordered_map<std::string_view, size_t> by_hash_string;
 
-    int const total = std::size(session->torrents);
-    int const running = std::count_if(
-        std::begin(session->torrents),
-        std::end(session->torrents),
-        [](auto const* tor) { return tor->isRunning; });
+    // session-get's arguments, less the braces and download-dir-free-space.
+    // The workers ask the disk for that themselves.
+    std::string session_fields;
+    std::string download_dir;
 
-    tr_sessionGetStats(session, &currentStats);
-    tr_sessionGetCumulativeStats(session, &cumulativeStats);
+    // session-stats' arguments
+    std::string session_stats;
+};
 
-    tr_variantDictAddInt(args_out, TR_KEY_activeTorrentCount, running);
-    tr_variantDictAddReal(args_out, TR_KEY_downloadSpeed, tr_sessionGetPieceSpeed_Bps(session, TR_DOWN));
-    tr_variantDictAddInt(args_out, TR_KEY_pausedTorrentCount, total - running);
-    tr_variantDictAddInt(args_out, TR_KEY_torrentCount, total);
-    tr_variantDictAddReal(args_out, TR_KEY_uploadSpeed, tr_sessionGetPieceSpeed_Bps(session, TR_UP));
+struct rpc_read_reply
+{
+    tr_rpc_response_buf_func callback;
+    void* callback_user_data;
+    struct evbuffer* buf;
+};
 
-    tr_variant* d = tr_variantDictAddDict(args_out, TR_KEY_cumulative_stats, 5);
-    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, cumulativeStats.downloadedBytes);
-    tr_variantDictAddInt(d, TR_KEY_filesAdded, cumulativeStats.filesAdded);
-    tr_variantDictAddInt(d, TR_KEY_secondsActive, cumulativeStats.secondsActive);
-    tr_variantDictAddInt(d, TR_KEY_sessionCount, cumulativeStats.sessionCount);
-    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, cumulativeStats.uploadedBytes);
+struct tr_rpc_readers
+{
+    tr_worker_pool workers{ std::clamp(size_t{ std::thread::hardware_concurrency() }, size_t{ 1 }, size_t{ 4 }) };
 
-    d = tr_variantDictAddDict(args_out, TR_KEY_current_stats, 5);
-    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, currentStats.downloadedBytes);
-    tr_variantDictAddInt(d, TR_KEY_filesAdded, currentStats.filesAdded);
-    tr_variantDictAddInt(d, TR_KEY_secondsActive, currentStats.secondsActive);
-    tr_variantDictAddInt(d, TR_KEY_sessionCount, currentStats.sessionCount);
-    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, currentStats.uploadedBytes);
+    std::shared_ptr<tr_rpc_snapshot const> snapshot;
 
-    return nullptr;
-}
+    // when torrent-get last asked for each of SnapshotFields.
+    // Only recently wanted settings fields are kept in snapshots.
+    std::array<uint64_t, std::size(SnapshotFields)> wanted_msec = {};
 
-static constexpr std::string_view getEncryptionModeString(tr_encryption_mode mode)
-{
-    switch (mode)
-    {
-    case TR_CLEAR_PREFERRED:
-        return "tolerated"sv;
+    // true if a request may have changed something since the snapshot was made
+    bool snapshot_stale = false;
 
-    case TR_ENCRYPTION_REQUIRED:
-        return "required"sv;
+    // finished responses that are waiting for the event thread
+    std::mutex replies_mutex;
+    std::vector<rpc_read_reply> replies;
+};
 
-    default:
-        return "preferred"sv;
-    }
+static std::string toJson(struct evbuffer* buf)
+{
+    auto ret = std::string(evbuffer_get_length(buf), '\0');
+    evbuffer_remove(buf, std::data(ret), std::size(ret));
+    return ret;
+}
+
+static bool isSnapshotSettingsField(size_t i)
+{
+    return isSettingsField(SnapshotFields[i]);
 }
 
-static void addSessionField(tr_session* s, tr_variant* d, tr_quark key)
+/** @return the settings fields that torrent-get asked for in the last WantedFieldMaxAgeMsec */
+static SnapshotFieldSet getWantedFields(tr_rpc_readers const* readers, uint64_t now)
 {
-    switch (key)
-    {
-    case TR_KEY_alt_speed_up:
-        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeed_KBps(s, TR_UP));
-        break;
+    auto fields = SnapshotFieldSet{};
 
-    case TR_KEY_alt_speed_down:
-        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeed_KBps(s, TR_DOWN));
-        break;
+    for (size_t i = 0; i < std::size(SnapshotFields); ++i)
+    {
+        auto const asked = readers->wanted_msec[i];
+        fields[i] = asked != 0 && now - asked < WantedFieldMaxAgeMsec && isSnapshotSettingsField(i);
+    }
 
-    case TR_KEY_alt_speed_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionUsesAltSpeed(s));
-        break;
+    return fields;
+}
 
-    case TR_KEY_alt_speed_time_begin:
-        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeedBegin(s));
-        break;
+static std::shared_ptr<tr_rpc_snapshot::Settings const> makeSnapshotSettings(
+    tr_torrent* tor,
+    SnapshotFieldSet const& fields,
+    struct evbuffer* scratch)
+{
+    auto ret = std::make_shared<tr_rpc_snapshot::Settings>();
+    ret->settings_version = tor->settings_version;
+    ret->fields = fields;
 
-    case TR_KEY_alt_speed_time_end:
-        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeedEnd(s));
-        break;
+    tr_info const* const inf = tr_torrentInfo(tor);
 
-    case TR_KEY_alt_speed_time_day:
-        tr_variantDictAddInt(d, key, tr_sessionGetAltSpeedDay(s));
-        break;
+    for (size_t i = 0; i < std::size(SnapshotFields); ++i)
+    {
+        if (fields[i])
+        {
+            // a new writer for each value, so that no commas are added
+            auto out = tr_json_writer{ scratch };
+            auto child = tr_variant{};
+            tr_variantInitInt(&child, 0);
+            initField(tor, inf, nullptr, &child, SnapshotFields[i]);
+            out.addVariant(&child);
+        }
 
-    case TR_KEY_alt_speed_time_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionUsesAltSpeedTime(s));
-        break;
+        ret->offsets[i + 1] = evbuffer_get_length(scratch);
+    }
 
-    case TR_KEY_blocklist_enabled:
-        tr_variantDictAddBool(d, key, s->useBlocklist());
-        break;
+    ret->json = toJson(scratch);
+    return ret;
+}
 
-    case TR_KEY_blocklist_url:
-        tr_variantDictAddStr(d, key, s->blocklistUrl());
-        break;
+static std::shared_ptr<tr_rpc_snapshot::Torrent const> makeSnapshotTorrent(
+    tr_torrent* tor,
+    tr_field_versions::Stamp const& stamp,
+    std::shared_ptr<tr_rpc_snapshot::Settings const> settings)
+{
+    auto ret = std::make_shared<tr_rpc_snapshot::Torrent>();
+    ret->id = tor->uniqueId;
+    ret->hash_string = tor->info.hashString;
+    ret->stamp = stamp;
+    ret->settings = std::move(settings);
 
-    case TR_KEY_cache_size_mb:
-        tr_variantDictAddInt(d, key, tr_sessionGetCacheLimit_MB(s));
-        break;
+    ret->stat = *tr_torrentStat(tor);
+    ret->error_string = ret->stat.errorString;
+    ret->stat.errorString = ret->error_string.c_str();
 
-    case TR_KEY_blocklist_size:
-        tr_variantDictAddInt(d, key, tr_blocklistGetRuleCount(s));
-        break;
+    return ret;
+}
 
-    case TR_KEY_config_dir:
-        tr_variantDictAddStr(d, key, tr_sessionGetConfigDir(s));
-        break;
+static void snapshotSession(tr_session* session, tr_rpc_snapshot& snap, struct evbuffer* scratch)
+{
+    {
+        auto out = tr_json_writer{ scratch };
+        out.startObject();
+        for (tr_quark key = TR_KEY_NONE + 1; key < TR_N_KEYS; ++key)
+        {
+            if (key != TR_KEY_download_dir_free_space)
+            {
+                writeSessionField(session, out, key);
+            }
+        }
+        out.endObject();
+    }
 
-    case TR_KEY_download_dir:
-        tr_variantDictAddStr(d, key, s->downloadDir());
-        break;
+    snap.session_fields = toJson(scratch);
+    snap.session_fields = snap.session_fields.substr(1, std::size(snap.session_fields) - 2);
+    snap.download_dir = session->downloadDir();
 
-    case TR_KEY_download_dir_free_space:
-        tr_variantDictAddInt(d, key, tr_dirSpace(s->downloadDir()).free);
-        break;
+    auto stats = tr_variant{};
+    tr_variantInitDict(&stats, 11);
+    sessionStats(session, nullptr, &stats, nullptr);
+    auto len = size_t{};
+    char* const str = tr_variantToStr(&stats, TR_VARIANT_FMT_JSON_LEAN, &len);
+    snap.session_stats = tr_strvStrip({ str, len });
+    tr_free(str);
+    tr_variantFree(&stats);
+}
 
-    case TR_KEY_download_queue_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionGetQueueEnabled(s, TR_DOWN));
-        break;
+/** @return a snapshot no older than SnapshotMaxAgeMsec, making one if needed */
+static std::shared_ptr<tr_rpc_snapshot const> getSnapshot(tr_session* session, tr_rpc_readers* readers)
+{
+    auto const now = tr_time_msec();
+    auto const old = readers->snapshot;
+    auto const fields = getWantedFields(readers, now);
 
-    case TR_KEY_download_queue_size:
-        tr_variantDictAddInt(d, key, tr_sessionGetQueueSize(s, TR_DOWN));
-        break;
+    // true if `have` has values for all of `fields`
+    auto const covers = [&fields](SnapshotFieldSet const& have)
+    {
+        return (fields & ~have).none();
+    };
 
-    case TR_KEY_peer_limit_global:
-        tr_variantDictAddInt(d, key, tr_sessionGetPeerLimit(s));
-        break;
+    if (old && !readers->snapshot_stale && now - old->time_msec < SnapshotMaxAgeMsec && covers(old->fields))
+    {
+        return old;
+    }
 
-    case TR_KEY_peer_limit_per_torrent:
-        tr_variantDictAddInt(d, key, tr_sessionGetPeerLimitPerTorrent(s));
-        break;
+    auto snap = std::make_shared<tr_rpc_snapshot>();
+    snap->time_msec = now;
+    snap->fields = fields;
 
-    case TR_KEY_incomplete_dir:
-        tr_variantDictAddStr(d, key, s->incompleteDir());
-        break;
+    auto const n = std::size(session->torrents);
+    snap->torrents.reserve(n);
+    snap->by_id.reserve(n);
+    snap->by_hash_string.reserve(n);
 
-    case TR_KEY_incomplete_dir_enabled:
-        tr_variantDictAddBool(d, key, s->useIncompleteDir());
-        break;
+    struct evbuffer* const scratch = evbuffer_new();
 
-    case TR_KEY_pex_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsPexEnabled(s));
-        break;
+    for (auto* tor : session->torrents)
+    {
+        auto const stamp = getStamp(tor);
+        auto entry = std::shared_ptr<tr_rpc_snapshot::Torrent const>{};
+        auto settings = std::shared_ptr<tr_rpc_snapshot::Settings const>{};
 
-    case TR_KEY_utp_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsUTPEnabled(s));
-        break;
+        if (old)
+        {
+            if (auto const it = old->by_id.find(tor->uniqueId); it != std::end(old->by_id))
+            {
+                auto const& old_entry = old->torrents[it->second];
 
-    case TR_KEY_dht_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsDHTEnabled(s));
-        break;
+                if (old_entry->settings->settings_version == tor->settings_version && covers(old_entry->settings->fields))
+                {
+                    settings = old_entry->settings;
 
-    case TR_KEY_lpd_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsLPDEnabled(s));
-        break;
+                    if (stamp.quiet && old_entry->stamp == stamp)
+                    {
+                        entry = old_entry;
+                    }
+                }
+            }
+        }
 
-    case TR_KEY_peer_port:
-        tr_variantDictAddInt(d, key, tr_sessionGetPeerPort(s));
-        break;
+        if (!entry)
+        {
+            if (!settings)
+            {
+                settings = makeSnapshotSettings(tor, fields, scratch);
+            }
 
-    case TR_KEY_peer_port_random_on_start:
-        tr_variantDictAddBool(d, key, tr_sessionGetPeerPortRandomOnStart(s));
-        break;
+            entry = makeSnapshotTorrent(tor, stamp, std::move(settings));
+        }
 
-    case TR_KEY_port_forwarding_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsPortForwardingEnabled(s));
-        break;
+        snap->by_id.try_emplace(entry->id, std::size(snap->torrents));
+        snap->by_hash_string.try_emplace(entry->hash_string, std::size(snap->torrents));
+        snap->torrents.push_back(std::move(entry));
+    }
 
-    case TR_KEY_rename_partial_files:
-        tr_variantDictAddBool(d, key, tr_sessionIsIncompleteFileNamingEnabled(s));
-        break;
+    snapshotSession(session, *snap, scratch);
+    evbuffer_free(scratch);
 
-    case TR_KEY_rpc_version:
-        tr_variantDictAddInt(d, key, RPC_VERSION);
-        break;
+    readers->snapshot = snap;
+    readers->snapshot_stale = false;
+    return snap;
+}
 
-    case TR_KEY_rpc_version_semver:
-        tr_variantDictAddStrView(d, key, RPC_VERSION_SEMVER);
-        break;
+/**
+ * A read-only request, with everything that the worker needs
+ * to answer it copied out of the tr_variant request.
+ */
+struct rpc_read_request
+{
+    enum class Method
+    {
+        FreeSpace,
+        SessionGet,
+        SessionStats,
+        TorrentGet
+    };
+
+    Method method;
+    std::optional<int64_t> tag;
+    std::shared_ptr<tr_rpc_snapshot const> snapshot;
+
+    // torrent-get
+    tr_format format = TR_FORMAT_OBJECT;
+    bool have_fields = false;
+    std::vector<tr_quark> keys;
+    std::vector<int> slots; // each key's index in SnapshotFields, or -1
+    bool all_torrents = false;
+    std::vector<tr_rpc_snapshot::Torrent const*> torrents;
+
+    // free-space
+    std::optional<std::string> path;
+
+    tr_rpc_response_buf_func callback = nullptr;
+    void* callback_user_data = nullptr;
+};
 
-    case TR_KEY_rpc_version_minimum:
-        tr_variantDictAddInt(d, key, RPC_VERSION_MIN);
-        break;
+static bool isReadOnlyMethod(std::string_view name)
+{
+    return name == "free-space"sv || name == "session-get"sv || name == "session-stats"sv || name == "torrent-get"sv;
+}
 
-    case TR_KEY_seedRatioLimit:
-        tr_variantDictAddReal(d, key, tr_sessionGetRatioLimit(s));
-        break;
+/** @return the method, if the request can be answered by a worker */
+static std::optional<rpc_read_request::Method> getReadMethod(std::string_view name, tr_variant* args_in)
+{
+    auto sv = std::string_view{};
 
-    case TR_KEY_seedRatioLimited:
-        tr_variantDictAddBool(d, key, tr_sessionIsRatioLimited(s));
-        break;
+    if (name == "free-space"sv)
+    {
+        return rpc_read_request::Method::FreeSpace;
+    }
 
-    case TR_KEY_idle_seeding_limit:
-        tr_variantDictAddInt(d, key, tr_sessionGetIdleLimit(s));
-        break;
+    if (name == "session-stats"sv)
+    {
+        return rpc_read_request::Method::SessionStats;
+    }
 
-    case TR_KEY_idle_seeding_limit_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsIdleLimited(s));
-        break;
+    if (name == "session-get"sv)
+    {
+        // picking out fields is cheap enough to do here
+        if (tr_variantDictFind(args_in, TR_KEY_fields) != nullptr)
+        {
+            return {};
+        }
 
-    case TR_KEY_seed_queue_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionGetQueueEnabled(s, TR_UP));
-        break;
+        return rpc_read_request::Method::SessionGet;
+    }
 
-    case TR_KEY_seed_queue_size:
-        tr_variantDictAddInt(d, key, tr_sessionGetQueueSize(s, TR_UP));
-        break;
+    if (name != "torrent-get"sv || tr_variantDictFind(args_in, TR_KEY_change_token) != nullptr ||
+        (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv) || hasSelection(args_in))
+    {
+        return {};
+    }
 
-    case TR_KEY_start_added_torrents:
-        tr_variantDictAddBool(d, key, !tr_sessionGetPaused(s));
-        break;
+    tr_variant* fields = nullptr;
+    if (tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
+    {
+        for (size_t i = 0, n = tr_variantListSize(fields); i < n; ++i)
+        {
+            if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
+            {
+                continue;
+            }
 
-    case TR_KEY_trash_original_torrent_files:
-        tr_variantDictAddBool(d, key, tr_sessionGetDeleteSource(s));
-        break;
+            if (auto const key = tr_quark_lookup(sv);
+                key && std::find(std::begin(LiveFields), std::end(LiveFields), *key) != std::end(LiveFields))
+            {
+                return {};
+            }
+        }
+    }
 
-    case TR_KEY_speed_limit_up:
-        tr_variantDictAddInt(d, key, tr_sessionGetSpeedLimit_KBps(s, TR_UP));
-        break;
+    return rpc_read_request::Method::TorrentGet;
+}
 
-    case TR_KEY_speed_limit_up_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsSpeedLimited(s, TR_UP));
-        break;
+/** @brief like getTorrents(), but looks in the snapshot */
+static void getSnapshotTorrents(tr_variant* args_in, rpc_read_request& req)
+{
+    auto const& snap = *req.snapshot;
 
-    case TR_KEY_speed_limit_down:
-        tr_variantDictAddInt(d, key, tr_sessionGetSpeedLimit_KBps(s, TR_DOWN));
-        break;
+    auto const find_id = [&snap, &req](int64_t id)
+    {
+        if (auto const it = snap.by_id.find(id); it != std::end(snap.by_id))
+        {
+            req.torrents.push_back(snap.torrents[it->second].get());
+        }
+    };
 
-    case TR_KEY_speed_limit_down_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsSpeedLimited(s, TR_DOWN));
-        break;
+    auto const find_hash_string = [&snap, &req](std::string_view hash_string)
+    {
+        auto lowercase = std::string{ hash_string };
+        std::transform(std::begin(lowercase), std::end(lowercase), std::begin(lowercase), [](auto ch) { return tolower(ch); });
 
-    case TR_KEY_script_torrent_added_filename:
-        tr_variantDictAddStr(d, key, tr_sessionGetScript(s, TR_SCRIPT_ON_TORRENT_ADDED));
-        break;
+        if (auto const it = snap.by_hash_string.find(lowercase); it != std::end(snap.by_hash_string))
+        {
+            req.torrents.push_back(snap.torrents[it->second].get());
+        }
+    };
 
-    case TR_KEY_script_torrent_added_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsScriptEnabled(s, TR_SCRIPT_ON_TORRENT_ADDED));
-        break;
+    auto id = int64_t{};
+    auto sv = std::string_view{};
+    tr_variant* ids = nullptr;
 
-    case TR_KEY_script_torrent_done_filename:
-        tr_variantDictAddStr(d, key, tr_sessionGetScript(s, TR_SCRIPT_ON_TORRENT_DONE));
-        break;
+    if (tr_variantDictFindList(args_in, TR_KEY_ids, &ids))
+    {
+        for (size_t i = 0, n = tr_variantListSize(ids); i < n; ++i)
+        {
+            tr_variant const* const node = tr_variantListChild(ids, i);
 
-    case TR_KEY_script_torrent_done_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionIsScriptEnabled(s, TR_SCRIPT_ON_TORRENT_DONE));
-        break;
+            if (tr_variantGetInt(node, &id))
+            {
+                find_id(id);
+            }
+            else if (tr_variantGetStrView(node, &sv))
+            {
+                find_hash_string(sv);
+            }
+        }
+    }
+    else if (tr_variantDictFindInt(args_in, TR_KEY_ids, &id) || tr_variantDictFindInt(args_in, TR_KEY_id, &id))
+    {
+        find_id(id);
+    }
+    else if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv))
+    {
+        find_hash_string(sv);
+    }
+    else
+    {
+        req.all_torrents = true;
+    }
+}
 
-    case TR_KEY_queue_stalled_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionGetQueueStalledEnabled(s));
-        break;
+static void parseTorrentGetFields(tr_variant* args_in, rpc_read_request& req)
+{
+    auto sv = std::string_view{};
 
-    case TR_KEY_queue_stalled_minutes:
-        tr_variantDictAddInt(d, key, tr_sessionGetQueueStalledMinutes(s));
-        break;
+    if (tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv)
+    {
+        req.format = TR_FORMAT_TABLE;
+    }
 
-    case TR_KEY_anti_brute_force_enabled:
-        tr_variantDictAddBool(d, key, tr_sessionGetAntiBruteForceEnabled(s));
-        break;
+    tr_variant* fields = nullptr;
+    req.have_fields = tr_variantDictFindList(args_in, TR_KEY_fields, &fields);
 
-    case TR_KEY_anti_brute_force_threshold:
-        tr_variantDictAddInt(d, key, tr_sessionGetAntiBruteForceThreshold(s));
-        break;
+    for (size_t i = 0, n = tr_variantListSize(fields); i < n; ++i)
+    {
+        if (!tr_variantGetStrView(tr_variantListChild(fields, i), &sv))
+        {
+            continue;
+        }
 
-    case TR_KEY_units:
-        tr_formatter_get_units(tr_variantDictAddDict(d, key, 0));
-        break;
+        if (auto const key = tr_quark_lookup(sv); key)
+        {
+            auto const it = std::find(std::begin(SnapshotFields), std::end(SnapshotFields), *key);
+            req.keys.push_back(*key);
+            req.slots.push_back(it != std::end(SnapshotFields) ? int(it - std::begin(SnapshotFields)) : -1);
+        }
+    }
+}
 
-    case TR_KEY_version:
-        tr_variantDictAddStrView(d, key, LONG_VERSION_STRING);
-        break;
+static void writeSnapshotTorrent(rpc_read_request const& req, tr_rpc_snapshot::Torrent const& tor, tr_json_writer& out)
+{
+    if (req.format == TR_FORMAT_TABLE)
+    {
+        out.startArray();
+    }
+    else
+    {
+        out.startObject();
+    }
 
-    case TR_KEY_encryption:
-        tr_variantDictAddStr(d, key, getEncryptionModeString(tr_sessionGetEncryption(s)));
-        break;
+    for (size_t i = 0, n = std::size(req.keys); i < n; ++i)
+    {
+        if (req.format != TR_FORMAT_TABLE)
+        {
+            out.key(req.keys[i]);
+        }
 
-    case TR_KEY_session_id:
-        tr_variantDictAddStr(d, key, tr_session_id_get_current(s->session_id));
-        break;
+        // initField() leaves keys that aren't torrent fields as 0
+        if (auto const slot = req.slots[i]; slot < 0)
+        {
+            out.addInt(0);
+        }
+        else if (isSnapshotSettingsField(slot))
+        {
+            out.addJson(tor.settings->value(slot));
+        }
+        else
+        {
+            auto child = tr_variant{};
+            tr_variantInitInt(&child, 0);
+            initStatField(&tor.stat, &child, SnapshotFields[slot]);
+            out.addVariant(&child);
+        }
+    }
+
+    if (req.format == TR_FORMAT_TABLE)
+    {
+        out.endArray();
+    }
+    else
+    {
+        out.endObject();
     }
 }
 
-static char const* sessionGet(tr_session* s, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+static char const* torrentGetFromSnapshot(rpc_read_request const& req, tr_json_writer& out)
 {
-    tr_variant* fields = nullptr;
-    if (tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
-    {
-        size_t const field_count = tr_variantListSize(fields);
+    out.key(TR_KEY_torrents);
+    out.startArray();
 
-        for (size_t i = 0; i < field_count; ++i)
+    if (req.have_fields)
+    {
+        if (req.format == TR_FORMAT_TABLE)
         {
-            auto field_name = std::string_view{};
-            if (tr_variantGetStrView(tr_variantListChild(fields, i), &field_name))
+            out.startArray();
+            for (auto const key : req.keys)
             {
-                continue;
+                out.addQuark(key);
             }
+            out.endArray();
+        }
 
-            auto const field_id = tr_quark_lookup(field_name);
-            if (field_id)
+        if (req.all_torrents)
+        {
+            for (auto const& tor : req.snapshot->torrents)
             {
-                addSessionField(s, args_out, *field_id);
+                writeSnapshotTorrent(req, *tor, out);
             }
         }
-    }
-    else
-    {
-        for (tr_quark field_id = TR_KEY_NONE + 1; field_id < TR_N_KEYS; ++field_id)
+        else
         {
-            addSessionField(s, args_out, field_id);
+            for (auto const* const tor : req.torrents)
+            {
+                writeSnapshotTorrent(req, *tor, out);
+            }
         }
     }
 
-    return nullptr;
+    out.endArray();
+
+    return req.have_fields ? nullptr : "no fields specified";
 }
 
-static char const* freeSpace(
-    tr_session* /*session*/,
-    tr_variant* args_in,
-    tr_variant* args_out,
-    tr_rpc_idle_data* /*idle_data*/)
+static struct evbuffer* execReadRequest(tr_session* session, rpc_read_request const& req)
 {
-    auto path = std::string_view{};
-
-    if (!tr_variantDictFindStrView(args_in, TR_KEY_path, &path))
+    if (req.method == rpc_read_request::Method::FreeSpace)
     {
-        return "directory path argument is missing";
+        // small enough to build the usual way
+        auto args_in = tr_variant{};
+        tr_variantInitDict(&args_in, 1);
+        if (req.path)
+        {
+            tr_variantDictAddStr(&args_in, TR_KEY_path, *req.path);
+        }
+
+        auto response = tr_variant{};
+        tr_variantInitDict(&response, 3);
+        tr_variant* const args_out = tr_variantDictAddDict(&response, TR_KEY_arguments, 3);
+        char const* const result = freeSpace(session, &args_in, args_out, nullptr);
+        tr_variantDictAddStr(&response, TR_KEY_result, result != nullptr ? result : "success");
+        if (req.tag)
+        {
+            tr_variantDictAddInt(&response, TR_KEY_tag, *req.tag);
+        }
+
+        struct evbuffer* const buf = tr_variantToBuf(&response, TR_VARIANT_FMT_JSON_LEAN);
+        tr_variantFree(&response);
+        tr_variantFree(&args_in);
+        return buf;
     }
 
-    if (tr_sys_path_is_relative(path))
+    // same output as tr_rpc_request_exec_json_buf()
+    struct evbuffer* const buf = evbuffer_new();
+    auto out = tr_json_writer{ buf };
+    out.startObject();
+
+    out.key(TR_KEY_arguments);
+    char const* result = nullptr;
+    switch (req.method)
     {
-        return "directory path is not absolute";
+    case rpc_read_request::Method::SessionGet:
+        {
+            auto const& snap = *req.snapshot;
+            auto args = std::string{ "{\"download-dir-free-space\":" };
+            args += std::to_string(tr_dirSpace(snap.download_dir).free);
+            args += ',';
+            args += snap.session_fields;
+            args += '}';
+            out.addJson(args);
+            break;
+        }
+
+    case rpc_read_request::Method::SessionStats:
+        out.addJson(req.snapshot->session_stats);
+        break;
+
+    default:
+        out.startObject();
+        result = torrentGetFromSnapshot(req, out);
+        out.endObject();
+        break;
     }
 
-    /* get the free space */
-    auto const old_errno = errno;
-    errno = 0;
-    auto const dir_space = tr_dirSpace(path);
-    char const* const err = dir_space.free < 0 || dir_space.total < 0 ? tr_strerror(errno) : nullptr;
-    errno = old_errno;
+    out.key(TR_KEY_result);
+    out.addStr(result != nullptr ? result : "success");
 
-    /* response */
-    tr_variantDictAddStr(args_out, TR_KEY_path, path);
-    tr_variantDictAddInt(args_out, TR_KEY_size_bytes, dir_space.free);
-    tr_variantDictAddInt(args_out, TR_KEY_total_size, dir_space.total);
-    return err;
-}
+    if (req.tag)
+    {
+        out.key(TR_KEY_tag);
+        out.addInt(*req.tag);
+    }
 
-/***
-****
-***/
+    out.endObject();
+    out.flush();
+    evbuffer_add(buf, "\n", 1);
+    return buf;
+}
 
-static char const* sessionClose(
-    tr_session* session,
-    tr_variant* /*args_in*/,
-    tr_variant* /*args_out*/,
-    tr_rpc_idle_data* /*idle_data*/)
+static void deliverReadReplies(void* vsession)
 {
-    notify(session, TR_RPC_SESSION_CLOSE, nullptr);
-    return nullptr;
-}
+    auto* const session = static_cast<tr_session*>(vsession);
+    auto* const readers = session->rpc_readers;
 
-/***
-****
-***/
+    if (readers == nullptr)
+    {
+        return;
+    }
 
-using handler = char const* (*)(tr_session*, tr_variant*, tr_variant*, struct tr_rpc_idle_data*);
+    auto replies = std::vector<rpc_read_reply>{};
 
-struct rpc_method
-{
-    std::string_view name;
-    bool immediate;
-    handler func;
-};
+    {
+        auto const lock = std::lock_guard(readers->replies_mutex);
+        replies.swap(readers->replies);
+    }
 
-static auto constexpr Methods = std::array<rpc_method, 22>{ {
-    { "blocklist-update"sv, false, blocklistUpdate },
-    { "free-space"sv, true, freeSpace },
-    { "port-test"sv, false, portTest },
-    { "queue-move-bottom"sv, true, queueMoveBottom },
-    { "queue-move-down"sv, true, queueMoveDown },
-    { "queue-move-top"sv, true, queueMoveTop },
-    { "queue-move-up"sv, true, queueMoveUp },
-    { "session-close"sv, true, sessionClose },
-    { "session-get"sv, true, sessionGet },
-    { "session-set"sv, true, sessionSet },
-    { "session-stats"sv, true, sessionStats },
-    { "torrent-add"sv, false, torrentAdd },
-    { "torrent-get"sv, true, torrentGet },
-    { "torrent-reannounce"sv, true, torrentReannounce },
-    { "torrent-remove"sv, true, torrentRemove },
-    { "torrent-rename-path"sv, false, torrentRenamePath },
-    { "torrent-set"sv, true, torrentSet },
-    { "torrent-set-location"sv, true, torrentSetLocation },
-    { "torrent-start"sv, true, torrentStart },
-    { "torrent-start-now"sv, true, torrentStartNow },
-    { "torrent-stop"sv, true, torrentStop },
-    { "torrent-verify"sv, true, torrentVerify },
-} };
+    for (auto const& reply : replies)
+    {
+        if (reply.callback != nullptr)
+        {
+            (*reply.callback)(session, reply.buf, reply.callback_user_data);
+        }
 
-static void noop_response_callback(tr_session* /*session*/, tr_variant* /*response*/, void* /*user_data*/)
-{
+        evbuffer_free(reply.buf);
+    }
 }
 
-void tr_rpc_request_exec_json(
+void tr_rpc_request_exec_json_buf_async(
     tr_session* session,
     tr_variant const* request,
-    tr_rpc_response_func callback,
+    tr_rpc_response_buf_func callback,
     void* callback_user_data)
 {
     auto* const mutable_request = const_cast<tr_variant*>(request);
-    tr_variant* args_in = tr_variantDictFind(mutable_request, TR_KEY_arguments);
-    char const* result = nullptr;
+    tr_variant* const args_in = tr_variantDictFind(mutable_request, TR_KEY_arguments);
 
-    if (callback == nullptr)
-    {
-        callback = noop_response_callback;
-    }
+    auto name = std::string_view{};
+    auto const has_name = tr_variantDictFindStrView(mutable_request, TR_KEY_method, &name);
+    auto const method = has_name ? getReadMethod(name, args_in) : std::nullopt;
 
-    // parse the request's method name
-    auto sv = std::string_view{};
-    rpc_method const* method = nullptr;
-    if (!tr_variantDictFindStrView(mutable_request, TR_KEY_method, &sv))
-    {
-        result = "no method name";
-    }
-    else
+    if (!method || session->isClosing())
     {
-        auto const it = std::find_if(std::begin(Methods), std::end(Methods), [&sv](auto const& row) { return row.name == sv; });
-        if (it == std::end(Methods))
-        {
-            result = "method name not recognized";
-        }
-        else
+        if (session->rpc_readers != nullptr && !isReadOnlyMethod(name))
         {
-            method = &*it;
+            session->rpc_readers->snapshot_stale = true;
         }
+
+        tr_rpc_request_exec_json_buf(session, request, callback, callback_user_data);
+        return;
     }
 
-    /* if we couldn't figure out which method to use, return an error */
-    if (result != nullptr)
+    if (session->rpc_readers == nullptr)
     {
-        auto response = tr_variant{};
-        tr_variantInitDict(&response, 3);
-        tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
-        tr_variantDictAddStr(&response, TR_KEY_result, result);
-
-        auto tag = int64_t{};
-        if (tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
-        {
-            tr_variantDictAddInt(&response, TR_KEY_tag, tag);
-        }
+        session->rpc_readers = new tr_rpc_readers{};
+    }
 
-        (*callback)(session, &response, callback_user_data);
+    auto* const readers = session->rpc_readers;
+    auto req = std::make_shared<rpc_read_request>();
+    req->method = *method;
+    req->callback = callback;
+    req->callback_user_data = callback_user_data;
 
-        tr_variantFree(&response);
-    }
-    else if (method->immediate)
+    if (auto tag = int64_t{}; tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
     {
-        auto response = tr_variant{};
-        tr_variantInitDict(&response, 3);
-        tr_variant* const args_out = tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
-        result = (*method->func)(session, args_in, args_out, nullptr);
+        req->tag = tag;
+    }
 
-        if (result == nullptr)
+    if (*method == rpc_read_request::Method::FreeSpace)
+    {
+        if (auto path = std::string_view{}; tr_variantDictFindStrView(args_in, TR_KEY_path, &path))
         {
-            result = "success";
+            req->path = path;
         }
+    }
+    else if (*method == rpc_read_request::Method::TorrentGet)
+    {
+        parseTorrentGetFields(args_in, *req);
 
-        tr_variantDictAddStr(&response, TR_KEY_result, result);
-
-        auto tag = int64_t{};
-        if (tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
+        auto const now = tr_time_msec();
+        for (auto const slot : req->slots)
         {
-            tr_variantDictAddInt(&response, TR_KEY_tag, tag);
+            if (slot >= 0)
+            {
+                readers->wanted_msec[slot] = now;
+            }
         }
 
-        (*callback)(session, &response, callback_user_data);
-
-        tr_variantFree(&response);
+        req->snapshot = getSnapshot(session, readers);
+        getSnapshotTorrents(args_in, *req);
     }
     else
     {
-        struct tr_rpc_idle_data* data = tr_new0(struct tr_rpc_idle_data, 1);
-        data->session = session;
-        data->response = tr_new0(tr_variant, 1);
-        tr_variantInitDict(data->response, 3);
+        req->snapshot = getSnapshot(session, readers);
+    }
 
-        auto tag = int64_t{};
-        if (tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
+    readers->workers.run(
+        [session, readers, req]()
         {
-            tr_variantDictAddInt(data->response, TR_KEY_tag, tag);
-        }
+            auto* const buf = execReadRequest(session, *req);
 
-        data->args_out = tr_variantDictAddDict(data->response, TR_KEY_arguments, 0);
-        data->callback = callback;
-        data->callback_user_data = callback_user_data;
-        result = (*method->func)(session, args_in, data->args_out, data);
+            {
+                auto const lock = std::lock_guard(readers->replies_mutex);
+                readers->replies.push_back({ req->callback, req->callback_user_data, buf });
+            }
 
-        /* Async operation failed prematurely? Invoke callback or else client will not get a reply */
-        if (result != nullptr)
-        {
-            tr_idle_function_done(data, result);
-        }
+            tr_runInEventThread(session, deliverReadReplies, session);
+        });
+}
+
+void tr_rpc_readers_close(tr_session* session)
+{
+    auto* const readers = session->rpc_readers;
+
+    if (readers == nullptr)
+    {
+        return;
     }
+
+    readers->workers.wait();
+    deliverReadReplies(session);
+
+    session->rpc_readers = nullptr;
+    delete readers;
 }
 
 /**
@@ -8,19 +8,25 @@
 
 #pragma once
 
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
 #include <string_view>
 
 #include "transmission.h"
+#include "quark.h"
 #include "tr-macros.h"
 
 /***
 ****  RPC processing
 ***/
 
+struct evbuffer;
 struct tr_variant;
 
 using tr_rpc_response_func = void (*)(tr_session* session, tr_variant* response, void* user_data);
 
+using tr_rpc_response_buf_func = void (*)(tr_session* session, struct evbuffer* response, void* user_data);
+
 /* http://www.json.org/ */
 void tr_rpc_request_exec_json(
     tr_session* session,
@@ -28,6 +34,44 @@ void tr_rpc_request_exec_json(
     tr_rpc_response_func callback,
     void* callback_user_data);
 
+/* like tr_rpc_request_exec_json(), but the response is given as lean JSON.
+   torrent-get and session-get responses are written as they're generated */
+void tr_rpc_request_exec_json_buf(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_response_buf_func callback,
+    void* callback_user_data);
+
+/* like tr_rpc_request_exec_json_buf(), but read-only requests are answered
+   on a worker thread from a recent snapshot of the session, so that large
+   responses don't hold up the event loop. The callback is invoked in the
+   event thread, possibly after this returns */
+void tr_rpc_request_exec_json_buf_async(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_response_buf_func callback,
+    void* callback_user_data);
+
+/* wait for the RPC worker threads and deliver their pending responses */
+void tr_rpc_readers_close(tr_session* session);
+
+/* how far along an RPC event stream is. A default cursor is at the start */
+struct tr_rpc_event_cursor
+{
+    uint64_t activity_sequence = 0;
+    uint64_t change_token = 0;
+};
+
+/* write one line of the RPC event stream: the torrent-get arguments for the
+   `fields` of the torrents that changed after `cursor`, and the session-stats
+   arguments. `cursor` is moved past what was written */
+void tr_rpc_write_event(
+    tr_session* session,
+    tr_rpc_event_cursor& cursor,
+    tr_quark const* fields,
+    size_t n_fields,
+    struct evbuffer* buf);
+
 /* see the RPC spec's "Request URI Notation" section */
 void tr_rpc_request_exec_uri(
     tr_session* session,
@@ -7,6 +7,7 @@
  */
 
 #include <algorithm> // std::partial_sort(), std::min(), std::max()
+#include <atomic>
 #include <cerrno> /* ENOENT */
 #include <climits> /* INT_MAX */
 #include <csignal>
@@ -16,6 +17,10 @@
 #include <iterator> // std::back_inserter
 #include <list>
 #include <numeric> // std::acumulate()
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread> // std::thread::hardware_concurrency()
 #include <unordered_set>
 #include <vector>
 
@@ -42,13 +47,16 @@
 #include "fdlimit.h"
 #include "file.h"
 #include "log.h"
+#include "metainfo.h" /* tr_metainfoParse() */
 #include "net.h"
 #include "peer-io.h"
 #include "peer-mgr.h"
 #include "platform-quota.h" /* tr_device_info_free() */
 #include "platform.h" /* tr_getTorrentDir() */
 #include "port-forwarding.h"
+#include "resume.h" /* tr_torrentReadResume() */
 #include "rpc-server.h"
+#include "rpcimpl.h" /* tr_rpc_readers_close() */
 #include "session-id.h"
 #include "session.h"
 #include "stats.h"
@@ -64,6 +72,7 @@
 #include "verify.h"
 #include "version.h"
 #include "web.h"
+#include "worker-pool.h"
 
 using namespace std::literals;
 
@@ -78,6 +87,10 @@ static auto constexpr DefaultPrefetchEnabled = bool{ true };
 #endif
 static auto constexpr SaveIntervalSecs = int{ 360 };
 
+// stopped and seeding torrents unmap their piece hashes after this long unused
+static auto constexpr PieceHashIdleSecs = int{ 300 };
+static auto constexpr TimerWheelTickMsec = uint64_t{ 500 };
+
 #define dbgmsg(...) tr_logAddDeepNamed(nullptr, __VA_ARGS__)
 
 static tr_port getRandomPort(tr_session* s)
@@ -324,7 +337,7 @@ void tr_sessionGetDefaultSettings(tr_variant* d)
 {
     TR_ASSERT(tr_variantIsDict(d));
 
-    tr_variantDictReserve(d, 69);
+    tr_variantDictReserve(d, 70);
     tr_variantDictAddBool(d, TR_KEY_blocklist_enabled, false);
     tr_variantDictAddStrView(d, TR_KEY_blocklist_url, "http://www.example.com/blocklist"sv);
     tr_variantDictAddInt(d, TR_KEY_cache_size_mb, DefaultCacheSizeMB);
@@ -342,6 +355,7 @@ void tr_sessionGetDefaultSettings(tr_variant* d)
     tr_variantDictAddInt(d, TR_KEY_message_level, TR_LOG_INFO);
     tr_variantDictAddInt(d, TR_KEY_download_queue_size, 5);
     tr_variantDictAddBool(d, TR_KEY_download_queue_enabled, true);
+    tr_variantDictAddInt(d, TR_KEY_open_file_limit, TR_DEFAULT_OPEN_FILE_LIMIT);
     tr_variantDictAddInt(d, TR_KEY_peer_limit_global, atoi(TR_DEFAULT_PEER_LIMIT_GLOBAL_STR));
     tr_variantDictAddInt(d, TR_KEY_peer_limit_per_torrent, atoi(TR_DEFAULT_PEER_LIMIT_TORRENT_STR));
     tr_variantDictAddInt(d, TR_KEY_peer_port, atoi(TR_DEFAULT_PEER_PORT_STR));
@@ -359,9 +373,11 @@ void tr_sessionGetDefaultSettings(tr_variant* d)
     tr_variantDictAddReal(d, TR_KEY_ratio_limit, 2.0);
     tr_variantDictAddBool(d, TR_KEY_ratio_limit_enabled, false);
     tr_variantDictAddBool(d, TR_KEY_rename_partial_files, true);
+    tr_variantDictAddBool(d, TR_KEY_resume_journal_enabled, false);
     tr_variantDictAddBool(d, TR_KEY_rpc_authentication_required, false);
     tr_variantDictAddStrView(d, TR_KEY_rpc_bind_address, "0.0.0.0");
     tr_variantDictAddBool(d, TR_KEY_rpc_enabled, false);
+    tr_variantDictAddInt(d, TR_KEY_rpc_event_interval, tr_rpc_events::DefaultIntervalMsec);
     tr_variantDictAddStrView(d, TR_KEY_rpc_password, "");
     tr_variantDictAddStrView(d, TR_KEY_rpc_username, "");
     tr_variantDictAddStrView(d, TR_KEY_rpc_whitelist, TR_DEFAULT_RPC_WHITELIST);
@@ -400,7 +416,7 @@ void tr_sessionGetSettings(tr_session* s, tr_variant* d)
 {
     TR_ASSERT(tr_variantIsDict(d));
 
-    tr_variantDictReserve(d, 68);
+    tr_variantDictReserve(d, 69);
     tr_variantDictAddBool(d, TR_KEY_blocklist_enabled, s->useBlocklist());
     tr_variantDictAddStr(d, TR_KEY_blocklist_url, s->blocklistUrl());
     tr_variantDictAddInt(d, TR_KEY_cache_size_mb, tr_sessionGetCacheLimit_MB(s));
@@ -418,6 +434,7 @@ void tr_sessionGetSettings(tr_session* s, tr_variant* d)
     tr_variantDictAddStr(d, TR_KEY_incomplete_dir, tr_sessionGetIncompleteDir(s));
     tr_variantDictAddBool(d, TR_KEY_incomplete_dir_enabled, tr_sessionIsIncompleteDirEnabled(s));
     tr_variantDictAddInt(d, TR_KEY_message_level, tr_logGetLevel());
+    tr_variantDictAddInt(d, TR_KEY_open_file_limit, tr_fdGetFileLimit(s));
     tr_variantDictAddInt(d, TR_KEY_peer_limit_global, s->peerLimit);
     tr_variantDictAddInt(d, TR_KEY_peer_limit_per_torrent, s->peerLimitPerTorrent);
     tr_variantDictAddInt(d, TR_KEY_peer_port, tr_sessionGetPeerPort(s));
@@ -436,9 +453,11 @@ void tr_sessionGetSettings(tr_session* s, tr_variant* d)
     tr_variantDictAddReal(d, TR_KEY_ratio_limit, s->desiredRatio);
     tr_variantDictAddBool(d, TR_KEY_ratio_limit_enabled, s->isRatioLimited);
     tr_variantDictAddBool(d, TR_KEY_rename_partial_files, tr_sessionIsIncompleteFileNamingEnabled(s));
+    tr_variantDictAddBool(d, TR_KEY_resume_journal_enabled, s->resume_journal_ != nullptr);
     tr_variantDictAddBool(d, TR_KEY_rpc_authentication_required, tr_sessionIsRPCPasswordEnabled(s));
     tr_variantDictAddStr(d, TR_KEY_rpc_bind_address, tr_sessionGetRPCBindAddress(s));
     tr_variantDictAddBool(d, TR_KEY_rpc_enabled, tr_sessionIsRPCEnabled(s));
+    tr_variantDictAddInt(d, TR_KEY_rpc_event_interval, tr_rpcGetEventInterval(s->rpc_server_.get()));
     tr_variantDictAddStr(d, TR_KEY_rpc_password, tr_sessionGetRPCPassword(s));
     tr_variantDictAddInt(d, TR_KEY_rpc_port, tr_sessionGetRPCPort(s));
     tr_variantDictAddStr(d, TR_KEY_rpc_url, tr_sessionGetRPCUrl(s));
@@ -605,7 +624,6 @@ tr_session* tr_sessionInit(char const* configDir, bool messageQueuingEnabled, tr
     session->magicNumber = SESSION_MAGIC_NUMBER;
     session->session_id = tr_session_id_new();
     session->bandwidth = new Bandwidth(nullptr);
-    session->removed_torrents.clear();
 
     /* nice to start logging at the very beginning */
     auto i = int64_t{};
@@ -661,6 +679,8 @@ static void onNowTimer(evutil_socket_t /*fd*/, short /*what*/, void* vsession)
         turtleCheckClock(session, &session->turtle);
     }
 
+    auto const release_idle_piece_hashes = now % PieceHashIdleSecs == 0;
+
     // TODO: this seems a little silly. Why do we increment this
     // every second instead of computing the value as needed by
     // subtracting the current time from a start time?
@@ -677,6 +697,11 @@ static void onNowTimer(evutil_socket_t /*fd*/, short /*what*/, void* vsession)
                 ++tor->secondsDownloading;
             }
         }
+
+        if (release_idle_piece_hashes && (!tor->isRunning || tr_torrentIsSeed(tor)))
+        {
+            tor->releaseIdlePieceHashes(now - PieceHashIdleSecs);
+        }
     }
 
     /**
@@ -716,6 +741,8 @@ static void tr_sessionInitImpl(void* vdata)
     session->nowTimer = evtimer_new(session->event_base, onNowTimer, session);
     onNowTimer(0, 0, session);
 
+    session->timer_wheel_ = std::make_unique<tr_timer_wheel>(session->event_base, TimerWheelTickMsec);
+
 #ifndef _WIN32
     /* Don't exit when writing on a broken socket */
     signal(SIGPIPE, SIG_IGN);
@@ -725,6 +752,12 @@ static void tr_sessionInitImpl(void* vdata)
 
     tr_setConfigDir(session, data->configDir);
 
+    {
+        auto use_journal = false;
+        tr_variantDictFindBool(&settings, TR_KEY_resume_journal_enabled, &use_journal);
+        tr_resumeInit(session, use_journal);
+    }
+
     session->peerMgr = tr_peerMgrNew(session);
 
     session->shared = tr_sharedInit(session);
@@ -988,7 +1021,13 @@ static void sessionSetImpl(void* vdata)
 
     if (tr_variantDictFindInt(settings, TR_KEY_peer_limit_global, &i))
     {
-        session->peerLimit = i;
+        tr_sessionSetPeerLimit(session, i);
+    }
+
+    /* this depends on peerLimit, since peers need fds too */
+    if (tr_variantDictFindInt(settings, TR_KEY_open_file_limit, &i) && i > 0)
+    {
+        tr_fdSetFileLimit(session, i);
     }
 
     /**
@@ -1720,6 +1759,9 @@ void tr_sessionSetPeerLimit(tr_session* session, uint16_t n)
     TR_ASSERT(tr_isSession(session));
 
     session->peerLimit = n;
+
+    /* peers need fds too, so this changes how many files can be open */
+    tr_fdSetFileLimit(session, tr_fdGetFileLimit(session));
 }
 
 uint16_t tr_sessionGetPeerLimit(tr_session const* session)
@@ -1836,6 +1878,7 @@ static void sessionCloseImplStart(tr_session* session)
 
     tr_verifyClose(session);
     tr_sharedClose(session);
+    tr_rpc_readers_close(session);
     session->rpc_server_.reset();
 
     /* Close the torrents. Get the most active ones first so that
@@ -1859,6 +1902,9 @@ static void sessionCloseImplStart(tr_session* session)
 
     torrents.clear();
 
+    // make sure the torrents' resume data is on disk before we go
+    session->resume_writer_->wait();
+
     /* Close the announcer *after* closing the torrents
        so that all the &event=stopped messages will be
        queued to be sent by tr_announcerClose() */
@@ -1910,6 +1956,7 @@ static void sessionCloseImplFinish(tr_session* session)
 
     tr_statsClose(session);
     tr_peerMgrFree(session->peerMgr);
+    session->timer_wheel_.reset();
 
     closeBlocklists(session);
 
@@ -2008,87 +2055,241 @@ void tr_sessionClose(tr_session* session)
     delete session;
 }
 
+/***
+****  Loading the torrents at startup
+***/
+
+// Reading and parsing the .torrent and .resume files is most of the work
+// of loading a torrent, so that's done on worker threads. The rest touches
+// the session and is done in the event thread, a slice at a time so that
+// the event loop -- and RPC -- keeps running while a large session loads.
+
+static auto constexpr LoadSliceMsec = uint64_t{ 50 };
+static auto constexpr LoadWaitMsec = int{ 10 };
+static auto constexpr LoadProgressMsec = uint64_t{ 5000 };
+
+// a .torrent file from the torrents dir, once a worker has read it
+struct tr_torrent_preload
+{
+    std::optional<tr_metainfo_parsed> parsed;
+    tr_variant resume = {};
+    bool has_resume = false;
+    std::atomic<bool> ready = false;
+};
+
 struct sessionLoadTorrentsData
 {
     tr_session* session;
     tr_ctor* ctor;
-    int* setmeCount;
-    tr_torrent** torrents;
-    bool done;
+    std::vector<std::string> filenames;
+    std::vector<tr_torrent_preload> preloads;
+    std::vector<tr_torrent*> torrents;
+    size_t n_added = 0;
+    uint64_t last_progress_msec = 0;
+    struct event* timer = nullptr;
+    std::atomic<bool> done = false;
 };
 
-static void sessionLoadTorrents(void* vdata)
+static std::vector<std::string> getTorrentFilenames(tr_session const* session)
 {
-    auto* data = static_cast<struct sessionLoadTorrentsData*>(vdata);
-    TR_ASSERT(tr_isSession(data->session));
-
-    tr_ctorSetSave(data->ctor, false); /* since we already have them */
+    auto filenames = std::vector<std::string>{};
 
     tr_sys_path_info info;
-    char const* dirname = tr_getTorrentDir(data->session);
-    tr_sys_dir_t odir = (tr_sys_path_get_info(dirname, 0, &info, nullptr) && info.type == TR_SYS_PATH_IS_DIRECTORY) ?
+    char const* const dirname = tr_getTorrentDir(session);
+    tr_sys_dir_t const odir = (tr_sys_path_get_info(dirname, 0, &info, nullptr) &&
+                               info.type == TR_SYS_PATH_IS_DIRECTORY) ?
         tr_sys_dir_open(dirname, nullptr) :
         TR_BAD_SYS_DIR;
 
-    auto torrents = std::list<tr_torrent*>{};
     if (odir != TR_BAD_SYS_DIR)
     {
         char const* name = nullptr;
         auto const dirname_sv = std::string_view{ dirname };
-        auto path = std::string{};
         while ((name = tr_sys_dir_read_name(odir, nullptr)) != nullptr)
         {
             if (tr_str_has_suffix(name, ".torrent"))
             {
-                tr_buildBuf(path, dirname_sv, "/", name);
-                tr_ctorSetMetainfoFromFile(data->ctor, path.c_str());
-
-                tr_torrent* const tor = tr_torrentNew(data->ctor, nullptr, nullptr);
-                if (tor != nullptr)
-                {
-                    torrents.push_back(tor);
-                }
+                filenames.push_back(tr_strvJoin(dirname_sv, "/", name));
             }
         }
 
         tr_sys_dir_close(odir, nullptr);
     }
 
-    int const n = std::size(torrents);
-    data->torrents = tr_new(tr_torrent*, n);
-    std::copy(std::begin(torrents), std::end(torrents), data->torrents);
+    return filenames;
+}
+
+// runs in a worker thread, so it mustn't touch anything the event thread does
+static void preloadTorrent(tr_session const* session, std::string const& filename, tr_torrent_preload& preload)
+{
+    auto* const ctor = tr_ctorNew(nullptr);
+
+    if (tr_variant const* metainfo = nullptr;
+        tr_ctorSetMetainfoFromFile(ctor, filename.c_str()) == 0 && tr_ctorGetMetainfo(ctor, &metainfo))
+    {
+        if (auto parsed = tr_metainfoParse(session, metainfo, nullptr); parsed)
+        {
+            // the piece hashes can be read from the file when they're needed
+            if (auto offset = uint64_t{}; filename == parsed->info.torrent && tr_ctorGetPiecesOffset(ctor, &offset))
+            {
+                parsed->pieces.setSource(filename, offset);
+            }
+
+            preload.parsed.emplace(std::move(*parsed));
+        }
+    }
+
+    tr_ctorFree(ctor);
 
-    if (n != 0)
+    if (preload.parsed)
     {
-        tr_logAddInfo(_("Loaded %d torrents"), n);
+        preload.has_resume = tr_torrentReadResume(session, &preload.parsed->info, &preload.resume);
     }
 
-    if (data->setmeCount != nullptr)
+    preload.ready = true;
+}
+
+static void addPreloadedTorrent(sessionLoadTorrentsData* data, tr_torrent_preload& preload)
+{
+    if (!preload.parsed)
     {
-        *data->setmeCount = n;
+        return;
+    }
+
+    auto* const resume = preload.has_resume ? &preload.resume : nullptr;
+    tr_torrent* const tor = tr_torrentNewPreloaded(data->ctor, *preload.parsed, resume, nullptr, nullptr);
+    if (tor != nullptr)
+    {
+        data->torrents.push_back(tor);
+    }
+
+    preload.parsed.reset();
+    tr_variantFree(&preload.resume);
+}
+
+static void finishLoadingTorrents(sessionLoadTorrentsData* data)
+{
+    if (auto const n = std::size(data->torrents); n != 0)
+    {
+        tr_logAddInfo(_("Loaded %zu torrents"), n);
+    }
+
+    if (data->timer != nullptr)
+    {
+        event_free(data->timer);
+        data->timer = nullptr;
     }
 
     data->done = true;
 }
 
+// add the preloaded torrents, in directory order, for up to LoadSliceMsec
+static void onLoadTorrentsTimer(evutil_socket_t /*fd*/, short /*what*/, void* vdata)
+{
+    auto* const data = static_cast<sessionLoadTorrentsData*>(vdata);
+    auto const n_files = std::size(data->preloads);
+    auto const begin_msec = tr_time_msec();
+
+    while (data->n_added < n_files)
+    {
+        auto& preload = data->preloads[data->n_added];
+        if (!preload.ready)
+        {
+            tr_timerAddMsec(data->timer, LoadWaitMsec);
+            return;
+        }
+
+        addPreloadedTorrent(data, preload);
+        ++data->n_added;
+
+        if (tr_time_msec() - begin_msec >= LoadSliceMsec)
+        {
+            break;
+        }
+    }
+
+    if (data->n_added == n_files)
+    {
+        finishLoadingTorrents(data);
+        return;
+    }
+
+    if (auto const now = tr_time_msec(); now - data->last_progress_msec >= LoadProgressMsec)
+    {
+        tr_logAddInfo(_("Loaded %zu of %zu torrents"), data->n_added, n_files);
+        data->last_progress_msec = now;
+    }
+
+    // let the event loop run before the next slice
+    tr_timerAdd(data->timer, 0, 0);
+}
+
+static void startLoadingTorrents(void* vdata)
+{
+    auto* const data = static_cast<sessionLoadTorrentsData*>(vdata);
+    TR_ASSERT(tr_isSession(data->session));
+
+    data->last_progress_msec = tr_time_msec();
+    data->timer = evtimer_new(data->session->event_base, onLoadTorrentsTimer, data);
+    onLoadTorrentsTimer(0, 0, data);
+}
+
 tr_torrent** tr_sessionLoadTorrents(tr_session* session, tr_ctor* ctor, int* setmeCount)
 {
-    struct sessionLoadTorrentsData data;
+    TR_ASSERT(tr_isSession(session));
+
+    tr_ctorSetSave(ctor, false); /* since we already have them */
 
+    auto data = sessionLoadTorrentsData{};
     data.session = session;
     data.ctor = ctor;
-    data.setmeCount = setmeCount;
-    data.torrents = nullptr;
-    data.done = false;
+    data.filenames = getTorrentFilenames(session);
 
-    tr_runInEventThread(session, sessionLoadTorrents, &data);
+    auto const n_files = std::size(data.filenames);
+    data.preloads = std::vector<tr_torrent_preload>(n_files);
+    data.torrents.reserve(n_files);
 
-    while (!data.done)
     {
-        tr_wait_msec(100);
+        auto workers = tr_worker_pool{ std::clamp(size_t{ std::thread::hardware_concurrency() }, size_t{ 2 }, size_t{ 8 }) };
+        for (size_t i = 0; i < n_files; ++i)
+        {
+            auto const& filename = data.filenames[i];
+            auto& preload = data.preloads[i];
+            workers.run([session, &filename, &preload]() { preloadTorrent(session, filename, preload); });
+        }
+
+        if (tr_amInEventThread(session))
+        {
+            workers.wait();
+
+            for (auto& preload : data.preloads)
+            {
+                addPreloadedTorrent(&data, preload);
+            }
+
+            finishLoadingTorrents(&data);
+        }
+        else
+        {
+            tr_runInEventThread(session, startLoadingTorrents, &data);
+
+            while (!data.done)
+            {
+                tr_wait_msec(100);
+            }
+        }
+    }
+
+    auto const n = std::size(data.torrents);
+    auto** const torrents = tr_new(tr_torrent*, n);
+    std::copy(std::begin(data.torrents), std::end(data.torrents), torrents);
+
+    if (setmeCount != nullptr)
+    {
+        *setmeCount = n;
     }
 
-    return data.torrents;
+    return torrents;
 }
 
 /***
@@ -2675,6 +2876,12 @@ void tr_sessionSetQueueEnabled(tr_session* session, tr_direction dir, bool is_en
     TR_ASSERT(tr_isDirection(dir));
 
     session->queueEnabled[dir] = is_enabled;
+
+    // queued torrents' activity depends on this
+    for (auto* tor : session->torrents)
+    {
+        session->torrent_index.update(tor);
+    }
 }
 
 bool tr_sessionGetQueueEnabled(tr_session const* session, tr_direction dir)
@@ -2747,28 +2954,23 @@ std::vector<tr_torrent*> tr_sessionGetNextQueuedTorrents(tr_session* session, tr
     TR_ASSERT(tr_isSession(session));
     TR_ASSERT(tr_isDirection(direction));
 
-    // build an array of the candidates
     auto candidates = std::vector<tr_torrent*>{};
-    candidates.reserve(tr_sessionCountTorrents(session));
-    for (auto* tor : session->torrents)
+    if (num_wanted == 0)
     {
-        if (tr_torrentIsQueued(tor) && (direction == tr_torrentGetQueueDirection(tor)))
-        {
-            candidates.push_back(tor);
-        }
+        return candidates;
     }
 
-    // find the best n candidates
-    num_wanted = std::min(num_wanted, std::size(candidates));
-    if (num_wanted < candidates.size())
-    {
-        std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + num_wanted,
-            std::end(candidates),
-            [](auto const* a, auto const* b) { return tr_torrentGetQueuePosition(a) < tr_torrentGetQueuePosition(b); });
-        candidates.resize(num_wanted);
-    }
+    // the queue visits its queued torrents in order, so the first n that match are the best n
+    session->torrent_queue.forEachQueued(
+        [&candidates, direction, num_wanted](tr_torrent* tor)
+        {
+            if (tr_torrentGetQueueDirection(tor) == direction)
+            {
+                candidates.push_back(tor);
+            }
+
+            return std::size(candidates) < num_wanted;
+        });
 
     return candidates;
 }
@@ -2822,6 +3024,9 @@ void tr_sessionAddTorrent(tr_session* session, tr_torrent* tor)
     session->torrentsById.insert_or_assign(tor->uniqueId, tor);
     session->torrentsByHash.insert_or_assign(tor->info.hash, tor);
     session->torrentsByHashString.insert_or_assign(tor->info.hashString, tor);
+    session->torrent_queue.push_back(tor);
+    session->torrent_queue.setQueued(tor, tr_torrentIsQueued(tor));
+    session->torrent_index.insert(tor);
 }
 
 void tr_sessionRemoveTorrent(tr_session* session, tr_torrent* tor)
@@ -2830,4 +3035,6 @@ void tr_sessionRemoveTorrent(tr_session* session, tr_torrent* tor)
     session->torrentsById.erase(tor->uniqueId);
     session->torrentsByHash.erase(tor->info.hash);
     session->torrentsByHashString.erase(tor->info.hashString);
+    session->torrent_queue.erase(tor);
+    session->torrent_index.erase(tor);
 }
@@ -16,6 +16,7 @@
 
 #include <array>
 #include <cstring> // memcmp()
+#include <ctime> // time()
 #include <list>
 #include <mutex>
 #include <map>
@@ -29,9 +30,16 @@
 
 #include "transmission.h"
 
+#include "activity-journal.h"
 #include "bandwidth.h"
 #include "net.h"
+#include "preallocator.h"
+#include "resume-journal.h"
+#include "resume-writer.h"
 #include "rpc-server.h"
+#include "timer-wheel.h"
+#include "torrent-index.h"
+#include "torrent-queue.h"
 #include "tr-macros.h"
 #include "utils.h" // tr_speed_K
 
@@ -282,9 +290,6 @@ public:
 
     uint8_t peer_id_ttl_hours;
 
-    // torrent id, time removed
-    std::vector<std::pair<int, time_t>> removed_torrents;
-
     bool stalledEnabled;
     bool queueEnabled[2];
     int queueSize[2];
@@ -343,6 +348,20 @@ public:
     std::map<uint8_t const*, tr_torrent*, CompareHash> torrentsByHash;
     std::map<std::string_view, tr_torrent*, CaseInsensitiveStringCompare> torrentsByHashString;
 
+    tr_torrent_queue torrent_queue;
+
+    // the torrents by activity and by label, for RPC filters
+    tr_torrent_index torrent_index;
+
+    // which torrents changed recently, for RPC "recently-active".
+    // Entries are kept long enough for clients polling every few seconds.
+    tr_activity_journal activity_journal{ 5 * 60 };
+
+    // the clock for tr_field_versions. It starts from the session's start
+    // time so that change tokens from an earlier session are never
+    // mistaken for current ones.
+    uint64_t field_version_clock = uint64_t(time(nullptr)) << 20;
+
     char* configDir;
     char* resumeDir;
     char* torrentDir;
@@ -382,6 +401,21 @@ public:
 
     std::unique_ptr<tr_rpc_server> rpc_server_;
 
+    // answers read-only RPC requests on worker threads. Made on first use
+    struct tr_rpc_readers* rpc_readers = nullptr;
+
+    // drives the coarse-grained per-peer protocol timers
+    std::unique_ptr<tr_timer_wheel> timer_wheel_;
+
+    // holds the torrents' resume data when "resume-journal-enabled" is set
+    std::unique_ptr<tr_resume_journal> resume_journal_;
+
+    // writes the torrents' resume data off the event thread
+    std::unique_ptr<tr_resume_writer> resume_writer_;
+
+    // creates and preallocates the files of torrents being started
+    tr_preallocator preallocator;
+
 private:
     static std::recursive_mutex session_mutex_;
 
@@ -0,0 +1,111 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstring> // memcpy()
+#include <string_view>
+
+#include <event2/buffer.h>
+
+#include "tr-assert.h"
+
+/**
+ * Collects the many small writes made by the serializers in a local
+ * array and hands them to an evbuffer in large chunks, rather than
+ * paying for an evbuffer_add() call on every token.
+ *
+ * Anything still staged is flushed when the buffer is destroyed.
+ */
+class tr_staging_buffer
+{
+public:
+    static auto constexpr Capacity = size_t{ 16384 };
+
+    explicit tr_staging_buffer(struct evbuffer* out)
+        : out_{ out }
+    {
+    }
+
+    ~tr_staging_buffer()
+    {
+        flush();
+    }
+
+    tr_staging_buffer(tr_staging_buffer const&) = delete;
+    tr_staging_buffer& operator=(tr_staging_buffer const&) = delete;
+
+    void push_back(char ch)
+    {
+        if (len_ == Capacity)
+        {
+            flush();
+        }
+
+        buf_[len_++] = ch;
+    }
+
+    void append(std::string_view sv)
+    {
+        if (std::size(sv) > Capacity - len_)
+        {
+            flush();
+
+            // too big to be worth copying twice
+            if (std::size(sv) > Capacity / 2)
+            {
+                evbuffer_add(out_, std::data(sv), std::size(sv));
+                return;
+            }
+        }
+
+        std::memcpy(std::data(buf_) + len_, std::data(sv), std::size(sv));
+        len_ += std::size(sv);
+    }
+
+    /** @return a pointer to at least `n` writable bytes. Follow with commit(). */
+    [[nodiscard]] char* reserve(size_t n)
+    {
+        TR_ASSERT(n <= Capacity);
+
+        if (n > Capacity - len_)
+        {
+            flush();
+        }
+
+        return std::data(buf_) + len_;
+    }
+
+    /** @brief keep `n` of the bytes written after the last reserve() */
+    void commit(size_t n)
+    {
+        TR_ASSERT(n <= Capacity - len_);
+
+        len_ += n;
+    }
+
+    void flush()
+    {
+        if (len_ != 0)
+        {
+            evbuffer_add(out_, std::data(buf_), len_);
+            len_ = 0;
+        }
+    }
+
+private:
+    struct evbuffer* const out_;
+    size_t len_ = 0;
+    std::array<char, Capacity> buf_;
+};
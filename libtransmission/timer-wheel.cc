@@ -0,0 +1,191 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+
+#include <event2/event.h>
+
+#include "transmission.h"
+#include "timer-wheel.h"
+#include "tr-assert.h"
+#include "utils.h" // tr_time_msec()
+
+namespace
+{
+
+void onWheelTick(evutil_socket_t /*fd*/, short /*what*/, void* vwheel)
+{
+    static_cast<tr_timer_wheel*>(vwheel)->advance(tr_time_msec());
+}
+
+} // namespace
+
+tr_timer_wheel::tr_timer_wheel(struct event_base* base, uint64_t tick_msec)
+    : base_{ base }
+    , tick_msec_{ tick_msec }
+    , now_{ tr_time_msec() / tick_msec }
+{
+    TR_ASSERT(tick_msec > 0);
+
+    if (base_ != nullptr)
+    {
+        event_ = event_new(base_, -1, EV_PERSIST, onWheelTick, this);
+    }
+}
+
+tr_timer_wheel::~tr_timer_wheel()
+{
+    // orphan any timers that are still pending so that
+    // their destructors don't try to reach back into us
+    auto const orphan = [](Slot& slot)
+    {
+        for (Link* link = slot.head.next; link != &slot.head;)
+        {
+            Link* const next = link->next;
+            link->prev = nullptr;
+            link->next = nullptr;
+            link = next;
+        }
+    };
+    std::for_each(std::begin(level0_), std::end(level0_), orphan);
+    std::for_each(std::begin(level1_), std::end(level1_), orphan);
+
+    if (event_ != nullptr)
+    {
+        event_free(event_);
+    }
+}
+
+void tr_timer_wheel::insert(Timer& timer)
+{
+    TR_ASSERT(!timer.isPending());
+    TR_ASSERT(timer.deadline_ >= now_);
+
+    Slot* slot = nullptr;
+
+    if (timer.deadline_ - now_ < Level0Size)
+    {
+        slot = &level0_[timer.deadline_ & (Level0Size - 1)];
+    }
+    else
+    {
+        // timers out of the second level's reach are parked in its
+        // farthest slot and re-filed when that slot is cascaded
+        auto const when = std::min(timer.deadline_, now_ + Level0Size * Level1Size - 1);
+        slot = &level1_[(when >> Level0Bits) & (Level1Size - 1)];
+    }
+
+    Link& head = slot->head;
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+}
+
+void tr_timer_wheel::schedule(Timer& timer, uint64_t msec)
+{
+    TR_ASSERT(&timer.wheel_ == this);
+
+    timer.stop();
+
+    // if the wheel has been idle, catch up to the present first
+    // so that the deadline isn't measured from a stale tick
+    if (size_ == 0 && base_ != nullptr)
+    {
+        now_ = std::max(now_, tr_time_msec() / tick_msec_);
+    }
+
+    auto const ticks = std::max(uint64_t{ 1 }, (msec + tick_msec_ - 1) / tick_msec_);
+    timer.deadline_ = now_ + ticks;
+    insert(timer);
+    ++size_;
+
+    updateEvent();
+}
+
+void tr_timer_wheel::cancel(Timer& timer)
+{
+    TR_ASSERT(timer.isPending());
+    TR_ASSERT(size_ > 0);
+
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = nullptr;
+    timer.next = nullptr;
+    --size_;
+}
+
+void tr_timer_wheel::tick()
+{
+    ++now_;
+
+    auto const index = now_ & (Level0Size - 1);
+
+    // at the start of each lap, move the next second-level slot down
+    if (Slot& slot = level1_[(now_ >> Level0Bits) & (Level1Size - 1)]; index == 0 && !slot.empty())
+    {
+        // detach the list first, since parked timers may land in this slot again
+        Link* link = slot.head.next;
+        slot.head.prev->next = nullptr;
+        slot.head.prev = &slot.head;
+        slot.head.next = &slot.head;
+
+        while (link != nullptr)
+        {
+            auto* const timer = static_cast<Timer*>(link);
+            link = link->next;
+            timer->prev = nullptr;
+            timer->next = nullptr;
+            insert(*timer);
+        }
+    }
+
+    // fire the timers in this tick's slot. Callbacks are free to
+    // arm, cancel, or destroy any timer, including the one firing.
+    Slot& slot = level0_[index];
+    while (!slot.empty())
+    {
+        auto* const timer = static_cast<Timer*>(slot.head.next);
+        TR_ASSERT(timer->deadline_ == now_);
+        cancel(*timer);
+        timer->callback_(timer->user_data_);
+    }
+}
+
+void tr_timer_wheel::advance(uint64_t now_msec)
+{
+    auto const target = now_msec / tick_msec_;
+
+    while (size_ > 0 && now_ < target)
+    {
+        tick();
+    }
+
+    now_ = std::max(now_, target);
+
+    updateEvent();
+}
+
+void tr_timer_wheel::updateEvent()
+{
+    if (event_ == nullptr)
+    {
+        return;
+    }
+
+    if (size_ > 0 && !event_armed_)
+    {
+        tr_timerAddMsec(event_, static_cast<int>(tick_msec_));
+        event_armed_ = true;
+    }
+    else if (size_ == 0 && event_armed_)
+    {
+        event_del(event_);
+        event_armed_ = false;
+    }
+}
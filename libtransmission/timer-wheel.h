@@ -0,0 +1,176 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+
+struct event;
+struct event_base;
+
+/**
+ * A hierarchical timing wheel for coarse-grained protocol timers
+ * such as PEX, keepalives, handshake and request timeouts.
+ *
+ * Arming and cancelling a timer are O(1), and the whole wheel is driven
+ * by a single libevent timer that ticks only while timers are pending,
+ * so tens of thousands of per-peer timers don't each sit in libevent's
+ * min-heap. The price is precision: a timer fires on the first tick at
+ * or after its deadline, so it may run up to one tick late.
+ *
+ * The first level has one slot per tick. The second level has one slot
+ * per lap of the first level and is cascaded down as time moves forward.
+ * Timers further out than the second level can reach are parked in its
+ * farthest slot and re-filed each time they're cascaded.
+ */
+class tr_timer_wheel
+{
+private:
+    // intrusive doubly-linked list hook
+    struct Link
+    {
+        Link* prev = nullptr;
+        Link* next = nullptr;
+    };
+
+public:
+    using Callback = void (*)(void* user_data);
+
+    /**
+     * A timer that is scheduled on a tr_timer_wheel.
+     * The owner embeds it and must keep it alive while it's pending;
+     * destroying a pending timer cancels it.
+     */
+    class Timer : private Link // prev is non-null iff the timer is pending
+    {
+    public:
+        Timer(tr_timer_wheel& wheel, Callback callback, void* user_data)
+            : wheel_{ wheel }
+            , callback_{ callback }
+            , user_data_{ user_data }
+        {
+        }
+
+        ~Timer()
+        {
+            stop();
+        }
+
+        Timer& operator=(Timer&&) = delete;
+        Timer& operator=(Timer const&) = delete;
+        Timer(Timer&&) = delete;
+        Timer(Timer const&) = delete;
+
+        /** @brief (re)arm the timer to fire once, `msec` from now */
+        void start(uint64_t msec)
+        {
+            wheel_.schedule(*this, msec);
+        }
+
+        /** @brief cancel the timer. A no-op if it's not pending. */
+        void stop()
+        {
+            if (isPending())
+            {
+                wheel_.cancel(*this);
+            }
+        }
+
+        [[nodiscard]] constexpr bool isPending() const
+        {
+            return prev != nullptr;
+        }
+
+    private:
+        friend class tr_timer_wheel;
+
+        tr_timer_wheel& wheel_;
+        Callback const callback_;
+        void* const user_data_;
+
+        uint64_t deadline_ = 0; // in ticks
+    };
+
+    /**
+     * @param base the event loop that drives the wheel, or nullptr to
+     *        drive it by hand with advance() (e.g. in tests)
+     * @param tick_msec the resolution of the wheel
+     */
+    tr_timer_wheel(struct event_base* base, uint64_t tick_msec);
+    ~tr_timer_wheel();
+
+    tr_timer_wheel& operator=(tr_timer_wheel&&) = delete;
+    tr_timer_wheel& operator=(tr_timer_wheel const&) = delete;
+    tr_timer_wheel(tr_timer_wheel&&) = delete;
+    tr_timer_wheel(tr_timer_wheel const&) = delete;
+
+    /** @brief fire every timer whose deadline is at or before `now_msec` */
+    void advance(uint64_t now_msec);
+
+    /** @return the time the wheel has been advanced to */
+    [[nodiscard]] constexpr uint64_t now() const
+    {
+        return now_ * tick_msec_;
+    }
+
+    /** @return the number of pending timers */
+    [[nodiscard]] constexpr size_t size() const
+    {
+        return size_;
+    }
+
+    static constexpr size_t Level0Bits = 8;
+    static constexpr size_t Level1Bits = 6;
+    static constexpr size_t Level0Size = 1U << Level0Bits;
+    static constexpr size_t Level1Size = 1U << Level1Bits;
+
+private:
+    // a sentinel-headed circular list of the timers in a slot
+    struct Slot
+    {
+        Slot()
+        {
+            head.prev = &head;
+            head.next = &head;
+        }
+
+        Slot& operator=(Slot&&) = delete;
+        Slot& operator=(Slot const&) = delete;
+        Slot(Slot&&) = delete;
+        Slot(Slot const&) = delete;
+
+        [[nodiscard]] bool empty() const
+        {
+            return head.next == &head;
+        }
+
+        Link head;
+    };
+
+    void schedule(Timer& timer, uint64_t msec);
+    void cancel(Timer& timer);
+    void insert(Timer& timer);
+    void tick();
+    void updateEvent();
+
+    std::array<Slot, Level0Size> level0_;
+    std::array<Slot, Level1Size> level1_;
+
+    struct event_base* const base_;
+    struct event* event_ = nullptr;
+    uint64_t const tick_msec_;
+    uint64_t now_ = 0; // in ticks
+    size_t size_ = 0;
+    bool event_armed_ = false;
+};
@@ -352,6 +352,28 @@ bool tr_ctorGetIncompleteDir(tr_ctor const* ctor, char const** setme)
     return true;
 }
 
+bool tr_ctorGetPiecesOffset(tr_ctor const* ctor, uint64_t* setme)
+{
+    // the metainfo was parsed in place, so its strings point into `contents`
+    auto pieces = std::string_view{};
+    tr_variant* info = nullptr;
+    if (!ctor->isSet_metainfo || !tr_variantDictFindDict(const_cast<tr_variant*>(&ctor->metainfo), TR_KEY_info, &info) ||
+        !tr_variantDictFindStrView(info, TR_KEY_pieces, &pieces))
+    {
+        return false;
+    }
+
+    auto const* const begin = std::data(ctor->contents);
+    auto const* const end = begin + std::size(ctor->contents);
+    if (std::data(pieces) < begin || std::data(pieces) + std::size(pieces) > end)
+    {
+        return false;
+    }
+
+    *setme = std::data(pieces) - begin;
+    return true;
+}
+
 bool tr_ctorGetMetainfo(tr_ctor const* ctor, tr_variant const** setme)
 {
     if (!ctor->isSet_metainfo)
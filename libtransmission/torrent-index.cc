@@ -0,0 +1,134 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+#include "transmission.h"
+#include "torrent.h"
+#include "torrent-index.h"
+#include "tr-assert.h"
+
+static std::vector<std::string> getLabels(tr_torrent const* tor)
+{
+    auto labels = std::vector<std::string>{ std::begin(tor->labels), std::end(tor->labels) };
+    std::sort(std::begin(labels), std::end(labels));
+    return labels;
+}
+
+static std::vector<tr_torrent*> toVector(std::map<int, tr_torrent*> const& bucket)
+{
+    auto ret = std::vector<tr_torrent*>{};
+    ret.reserve(std::size(bucket));
+    std::transform(std::begin(bucket), std::end(bucket), std::back_inserter(ret), [](auto const& it) { return it.second; });
+    return ret;
+}
+
+void tr_torrent_index::fileLabels(tr_torrent* tor, Entry& entry)
+{
+    for (auto const& label : entry.labels)
+    {
+        by_label_[label].try_emplace(tor->uniqueId, tor);
+    }
+}
+
+void tr_torrent_index::unfileLabels(tr_torrent const* tor, Entry& entry)
+{
+    for (auto const& label : entry.labels)
+    {
+        if (auto it = by_label_.find(label); it != std::end(by_label_))
+        {
+            it->second.erase(tor->uniqueId);
+
+            if (std::empty(it->second))
+            {
+                by_label_.erase(it);
+            }
+        }
+    }
+
+    entry.labels.clear();
+}
+
+void tr_torrent_index::insert(tr_torrent* tor)
+{
+    auto entry = Entry{ tr_torrentGetActivity(tor), getLabels(tor) };
+
+    auto const lock = std::lock_guard(mutex_);
+    TR_ASSERT(entries_.count(tor) == 0);
+
+    by_activity_[entry.activity].try_emplace(tor->uniqueId, tor);
+    fileLabels(tor, entry);
+    entries_.try_emplace(tor, std::move(entry));
+}
+
+void tr_torrent_index::erase(tr_torrent const* tor)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const it = entries_.find(tor);
+    if (it == std::end(entries_))
+    {
+        return;
+    }
+
+    by_activity_[it->second.activity].erase(tor->uniqueId);
+    unfileLabels(tor, it->second);
+    entries_.erase(it);
+}
+
+void tr_torrent_index::update(tr_torrent* tor)
+{
+    auto const activity = tr_torrentGetActivity(tor);
+
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const it = entries_.find(tor);
+    if (it == std::end(entries_) || it->second.activity == activity)
+    {
+        return;
+    }
+
+    by_activity_[it->second.activity].erase(tor->uniqueId);
+    by_activity_[activity].try_emplace(tor->uniqueId, tor);
+    it->second.activity = activity;
+}
+
+void tr_torrent_index::updateLabels(tr_torrent* tor)
+{
+    auto labels = getLabels(tor);
+
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const it = entries_.find(tor);
+    if (it == std::end(entries_) || it->second.labels == labels)
+    {
+        return;
+    }
+
+    unfileLabels(tor, it->second);
+    it->second.labels = std::move(labels);
+    fileLabels(tor, it->second);
+}
+
+std::vector<tr_torrent*> tr_torrent_index::withActivity(tr_torrent_activity activity) const
+{
+    TR_ASSERT(size_t(activity) < NumActivities);
+
+    auto const lock = std::lock_guard(mutex_);
+    return toVector(by_activity_[activity]);
+}
+
+std::vector<tr_torrent*> tr_torrent_index::withLabel(std::string_view label) const
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const it = by_label_.find(label);
+    return it != std::end(by_label_) ? toVector(it->second) : std::vector<tr_torrent*>{};
+}
@@ -0,0 +1,91 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // size_t
+#include <functional> // std::less
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "transmission.h" // tr_torrent_activity
+
+struct tr_torrent;
+
+/**
+ * The session's torrents, grouped by activity and by label so that
+ * RPC clients can ask for e.g. "the seeding ones" without the server
+ * looking at every torrent.
+ *
+ * The index is kept current by the code that changes a torrent's
+ * activity or labels, which calls update() or updateLabels().
+ * Since the verify thread changes torrents' activity too, the
+ * index has a lock of its own.
+ */
+class tr_torrent_index
+{
+public:
+    tr_torrent_index() = default;
+    ~tr_torrent_index() = default;
+
+    tr_torrent_index& operator=(tr_torrent_index&&) = delete;
+    tr_torrent_index& operator=(tr_torrent_index const&) = delete;
+    tr_torrent_index(tr_torrent_index&&) = delete;
+    tr_torrent_index(tr_torrent_index const&) = delete;
+
+    void insert(tr_torrent* tor);
+    void erase(tr_torrent const* tor);
+
+    /** @brief re-file `tor` if its activity changed */
+    void update(tr_torrent* tor);
+
+    /** @brief re-file `tor` under its current labels */
+    void updateLabels(tr_torrent* tor);
+
+    /** @return the torrents with that activity, sorted by id */
+    [[nodiscard]] std::vector<tr_torrent*> withActivity(tr_torrent_activity activity) const;
+
+    /** @return the torrents with that label, sorted by id */
+    [[nodiscard]] std::vector<tr_torrent*> withLabel(std::string_view label) const;
+
+    [[nodiscard]] size_t size() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return std::size(entries_);
+    }
+
+private:
+    // keyed by torrent id, so that lookups come back in id order
+    using Bucket = std::map<int, tr_torrent*>;
+
+    struct Entry
+    {
+        tr_torrent_activity activity;
+        std::vector<std::string> labels;
+    };
+
+    static auto constexpr NumActivities = size_t{ TR_STATUS_SEED + 1 };
+
+    void fileLabels(tr_torrent* tor, Entry& entry);
+    void unfileLabels(tr_torrent const* tor, Entry& entry);
+
+    mutable std::mutex mutex_;
+
+    std::unordered_map<tr_torrent const*, Entry> entries_;
+    std::array<Bucket, NumActivities> by_activity_;
+    std::map<std::string, Bucket, std::less<>> by_label_;
+};
@@ -0,0 +1,233 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+
+#include "transmission.h"
+
+#include "torrent-queue.h"
+#include "tr-assert.h"
+
+void tr_torrent_queue::update(Node* node)
+{
+    node->size = 1 + sizeOf(node->left) + sizeOf(node->right);
+    node->queued_count = (node->queued ? 1 : 0) + queuedCountOf(node->left) + queuedCountOf(node->right);
+
+    if (node->left != nullptr)
+    {
+        node->left->parent = node;
+    }
+
+    if (node->right != nullptr)
+    {
+        node->right->parent = node;
+    }
+}
+
+// join two trees, every node of `a` coming before every node of `b`
+tr_torrent_queue::Node* tr_torrent_queue::merge(Node* a, Node* b)
+{
+    if (a == nullptr || b == nullptr)
+    {
+        return a != nullptr ? a : b;
+    }
+
+    if (a->priority > b->priority)
+    {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    }
+
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
+
+// split a tree into its first `n` nodes and the rest
+void tr_torrent_queue::split(Node* node, size_t n, Node** setme_left, Node** setme_right)
+{
+    if (node == nullptr)
+    {
+        *setme_left = nullptr;
+        *setme_right = nullptr;
+        return;
+    }
+
+    node->parent = nullptr;
+
+    if (sizeOf(node->left) < n)
+    {
+        split(node->right, n - sizeOf(node->left) - 1, &node->right, setme_right);
+        *setme_left = node;
+    }
+    else
+    {
+        split(node->left, n, setme_left, &node->left);
+        *setme_right = node;
+    }
+
+    update(node);
+
+    if (*setme_left != nullptr)
+    {
+        (*setme_left)->parent = nullptr;
+    }
+
+    if (*setme_right != nullptr)
+    {
+        (*setme_right)->parent = nullptr;
+    }
+}
+
+size_t tr_torrent_queue::position(Node const* node) const
+{
+    auto pos = sizeOf(node->left);
+
+    for (; node->parent != nullptr; node = node->parent)
+    {
+        if (node->parent->right == node)
+        {
+            pos += sizeOf(node->parent->left) + 1;
+        }
+    }
+
+    TR_ASSERT(node == root_);
+    return pos;
+}
+
+// remove a node from the tree, but not from nodes_
+void tr_torrent_queue::unlink(Node* node)
+{
+    auto const pos = position(node);
+
+    Node* left = nullptr;
+    Node* rest = nullptr;
+    Node* middle = nullptr;
+    Node* right = nullptr;
+    split(root_, pos, &left, &rest);
+    split(rest, 1, &middle, &right);
+    TR_ASSERT(middle == node);
+
+    root_ = merge(left, right);
+    if (root_ != nullptr)
+    {
+        root_->parent = nullptr;
+    }
+}
+
+// insert a lone node into the tree at `pos`
+void tr_torrent_queue::link(Node* node, size_t pos)
+{
+    node->left = nullptr;
+    node->right = nullptr;
+    node->parent = nullptr;
+    update(node);
+
+    Node* left = nullptr;
+    Node* right = nullptr;
+    split(root_, std::min(pos, sizeOf(root_)), &left, &right);
+
+    root_ = merge(merge(left, node), right);
+    root_->parent = nullptr;
+}
+
+void tr_torrent_queue::push_back(tr_torrent* tor)
+{
+    TR_ASSERT(!contains(tor));
+
+    // xorshift32; the treap only needs the priorities to be well-mixed
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+
+    auto& node = nodes_[tor];
+    node.tor = tor;
+    node.priority = seed_;
+    link(&node, sizeOf(root_));
+}
+
+void tr_torrent_queue::erase(tr_torrent* tor)
+{
+    auto const it = nodes_.find(tor);
+    if (it == std::end(nodes_))
+    {
+        return;
+    }
+
+    unlink(&it->second);
+    nodes_.erase(it);
+    ++version_;
+}
+
+void tr_torrent_queue::move(tr_torrent* tor, size_t pos)
+{
+    auto const it = nodes_.find(tor);
+    if (it == std::end(nodes_))
+    {
+        return;
+    }
+
+    auto* const node = &it->second;
+    unlink(node);
+    link(node, pos);
+    ++version_;
+}
+
+size_t tr_torrent_queue::position(tr_torrent const* tor) const
+{
+    auto const it = nodes_.find(tor);
+    TR_ASSERT(it != std::end(nodes_));
+    return it != std::end(nodes_) ? position(&it->second) : 0;
+}
+
+tr_torrent* tr_torrent_queue::at(size_t pos) const
+{
+    if (pos >= sizeOf(root_))
+    {
+        return nullptr;
+    }
+
+    auto const* node = root_;
+
+    for (;;)
+    {
+        auto const left_size = sizeOf(node->left);
+
+        if (pos < left_size)
+        {
+            node = node->left;
+        }
+        else if (pos == left_size)
+        {
+            return node->tor;
+        }
+        else
+        {
+            pos -= left_size + 1;
+            node = node->right;
+        }
+    }
+}
+
+void tr_torrent_queue::setQueued(tr_torrent const* tor, bool queued)
+{
+    auto const it = nodes_.find(tor);
+    if (it == std::end(nodes_) || it->second.queued == queued)
+    {
+        return;
+    }
+
+    auto* node = &it->second;
+    node->queued = queued;
+
+    for (; node != nullptr; node = node->parent)
+    {
+        update(node);
+    }
+}
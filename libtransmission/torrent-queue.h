@@ -0,0 +1,140 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <unordered_map>
+
+struct tr_torrent;
+
+/**
+ * The session's torrent queue.
+ *
+ * Torrents are kept in an implicit treap -- a balanced binary tree whose
+ * in-order traversal is the queue order and whose nodes know the size of
+ * their subtrees -- so a torrent's position is computed on demand rather
+ * than stored in each torrent. Looking up, inserting, removing, or moving
+ * a torrent are all O(log N), instead of renumbering every torrent behind
+ * it on every change.
+ *
+ * Each subtree also counts its queued torrents (the ones waiting for a
+ * free slot) so that they can be walked in queue order without visiting
+ * the rest of the queue.
+ *
+ * The queue never dereferences the torrent pointers it holds.
+ */
+class tr_torrent_queue
+{
+public:
+    tr_torrent_queue() = default;
+    ~tr_torrent_queue() = default;
+
+    tr_torrent_queue& operator=(tr_torrent_queue&&) = delete;
+    tr_torrent_queue& operator=(tr_torrent_queue const&) = delete;
+    tr_torrent_queue(tr_torrent_queue&&) = delete;
+    tr_torrent_queue(tr_torrent_queue const&) = delete;
+
+    void push_back(tr_torrent* tor);
+    void erase(tr_torrent* tor);
+
+    /** @brief move `tor` to `pos`, or to the back if `pos` is past it */
+    void move(tr_torrent* tor, size_t pos);
+
+    /** @return the torrent's zero-based position in the queue */
+    [[nodiscard]] size_t position(tr_torrent const* tor) const;
+
+    /** @return the torrent at `pos`, or nullptr if `pos` is out of range */
+    [[nodiscard]] tr_torrent* at(size_t pos) const;
+
+    [[nodiscard]] bool contains(tr_torrent const* tor) const
+    {
+        return nodes_.count(tor) != 0;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return std::size(nodes_);
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return std::empty(nodes_);
+    }
+
+    /** @return a number that changes whenever torrents' positions may have changed */
+    [[nodiscard]] uint64_t version() const
+    {
+        return version_;
+    }
+
+    /** @brief mark whether `tor` is waiting in the queue for a free slot */
+    void setQueued(tr_torrent const* tor, bool queued);
+
+    /**
+     * @brief visit the queued torrents in queue order
+     * @param visit called for each one; return false to stop
+     */
+    template<typename Visitor>
+    void forEachQueued(Visitor visit) const
+    {
+        visitQueued(root_, visit);
+    }
+
+private:
+    struct Node
+    {
+        Node* left = nullptr;
+        Node* right = nullptr;
+        Node* parent = nullptr;
+        tr_torrent* tor = nullptr;
+        size_t size = 1; // nodes in this subtree
+        size_t queued_count = 0; // queued nodes in this subtree
+        uint32_t priority = 0;
+        bool queued = false;
+    };
+
+    static constexpr size_t sizeOf(Node const* node)
+    {
+        return node != nullptr ? node->size : 0;
+    }
+
+    static constexpr size_t queuedCountOf(Node const* node)
+    {
+        return node != nullptr ? node->queued_count : 0;
+    }
+
+    static void update(Node* node);
+    static Node* merge(Node* a, Node* b);
+    static void split(Node* node, size_t n, Node** setme_left, Node** setme_right);
+
+    [[nodiscard]] size_t position(Node const* node) const;
+    void unlink(Node* node);
+    void link(Node* node, size_t pos);
+
+    template<typename Visitor>
+    static bool visitQueued(Node const* node, Visitor& visit)
+    {
+        if (queuedCountOf(node) == 0)
+        {
+            return true;
+        }
+
+        return visitQueued(node->left, visit) && (!node->queued || visit(node->tor)) && visitQueued(node->right, visit);
+    }
+
+    std::unordered_map<tr_torrent const*, Node> nodes_;
+    Node* root_ = nullptr;
+    uint32_t seed_ = 0x9E3779B9U;
+    uint64_t version_ = 0;
+};
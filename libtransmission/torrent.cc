@@ -519,6 +519,7 @@ void tr_torrentSetLocalError(tr_torrent* tor, char const* fmt, ...)
     va_end(ap);
 
     tr_logAddTorErr(tor, "%s", tor->errorString);
+    tor->markChanged(tr_time());
 
     if (tor->isRunning)
     {
@@ -555,17 +556,25 @@ static void onTrackerResponse(tr_torrent* tor, tr_tracker_event const* event, vo
         tor->error = TR_STAT_TRACKER_WARNING;
         tor->error_announce_url = event->announce_url;
         tr_strlcpy(tor->errorString, event->text, sizeof(tor->errorString));
+        tor->markChanged(tr_time());
         break;
 
     case TR_TRACKER_ERROR:
         tor->error = TR_STAT_TRACKER_ERROR;
         tor->error_announce_url = event->announce_url;
         tr_strlcpy(tor->errorString, event->text, sizeof(tor->errorString));
+        tor->markChanged(tr_time());
         break;
 
     case TR_TRACKER_ERROR_CLEAR:
         if (tor->error != TR_STAT_LOCAL_ERROR)
         {
+            // most announces have no error to clear, and that isn't news
+            if (tor->error != TR_STAT_OK)
+            {
+                tor->markChanged(tr_time());
+            }
+
             tr_torrentClearError(tor);
         }
 
@@ -589,20 +598,12 @@ static void torrentInitFromInfoDict(tr_torrent* tor)
     tor->completion = tr_completion{ tor, tor };
     tr_sha1(tor->obfuscatedHash, "req2", 4, tor->info.hash, SHA_DIGEST_LENGTH, nullptr);
 
-    // init file offsets
-    auto offset = uint64_t{ 0 };
-    for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
-    {
-        auto& file = tor->file(i);
-        file.priv.offset = offset;
-        offset += file.length;
-    }
-
     tor->fpm_.reset(tor->info);
     tor->file_priorities_.reset(&tor->fpm_);
     tor->files_wanted_.reset(&tor->fpm_);
 
     tor->checked_pieces_ = tr_bitfield{ tor->info.pieceCount };
+    tor->forgetFileLocations();
 }
 
 void tr_torrentGotNewInfoDict(tr_torrent* tor)
@@ -658,7 +659,7 @@ static void callScriptIfEnabled(tr_torrent const* tor, TrScript type)
 
 static void refreshCurrentDir(tr_torrent* tor);
 
-static void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
+static void torrentInit(tr_torrent* tor, tr_ctor const* ctor, tr_variant* resume)
 {
     static auto next_unique_id = int{ 1 };
     auto const lock = tor->unique_lock();
@@ -668,7 +669,6 @@ static void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
 
     tor->session = session;
     tor->uniqueId = next_unique_id++;
-    tor->queuePosition = tr_sessionCountTorrents(session);
 
     torrentInitFromInfoDict(tor);
 
@@ -707,7 +707,7 @@ static void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     // affect the 'is dirty' flag.
     auto const was_dirty = tor->isDirty;
     bool didRenameResumeFileToHashOnlyName = false;
-    auto const loaded = tr_torrentLoadResume(tor, ~(uint64_t)0, ctor, &didRenameResumeFileToHashOnlyName);
+    auto const loaded = tr_torrentLoadResume(tor, ~(uint64_t)0, ctor, resume, &didRenameResumeFileToHashOnlyName);
     tor->isDirty = was_dirty;
 
     if (didRenameResumeFileToHashOnlyName)
@@ -754,16 +754,28 @@ static void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
     bool const isNewTorrent = !tr_sys_path_exists(tor->info.torrent, nullptr);
 
     /* maybe save our own copy of the metainfo */
+    auto has_own_copy = tr_strcmp0(tr_ctorGetSourceFile(ctor), tor->info.torrent) == 0;
     if (tr_ctorGetSave(ctor))
     {
         tr_error* error = nullptr;
-        if (!tr_ctorSaveContents(ctor, tor->info.torrent, &error))
+        if (tr_ctorSaveContents(ctor, tor->info.torrent, &error))
+        {
+            has_own_copy = true;
+        }
+        else
         {
             tr_torrentSetLocalError(tor, "Unable to save torrent file: %s (%d)", error->message, error->code);
         }
         tr_error_clear(&error);
     }
 
+    /* read the piece hashes from our copy when they're needed */
+    if (auto offset = uint64_t{};
+        has_own_copy && tr_torrentHasMetadata(tor) && !tor->hasPieceHashSource() && tr_ctorGetPiecesOffset(ctor, &offset))
+    {
+        tor->setPieceHashSource(tor->info.torrent, offset);
+    }
+
     tor->tiers = tr_announcerAddTorrent(tor, onTrackerResponse, nullptr);
 
     if (isNewTorrent)
@@ -813,26 +825,17 @@ tr_parse_result tr_torrentParse(tr_ctor const* ctor, tr_info* setmeInfo)
     return TR_PARSE_OK;
 }
 
-tr_torrent* tr_torrentNew(tr_ctor const* ctor, int* setme_error, int* setme_duplicate_id)
+tr_torrent* tr_torrentNewPreloaded(
+    tr_ctor const* ctor,
+    tr_metainfo_parsed& parsed,
+    tr_variant* resume,
+    int* setme_error,
+    int* setme_duplicate_id)
 {
-    TR_ASSERT(ctor != nullptr);
     auto* const session = tr_ctorGetSession(ctor);
     TR_ASSERT(tr_isSession(session));
 
-    tr_variant const* metainfo = nullptr;
-    tr_ctorGetMetainfo(ctor, &metainfo);
-    auto parsed = tr_metainfoParse(session, metainfo, nullptr);
-    if (!parsed)
-    {
-        if (setme_error != nullptr)
-        {
-            *setme_error = TR_PARSE_ERR;
-        }
-
-        return nullptr;
-    }
-
-    tr_torrent const* const dupe = tr_torrentFindFromHash(session, parsed->info.hash);
+    tr_torrent const* const dupe = tr_torrentFindFromHash(session, parsed.info.hash);
     if (dupe != nullptr)
     {
         if (setme_duplicate_id != nullptr)
@@ -848,12 +851,34 @@ tr_torrent* tr_torrentNew(tr_ctor const* ctor, int* setme_error, int* setme_dupl
         return nullptr;
     }
 
-    auto* tor = new tr_torrent{ parsed->info };
-    tor->swapMetainfo(*parsed);
-    torrentInit(tor, ctor);
+    auto* tor = new tr_torrent{ parsed.info };
+    tor->swapMetainfo(parsed);
+    torrentInit(tor, ctor, resume);
     return tor;
 }
 
+tr_torrent* tr_torrentNew(tr_ctor const* ctor, int* setme_error, int* setme_duplicate_id)
+{
+    TR_ASSERT(ctor != nullptr);
+    auto* const session = tr_ctorGetSession(ctor);
+    TR_ASSERT(tr_isSession(session));
+
+    tr_variant const* metainfo = nullptr;
+    tr_ctorGetMetainfo(ctor, &metainfo);
+    auto parsed = tr_metainfoParse(session, metainfo, nullptr);
+    if (!parsed)
+    {
+        if (setme_error != nullptr)
+        {
+            *setme_error = TR_PARSE_ERR;
+        }
+
+        return nullptr;
+    }
+
+    return tr_torrentNewPreloaded(ctor, *parsed, nullptr, setme_error, setme_duplicate_id);
+}
+
 /**
 ***
 **/
@@ -940,7 +965,8 @@ void tr_torrentSetVerifyState(tr_torrent* tor, tr_verify_state state)
     TR_ASSERT(state == TR_VERIFY_NONE || state == TR_VERIFY_WAIT || state == TR_VERIFY_NOW);
 
     tor->verifyState = state;
-    tor->anyDate = tr_time();
+    tor->session->torrent_index.update(tor);
+    tor->markChanged(tr_time());
 }
 
 tr_torrent_activity tr_torrentGetActivity(tr_torrent const* tor)
@@ -1012,7 +1038,7 @@ tr_stat const* tr_torrentStat(tr_torrent* tor)
     s->id = tor->uniqueId;
     s->activity = tr_torrentGetActivity(tor);
     s->error = tor->error;
-    s->queuePosition = tor->queuePosition;
+    s->queuePosition = tr_torrentGetQueuePosition(tor);
     s->idleSecs = torrentGetIdleSecs(tor, s->activity);
     s->isStalled = tr_torrentIsStalled(tor, s->idleSecs);
     s->errorString = tor->errorString;
@@ -1042,6 +1068,7 @@ tr_stat const* tr_torrentStat(tr_torrent* tor)
     s->leftUntilDone = tor->completion.leftUntilDone();
     s->sizeWhenDone = tor->completion.sizeWhenDone();
     s->recheckProgress = s->activity == TR_STATUS_CHECK ? getVerifyProgress(tor) : 0;
+    s->preallocationProgress = tor->session->preallocator.progress(tor->uniqueId).value_or(1.0);
     s->activityDate = tor->activityDate;
     s->addedDate = tor->addedDate;
     s->doneDate = tor->doneDate;
@@ -1306,9 +1333,16 @@ static void tr_torrentResetTransferStats(tr_torrent* tor)
 ****
 ***/
 
-#ifdef TR_ENABLE_ASSERTS
-static bool queueIsSequenced(tr_session*);
-#endif
+/* the torrents in [begin, end) have new queue positions */
+static void markQueueMoved(tr_session* session, size_t begin, size_t end, time_t now)
+{
+    auto const& queue = session->torrent_queue;
+
+    for (auto pos = begin; pos < end; ++pos)
+    {
+        queue.at(pos)->markChanged(now);
+    }
+}
 
 static void freeTorrent(tr_torrent* tor)
 {
@@ -1327,22 +1361,15 @@ static void freeTorrent(tr_torrent* tor)
     tr_free(tor->downloadDir);
     tr_free(tor->incompleteDir);
 
+    // "so you die, captain, and we all move up in rank."
+    auto const& queue = session->torrent_queue;
+    auto const pos = queue.position(tor);
+
     tr_sessionRemoveTorrent(session, tor);
 
     if (!session->isClosing())
     {
-        // "so you die, captain, and we all move up in rank."
-        // resequence the queue positions
-        for (auto* t : session->torrents)
-        {
-            if (t->queuePosition > tor->queuePosition)
-            {
-                t->queuePosition--;
-                t->anyDate = now;
-            }
-        }
-
-        TR_ASSERT(queueIsSequenced(session));
+        markQueueMoved(session, pos, std::size(queue), now);
     }
 
     delete tor->bandwidth;
@@ -1357,6 +1384,39 @@ static void freeTorrent(tr_torrent* tor)
 
 static void torrentSetQueued(tr_torrent* tor, bool queued);
 
+/* Queue the wanted files to be created and preallocated on a worker thread,
+ * so that writing the first block of a 100 GB file doesn't stall the event
+ * thread while the disk fills it in. The worker skips the files that exist. */
+static void torrentStartPreallocating(tr_torrent* tor)
+{
+    auto const mode = tor->session->preallocationMode;
+
+    if (mode == TR_PREALLOCATE_NONE || tor->isDone())
+    {
+        return;
+    }
+
+    auto files = std::vector<tr_preallocator::File>{};
+
+    for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
+    {
+        auto const file = tor->file(i);
+
+        if (file.length == 0 || !tor->fileIsWanted(i))
+        {
+            continue;
+        }
+
+        /* the same place that tr_ioWrite() would create it */
+        char* const subpath = tr_sessionIsIncompleteFileNamingEnabled(tor->session) ? tr_torrentBuildPartial(tor, i) :
+                                                                                     tr_strdup(file.name);
+        files.push_back({ i, tr_strvPath(tr_torrentGetCurrentDir(tor), subpath), file.length, tor->filePaths(i) });
+        tr_free(subpath);
+    }
+
+    tor->session->preallocator.add(tor->uniqueId, mode, std::move(files));
+}
+
 static void torrentStartImpl(void* vtor)
 {
     auto* tor = static_cast<tr_torrent*>(vtor);
@@ -1371,8 +1431,9 @@ static void torrentStartImpl(void* vtor)
 
     tor->isRunning = true;
     tor->completeness = tor->completion.status();
+    tor->session->torrent_index.update(tor);
     tor->startDate = now;
-    tor->anyDate = now;
+    tor->markChanged(now);
     tr_torrentClearError(tor);
     tor->finishedSeedingByIdle = false;
 
@@ -1381,6 +1442,7 @@ static void torrentStartImpl(void* vtor)
     tor->dhtAnnounceAt = now + tr_rand_int_weak(20);
     tor->dhtAnnounce6At = now + tr_rand_int_weak(20);
     tor->lpdAnnounceAt = now;
+    torrentStartPreallocating(tor);
     tr_peerMgrStartTorrent(tor);
 }
 
@@ -1388,18 +1450,14 @@ uint64_t tr_torrentGetCurrentSizeOnDisk(tr_torrent const* tor)
 {
     uint64_t byte_count = 0;
     auto const n = tor->fileCount();
+    auto filename = std::string{};
 
     for (tr_file_index_t i = 0; i < n; ++i)
     {
-        tr_sys_path_info info;
-        char* filename = tr_torrentFindFile(tor, i);
-
-        if (filename != nullptr && tr_sys_path_get_info(filename, 0, &info, nullptr))
+        if (auto const found = tor->findFile(filename, i); found)
         {
-            byte_count += info.size;
+            byte_count += found->size;
         }
-
-        tr_free(filename);
     }
 
     return byte_count;
@@ -1469,6 +1527,7 @@ static void torrentStart(tr_torrent* tor, bool bypass_queue)
      * was missed to ensure that we didn't think someone was cheating. */
     tr_torrentUnsetPeerId(tor);
     tor->isRunning = true;
+    tor->session->torrent_index.update(tor);
     tr_torrentSetDirty(tor);
     tr_runInEventThread(tor->session, torrentStartImpl, tor);
 }
@@ -1607,6 +1666,7 @@ static void stopTorrent(void* vtor)
     tr_verifyRemove(tor);
     tr_peerMgrStopTorrent(tor);
     tr_announcerTorrentStopped(tor);
+    tor->session->preallocator.cancel(tor->uniqueId);
     tr_cacheFlushTorrent(tor->session->cache, tor);
 
     tr_fdTorrentClose(tor->session, tor->uniqueId);
@@ -1617,6 +1677,7 @@ static void stopTorrent(void* vtor)
     }
 
     torrentSetQueued(tor, false);
+    tor->markChanged(tr_time());
 
     if (tor->magnetVerify)
     {
@@ -1640,6 +1701,7 @@ void tr_torrentStop(tr_torrent* tor)
         tor->isRunning = false;
         tor->isStopping = false;
         tor->prefetchMagnetMetadata = false;
+        tor->session->torrent_index.update(tor);
         tr_torrentSetDirty(tor);
         tr_runInEventThread(tor->session, stopTorrent, tor);
     }
@@ -1651,8 +1713,6 @@ static void closeTorrent(void* vtor)
 
     TR_ASSERT(tr_isTorrent(tor));
 
-    tor->session->removed_torrents.emplace_back(tor->uniqueId, tr_time());
-
     tr_logAddTorInfo(tor, "%s", _("Removing torrent"));
 
     tor->magnetVerify = false;
@@ -1665,6 +1725,9 @@ static void closeTorrent(void* vtor)
     }
 
     tor->isRunning = false;
+
+    // after stopTorrent(), which may record the torrent as changed
+    tor->session->activity_journal.addRemoved(tor->uniqueId, tr_time());
     freeTorrent(tor);
 }
 
@@ -1897,6 +1960,7 @@ void tr_torrent::recheckCompleteness()
         }
 
         this->completeness = new_completeness;
+        this->session->torrent_index.update(this);
         tr_fdTorrentClose(this->session, this->uniqueId);
 
         if (tr_torrentIsSeed(this))
@@ -1904,7 +1968,8 @@ void tr_torrent::recheckCompleteness()
             if (recentChange)
             {
                 tr_announcerTorrentCompleted(this);
-                this->doneDate = this->anyDate = tr_time();
+                this->doneDate = tr_time();
+                this->markChanged(this->doneDate);
             }
 
             if (wasLeeching && wasRunning)
@@ -1981,6 +2046,7 @@ void tr_torrentSetLabels(tr_torrent* tor, tr_labels_t&& labels)
     auto const lock = tor->unique_lock();
 
     tor->labels = std::move(labels);
+    tor->session->torrent_index.updateLabels(tor);
     tr_torrentSetDirty(tor);
 }
 
@@ -2262,12 +2328,39 @@ BACK_COMPAT_FUNC(tr_torrentSetActivityDate, tr_torrentSetDateActive)
 BACK_COMPAT_FUNC(tr_torrentSetDoneDate, tr_torrentSetDateDone)
 #undef BACK_COMPAT_FUNC
 
+void tr_torrent::markChanged(time_t when)
+{
+    ++this->change_count;
+
+    auto const now = tr_time();
+    auto prev = this->anyDate.load();
+    while (prev < when && !this->anyDate.compare_exchange_weak(prev, when))
+    {
+    }
+    bool const changed_this_second = prev >= now;
+
+    // e.g. dates restored from the resume file aren't news
+    if (when < now)
+    {
+        return;
+    }
+
+    // one entry per torrent is enough until an RPC client reads it
+    auto& journal = this->session->activity_journal;
+    if (changed_this_second && journal.isPending(this->activity_seq))
+    {
+        return;
+    }
+
+    this->activity_seq = journal.addChanged(this->uniqueId, now);
+}
+
 void tr_torrentSetDateAdded(tr_torrent* tor, time_t t)
 {
     TR_ASSERT(tr_isTorrent(tor));
 
     tor->addedDate = t;
-    tor->anyDate = std::max(tor->anyDate, tor->addedDate);
+    tor->markChanged(t);
 }
 
 void tr_torrentSetDateActive(tr_torrent* tor, time_t t)
@@ -2275,7 +2368,7 @@ void tr_torrentSetDateActive(tr_torrent* tor, time_t t)
     TR_ASSERT(tr_isTorrent(tor));
 
     tor->activityDate = t;
-    tor->anyDate = std::max(tor->anyDate, tor->activityDate);
+    tor->markChanged(t);
 }
 
 void tr_torrentSetDateDone(tr_torrent* tor, time_t t)
@@ -2283,7 +2376,7 @@ void tr_torrentSetDateDone(tr_torrent* tor, time_t t)
     TR_ASSERT(tr_isTorrent(tor));
 
     tor->doneDate = t;
-    tor->anyDate = std::max(tor->anyDate, tor->doneDate);
+    tor->markChanged(t);
 }
 
 /**
@@ -2295,6 +2388,7 @@ uint64_t tr_torrentGetBytesLeftToAllocate(tr_torrent const* tor)
     TR_ASSERT(tr_isTorrent(tor));
 
     uint64_t bytesLeft = 0;
+    auto filename = std::string{};
 
     for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
     {
@@ -2303,18 +2397,14 @@ uint64_t tr_torrentGetBytesLeftToAllocate(tr_torrent const* tor)
         if (file.wanted)
         {
             uint64_t const length = file.length;
-            char* path = tr_torrentFindFile(tor, i);
+            auto const found = tor->findFile(filename, i);
 
             bytesLeft += length;
 
-            tr_sys_path_info info;
-            if (path != nullptr && tr_sys_path_get_info(path, 0, &info, nullptr) && info.type == TR_SYS_PATH_IS_FILE &&
-                info.size <= length)
+            if (found && found->type == TR_SYS_PATH_IS_FILE && found->size <= length)
             {
-                bytesLeft -= info.size;
+                bytesLeft -= found->size;
             }
-
-            tr_free(path);
         }
     }
 
@@ -2543,10 +2633,12 @@ static void tr_torrentDeleteLocalData(tr_torrent* tor, tr_fileFunc func)
     }
 
     /* close all the files because we're about to delete them */
+    tor->session->preallocator.cancel(tor->uniqueId);
     tr_cacheFlushTorrent(tor->session->cache, tor);
     tr_fdTorrentClose(tor->session, tor->uniqueId);
 
     deleteLocalData(tor, func);
+    tor->forgetFileLocations();
 }
 
 /***
@@ -2586,8 +2678,9 @@ static void setLocationImpl(void* vdata)
 
     if (!tr_sys_path_is_same(location.c_str(), tor->currentDir, nullptr))
     {
-        /* bad idea to move files while they're being verified... */
+        /* bad idea to move files while they're being verified or preallocated... */
         tr_verifyRemove(tor);
+        tor->session->preallocator.cancel(tor->uniqueId);
 
         /* try to move the files.
          * FIXME: there are still all kinds of nasty cases, like what
@@ -2639,6 +2732,8 @@ static void setLocationImpl(void* vdata)
             /* blow away the leftover subdirectories in the old location */
             tr_torrentDeleteLocalData(tor, tr_sys_path_remove);
         }
+
+        tor->forgetFileLocations();
     }
 
     if (!err)
@@ -2743,8 +2838,8 @@ static void tr_torrentFileCompleted(tr_torrent* tor, tr_file_index_t i)
 
     /* now that the file is complete and closed, we can start watching its
      * mtime timestamp for changes to know if we need to reverify pieces */
-    tr_file& file = tor->file(i);
-    file.priv.mtime = tr_time();
+    tor->fileTable().setMtime(i, tr_time());
+    auto const file = tor->file(i);
 
     /* if the torrent's current filename isn't the same as the one in the
      * metadata -- for example, if it had the ".part" suffix appended to
@@ -2764,6 +2859,8 @@ static void tr_torrentFileCompleted(tr_torrent* tor, tr_file_index_t i)
                 tr_logAddTorErr(tor, "Error moving \"%s\" to \"%s\": %s", oldpath.c_str(), newpath.c_str(), error->message);
                 tr_error_free(error);
             }
+
+            tor->forgetFileLocation(i);
         }
 
         tr_free(sub);
@@ -2827,46 +2924,116 @@ void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t block)
 ****
 ***/
 
+std::optional<std::string_view> tr_torrent::buildFilePath(std::string& setme, tr_file_index_t i, FileLocation location) const
+{
+    auto const in_download_dir = location == FileLocation::DownloadDir || location == FileLocation::DownloadDirPartial;
+    auto const* const dir = in_download_dir ? this->downloadDir : this->incompleteDir;
+    if (dir == nullptr)
+    {
+        return {};
+    }
+
+    auto const base = std::string_view{ dir };
+    auto const is_partial = location == FileLocation::DownloadDirPartial || location == FileLocation::IncompleteDirPartial;
+    tr_buildBuf(setme, base, "/"sv, this->file(i).name, is_partial ? ".part"sv : ""sv);
+    return base;
+}
+
 std::optional<tr_torrent::tr_found_file_t> tr_torrent::findFile(std::string& filename, tr_file_index_t i) const
 {
-    tr_file const& file = this->file(i);
     auto file_info = tr_sys_path_info{};
 
-    if (this->downloadDir != nullptr)
+    // look where it was last time before looking everywhere
+    auto const last_location = i < std::size(file_locations_) ? file_locations_[i].load() : FileLocation::Unknown;
+    if (last_location != FileLocation::Unknown)
     {
-        auto base = std::string_view{ this->downloadDir };
+        auto const base = buildFilePath(filename, i, last_location);
+        if (base && tr_sys_path_get_info(filename.c_str(), 0, &file_info, nullptr))
+        {
+            return tr_found_file_t{ file_info, filename, *base };
+        }
+    }
 
-        tr_buildBuf(filename, base, "/"sv, file.name);
-        if (tr_sys_path_get_info(filename.c_str(), 0, &file_info, nullptr))
+    for (auto const location : { FileLocation::DownloadDir,
+                                 FileLocation::DownloadDirPartial,
+                                 FileLocation::IncompleteDir,
+                                 FileLocation::IncompleteDirPartial })
+    {
+        if (location == last_location)
         {
-            return tr_found_file_t{ file_info, filename, base };
+            continue;
         }
 
-        tr_buildBuf(filename, base, "/"sv, file.name, ".part"sv);
-        if (tr_sys_path_get_info(filename.c_str(), 0, &file_info, nullptr))
+        auto const base = buildFilePath(filename, i, location);
+        if (base && tr_sys_path_get_info(filename.c_str(), 0, &file_info, nullptr))
         {
-            return tr_found_file_t{ file_info, filename, base };
+            if (i < std::size(file_locations_))
+            {
+                file_locations_[i] = location;
+            }
+
+            return tr_found_file_t{ file_info, filename, *base };
         }
     }
 
-    if (this->incompleteDir != nullptr)
-    {
-        auto const base = std::string_view{ this->incompleteDir };
+    forgetFileLocation(i);
+    return {};
+}
+
+std::vector<std::string> tr_torrent::filePaths(tr_file_index_t i) const
+{
+    auto paths = std::vector<std::string>{};
+    auto filename = std::string{};
 
-        tr_buildBuf(filename, base, "/"sv, file.name);
-        if (tr_sys_path_get_info(filename.c_str(), 0, &file_info, nullptr))
+    for (auto const location : { FileLocation::DownloadDir,
+                                 FileLocation::DownloadDirPartial,
+                                 FileLocation::IncompleteDir,
+                                 FileLocation::IncompleteDirPartial })
+    {
+        if (buildFilePath(filename, i, location))
         {
-            return tr_found_file_t{ file_info, filename, base };
+            paths.push_back(filename);
         }
+    }
+
+    return paths;
+}
 
-        tr_buildBuf(filename, base, "/"sv, file.name, ".part"sv);
-        if (tr_sys_path_get_info(filename.c_str(), 0, &file_info, nullptr))
+std::optional<tr_torrent::tr_found_file_t> tr_torrent::findFileQuickly(std::string& filename, tr_file_index_t i) const
+{
+    if (i < std::size(file_locations_))
+    {
+        if (auto const location = file_locations_[i].load(); location != FileLocation::Unknown)
         {
-            return tr_found_file_t{ file_info, filename, base };
+            if (auto const base = buildFilePath(filename, i, location); base)
+            {
+                return tr_found_file_t{ tr_sys_path_info{}, filename, *base };
+            }
         }
     }
 
-    return {};
+    return findFile(filename, i);
+}
+
+void tr_torrent::forgetFileLocations() const
+{
+    if (std::size(file_locations_) != this->fileCount())
+    {
+        file_locations_ = std::vector<std::atomic<FileLocation>>(this->fileCount());
+    }
+
+    for (auto& location : file_locations_)
+    {
+        location = FileLocation::Unknown;
+    }
+}
+
+void tr_torrent::forgetFileLocation(tr_file_index_t i) const
+{
+    if (i < std::size(file_locations_))
+    {
+        file_locations_[i] = FileLocation::Unknown;
+    }
 }
 
 // TODO: clients that call this should call tr_torrent::findFile() instead
@@ -2911,6 +3078,8 @@ static void refreshCurrentDir(tr_torrent* tor)
 {
     char const* dir = nullptr;
 
+    tor->forgetFileLocations();
+
     if (tor->incompleteDir == nullptr)
     {
         dir = tor->downloadDir;
@@ -2939,91 +3108,34 @@ char* tr_torrentBuildPartial(tr_torrent const* tor, tr_file_index_t i)
 ****
 ***/
 
-#ifdef TR_ENABLE_ASSERTS
-
-static bool queueIsSequenced(tr_session* session)
-{
-    auto torrents = tr_sessionGetTorrents(session);
-    std::sort(
-        std::begin(torrents),
-        std::end(torrents),
-        [](auto const* a, auto const* b) { return a->queuePosition < b->queuePosition; });
-
-#if 0
-
-    fprintf(stderr, "%s", "queue: ");
-
-    for (int i = 0; i < n; ++i)
-    {
-        fprintf(stderr, "%d ", tmp[i]->queuePosition);
-    }
-
-    fputc('\n', stderr);
-
-#endif
-
-    /* test them */
-    bool is_sequenced = true;
-
-    for (int i = 0, n = std::size(torrents); is_sequenced && i < n; ++i)
-    {
-        is_sequenced = torrents[i]->queuePosition == i;
-    }
-
-    return is_sequenced;
-}
-
-#endif
-
 int tr_torrentGetQueuePosition(tr_torrent const* tor)
 {
-    return tor->queuePosition;
+    return int(tor->session->torrent_queue.position(tor));
 }
 
 void tr_torrentSetQueuePosition(tr_torrent* tor, int pos)
 {
-    int back = -1;
-    int const old_pos = tor->queuePosition;
+    auto& queue = tor->session->torrent_queue;
+    auto const old_pos = queue.position(tor);
     time_t const now = tr_time();
 
-    if (pos < 0)
+    queue.move(tor, std::max(pos, 0));
+
+    if (auto const new_pos = queue.position(tor); new_pos != old_pos)
     {
-        pos = 0;
+        markQueueMoved(tor->session, std::min(old_pos, new_pos), std::max(old_pos, new_pos) + 1, now);
     }
-
-    tor->queuePosition = -1;
-
-    for (auto* walk : tor->session->torrents)
+    else
     {
-        if ((old_pos < pos) && (old_pos <= walk->queuePosition) && (walk->queuePosition <= pos))
-        {
-            walk->queuePosition--;
-            walk->anyDate = now;
-        }
-
-        if ((old_pos > pos) && (pos <= walk->queuePosition) && (walk->queuePosition < old_pos))
-        {
-            walk->queuePosition++;
-            walk->anyDate = now;
-        }
-
-        if (back < walk->queuePosition)
-        {
-            back = walk->queuePosition;
-        }
+        tor->markChanged(now);
     }
-
-    tor->queuePosition = std::min(pos, back + 1);
-    tor->anyDate = now;
-
-    TR_ASSERT(queueIsSequenced(tor->session));
 }
 
 struct CompareTorrentByQueuePosition
 {
     bool operator()(tr_torrent const* a, tr_torrent const* b) const
     {
-        return a->queuePosition < b->queuePosition;
+        return tr_torrentGetQueuePosition(a) < tr_torrentGetQueuePosition(b);
     }
 };
 
@@ -3043,7 +3155,7 @@ void tr_torrentsQueueMoveUp(tr_torrent* const* torrents_in, size_t n)
     std::sort(std::begin(torrents), std::end(torrents), CompareTorrentByQueuePosition{});
     for (auto* tor : torrents)
     {
-        tr_torrentSetQueuePosition(tor, tor->queuePosition - 1);
+        tr_torrentSetQueuePosition(tor, tr_torrentGetQueuePosition(tor) - 1);
     }
 }
 
@@ -3053,7 +3165,7 @@ void tr_torrentsQueueMoveDown(tr_torrent* const* torrents_in, size_t n)
     std::sort(std::rbegin(torrents), std::rend(torrents), CompareTorrentByQueuePosition{});
     for (auto* tor : torrents)
     {
-        tr_torrentSetQueuePosition(tor, tor->queuePosition + 1);
+        tr_torrentSetQueuePosition(tor, tr_torrentGetQueuePosition(tor) + 1);
     }
 }
 
@@ -3074,7 +3186,9 @@ static void torrentSetQueued(tr_torrent* tor, bool queued)
     if (tr_torrentIsQueued(tor) != queued)
     {
         tor->isQueued = queued;
-        tor->anyDate = tr_time();
+        tor->session->torrent_queue.setQueued(tor, queued);
+        tor->session->torrent_index.update(tor);
+        tor->markChanged(tr_time());
         tr_torrentSetDirty(tor);
     }
 }
@@ -3167,7 +3281,7 @@ static int renamePath(tr_torrent* tor, char const* oldpath, char const* newname)
 static void renameTorrentFileString(tr_torrent* tor, char const* oldpath, char const* newname, tr_file_index_t fileIndex)
 {
     char* name = nullptr;
-    tr_file& file = tor->file(fileIndex);
+    auto const file = tor->file(fileIndex);
     size_t const oldpath_len = strlen(oldpath);
 
     if (strchr(oldpath, TR_PATH_DELIMITER) == nullptr)
@@ -3202,16 +3316,13 @@ static void renameTorrentFileString(tr_torrent* tor, char const* oldpath, char c
         tr_free(tmp);
     }
 
-    if (strcmp(file.name, name) == 0)
+    if (strcmp(file.name, name) != 0)
     {
-        tr_free(name);
-    }
-    else
-    {
-        tr_free(file.name);
-        file.name = name;
-        file.priv.is_renamed = true;
+        tor->fileTable().rename(fileIndex, name);
+        tor->forgetFileLocation(fileIndex);
     }
+
+    tr_free(name);
 }
 
 struct rename_data
@@ -3282,7 +3393,7 @@ static void torrentRenamePath(void* vdata)
     ****
     ***/
 
-    tor->anyDate = tr_time();
+    tor->markChanged(tr_time());
 
     /* callback */
     if (data->callback != nullptr)
@@ -3328,7 +3439,7 @@ void tr_torrentRenamePath(
 void tr_torrent::swapMetainfo(tr_metainfo_parsed& parsed)
 {
     std::swap(this->info, parsed.info);
-    std::swap(this->piece_checksums_, parsed.pieces);
+    this->piece_checksums_.swap(parsed.pieces);
     std::swap(this->infoDictLength, parsed.info_dict_length);
 }
 
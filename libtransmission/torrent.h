@@ -12,6 +12,7 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <atomic>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -24,8 +25,11 @@
 #include "bitfield.h"
 #include "block-info.h"
 #include "completion.h"
+#include "field-versions.h"
 #include "file.h"
 #include "file-piece-map.h"
+#include "file-table.h"
+#include "piece-checksums.h"
 #include "quark.h"
 #include "session.h"
 #include "tr-assert.h"
@@ -56,10 +60,25 @@ bool tr_ctorSaveContents(tr_ctor const* ctor, char const* filename, tr_error** e
 
 bool tr_ctorGetMetainfo(tr_ctor const* ctor, tr_variant const** setme);
 
+/* where the info dict's `pieces` string starts in the ctor's contents */
+bool tr_ctorGetPiecesOffset(tr_ctor const* ctor, uint64_t* setme);
+
 tr_session* tr_ctorGetSession(tr_ctor const* ctor);
 
 bool tr_ctorGetIncompleteDir(tr_ctor const* ctor, char const** setmeIncompleteDir);
 
+/**
+ * Like tr_torrentNew(), but with metainfo that's already been parsed
+ * and, if `resume` isn't null, a resume file from tr_torrentReadResume().
+ * This lets tr_sessionLoadTorrents() do that work on other threads.
+ */
+tr_torrent* tr_torrentNewPreloaded(
+    tr_ctor const* ctor,
+    tr_metainfo_parsed& parsed,
+    tr_variant* resume,
+    int* setme_error,
+    int* setme_duplicate_id);
+
 /**
 ***
 **/
@@ -152,7 +171,23 @@ public:
     tr_sha1_digest_t pieceHash(tr_piece_index_t i) const
     {
         TR_ASSERT(i < std::size(this->piece_checksums_));
-        return this->piece_checksums_[i];
+        return this->piece_checksums_.get(i);
+    }
+
+    // read the piece hashes from `filename` when they're needed instead of keeping them in memory
+    void setPieceHashSource(std::string filename, uint64_t offset)
+    {
+        this->piece_checksums_.setSource(std::move(filename), offset);
+    }
+
+    bool hasPieceHashSource() const
+    {
+        return this->piece_checksums_.hasSource();
+    }
+
+    void releaseIdlePieceHashes(time_t idle_since)
+    {
+        this->piece_checksums_.releaseIfIdle(idle_since);
     }
 
     // these functions should become private when possible,
@@ -246,6 +281,20 @@ public:
         return fpm_.pieceSpan(file);
     }
 
+    auto fileOffset(tr_piece_index_t piece, uint32_t piece_offset) const
+    {
+        return fpm_.fileOffset(offset(piece, piece_offset));
+    }
+
+    void fileSegments(
+        tr_piece_index_t piece,
+        uint32_t piece_offset,
+        uint64_t length,
+        std::vector<tr_file_piece_map::file_segment_t>& setme) const
+    {
+        fpm_.segments(offset(piece, piece_offset), length, setme);
+    }
+
     /// WANTED
 
     bool pieceIsWanted(tr_piece_index_t piece) const final
@@ -296,18 +345,21 @@ public:
         return info.fileCount;
     }
 
-    auto& file(tr_file_index_t i)
+    tr_file file(tr_file_index_t i) const
     {
         TR_ASSERT(i < this->fileCount());
 
-        return info.files[i];
+        return info.files->get(i);
     }
 
-    auto const& file(tr_file_index_t i) const
+    tr_file_table& fileTable()
     {
-        TR_ASSERT(i < this->fileCount());
+        return *info.files;
+    }
 
-        return info.files[i];
+    tr_file_table const& fileTable() const
+    {
+        return *info.files;
     }
 
     struct tr_found_file_t : public tr_sys_path_info
@@ -327,6 +379,20 @@ public:
 
     std::optional<tr_found_file_t> findFile(std::string& filename, tr_file_index_t i) const;
 
+    /**
+     * Like findFile(), but trusts the file to still be where it was last
+     * found instead of checking, so the tr_sys_path_info isn't filled in.
+     * For callers that are about to open the file anyway.
+     */
+    std::optional<tr_found_file_t> findFileQuickly(std::string& filename, tr_file_index_t i) const;
+
+    /** @return every place that findFile() looks for file `i` */
+    [[nodiscard]] std::vector<std::string> filePaths(tr_file_index_t i) const;
+
+    /* call when files may have moved, e.g. by renaming or relocating them */
+    void forgetFileLocations() const;
+    void forgetFileLocation(tr_file_index_t i) const;
+
     /// WEBSEEDS
 
     auto webseedCount() const
@@ -360,7 +426,7 @@ public:
         }
 
         bool const checked = checkPiece(piece);
-        this->anyDate = tr_time();
+        this->markChanged(tr_time());
         this->setDirty();
 
         checked_pieces_.set(piece, checked);
@@ -378,7 +444,7 @@ public:
             auto const found = this->findFile(filename, i);
             auto const mtime = found ? found->last_modified_at : 0;
 
-            this->file(i).priv.mtime = mtime;
+            this->fileTable().setMtime(i, mtime);
 
             // if a file has changed, mark its pieces as unchecked
             if (mtime == 0 || mtime != mtimes[i])
@@ -477,7 +543,9 @@ public:
 
     time_t activityDate = 0;
     time_t addedDate = 0;
-    time_t anyDate = 0;
+    // the newest of the other dates, or of any change that RPC clients would want to know about.
+    // Atomic since markChanged() is also called from the verify thread.
+    std::atomic<time_t> anyDate = 0;
     time_t doneDate = 0;
     time_t editDate = 0;
     time_t startDate = 0;
@@ -485,8 +553,6 @@ public:
     int secondsDownloading = 0;
     int secondsSeeding = 0;
 
-    int queuePosition = 0;
-
     tr_torrent_metadata_func metadata_func = nullptr;
     void* metadata_func_user_data = nullptr;
 
@@ -518,8 +584,27 @@ public:
     void setDirty()
     {
         this->isDirty = true;
+        ++this->settings_version;
     }
 
+    // Bump anyDate to `when` and, if that's now, note the change
+    // in the session's activity journal for RPC "recently-active".
+    // Safe to call from the verify thread.
+    void markChanged(time_t when);
+
+    // this torrent's newest entry in the session's activity journal
+    std::atomic<uint64_t> activity_seq = 0;
+
+    // bumped whenever a setting or the tr_info changes, so that RPC
+    // change tracking can skip recomputing fields that only change then
+    uint32_t settings_version = 0;
+
+    // bumped by markChanged()
+    std::atomic<uint32_t> change_count = 0;
+
+    // when each RPC field last changed, for torrent-get change tokens
+    tr_field_versions field_versions;
+
     uint16_t maxConnectedPeers = TR_DEFAULT_PEER_LIMIT_TORRENT;
 
     tr_verify_state verifyState = TR_VERIFY_NONE;
@@ -559,7 +644,22 @@ private:
         }
     }
 
-    mutable std::vector<tr_sha1_digest_t> piece_checksums_;
+    mutable tr_piece_checksums piece_checksums_;
+
+    // where each file was last found, so that we needn't stat()
+    // each place it might be every time it's opened
+    enum class FileLocation : uint8_t
+    {
+        Unknown,
+        DownloadDir,
+        DownloadDirPartial,
+        IncompleteDir,
+        IncompleteDirPartial
+    };
+
+    std::optional<std::string_view> buildFilePath(std::string& setme, tr_file_index_t i, FileLocation location) const;
+
+    mutable std::vector<std::atomic<FileLocation>> file_locations_;
 };
 
 static inline bool tr_torrentExists(tr_session const* session, uint8_t const* torrentHash)
@@ -614,6 +714,7 @@ constexpr void tr_torrentSetDirty(tr_torrent* tor)
     TR_ASSERT(tr_isTorrent(tor));
 
     tor->isDirty = true;
+    ++tor->settings_version;
 }
 
 /* note that the torrent's tr_info just changed */
@@ -622,6 +723,7 @@ static inline void tr_torrentMarkEdited(tr_torrent* tor)
     TR_ASSERT(tr_isTorrent(tor));
 
     tor->editDate = tr_time();
+    ++tor->settings_version;
 }
 
 /**
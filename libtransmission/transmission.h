@@ -43,6 +43,7 @@ struct tr_block_span_t
 
 struct tr_ctor;
 struct tr_file;
+struct tr_file_table;
 struct tr_error;
 struct tr_info;
 struct tr_session;
@@ -1526,7 +1527,7 @@ struct tr_file_priv
 struct tr_file
 {
     // public
-    char* name; /* Path to the file */
+    char const* name; /* Path to the file */
     uint64_t length; /* Length of the file, in bytes */
 
     // libtransmission implementation; do not use
@@ -1554,8 +1555,9 @@ struct tr_info
     char* source;
 
     // Private.
-    // Use tr_torrentFile() and tr_torrentFileCount() instead.
-    tr_file* files;
+    // Use tr_torrentFile() and tr_torrentFileCount() instead,
+    // or tr_infoFile() for an info that isn't a torrent's.
+    struct tr_file_table* files;
 
     /* these trackers are sorted by tier */
     tr_tracker_info* trackers;
@@ -1578,6 +1580,12 @@ struct tr_info
     bool isFolder;
 };
 
+/**
+ * @brief the nth file of a parsed info, e.g. one from tr_torrentParse().
+ * The name is owned by `inf` and is only valid while `inf` is.
+ */
+tr_file tr_infoFile(tr_info const* inf, tr_file_index_t i);
+
 static inline bool tr_torrentHasMetadata(tr_torrent const* tor)
 {
     tr_info const* const inf = tr_torrentInfo(tor);
@@ -1650,6 +1658,12 @@ struct tr_stat
         @see tr_stat.activity */
     float recheckProgress;
 
+    /** While the torrent's new files are being created and preallocated
+        in the background, this is how much of that is done. It's 1 when
+        there's nothing left to preallocate.
+        Range is [0..1] */
+    float preallocationProgress;
+
     /** How much has been downloaded of the entire torrent.
         Range is [0..1] */
     float percentComplete;
@@ -6,6 +6,8 @@
  *
  */
 
+#include <array>
+#include <charconv>
 #include <cstdlib>
 #include <cctype> /* isdigit() */
 #include <deque>
@@ -21,8 +23,9 @@
 
 #include "transmission.h"
 
+#include "staging-buffer.h"
 #include "tr-assert.h"
-#include "utils.h" /* tr_snprintf() */
+#include "utils.h"
 #include "variant-common.h"
 #include "variant.h"
 
@@ -154,7 +157,12 @@ static tr_variant* get_node(std::deque<tr_variant*>& stack, std::optional<tr_qua
  * easier to read, but was vulnerable to a smash-stacking
  * attack via maliciously-crafted bencoded data. (#667)
  */
-int tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc, char const** setme_end)
+int tr_variantParseBenc(
+    tr_variant& top,
+    int parse_opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_variant_arena* arena)
 {
     TR_ASSERT((parse_opts & TR_VARIANT_PARSE_BENC) != 0);
 
@@ -197,7 +205,7 @@ int tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc,
 
             if (tr_variant* const v = get_node(stack, key, &top, &err); v != nullptr)
             {
-                tr_variantInitList(v, 0);
+                tr_variantInitContainer(v, TR_VARIANT_TYPE_LIST, 0, arena);
                 stack.push_back(v);
             }
             break;
@@ -207,7 +215,7 @@ int tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc,
 
             if (tr_variant* const v = get_node(stack, key, &top, &err); v != nullptr)
             {
-                tr_variantInitDict(v, 0);
+                tr_variantInitContainer(v, TR_VARIANT_TYPE_DICT, 0, arena);
                 stack.push_back(v);
             }
             break;
@@ -297,61 +305,69 @@ int tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc,
 *****
 ****/
 
-static void saveIntFunc(tr_variant const* val, void* vevbuf)
+static void saveStringLength(tr_staging_buffer* out, size_t len)
 {
-    auto* evbuf = static_cast<struct evbuffer*>(vevbuf);
-    evbuffer_add_printf(evbuf, "i%" PRId64 "e", val->val.i);
+    auto constexpr MaxLen = size_t{ 24 };
+    auto* const begin = out->reserve(MaxLen);
+    auto* const walk = std::to_chars(begin, begin + MaxLen, len).ptr;
+    *walk = ':';
+    out->commit(walk + 1 - begin);
 }
 
-static void saveBoolFunc(tr_variant const* val, void* vevbuf)
+static void saveIntFunc(tr_variant const* val, void* vout)
 {
-    auto* evbuf = static_cast<struct evbuffer*>(vevbuf);
-    if (val->val.b)
-    {
-        evbuffer_add(evbuf, "i1e", 3);
-    }
-    else
-    {
-        evbuffer_add(evbuf, "i0e", 3);
-    }
+    auto constexpr MaxLen = size_t{ 26 };
+    auto* const begin = static_cast<tr_staging_buffer*>(vout)->reserve(MaxLen);
+    auto* const end = begin + MaxLen;
+
+    auto* walk = begin;
+    *walk++ = 'i';
+    walk = std::to_chars(walk, end, val->val.i).ptr;
+    *walk++ = 'e';
+
+    static_cast<tr_staging_buffer*>(vout)->commit(walk - begin);
+}
+
+static void saveBoolFunc(tr_variant const* val, void* vout)
+{
+    static_cast<tr_staging_buffer*>(vout)->append(val->val.b ? "i1e"sv : "i0e"sv);
 }
 
-static void saveRealFunc(tr_variant const* val, void* vevbuf)
+// benc has no reals, so they're saved as strings of the form "%f"
+static void saveRealFunc(tr_variant const* val, void* vout)
 {
-    auto buf = std::array<char, 64>{};
-    int const len = tr_snprintf(std::data(buf), std::size(buf), "%f", val->val.d);
+    auto buf = std::array<char, 512>{};
+    auto* const begin = std::data(buf);
+    auto const [end, ec] = std::to_chars(begin, begin + std::size(buf), val->val.d, std::chars_format::fixed, 6);
 
-    auto* evbuf = static_cast<evbuffer*>(vevbuf);
-    evbuffer_add_printf(evbuf, "%d:", len);
-    evbuffer_add(evbuf, std::data(buf), len);
+    auto* const out = static_cast<tr_staging_buffer*>(vout);
+    saveStringLength(out, end - begin);
+    out->append({ begin, size_t(end - begin) });
 }
 
-static void saveStringFunc(tr_variant const* v, void* vevbuf)
+static void saveStringFunc(tr_variant const* v, void* vout)
 {
     auto sv = std::string_view{};
     (void)!tr_variantGetStrView(v, &sv);
 
-    auto* evbuf = static_cast<struct evbuffer*>(vevbuf);
-    evbuffer_add_printf(evbuf, "%zu:", std::size(sv));
-    evbuffer_add(evbuf, std::data(sv), std::size(sv));
+    auto* const out = static_cast<tr_staging_buffer*>(vout);
+    saveStringLength(out, std::size(sv));
+    out->append(sv);
 }
 
-static void saveDictBeginFunc(tr_variant const* /*val*/, void* vevbuf)
+static void saveDictBeginFunc(tr_variant const* /*val*/, void* vout)
 {
-    auto* evbuf = static_cast<struct evbuffer*>(vevbuf);
-    evbuffer_add(evbuf, "d", 1);
+    static_cast<tr_staging_buffer*>(vout)->push_back('d');
 }
 
-static void saveListBeginFunc(tr_variant const* /*val*/, void* vevbuf)
+static void saveListBeginFunc(tr_variant const* /*val*/, void* vout)
 {
-    auto* evbuf = static_cast<struct evbuffer*>(vevbuf);
-    evbuffer_add(evbuf, "l", 1);
+    static_cast<tr_staging_buffer*>(vout)->push_back('l');
 }
 
-static void saveContainerEndFunc(tr_variant const* /*val*/, void* vevbuf)
+static void saveContainerEndFunc(tr_variant const* /*val*/, void* vout)
 {
-    auto* evbuf = static_cast<struct evbuffer*>(vevbuf);
-    evbuffer_add(evbuf, "e", 1);
+    static_cast<tr_staging_buffer*>(vout)->push_back('e');
 }
 
 static struct VariantWalkFuncs const walk_funcs = {
@@ -366,5 +382,6 @@ static struct VariantWalkFuncs const walk_funcs = {
 
 void tr_variantToBufBenc(tr_variant const* top, struct evbuffer* buf)
 {
-    tr_variantWalk(top, &walk_funcs, buf, true);
+    auto out = tr_staging_buffer{ buf };
+    tr_variantWalk(top, &walk_funcs, &out, true);
 }
@@ -40,12 +40,25 @@ void tr_variantToBufBenc(tr_variant const* top, struct evbuffer* buf);
 
 void tr_variantInit(tr_variant* v, char type);
 
+/** @brief init a list or dict whose child array comes from `arena`, if it's not null */
+void tr_variantInitContainer(tr_variant* v, char type, size_t reserve_count, tr_variant_arena* arena);
+
 /** @brief Private function that's exposed here only for unit tests */
 std::optional<int64_t> tr_bencParseInt(std::string_view* benc_inout);
 
 /** @brief Private function that's exposed here only for unit tests */
 std::optional<std::string_view> tr_bencParseStr(std::string_view* benc_inout);
 
-int tr_variantParseBenc(tr_variant& setme, int opts, std::string_view benc, char const** setme_end);
+int tr_variantParseBenc(
+    tr_variant& setme,
+    int opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_variant_arena* arena);
 
-int tr_variantParseJson(tr_variant& setme, int opts, std::string_view benc, char const** setme_end);
+int tr_variantParseJson(
+    tr_variant& setme,
+    int opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_variant_arena* arena);
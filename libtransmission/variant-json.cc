@@ -21,8 +21,10 @@
 
 #include "transmission.h"
 
+#include "json-writer.h"
 #include "jsonsl.h"
 #include "log.h"
+#include "staging-buffer.h"
 #include "tr-assert.h"
 #include "utils.h"
 #include "variant-common.h"
@@ -42,6 +44,7 @@ struct json_wrapper_data
     int error;
     std::deque<tr_variant*> stack;
     tr_variant* top;
+    tr_variant_arena* arena;
     int parse_opts;
 
     /* A very common pattern is for a container's children to be similar,
@@ -106,14 +109,8 @@ static void action_callback_PUSH(
 
         int const depth = std::size(data->stack);
         size_t const n = depth < MAX_DEPTH ? data->preallocGuess[depth] : 0;
-        if (state->type == JSONSL_T_LIST)
-        {
-            tr_variantInitList(node, n);
-        }
-        else
-        {
-            tr_variantInitDict(node, n);
-        }
+        char const type = state->type == JSONSL_T_LIST ? TR_VARIANT_TYPE_LIST : TR_VARIANT_TYPE_DICT;
+        tr_variantInitContainer(node, type, n, data->arena);
     }
 }
 
@@ -289,6 +286,10 @@ static void action_callback_POP(
         {
             tr_variantInitStrView(get_node(jsn), str);
         }
+        else if (data->arena != nullptr)
+        {
+            tr_variantInitStrView(get_node(jsn), data->arena->copy(str));
+        }
         else
         {
             tr_variantInitStr(get_node(jsn), str);
@@ -339,7 +340,12 @@ static void action_callback_POP(
     }
 }
 
-int tr_variantParseJson(tr_variant& setme, int parse_opts, std::string_view benc, char const** setme_end)
+int tr_variantParseJson(
+    tr_variant& setme,
+    int parse_opts,
+    std::string_view benc,
+    char const** setme_end,
+    tr_variant_arena* arena)
 {
     TR_ASSERT((parse_opts & TR_VARIANT_PARSE_JSON) != 0);
 
@@ -361,6 +367,7 @@ int tr_variantParseJson(tr_variant& setme, int parse_opts, std::string_view benc
     data.stack = {};
     data.strbuf = evbuffer_new();
     data.top = &setme;
+    data.arena = arena;
 
     /* parse it */
     jsonsl_feed(jsn, static_cast<jsonsl_char_t const*>(std::data(benc)), std::size(benc));
@@ -398,9 +405,15 @@ struct ParentState
 
 struct jsonWalk
 {
+    jsonWalk(struct evbuffer* buf, bool lean)
+        : doIndent{ !lean }
+        , out{ buf }
+    {
+    }
+
     bool doIndent;
     std::deque<ParentState> parents;
-    struct evbuffer* out;
+    tr_staging_buffer out;
 };
 
 static void jsonIndent(struct jsonWalk* data)
@@ -415,7 +428,7 @@ static void jsonIndent(struct jsonWalk* data)
 
     if (data->doIndent)
     {
-        evbuffer_add(data->out, buf, std::size(data->parents) * 4 + 1);
+        data->out.append({ buf, std::size(data->parents) * 4 + 1 });
     }
 }
 
@@ -434,14 +447,14 @@ static void jsonChildFunc(struct jsonWalk* data)
 
                 if (i % 2 == 0)
                 {
-                    evbuffer_add(data->out, ": ", data->doIndent ? 2 : 1);
+                    data->out.append(data->doIndent ? ": "sv : ":"sv);
                 }
                 else
                 {
                     bool const is_last = pstate.childIndex == pstate.childCount;
                     if (!is_last)
                     {
-                        evbuffer_add(data->out, ",", 1);
+                        data->out.push_back(',');
                         jsonIndent(data);
                     }
                 }
@@ -455,7 +468,7 @@ static void jsonChildFunc(struct jsonWalk* data)
                 bool const is_last = pstate.childIndex == pstate.childCount;
                 if (!is_last)
                 {
-                    evbuffer_add(data->out, ",", 1);
+                    data->out.push_back(',');
                     jsonIndent(data);
                 }
 
@@ -482,7 +495,7 @@ static void jsonPopParent(struct jsonWalk* data)
 static void jsonIntFunc(tr_variant const* val, void* vdata)
 {
     auto* data = static_cast<struct jsonWalk*>(vdata);
-    evbuffer_add_printf(data->out, "%" PRId64, val->val.i);
+    tr_jsonAddInt(data->out, val->val.i);
     jsonChildFunc(data);
 }
 
@@ -492,11 +505,11 @@ static void jsonBoolFunc(tr_variant const* val, void* vdata)
 
     if (val->val.b)
     {
-        evbuffer_add(data->out, "true", 4);
+        data->out.append("true"sv);
     }
     else
     {
-        evbuffer_add(data->out, "false", 5);
+        data->out.append("false"sv);
     }
 
     jsonChildFunc(data);
@@ -505,101 +518,17 @@ static void jsonBoolFunc(tr_variant const* val, void* vdata)
 static void jsonRealFunc(tr_variant const* val, void* vdata)
 {
     auto* data = static_cast<struct jsonWalk*>(vdata);
-
-    if (fabs(val->val.d - (int)val->val.d) < 0.00001)
-    {
-        evbuffer_add_printf(data->out, "%d", (int)val->val.d);
-    }
-    else
-    {
-        evbuffer_add_printf(data->out, "%.4f", tr_truncd(val->val.d, 4));
-    }
-
+    tr_jsonAddReal(data->out, val->val.d);
     jsonChildFunc(data);
 }
 
 static void jsonStringFunc(tr_variant const* val, void* vdata)
 {
-    struct evbuffer_iovec vec[1];
     auto* data = static_cast<struct jsonWalk*>(vdata);
 
     auto sv = std::string_view{};
     (void)!tr_variantGetStrView(val, &sv);
-
-    evbuffer_reserve_space(data->out, std::size(sv) * 4, vec, 1);
-    auto* out = static_cast<char*>(vec[0].iov_base);
-    char const* const outend = out + vec[0].iov_len;
-
-    char* outwalk = out;
-    *outwalk++ = '"';
-
-    for (; !std::empty(sv); sv.remove_prefix(1))
-    {
-        switch (sv.front())
-        {
-        case '\b':
-            *outwalk++ = '\\';
-            *outwalk++ = 'b';
-            break;
-
-        case '\f':
-            *outwalk++ = '\\';
-            *outwalk++ = 'f';
-            break;
-
-        case '\n':
-            *outwalk++ = '\\';
-            *outwalk++ = 'n';
-            break;
-
-        case '\r':
-            *outwalk++ = '\\';
-            *outwalk++ = 'r';
-            break;
-
-        case '\t':
-            *outwalk++ = '\\';
-            *outwalk++ = 't';
-            break;
-
-        case '"':
-            *outwalk++ = '\\';
-            *outwalk++ = '"';
-            break;
-
-        case '\\':
-            *outwalk++ = '\\';
-            *outwalk++ = '\\';
-            break;
-
-        default:
-            if (isprint(sv.front()))
-            {
-                *outwalk++ = sv.front();
-            }
-            else
-            {
-                try
-                {
-                    auto* begin8 = std::data(sv);
-                    auto* end8 = begin8 + std::size(sv);
-                    auto* walk8 = begin8;
-                    auto const uch32 = utf8::next(walk8, end8);
-                    outwalk += tr_snprintf(outwalk, outend - outwalk, "\\u%04x", uch32);
-                    sv.remove_prefix(walk8 - begin8 - 1);
-                }
-                catch (utf8::exception const&)
-                {
-                    *outwalk++ = '?';
-                }
-            }
-            break;
-        }
-    }
-
-    *outwalk++ = '"';
-    vec[0].iov_len = outwalk - out;
-    evbuffer_commit_space(data->out, vec, 1);
+    tr_jsonAddString(data->out, sv);
 
     jsonChildFunc(data);
 }
@@ -609,7 +538,7 @@ static void jsonDictBeginFunc(tr_variant const* val, void* vdata)
     auto* data = static_cast<struct jsonWalk*>(vdata);
 
     jsonPushParent(data, val);
-    evbuffer_add(data->out, "{", 1);
+    data->out.push_back('{');
 
     if (val->val.l.count != 0)
     {
@@ -623,7 +552,7 @@ static void jsonListBeginFunc(tr_variant const* val, void* vdata)
     auto* data = static_cast<struct jsonWalk*>(vdata);
 
     jsonPushParent(data, val);
-    evbuffer_add(data->out, "[", 1);
+    data->out.push_back('[');
 
     if (nChildren != 0)
     {
@@ -641,11 +570,11 @@ static void jsonContainerEndFunc(tr_variant const* val, void* vdata)
 
     if (tr_variantIsDict(val))
     {
-        evbuffer_add(data->out, "}", 1);
+        data->out.push_back('}');
     }
     else /* list */
     {
-        evbuffer_add(data->out, "]", 1);
+        data->out.push_back(']');
     }
 
     jsonChildFunc(data);
@@ -663,12 +592,10 @@ static struct VariantWalkFuncs const walk_funcs = {
 
 void tr_variantToBufJson(tr_variant const* top, struct evbuffer* buf, bool lean)
 {
-    struct jsonWalk data;
-
-    data.doIndent = !lean;
-    data.out = buf;
+    struct jsonWalk data(buf, lean);
 
     tr_variantWalk(top, &walk_funcs, &data, true);
+    data.out.flush();
 
     if (evbuffer_get_length(buf) != 0)
     {
@@ -17,6 +17,7 @@
 
 #include <algorithm> // std::sort
 #include <cerrno>
+#include <cstdint> /* uintptr_t */
 #include <stack>
 #include <cstdlib> /* strtod() */
 #include <cstring>
@@ -113,6 +114,60 @@ static void restore_locale(struct locale_context* context)
 ****
 ***/
 
+void* tr_variant_arena::allocate(size_t size, size_t alignment)
+{
+    auto const align = [alignment](char* p)
+    {
+        auto const offset = reinterpret_cast<uintptr_t>(p) % alignment;
+        return offset == 0 ? p : p + (alignment - offset);
+    };
+
+    auto* ptr = align(pos_);
+
+    if (pos_ == nullptr || ptr > end_ || size_t(end_ - ptr) < size)
+    {
+        auto const n = std::max(block_size_, size + alignment);
+        blocks_.emplace_back(new char[n]);
+        pos_ = blocks_.back().get();
+        end_ = pos_ + n;
+        ptr = align(pos_);
+    }
+
+    pos_ = ptr + size;
+    last_ = ptr;
+    return ptr;
+}
+
+void* tr_variant_arena::reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment)
+{
+    if (ptr != nullptr && ptr == last_ && size_t(end_ - static_cast<char*>(ptr)) >= new_size)
+    {
+        pos_ = static_cast<char*>(ptr) + new_size;
+        return ptr;
+    }
+
+    auto* const new_ptr = allocate(new_size, alignment);
+
+    if (old_size != 0)
+    {
+        memcpy(new_ptr, ptr, old_size);
+    }
+
+    return new_ptr;
+}
+
+std::string_view tr_variant_arena::copy(std::string_view str)
+{
+    auto* const ptr = static_cast<char*>(allocate(std::size(str) + 1, 1));
+    std::copy_n(std::data(str), std::size(str), ptr);
+    ptr[std::size(str)] = '\0';
+    return { ptr, std::size(str) };
+}
+
+/***
+****
+***/
+
 static bool tr_variantIsContainer(tr_variant const* v)
 {
     return tr_variantIsList(v) || tr_variantIsDict(v);
@@ -225,17 +280,111 @@ static constexpr char const* getStr(tr_variant const* v)
     return tr_variant_string_get_string(&v->val.s);
 }
 
+/***
+****  A dict with room for many children also keeps a hash index of
+****  their keys. It lives in the same allocation, after the children,
+****  so that lookups needn't compare every key.
+***/
+
+static auto constexpr DictIndexMinAlloc = size_t{ 32 };
+
+// each slot holds a child's index + 1, or 0 if it's empty
+using DictIndexSlot = uint32_t;
+
+static constexpr bool dictHasIndex(tr_variant const* dict)
+{
+    return dict->val.l.alloc >= DictIndexMinAlloc;
+}
+
+// keep the index at most half full. alloc is a power of two, so this is too
+static constexpr size_t dictIndexSlotCount(size_t alloc)
+{
+    return alloc * 2;
+}
+
+static constexpr size_t containerAllocSize(tr_variant const* v, size_t alloc)
+{
+    auto size = alloc * sizeof(tr_variant);
+
+    if (tr_variantIsDict(v) && alloc >= DictIndexMinAlloc)
+    {
+        size += dictIndexSlotCount(alloc) * sizeof(DictIndexSlot);
+    }
+
+    return size;
+}
+
+static DictIndexSlot* dictIndexSlots(tr_variant const* dict)
+{
+    return reinterpret_cast<DictIndexSlot*>(dict->val.l.vals + dict->val.l.alloc);
+}
+
+static constexpr size_t dictIndexHash(tr_quark const key)
+{
+    return size_t((uint64_t(key) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static void dictIndexInsert(tr_variant const* dict, size_t i)
+{
+    auto* const slots = dictIndexSlots(dict);
+    auto const mask = dictIndexSlotCount(dict->val.l.alloc) - 1;
+    auto const key = dict->val.l.vals[i].key;
+
+    for (auto pos = dictIndexHash(key) & mask;; pos = (pos + 1) & mask)
+    {
+        if (slots[pos] == 0)
+        {
+            slots[pos] = DictIndexSlot(i + 1);
+            return;
+        }
+
+        // a duplicate key; lookups find the first one
+        if (dict->val.l.vals[slots[pos] - 1].key == key)
+        {
+            return;
+        }
+    }
+}
+
+static void dictIndexRebuild(tr_variant const* dict)
+{
+    std::fill_n(dictIndexSlots(dict), dictIndexSlotCount(dict->val.l.alloc), DictIndexSlot{ 0 });
+
+    for (size_t i = 0, n = dict->val.l.count; i < n; ++i)
+    {
+        dictIndexInsert(dict, i);
+    }
+}
+
 static int dictIndexOf(tr_variant const* dict, tr_quark const key)
 {
-    if (tr_variantIsDict(dict))
+    if (!tr_variantIsDict(dict))
+    {
+        return -1;
+    }
+
+    if (dictHasIndex(dict))
     {
-        for (size_t i = 0; i < dict->val.l.count; ++i)
+        auto const* const slots = dictIndexSlots(dict);
+        auto const mask = dictIndexSlotCount(dict->val.l.alloc) - 1;
+
+        for (auto pos = dictIndexHash(key) & mask; slots[pos] != 0; pos = (pos + 1) & mask)
         {
-            if (dict->val.l.vals[i].key == key)
+            if (auto const i = slots[pos] - 1; dict->val.l.vals[i].key == key)
             {
-                return (int)i;
+                return int(i);
             }
         }
+
+        return -1;
+    }
+
+    for (size_t i = 0; i < dict->val.l.count; ++i)
+    {
+        if (dict->val.l.vals[i].key == key)
+        {
+            return (int)i;
+        }
     }
 
     return -1;
@@ -515,13 +664,39 @@ static tr_variant* containerReserve(tr_variant* v, size_t count)
             n *= 2U;
         }
 
-        v->val.l.vals = tr_renew(tr_variant, v->val.l.vals, n);
+        auto const size = containerAllocSize(v, n);
+
+        if (auto* const arena = v->val.l.arena; arena != nullptr)
+        {
+            auto const old_size = v->val.l.count * sizeof(tr_variant);
+            auto* const vals = arena->reallocate(v->val.l.vals, old_size, size, alignof(tr_variant));
+            v->val.l.vals = static_cast<tr_variant*>(vals);
+        }
+        else
+        {
+            v->val.l.vals = static_cast<tr_variant*>(tr_realloc(v->val.l.vals, size));
+        }
+
         v->val.l.alloc = n;
+
+        if (tr_variantIsDict(v) && dictHasIndex(v))
+        {
+            dictIndexRebuild(v);
+        }
     }
 
     return v->val.l.vals + v->val.l.count;
 }
 
+void tr_variantInitContainer(tr_variant* v, char type, size_t reserve_count, tr_variant_arena* arena)
+{
+    TR_ASSERT(type == TR_VARIANT_TYPE_LIST || type == TR_VARIANT_TYPE_DICT);
+
+    tr_variantInit(v, type);
+    v->val.l.arena = arena;
+    containerReserve(v, reserve_count);
+}
+
 void tr_variantListReserve(tr_variant* list, size_t count)
 {
     TR_ASSERT(tr_variantIsList(list));
@@ -626,6 +801,11 @@ tr_variant* tr_variantDictAdd(tr_variant* dict, tr_quark const key)
     val->key = key;
     tr_variantInit(val, TR_VARIANT_TYPE_INT);
 
+    if (dictHasIndex(dict))
+    {
+        dictIndexInsert(dict, dict->val.l.count - 1);
+    }
+
     return val;
 }
 
@@ -745,6 +925,11 @@ bool tr_variantDictRemove(tr_variant* dict, tr_quark const key)
 
         --dict->val.l.count;
 
+        if (dictHasIndex(dict))
+        {
+            dictIndexRebuild(dict);
+        }
+
         removed = true;
     }
 
@@ -990,7 +1175,10 @@ static void freeStringFunc(tr_variant const* v, void* /*user_data*/)
 
 static void freeContainerEndFunc(tr_variant const* v, void* /*user_data*/)
 {
-    tr_free(v->val.l.vals);
+    if (v->val.l.arena == nullptr)
+    {
+        tr_free(v->val.l.vals);
+    }
 }
 
 static struct VariantWalkFuncs const freeWalkFuncs = {
@@ -1228,7 +1416,13 @@ int tr_variantToFile(tr_variant const* v, tr_variant_fmt fmt, char const* filena
 ****
 ***/
 
-bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char const** setme_end, tr_error** error)
+static bool parseBuf(
+    tr_variant* setme,
+    tr_variant_arena* arena,
+    int opts,
+    std::string_view buf,
+    char const** setme_end,
+    tr_error** error)
 {
     // supported formats: benc, json
     TR_ASSERT((opts & (TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_JSON)) != 0);
@@ -1237,8 +1431,8 @@ bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char c
     auto locale_ctx = locale_context{};
     use_numeric_locale(&locale_ctx, "C");
 
-    auto err = (opts & TR_VARIANT_PARSE_BENC) ? tr_variantParseBenc(*setme, opts, buf, setme_end) :
-                                                tr_variantParseJson(*setme, opts, buf, setme_end);
+    auto err = (opts & TR_VARIANT_PARSE_BENC) ? tr_variantParseBenc(*setme, opts, buf, setme_end, arena) :
+                                                tr_variantParseJson(*setme, opts, buf, setme_end, arena);
 
     /* restore the previous locale */
     restore_locale(&locale_ctx);
@@ -1252,6 +1446,23 @@ bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char c
     return true;
 }
 
+bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char const** setme_end, tr_error** error)
+{
+    return parseBuf(setme, nullptr, opts, buf, setme_end, error);
+}
+
+bool tr_variantFromBuf(
+    tr_variant* setme,
+    tr_variant_arena& arena,
+    int opts,
+    std::string_view buf,
+    char const** setme_end,
+    tr_error** error)
+{
+    // the strings that needn't be unescaped are views into `buf`
+    return parseBuf(setme, &arena, opts | TR_VARIANT_PARSE_INPLACE, buf, setme_end, error);
+}
+
 bool tr_variantFromFile(tr_variant* setme, tr_variant_parse_opts opts, char const* filename, tr_error** error)
 {
     // can't do inplace when this function is allocating & freeing the memory...
@@ -10,6 +10,9 @@
 
 #include <cstddef> // size_t
 #include <inttypes.h> // int64_t
+#include <memory>
+#include <string_view>
+#include <vector>
 
 #include "tr-macros.h"
 #include "quark.h"
@@ -18,6 +21,8 @@ struct evbuffer;
 
 struct tr_error;
 
+class tr_variant_arena;
+
 /**
  * @addtogroup tr_variant Variant
  *
@@ -89,12 +94,59 @@ struct tr_variant
             size_t alloc;
             size_t count;
             struct tr_variant* vals;
+
+            /* if not null, `vals` came from here and isn't ours to free */
+            tr_variant_arena* arena;
         } l;
     } val = {};
 };
 
 void tr_variantFree(tr_variant*);
 
+/**
+ * A bump allocator for parsing a tr_variant that's only needed briefly,
+ * such as an RPC request. The tree's child arrays and unescaped strings
+ * come from a few large blocks rather than from one heap allocation
+ * apiece, and destroying the arena releases them all at once.
+ *
+ * A tree parsed into an arena needn't be passed to tr_variantFree()
+ * unless heap-backed strings were added to it after parsing. Either way,
+ * the tree can't be used once the arena (or its source buffer) is gone.
+ */
+class tr_variant_arena
+{
+public:
+    static auto constexpr DefaultBlockSize = size_t{ 64 * 1024 };
+
+    explicit tr_variant_arena(size_t block_size = DefaultBlockSize)
+        : block_size_{ block_size }
+    {
+    }
+
+    tr_variant_arena(tr_variant_arena const&) = delete;
+    tr_variant_arena& operator=(tr_variant_arena const&) = delete;
+
+    [[nodiscard]] void* allocate(size_t size, size_t alignment);
+
+    /** @brief grows `ptr` in place if it was the last allocation, else moves it */
+    [[nodiscard]] void* reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment);
+
+    /** @return a zero-terminated copy of `str` */
+    [[nodiscard]] std::string_view copy(std::string_view str);
+
+    [[nodiscard]] size_t blockCount() const
+    {
+        return std::size(blocks_);
+    }
+
+private:
+    size_t const block_size_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* pos_ = nullptr;
+    char* end_ = nullptr;
+    void* last_ = nullptr;
+};
+
 /***
 ****  Serialization / Deserialization
 ***/
@@ -129,6 +181,18 @@ bool tr_variantFromBuf(
     char const** setme_end = nullptr,
     tr_error** error = nullptr);
 
+/**
+ * @brief like tr_variantFromBuf(), but the tree is allocated from `arena`.
+ * Implies TR_VARIANT_PARSE_INPLACE, so `buf` must outlive the tree too.
+ */
+bool tr_variantFromBuf(
+    tr_variant* setme,
+    tr_variant_arena& arena,
+    int variant_parse_opts,
+    std::string_view buf,
+    char const** setme_end = nullptr,
+    tr_error** error = nullptr);
+
 constexpr bool tr_variantIsType(tr_variant const* b, int type)
 {
     return b != nullptr && b->type == type;
@@ -10,7 +10,9 @@
 #include <cstdlib> /* free() */
 #include <cstring> /* memcmp() */
 #include <mutex>
+#include <optional>
 #include <set>
+#include <vector>
 
 #include "transmission.h"
 #include "completion.h"
@@ -32,108 +34,90 @@ static auto constexpr MsecToSleepPerSecondDuringVerify = int{ 100 };
 static bool verifyTorrent(tr_torrent* tor, bool* stopFlag)
 {
     tr_sys_file_t fd = TR_BAD_SYS_FILE;
-    uint64_t filePos = 0;
+    auto fd_index = std::optional<tr_file_index_t>{};
     bool changed = false;
-    bool hadPiece = false;
     time_t lastSleptAt = 0;
-    uint32_t piecePos = 0;
-    tr_file_index_t fileIndex = 0;
-    tr_file_index_t prevFileIndex = !fileIndex;
-    tr_piece_index_t piece = 0;
     time_t const begin = tr_time();
     size_t const buflen = 1024 * 128; // 128 KiB buffer
     auto* const buffer = static_cast<uint8_t*>(tr_malloc(buflen));
+    auto segments = std::vector<tr_file_piece_map::file_segment_t>{};
 
     tr_sha1_ctx_t sha = tr_sha1_init();
 
     tr_logAddTorDbg(tor, "%s", "verifying torrent...");
     tor->verify_progress = 0;
 
-    while (!*stopFlag && piece < tor->info.pieceCount)
+    for (tr_piece_index_t piece = 0; !*stopFlag && piece < tor->info.pieceCount; ++piece)
     {
-        auto const file_length = tor->file(fileIndex).length;
+        bool const hadPiece = tor->hasPiece(piece);
 
-        /* if we're starting a new piece... */
-        if (piecePos == 0)
+        tor->fileSegments(piece, 0, tor->pieceSize(piece), segments);
+        for (auto const& segment : segments)
         {
-            hadPiece = tor->hasPiece(piece);
+            /* if we're starting a new file... */
+            if (fd_index != segment.index)
+            {
+                if (fd != TR_BAD_SYS_FILE)
+                {
+                    tr_sys_file_close(fd, nullptr);
+                }
+
+                char* filename = tr_torrentFindFile(tor, segment.index);
+                fd = filename == nullptr ? TR_BAD_SYS_FILE :
+                                           tr_sys_file_open(filename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, nullptr);
+                tr_free(filename);
+                fd_index = segment.index;
+            }
+
+            /* read it a bit at a time */
+            for (uint64_t pos = 0; !*stopFlag && pos < segment.length;)
+            {
+                uint64_t bytesThisPass = std::min(segment.length - pos, uint64_t{ buflen });
+                auto const filePos = segment.offset + pos;
+
+                if (fd != TR_BAD_SYS_FILE)
+                {
+                    auto numRead = uint64_t{};
+                    if (tr_sys_file_read_at(fd, buffer, bytesThisPass, filePos, &numRead, nullptr) && numRead > 0)
+                    {
+                        bytesThisPass = numRead;
+                        tr_sha1_update(sha, buffer, bytesThisPass);
+                        tr_sys_file_advise(fd, filePos, bytesThisPass, TR_SYS_FILE_ADVICE_DONT_NEED, nullptr);
+                    }
+                }
+
+                pos += bytesThisPass;
+            }
         }
 
-        /* if we're starting a new file... */
-        if (filePos == 0 && fd == TR_BAD_SYS_FILE && fileIndex != prevFileIndex)
+        if (*stopFlag)
         {
-            char* filename = tr_torrentFindFile(tor, fileIndex);
-            fd = filename == nullptr ? TR_BAD_SYS_FILE :
-                                       tr_sys_file_open(filename, TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0, nullptr);
-            tr_free(filename);
-            prevFileIndex = fileIndex;
+            break;
         }
 
-        /* figure out how much we can read this pass */
-        uint64_t leftInPiece = tor->pieceSize(piece) - piecePos;
-        uint64_t leftInFile = file_length - filePos;
-        uint64_t bytesThisPass = std::min(leftInFile, leftInPiece);
-        bytesThisPass = std::min(bytesThisPass, uint64_t{ buflen });
+        /* we've finished a piece */
+        auto hash = tr_sha1_final(sha);
+        auto const hasPiece = hash && *hash == tor->pieceHash(piece);
 
-        /* read a bit */
-        if (fd != TR_BAD_SYS_FILE)
+        if (hasPiece || hadPiece)
         {
-            auto numRead = uint64_t{};
-            if (tr_sys_file_read_at(fd, buffer, bytesThisPass, filePos, &numRead, nullptr) && numRead > 0)
-            {
-                bytesThisPass = numRead;
-                tr_sha1_update(sha, buffer, bytesThisPass);
-                tr_sys_file_advise(fd, filePos, bytesThisPass, TR_SYS_FILE_ADVICE_DONT_NEED, nullptr);
-            }
+            tor->setHasPiece(piece, hasPiece);
+            changed |= hasPiece != hadPiece;
         }
 
-        /* move our offsets */
-        leftInPiece -= bytesThisPass;
-        leftInFile -= bytesThisPass;
-        piecePos += bytesThisPass;
-        filePos += bytesThisPass;
+        time_t const now = tr_time();
+        tor->markChanged(now);
 
-        /* if we're finishing a piece... */
-        if (leftInPiece == 0)
+        /* sleeping even just a few msec per second goes a long
+         * way towards reducing IO load... */
+        if (lastSleptAt != now)
         {
-            auto hash = tr_sha1_final(sha);
-            auto const hasPiece = hash && *hash == tor->pieceHash(piece);
-
-            if (hasPiece || hadPiece)
-            {
-                tor->setHasPiece(piece, hasPiece);
-                changed |= hasPiece != hadPiece;
-            }
-
-            time_t const now = tr_time();
-            tor->anyDate = now;
-
-            /* sleeping even just a few msec per second goes a long
-             * way towards reducing IO load... */
-            if (lastSleptAt != now)
-            {
-                lastSleptAt = now;
-                tr_wait_msec(MsecToSleepPerSecondDuringVerify);
-            }
-
-            sha = tr_sha1_init();
-            ++piece;
-            tor->verify_progress = piece / double(tor->info.pieceCount);
-            piecePos = 0;
+            lastSleptAt = now;
+            tr_wait_msec(MsecToSleepPerSecondDuringVerify);
         }
 
-        /* if we're finishing a file... */
-        if (leftInFile == 0)
-        {
-            if (fd != TR_BAD_SYS_FILE)
-            {
-                tr_sys_file_close(fd, nullptr);
-                fd = TR_BAD_SYS_FILE;
-            }
-
-            fileIndex++;
-            filePos = 0;
-        }
+        sha = tr_sha1_init();
+        tor->verify_progress = (piece + 1) / double(tor->info.pieceCount);
     }
 
     /* cleanup */
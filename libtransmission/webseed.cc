@@ -20,6 +20,8 @@
 #include "cache.h"
 #include "inout.h" /* tr_ioFindFileLocation() */
 #include "peer-mgr.h"
+#include "session.h"
+#include "timer-wheel.h"
 #include "torrent.h"
 #include "trevent.h" /* tr_runInEventThread() */
 #include "utils.h"
@@ -56,7 +58,7 @@ auto constexpr MAX_CONSECUTIVE_FAILURES = 5;
 
 auto constexpr MAX_WEBSEED_CONNECTIONS = 4;
 
-void webseed_timer_func(evutil_socket_t fd, short what, void* vw);
+void webseed_timer_func(void* vw);
 
 struct tr_webseed : public tr_peer
 {
@@ -68,6 +70,7 @@ public:
         , callback{ callback_in }
         , callback_data{ callback_data_in }
         , bandwidth(tor->bandwidth)
+        , timer{ *session->timer_wheel_, webseed_timer_func, this }
     {
         // init parent bits
         have.setHasAll();
@@ -75,8 +78,7 @@ public:
 
         file_urls.resize(tor->fileCount());
 
-        timer = evtimer_new(session->event_base, webseed_timer_func, this);
-        tr_timerAddMsec(timer, TR_IDLE_TIMER_MSEC);
+        timer.start(TR_IDLE_TIMER_MSEC);
     }
 
     ~tr_webseed() override
@@ -84,8 +86,6 @@ public:
         // flag all the pending tasks as dead
         std::for_each(std::begin(tasks), std::end(tasks), [](auto* task) { task->dead = true; });
         tasks.clear();
-
-        event_free(timer);
     }
 
     bool is_transferring_pieces(uint64_t now, tr_direction direction, unsigned int* setme_Bps) const override
@@ -114,7 +114,7 @@ public:
 
     Bandwidth bandwidth;
     std::set<tr_webseed_task*> tasks;
-    struct event* timer = nullptr;
+    tr_timer_wheel::Timer timer;
     int consecutive_failures = 0;
     int retry_tickcount = 0;
     int retry_challenge = 0;
@@ -553,7 +553,7 @@ static void task_request_next_chunk(struct tr_webseed_task* t)
 namespace
 {
 
-void webseed_timer_func(evutil_socket_t /*fd*/, short /*what*/, void* vw)
+void webseed_timer_func(void* vw)
 {
     auto* w = static_cast<tr_webseed*>(vw);
 
@@ -564,7 +564,7 @@ void webseed_timer_func(evutil_socket_t /*fd*/, short /*what*/, void* vw)
 
     on_idle(w);
 
-    tr_timerAddMsec(w->timer, TR_IDLE_TIMER_MSEC);
+    w->timer.start(TR_IDLE_TIMER_MSEC);
 }
 
 } // unnamed namespace
@@ -0,0 +1,61 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+#include "transmission.h"
+#include "platform.h" // tr_threadNew()
+#include "worker-pool.h"
+
+void tr_worker_pool::run(Job job)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    jobs_.push_back(std::move(job));
+
+    // start another worker if the ones we have are all spoken for
+    if (n_threads_ < std::min(max_threads_, n_busy_ + std::size(jobs_)))
+    {
+        ++n_threads_;
+        tr_threadNew(workerFunc, this);
+    }
+}
+
+void tr_worker_pool::wait()
+{
+    auto lock = std::unique_lock(mutex_);
+    idle_.wait(lock, [this]() { return n_threads_ == 0; });
+}
+
+void tr_worker_pool::workerFunc(void* vself)
+{
+    auto* const self = static_cast<tr_worker_pool*>(vself);
+    auto lock = std::unique_lock(self->mutex_);
+
+    while (!std::empty(self->jobs_))
+    {
+        ++self->n_busy_;
+
+        {
+            auto job = std::move(self->jobs_.front());
+            self->jobs_.pop_front();
+            lock.unlock();
+            job();
+        }
+
+        lock.lock();
+        --self->n_busy_;
+    }
+
+    if (--self->n_threads_ == 0)
+    {
+        self->idle_.notify_all();
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/**
+ * Runs jobs on a small set of background threads.
+ *
+ * Like the verify thread, workers are started on demand and exit
+ * once the queue is empty, so an idle pool costs nothing.
+ * Jobs must not touch the session's libevent state; use
+ * tr_runInEventThread() to hand results back.
+ */
+class tr_worker_pool
+{
+public:
+    using Job = std::function<void()>;
+
+    explicit tr_worker_pool(size_t max_threads)
+        : max_threads_{ max_threads != 0 ? max_threads : 1 }
+    {
+    }
+
+    ~tr_worker_pool()
+    {
+        wait();
+    }
+
+    tr_worker_pool(tr_worker_pool const&) = delete;
+    tr_worker_pool& operator=(tr_worker_pool const&) = delete;
+
+    /** @brief queue `job` to be run on one of the workers */
+    void run(Job job);
+
+    /** @brief block until every queued job has finished */
+    void wait();
+
+    [[nodiscard]] size_t maxThreads() const
+    {
+        return max_threads_;
+    }
+
+private:
+    static void workerFunc(void* vself);
+
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    std::deque<Job> jobs_;
+    size_t const max_threads_;
+    size_t n_threads_ = 0;
+    size_t n_busy_ = 0;
+};
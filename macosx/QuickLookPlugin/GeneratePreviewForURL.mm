@@ -193,7 +193,7 @@ OSStatus GeneratePreviewForURL(void* thisInterface, QLPreviewRequestRef preview,
 #warning display folders?
         for (int i = 0; i < inf.fileCount; ++i)
         {
-            NSString* fullFilePath = [NSString stringWithUTF8String:inf.files[i].name];
+            NSString* fullFilePath = [NSString stringWithUTF8String:tr_infoFile(&inf, i).name];
             NSCAssert([fullFilePath hasPrefix:[name stringByAppendingString:@"/"]], @"Expected file path %@ to begin with %@/", fullFilePath, name);
 
             NSString* shortenedFilePath = [fullFilePath substringFromIndex:[name length] + 1];
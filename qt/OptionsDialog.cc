@@ -185,13 +185,14 @@ void OptionsDialog::reload()
 
         for (tr_file_index_t i = 0; i < info_.fileCount; ++i)
         {
+            auto const info_file = tr_infoFile(&info_, i);
             TorrentFile file;
             file.index = i;
             file.priority = priorities_[i];
             file.wanted = wanted_[i];
-            file.size = info_.files[i].length;
+            file.size = info_file.length;
             file.have = 0;
-            file.filename = QString::fromUtf8(info_.files[i].name);
+            file.filename = QString::fromUtf8(info_file.name);
             files_.push_back(file);
         }
     }
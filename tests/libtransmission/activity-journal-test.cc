@@ -0,0 +1,144 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <vector>
+
+#include "transmission.h"
+#include "activity-journal.h"
+
+#include "gtest/gtest.h"
+
+using ActivityJournalTest = ::testing::Test;
+
+TEST_F(ActivityJournalTest, changesSince)
+{
+    auto journal = tr_activity_journal{ 300 };
+    auto now = time_t{ 1000 };
+
+    EXPECT_EQ(0U, journal.sequence());
+    auto changes = journal.changesSince(0);
+    ASSERT_TRUE(changes);
+    EXPECT_FALSE(changes->all);
+    EXPECT_TRUE(std::empty(changes->changed));
+    EXPECT_TRUE(std::empty(changes->removed));
+
+    journal.addChanged(1, now);
+    journal.addChanged(2, now);
+    auto const seq = journal.sequence();
+    journal.addChanged(3, ++now);
+    journal.addChanged(1, now);
+    journal.addRemoved(4, now);
+
+    changes = journal.changesSince(0);
+    ASSERT_TRUE(changes);
+    EXPECT_EQ((std::vector<int>{ 1, 3, 2 }), changes->changed);
+    EXPECT_EQ((std::vector<int>{ 4 }), changes->removed);
+
+    changes = journal.changesSince(seq);
+    ASSERT_TRUE(changes);
+    EXPECT_EQ((std::vector<int>{ 1, 3 }), changes->changed);
+    EXPECT_EQ((std::vector<int>{ 4 }), changes->removed);
+
+    changes = journal.changesSince(journal.sequence());
+    ASSERT_TRUE(changes);
+    EXPECT_TRUE(std::empty(changes->changed));
+    EXPECT_TRUE(std::empty(changes->removed));
+
+    // a sequence number from the future, e.g. from another session
+    EXPECT_FALSE(journal.changesSince(journal.sequence() + 1));
+}
+
+TEST_F(ActivityJournalTest, changesAfter)
+{
+    auto journal = tr_activity_journal{ 300 };
+
+    journal.addChanged(1, 100);
+    journal.addChanged(2, 200);
+    journal.addChanged(3, 300);
+
+    EXPECT_EQ((std::vector<int>{ 3, 2, 1 }), journal.changesAfter(0).changed);
+    EXPECT_EQ((std::vector<int>{ 3, 2 }), journal.changesAfter(200).changed);
+    EXPECT_TRUE(std::empty(journal.changesAfter(301).changed));
+
+    // a newer change to an old torrent moves it forward
+    journal.addChanged(1, 400);
+    EXPECT_EQ((std::vector<int>{ 1, 3 }), journal.changesAfter(300).changed);
+}
+
+TEST_F(ActivityJournalTest, allChanged)
+{
+    auto journal = tr_activity_journal{ 300 };
+
+    journal.addChanged(1, 100);
+    auto const seq = journal.sequence();
+    EXPECT_FALSE(journal.changesSince(0)->all);
+
+    journal.addAllChanged(100);
+    EXPECT_TRUE(journal.changesSince(seq)->all);
+    EXPECT_TRUE(journal.changesAfter(100).all);
+    EXPECT_FALSE(journal.changesSince(journal.sequence())->all);
+}
+
+TEST_F(ActivityJournalTest, isPending)
+{
+    auto journal = tr_activity_journal{ 300 };
+
+    auto const seq = journal.addChanged(1, 100);
+    EXPECT_TRUE(journal.isPending(seq));
+
+    // reading the journal consumes the pending entries
+    (void)journal.changesSince(0);
+    EXPECT_FALSE(journal.isPending(seq));
+
+    auto const next = journal.addChanged(1, 100);
+    EXPECT_TRUE(journal.isPending(next));
+    (void)journal.changesAfter(0);
+    EXPECT_FALSE(journal.isPending(next));
+
+    // handing out the sequence number reads everything up to it
+    auto const last = journal.addChanged(1, 100);
+    EXPECT_TRUE(journal.isPending(last));
+    EXPECT_EQ(last, journal.markRead());
+    EXPECT_FALSE(journal.isPending(last));
+}
+
+TEST_F(ActivityJournalTest, pruning)
+{
+    auto journal = tr_activity_journal{ 60 };
+
+    journal.addChanged(1, 100);
+    auto const seq = journal.sequence();
+    journal.addChanged(2, 150);
+
+    // adding an entry ages out the ones older than the retention window
+    journal.addChanged(3, 200);
+    EXPECT_EQ(2U, journal.size());
+    EXPECT_EQ((std::vector<int>{ 3, 2 }), journal.changesAfter(0).changed);
+
+    // the journal can't tell what happened after a pruned entry
+    EXPECT_FALSE(journal.changesSince(0));
+    EXPECT_TRUE(journal.changesSince(seq));
+    EXPECT_FALSE(journal.isPending(seq));
+}
+
+TEST_F(ActivityJournalTest, supersededEntriesAreCompacted)
+{
+    auto journal = tr_activity_journal{ 300 };
+
+    // a handful of torrents changing over and over
+    for (int i = 0; i < 10000; ++i)
+    {
+        journal.addChanged(1 + i % 10, 100);
+    }
+
+    EXPECT_LE(journal.size(), 2048U);
+
+    auto const changes = journal.changesSince(0);
+    ASSERT_TRUE(changes);
+    EXPECT_EQ((std::vector<int>{ 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 }), changes->changed);
+}
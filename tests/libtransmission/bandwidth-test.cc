@@ -0,0 +1,63 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <cstdint>
+
+#include "transmission.h"
+#include "bandwidth.h"
+
+#include "gtest/gtest.h"
+
+using BandwidthTest = ::testing::Test;
+
+TEST_F(BandwidthTest, speedIsAveragedOverHistory)
+{
+    auto b = Bandwidth{};
+    auto const now = uint64_t{ 1000000 };
+
+    EXPECT_EQ(0, b.getRawSpeedBytesPerSecond(now, TR_DOWN));
+
+    // 1000 bytes every 100 msec is 10000 bytes per second
+    for (uint64_t t = now; t < now + Bandwidth::HistoryMSec; t += 100)
+    {
+        b.notifyBandwidthConsumed(TR_DOWN, 1000, true, t);
+    }
+
+    auto const later = now + Bandwidth::HistoryMSec - 1;
+    EXPECT_EQ(10000, b.getRawSpeedBytesPerSecond(later, TR_DOWN));
+    EXPECT_EQ(10000, b.getPieceSpeedBytesPerSecond(later, TR_DOWN));
+    EXPECT_EQ(0, b.getRawSpeedBytesPerSecond(later, TR_UP));
+
+    // old transfers age out of the window one slice at a time
+    EXPECT_EQ(9000, b.getRawSpeedBytesPerSecond(later + Bandwidth::GranularityMSec, TR_DOWN));
+    EXPECT_EQ(0, b.getRawSpeedBytesPerSecond(later + Bandwidth::HistoryMSec, TR_DOWN));
+}
+
+TEST_F(BandwidthTest, rawAndPieceSpeedsAreTrackedSeparately)
+{
+    auto b = Bandwidth{};
+    auto const now = uint64_t{ 1000000 };
+
+    b.notifyBandwidthConsumed(TR_UP, 2000, true, now);
+    b.notifyBandwidthConsumed(TR_UP, 2000, false, now);
+
+    EXPECT_EQ(2000, b.getRawSpeedBytesPerSecond(now, TR_UP));
+    EXPECT_EQ(1000, b.getPieceSpeedBytesPerSecond(now, TR_UP));
+}
+
+TEST_F(BandwidthTest, childrenCountTowardsParent)
+{
+    auto parent = Bandwidth{};
+    auto child = Bandwidth{ &parent };
+    auto const now = uint64_t{ 1000000 };
+
+    child.notifyBandwidthConsumed(TR_DOWN, 4000, true, now);
+
+    EXPECT_EQ(2000, child.getPieceSpeedBytesPerSecond(now, TR_DOWN));
+    EXPECT_EQ(2000, parent.getPieceSpeedBytesPerSecond(now, TR_DOWN));
+}
@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <array>
 #include <limits>
+#include <memory>
 #include <vector>
 
 #include "transmission.h"
@@ -323,3 +324,320 @@ TEST(Bitfield, hasAllNone)
         EXPECT_TRUE(!field.hasNone());
     }
 }
+
+namespace
+{
+
+tr_bitfield makeRandomBitfield(size_t bit_count, size_t set_count)
+{
+    auto bf = tr_bitfield{ bit_count };
+
+    for (size_t i = 0; i < set_count; ++i)
+    {
+        bf.set(tr_rand_int_weak(bit_count));
+    }
+
+    return bf;
+}
+
+} // namespace
+
+TEST(Bitfield, setOperations)
+{
+    auto constexpr IterCount = int{ 1000 };
+
+    for (auto i = 0; i < IterCount; ++i)
+    {
+        // cover sizes that are and aren't multiples of a byte and of a word
+        size_t const bit_count = 1 + tr_rand_int_weak(300);
+        auto const a = makeRandomBitfield(bit_count, tr_rand_int_weak(bit_count));
+        auto const b = makeRandomBitfield(bit_count, tr_rand_int_weak(bit_count));
+
+        auto a_or_b = a;
+        a_or_b |= b;
+        auto a_and_b = a;
+        a_and_b &= b;
+        auto a_and_not_b = a;
+        a_and_not_b.andNot(b);
+
+        auto intersects = false;
+        auto has_any_not_in = false;
+        for (size_t j = 0; j < bit_count; ++j)
+        {
+            EXPECT_EQ(a.test(j) || b.test(j), a_or_b.test(j));
+            EXPECT_EQ(a.test(j) && b.test(j), a_and_b.test(j));
+            EXPECT_EQ(a.test(j) && !b.test(j), a_and_not_b.test(j));
+            intersects |= a.test(j) && b.test(j);
+            has_any_not_in |= a.test(j) && !b.test(j);
+        }
+
+        EXPECT_EQ(intersects, a.intersects(b));
+        EXPECT_EQ(has_any_not_in, a.hasAnyNotIn(b));
+        EXPECT_EQ(a_and_b.count(), a_and_b.count(0, bit_count));
+        EXPECT_EQ(a_and_not_b.count(), a_and_not_b.count(0, bit_count));
+    }
+}
+
+TEST(Bitfield, setOperationsWithHasAllNone)
+{
+    auto constexpr BitCount = size_t{ 100 };
+
+    auto all = tr_bitfield{ BitCount };
+    all.setHasAll();
+    auto none = tr_bitfield{ BitCount };
+    none.setHasNone();
+    auto some = tr_bitfield{ BitCount };
+    some.setSpan(10, 20);
+
+    EXPECT_TRUE(all.intersects(some));
+    EXPECT_TRUE(some.intersects(all));
+    EXPECT_FALSE(none.intersects(some));
+    EXPECT_FALSE(some.intersects(none));
+    EXPECT_TRUE(all.hasAnyNotIn(some));
+    EXPECT_FALSE(some.hasAnyNotIn(all));
+    EXPECT_TRUE(some.hasAnyNotIn(none));
+    EXPECT_FALSE(none.hasAnyNotIn(some));
+
+    auto bf = some;
+    bf |= all;
+    EXPECT_TRUE(bf.hasAll());
+
+    bf = none;
+    bf |= some;
+    EXPECT_EQ(10U, bf.count());
+    EXPECT_TRUE(bf.test(10));
+    EXPECT_FALSE(bf.test(20));
+
+    bf = all;
+    bf &= some;
+    EXPECT_EQ(10U, bf.count());
+    EXPECT_TRUE(bf.test(19));
+
+    bf = some;
+    bf &= none;
+    EXPECT_TRUE(bf.hasNone());
+
+    bf = all;
+    bf.andNot(some);
+    EXPECT_EQ(BitCount - 10, bf.count());
+    EXPECT_FALSE(bf.test(10));
+    EXPECT_TRUE(bf.test(99));
+
+    bf = some;
+    bf.andNot(all);
+    EXPECT_TRUE(bf.hasNone());
+
+    // the result collapses back to have-all
+    bf = all;
+    bf.andNot(some);
+    bf |= some;
+    EXPECT_TRUE(bf.hasAll());
+}
+
+TEST(Bitfield, wordWiseOperations)
+{
+    // many words, with a partial word at the end
+    auto constexpr BitCount = size_t{ 4111 };
+
+    auto const make_bitfield = [](size_t step)
+    {
+        auto flags = std::make_unique<bool[]>(BitCount);
+        for (size_t i = 0; i < BitCount; i += step)
+        {
+            flags[i] = true;
+        }
+
+        auto bf = tr_bitfield{ BitCount };
+        bf.setFromBools(flags.get(), BitCount);
+        return bf;
+    };
+
+    auto const a = make_bitfield(3);
+    auto const b = make_bitfield(5);
+
+    auto constexpr CountA = (BitCount + 2) / 3;
+    auto constexpr CountB = (BitCount + 4) / 5;
+    auto constexpr CountAB = (BitCount + 14) / 15;
+    EXPECT_EQ(CountA, a.count());
+    EXPECT_EQ(CountA, a.count(0, BitCount));
+    EXPECT_EQ(CountB, b.count(0, BitCount));
+    EXPECT_EQ(2U, a.count(BitCount - 4, BitCount)); // 4107 and 4110
+
+    auto bf = a;
+    bf &= b;
+    EXPECT_EQ(CountAB, bf.count());
+
+    bf = a;
+    bf |= b;
+    EXPECT_EQ(CountA + CountB - CountAB, bf.count());
+
+    bf = a;
+    bf.andNot(b);
+    EXPECT_EQ(CountA - CountAB, bf.count());
+
+    EXPECT_TRUE(a.intersects(b));
+    EXPECT_TRUE(a.hasAnyNotIn(b));
+    EXPECT_FALSE(bf.intersects(b));
+    EXPECT_FALSE(bf.hasAnyNotIn(a));
+
+    // a single bit near the very end
+    auto last = tr_bitfield{ BitCount };
+    last.set(BitCount - 2);
+    EXPECT_FALSE(last.intersects(a));
+    EXPECT_TRUE(last.hasAnyNotIn(a));
+    last.set(BitCount - 1);
+    EXPECT_TRUE(last.intersects(a));
+    EXPECT_TRUE(last.intersects(b));
+}
+
+TEST(Bitfield, runsMatchDense)
+{
+    // apply the same random edits to a bitfield and to a plain array of bools,
+    // crossing between the run and dense representations along the way
+    auto constexpr BitCount = size_t{ 4096 };
+    auto constexpr IterCount = int{ 2000 };
+
+    auto bf = tr_bitfield{ BitCount };
+    bf.setHasNone();
+    auto expected = std::vector<bool>(BitCount);
+
+    for (auto i = 0; i < IterCount; ++i)
+    {
+        auto const value = tr_rand_int_weak(3) != 0;
+        size_t const begin = tr_rand_int_weak(BitCount);
+        size_t const end = std::min(BitCount, begin + 1 + tr_rand_int_weak(i < IterCount / 2 ? 512 : 4));
+
+        if (end - begin == 1)
+        {
+            bf.set(begin, value);
+        }
+        else
+        {
+            bf.setSpan(begin, end, value);
+        }
+
+        std::fill(std::begin(expected) + begin, std::begin(expected) + end, value);
+
+        auto const expected_count = size_t(std::count(std::begin(expected), std::end(expected), true));
+        EXPECT_EQ(expected_count, bf.count());
+
+        size_t const probe = tr_rand_int_weak(BitCount);
+        EXPECT_EQ(expected[probe], bf.test(probe));
+    }
+
+    auto raw = bf.raw();
+    raw.resize(BitCount / 8);
+    for (size_t i = 0; i < BitCount; ++i)
+    {
+        EXPECT_EQ(expected[i], (raw[i >> 3U] & (0x80 >> (i & 7U))) != 0);
+        EXPECT_EQ(expected[i], bf.test(i));
+    }
+
+    EXPECT_EQ(size_t(std::count(std::begin(expected), std::end(expected), true)), bf.count(0, BitCount));
+}
+
+TEST(Bitfield, runsAreCompact)
+{
+    auto constexpr BitCount = size_t{ 1024 * 1024 };
+    auto constexpr DenseBytes = BitCount / 8;
+
+    // a sequential download is a single run
+    auto bf = tr_bitfield{ BitCount };
+    bf.setHasNone();
+    for (size_t i = 0; i < BitCount / 2; ++i)
+    {
+        bf.set(i);
+    }
+    EXPECT_EQ(BitCount / 2, bf.count());
+    EXPECT_LT(bf.allocatedBytes(), size_t{ 64 });
+
+    // a seed that's missing a handful of pieces
+    bf.setHasAll();
+    bf.unset(10);
+    bf.unsetSpan(1000, 2000);
+    EXPECT_EQ(BitCount - 1001, bf.count());
+    EXPECT_FALSE(bf.test(10));
+    EXPECT_TRUE(bf.test(11));
+    EXPECT_LT(bf.allocatedBytes(), size_t{ 128 });
+
+    // filling the gaps goes back to have-all
+    bf.set(10);
+    bf.setSpan(1000, 2000);
+    EXPECT_TRUE(bf.hasAll());
+    EXPECT_EQ(0U, bf.allocatedBytes());
+
+    // a peer bitfield sent over the wire is compacted on arrival
+    auto raw = std::vector<uint8_t>(DenseBytes, 0xFF);
+    raw[100] = 0x00;
+    bf.setRaw(std::data(raw), std::size(raw));
+    EXPECT_EQ(BitCount - 8, bf.count());
+    EXPECT_LT(bf.allocatedBytes(), size_t{ 128 });
+    EXPECT_EQ(raw, bf.raw());
+
+    // scattered bits stay dense
+    for (size_t i = 0; i < BitCount; i += 2)
+    {
+        raw[i >> 3U] = 0xAA;
+    }
+    bf.setRaw(std::data(raw), std::size(raw));
+    EXPECT_EQ(BitCount / 2, bf.count());
+    EXPECT_EQ(DenseBytes, bf.allocatedBytes());
+}
+
+TEST(Bitfield, peerBitfieldsAreCompact)
+{
+    // peers in a torrent with 200,000 pieces, e.g. 50 GiB with 256 KiB pieces
+    auto constexpr PeerCount = size_t{ 100 };
+    auto constexpr PieceCount = size_t{ 200000 };
+    auto constexpr DenseBytes = PieceCount / 8;
+
+    auto peers = std::vector<tr_bitfield>{};
+    peers.reserve(PeerCount);
+
+    for (size_t i = 0; i < PeerCount; ++i)
+    {
+        auto& have = peers.emplace_back(PieceCount);
+
+        switch (i % 4)
+        {
+        case 0: // a seed
+            have.setHasAll();
+            break;
+
+        case 1: // a new peer announcing pieces as they arrive, mostly in order
+            have.setHasNone();
+            have.setSpan(0, i % PieceCount);
+            have.set(PieceCount - 1 - i % 100);
+            break;
+
+        case 2: // a nearly-complete peer sends its bitfield
+            {
+                auto raw = std::vector<uint8_t>(DenseBytes, 0xFF);
+                raw[i % DenseBytes] = 0x0F;
+                raw[(i * 7) % DenseBytes] = 0x00;
+                have.setRaw(std::data(raw), std::size(raw));
+            }
+            break;
+
+        default: // a peer with scattered pieces
+            {
+                auto raw = std::vector<uint8_t>(DenseBytes);
+                for (size_t j = i % 3; j < DenseBytes; j += 3)
+                {
+                    raw[j] = 0x5A;
+                }
+                have.setRaw(std::data(raw), std::size(raw));
+            }
+            break;
+        }
+    }
+
+    auto allocated = size_t{};
+    for (auto const& have : peers)
+    {
+        allocated += have.allocatedBytes();
+    }
+
+    // only the scattered peers need a dense array
+    EXPECT_LE(allocated, PeerCount / 4 * DenseBytes + PeerCount * 256);
+}
@@ -0,0 +1,140 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h> // getrlimit()
+#endif
+
+#include "transmission.h"
+#include "fdlimit.h"
+#include "file.h"
+#include "utils.h" // tr_strvPath()
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class FdLimitTest : public SessionTest
+{
+protected:
+    static auto constexpr TorId = int{ 1 };
+
+    std::string makeFile(tr_file_index_t i) const
+    {
+        auto const filename = tr_strvPath(sandboxDir(), "file" + std::to_string(i));
+        createFileWithContents(filename, "hello");
+        return filename;
+    }
+
+    tr_sys_file_t checkout(tr_file_index_t i, bool writable, int torrent_id = TorId) const
+    {
+        auto const filename = makeFile(i);
+        return tr_fdFileCheckout(session_, torrent_id, i, filename.c_str(), writable, TR_PREALLOCATE_NONE, 5);
+    }
+};
+
+TEST_F(FdLimitTest, evictsLeastRecentlyUsed)
+{
+    tr_fdSetFileLimit(session_, 2);
+    EXPECT_EQ(2, tr_fdGetFileLimit(session_));
+    auto const before = tr_fdGetStats(session_);
+
+    auto const fd0 = checkout(0, false);
+    auto const fd1 = checkout(1, false);
+    EXPECT_NE(TR_BAD_SYS_FILE, fd0);
+    EXPECT_NE(TR_BAD_SYS_FILE, fd1);
+
+    // using file 0 makes file 1 the least recently used...
+    EXPECT_EQ(fd0, tr_fdFileGetCached(session_, TorId, 0, false));
+
+    // ...so it's the one that's closed to make room for file 2
+    EXPECT_NE(TR_BAD_SYS_FILE, checkout(2, false));
+    EXPECT_EQ(fd0, tr_fdFileGetCached(session_, TorId, 0, false));
+    EXPECT_EQ(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorId, 1, false));
+    EXPECT_NE(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorId, 2, false));
+
+    auto const after = tr_fdGetStats(session_);
+    EXPECT_EQ(2, after.open_files);
+    EXPECT_EQ(2, after.open_file_limit);
+    EXPECT_EQ(3, after.files_opened - before.files_opened);
+    EXPECT_EQ(1, after.files_closed - before.files_closed);
+
+    // lowering the limit closes the least recently used files
+    EXPECT_EQ(fd0, tr_fdFileGetCached(session_, TorId, 0, false));
+    tr_fdSetFileLimit(session_, 1);
+    EXPECT_EQ(1, tr_fdGetStats(session_).open_files);
+    EXPECT_EQ(fd0, tr_fdFileGetCached(session_, TorId, 0, false));
+}
+
+#ifndef _WIN32
+
+TEST_F(FdLimitTest, peersGetTheirShareOfFds)
+{
+    auto rlim = rlimit{};
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &rlim));
+    if (rlim.rlim_max == RLIM_INFINITY)
+    {
+        return;
+    }
+
+    // ask for as many files as the process can open, so that
+    // the files have to make room for the peers
+    tr_fdSetFileLimit(session_, size_t(rlim.rlim_max));
+    auto const before = tr_fdGetStats(session_).open_file_limit;
+
+    // raising the peer limit later leaves fewer fds for files
+    tr_sessionSetPeerLimit(session_, tr_sessionGetPeerLimit(session_) + 100);
+    EXPECT_EQ(before - 100, tr_fdGetStats(session_).open_file_limit);
+    EXPECT_EQ(size_t(rlim.rlim_max), tr_fdGetFileLimit(session_));
+}
+
+#endif
+
+TEST_F(FdLimitTest, readAndWriteHandlesAreSeparate)
+{
+    auto const read_fd = checkout(0, false);
+    EXPECT_NE(TR_BAD_SYS_FILE, read_fd);
+    EXPECT_EQ(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorId, 0, true));
+
+    // writing to the file doesn't close its read-only handle
+    auto const write_fd = checkout(0, true);
+    EXPECT_NE(TR_BAD_SYS_FILE, write_fd);
+    EXPECT_NE(read_fd, write_fd);
+    EXPECT_EQ(read_fd, tr_fdFileGetCached(session_, TorId, 0, false));
+    EXPECT_EQ(write_fd, tr_fdFileGetCached(session_, TorId, 0, true));
+    EXPECT_EQ(2, tr_fdGetStats(session_).open_files);
+
+    // but reads can use the writable handle if it's the only one
+    auto const write_fd1 = checkout(1, true);
+    EXPECT_EQ(write_fd1, tr_fdFileGetCached(session_, TorId, 1, false));
+    EXPECT_EQ(write_fd1, checkout(1, false));
+    EXPECT_EQ(3, tr_fdGetStats(session_).open_files);
+}
+
+TEST_F(FdLimitTest, torrentClose)
+{
+    EXPECT_NE(TR_BAD_SYS_FILE, checkout(0, false, TorId));
+    EXPECT_NE(TR_BAD_SYS_FILE, checkout(1, true, TorId));
+    EXPECT_NE(TR_BAD_SYS_FILE, checkout(0, false, TorId + 1));
+
+    tr_fdTorrentClose(session_, TorId);
+    EXPECT_EQ(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorId, 0, false));
+    EXPECT_EQ(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorId, 1, false));
+    EXPECT_NE(TR_BAD_SYS_FILE, tr_fdFileGetCached(session_, TorId + 1, 0, false));
+    EXPECT_EQ(1, tr_fdGetStats(session_).open_files);
+}
+
+} // namespace test
+
+} // namespace libtransmission
@@ -9,6 +9,7 @@
 #include <array>
 #include <numeric>
 #include <cstdint>
+#include <vector>
 
 #include "transmission.h"
 
@@ -87,6 +88,99 @@ TEST_F(FilePieceMapTest, pieceSpan)
     EXPECT_EQ(block_info_.n_pieces, fpm.pieceSpan(std::size(FileSizes) - 1).end);
 }
 
+TEST_F(FilePieceMapTest, fileSpan)
+{
+    // the inverse of the pieceSpan test's spans
+    auto constexpr ExpectedFileSpans = std::array<tr_file_piece_map::file_span_t, 11>{ {
+        { 0, 1 },
+        { 0, 1 },
+        { 0, 1 },
+        { 0, 1 },
+        { 0, 1 },
+        { 1, 7 },
+        { 6, 13 },
+        { 12, 13 },
+        { 12, 13 },
+        { 12, 13 },
+        { 12, 17 },
+    } };
+
+    auto const fpm = tr_file_piece_map{ block_info_, std::data(FileSizes), std::size(FileSizes) };
+    for (tr_piece_index_t piece = 0; piece < block_info_.n_pieces; ++piece)
+    {
+        EXPECT_EQ(ExpectedFileSpans[piece].begin, fpm.fileSpan(piece).begin);
+        EXPECT_EQ(ExpectedFileSpans[piece].end, fpm.fileSpan(piece).end);
+    }
+}
+
+TEST_F(FilePieceMapTest, fileOffset)
+{
+    auto const fpm = tr_file_piece_map{ block_info_, std::data(FileSizes), std::size(FileSizes) };
+
+    // walk every byte of the torrent, skipping over the empty files
+    auto file = tr_file_index_t{ 0 };
+    auto file_offset = uint64_t{ 0 };
+    for (uint64_t offset = 0; offset < TotalSize; ++offset)
+    {
+        while (file_offset == FileSizes[file])
+        {
+            ++file;
+            file_offset = 0;
+        }
+
+        auto const [index, offset_in_file] = fpm.fileOffset(offset);
+        EXPECT_EQ(file, index);
+        EXPECT_EQ(file_offset, offset_in_file);
+        ++file_offset;
+    }
+}
+
+TEST_F(FilePieceMapTest, segments)
+{
+    auto const fpm = tr_file_piece_map{ block_info_, std::data(FileSizes), std::size(FileSizes) };
+    auto segments = std::vector<tr_file_piece_map::file_segment_t>{};
+
+    // piece #5 begins with the empty files, which aren't listed
+    fpm.segments(500, 100, segments);
+    EXPECT_EQ(2U, std::size(segments));
+    EXPECT_EQ(5U, segments[0].index);
+    EXPECT_EQ(0U, segments[0].offset);
+    EXPECT_EQ(50U, segments[0].length);
+    EXPECT_EQ(6U, segments[1].index);
+    EXPECT_EQ(0U, segments[1].offset);
+    EXPECT_EQ(50U, segments[1].length);
+
+    // a span inside one file
+    fpm.segments(560, 20, segments);
+    EXPECT_EQ(1U, std::size(segments));
+    EXPECT_EQ(6U, segments[0].index);
+    EXPECT_EQ(10U, segments[0].offset);
+    EXPECT_EQ(20U, segments[0].length);
+
+    // piece #6 holds many small files
+    fpm.segments(600, 100, segments);
+    auto constexpr ExpectedLengths = std::array<uint64_t, 7>{ 50, 10, 9, 8, 7, 6, 10 };
+    EXPECT_EQ(std::size(ExpectedLengths), std::size(segments));
+    for (size_t i = 0; i < std::size(segments) && i < std::size(ExpectedLengths); ++i)
+    {
+        EXPECT_EQ(6 + i, segments[i].index);
+        EXPECT_EQ(i == 0 ? 50U : 0U, segments[i].offset);
+        EXPECT_EQ(ExpectedLengths[i], segments[i].length);
+    }
+
+    // the whole torrent
+    fpm.segments(0, TotalSize, segments);
+    auto total = uint64_t{};
+    for (auto const& segment : segments)
+    {
+        EXPECT_NE(0U, FileSizes[segment.index]);
+        EXPECT_EQ(0U, segment.offset);
+        EXPECT_EQ(FileSizes[segment.index], segment.length);
+        total += segment.length;
+    }
+    EXPECT_EQ(TotalSize, total);
+}
+
 TEST_F(FilePieceMapTest, priorities)
 {
     auto const fpm = tr_file_piece_map{ block_info_, std::data(FileSizes), std::size(FileSizes) };
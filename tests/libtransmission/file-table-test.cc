@@ -0,0 +1,104 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "transmission.h"
+#include "file-table.h"
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+class FileTableTest : public ::testing::Test
+{
+protected:
+    struct test_file
+    {
+        std::string_view name;
+        uint64_t length;
+        bool is_renamed;
+    };
+
+    static auto constexpr Files = std::array<test_file, 5>{ {
+        { "Felidae/Felinae/Felis/catus/Kyphi"sv, 1024, false },
+        { "Felidae/Felinae/Felis/catus/empty"sv, 0, false },
+        { "Felidae/Felinae/Felis/catus/Saffron"sv, 2048, true },
+        { "Felidae/Pantherinae/Panthera/Tiger"sv, 1, false },
+        { "Felidae/Pantherinae/Panthera/Lion"sv, 0, false },
+    } };
+
+    static tr_file_table makeTable()
+    {
+        auto table = tr_file_table{ std::size(Files) };
+        for (auto const& file : Files)
+        {
+            EXPECT_TRUE(table.add(file.name, file.length, file.is_renamed));
+        }
+        table.shrinkToFit();
+        return table;
+    }
+};
+
+TEST_F(FileTableTest, add)
+{
+    auto const table = makeTable();
+
+    EXPECT_EQ(std::size(Files), table.size());
+    EXPECT_EQ(3073, table.totalSize());
+
+    auto offset = uint64_t{ 0 };
+    for (tr_file_index_t i = 0; i < table.size(); ++i)
+    {
+        auto const file = table.get(i);
+        EXPECT_EQ(Files[i].name, file.name);
+        EXPECT_EQ(Files[i].length, file.length);
+        EXPECT_EQ(Files[i].is_renamed, file.priv.is_renamed);
+        EXPECT_EQ(offset, file.priv.offset);
+        EXPECT_EQ(0, file.priv.mtime);
+        offset += Files[i].length;
+    }
+}
+
+TEST_F(FileTableTest, addTooMany)
+{
+    auto table = tr_file_table{ 1 };
+    EXPECT_TRUE(table.add("a"sv, 1, false));
+    EXPECT_FALSE(table.add("b"sv, 1, false));
+    EXPECT_EQ(1, table.size());
+}
+
+TEST_F(FileTableTest, rename)
+{
+    auto table = makeTable();
+    auto const* const old_name = table.name(3);
+
+    table.rename(0, "Felidae/Felinae/Felis/catus/Kyphi the Cat"sv);
+    EXPECT_STREQ("Felidae/Felinae/Felis/catus/Kyphi the Cat", table.name(0));
+    EXPECT_TRUE(table.isRenamed(0));
+
+    // other files' names don't move
+    EXPECT_EQ(old_name, table.name(3));
+    EXPECT_FALSE(table.isRenamed(3));
+
+    table.rename(0, "Kyphi"sv);
+    EXPECT_STREQ("Kyphi", table.name(0));
+    EXPECT_EQ(1024, table.length(0));
+}
+
+TEST_F(FileTableTest, mtime)
+{
+    auto table = makeTable();
+
+    table.setMtime(2, 12345);
+    EXPECT_EQ(12345, table.mtime(2));
+    EXPECT_EQ(12345, table.get(2).priv.mtime);
+    EXPECT_EQ(0, table.mtime(1));
+}
@@ -6,6 +6,8 @@
  *
  */
 
+#include <algorithm>
+
 #include "transmission.h"
 #include "history.h"
 
@@ -16,12 +18,40 @@ TEST(History, recentHistory)
     auto h = tr_recentHistory{};
 
     h.add(10000, 1);
-    EXPECT_EQ(0, h.count(12000, 1000));
-    EXPECT_EQ(1, h.count(12000, 3000));
-    EXPECT_EQ(1, h.count(12000, 5000));
-    h.add(20000, 1);
-    EXPECT_EQ(0, h.count(22000, 1000));
-    EXPECT_EQ(1, h.count(22000, 3000));
-    EXPECT_EQ(2, h.count(22000, 15000));
-    EXPECT_EQ(2, h.count(22000, 20000));
+    EXPECT_EQ(1, h.count(10000, 0));
+    EXPECT_EQ(1, h.count(10010, 10));
+    EXPECT_EQ(0, h.count(10010, 9));
+    h.add(10030, 2);
+    EXPECT_EQ(3, h.count(10030, 60));
+    EXPECT_EQ(2, h.count(10030, 10));
+    EXPECT_EQ(3, h.count(10059, 60));
+    EXPECT_EQ(2, h.count(10060, 60));
+    EXPECT_EQ(2, h.count(10070, 60));
+    EXPECT_EQ(0, h.count(12000, 60));
+}
+
+TEST(History, recentHistoryWrapsAround)
+{
+    auto h = tr_recentHistory{};
+
+    // one event per second for five minutes
+    for (time_t now = 20000; now < 20300; ++now)
+    {
+        h.add(now, 1);
+        EXPECT_EQ(std::min(size_t(now - 20000 + 1), size_t{ 60 }), h.count(now, 60));
+    }
+
+    EXPECT_EQ(5, h.count(20299, 4));
+    EXPECT_EQ(60, h.count(20299, 1000));
+    EXPECT_EQ(30, h.count(20329, 60));
+}
+
+TEST(History, recentHistoryIgnoresClockGoingBackwards)
+{
+    auto h = tr_recentHistory{};
+
+    h.add(30000, 1);
+    h.add(29000, 1);
+    EXPECT_EQ(2, h.count(30000, 60));
+    EXPECT_EQ(2, h.count(29000, 60));
 }
@@ -8,10 +8,13 @@
 
 #define LIBTRANSMISSION_VARIANT_MODULE
 
+#include <array>
 #include <clocale> // setlocale()
+#include <cmath> // fabs()
 #include <cstring> // strlen()
 #include <string>
 #include <string_view>
+#include <utility>
 
 #include "transmission.h"
 #include "utils.h" // tr_free()
@@ -220,6 +223,71 @@ TEST_P(JSONTest, unescape)
     tr_variantFree(&top);
 }
 
+TEST_P(JSONTest, escapeAtEveryOffset)
+{
+    auto const to_json = [](std::string_view str)
+    {
+        tr_variant top;
+        tr_variantInitStr(&top, str);
+        auto len = size_t{};
+        auto* const json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN, &len);
+        auto ret = std::string{ json, len };
+        tr_free(json);
+        tr_variantFree(&top);
+        return ret;
+    };
+
+    // the escaper looks at several bytes at a time,
+    // so make sure it finds a special byte wherever it is
+    for (auto const& [special, escaped] : { std::pair{ "\""sv, R"(\")"sv },
+                                            std::pair{ "\\"sv, R"(\\)"sv },
+                                            std::pair{ "\n"sv, R"(\n)"sv },
+                                            std::pair{ "\x01"sv, R"(\u0001)"sv },
+                                            std::pair{ "\x7f"sv, R"(\u007f)"sv },
+                                            std::pair{ "\xc3\xa9"sv, R"(\u00e9)"sv } })
+    {
+        for (size_t offset = 0; offset < 20; ++offset)
+        {
+            auto const prefix = std::string(offset, 'a');
+            auto const suffix = std::string(20 - offset, 'z');
+            auto const expected = '"' + prefix + std::string{ escaped } + suffix + "\"\n";
+            EXPECT_EQ(expected, to_json(prefix + std::string{ special } + suffix));
+        }
+    }
+}
+
+TEST_P(JSONTest, realsMatchPrintf)
+{
+    for (auto const d : { 0.5, -0.5, 0.3, 1.00000001, 3.14159265, -0.00002, 99.99999, 123456.789, 1500000000.25 })
+    {
+        // the format that transmission has always used
+        auto buf = std::array<char, 64>{};
+        if (fabs(d - (int)d) < 0.00001)
+        {
+            tr_snprintf(std::data(buf), std::size(buf), "[%d]\n", (int)d);
+        }
+        else
+        {
+            tr_snprintf(std::data(buf), std::size(buf), "[%.4f]\n", tr_truncd(d, 4));
+        }
+
+        for (auto& ch : buf)
+        {
+            // in case the locale uses a decimal comma
+            ch = ch == ',' ? '.' : ch;
+        }
+
+        tr_variant top;
+        tr_variantInitList(&top, 1);
+        tr_variantListAddReal(&top, d);
+        auto len = size_t{};
+        auto* const json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN, &len);
+        EXPECT_EQ(std::string_view{ std::data(buf) }, (std::string_view{ json, len })) << d;
+        tr_free(json);
+        tr_variantFree(&top);
+    }
+}
+
 INSTANTIATE_TEST_SUITE_P( //
     JSON,
     JSONTest,
@@ -10,13 +10,16 @@
 
 #include "transmission.h"
 #include "cache.h" // tr_cacheWriteBlock()
+#include "fdlimit.h" // tr_fdTorrentClose()
 #include "file.h" // tr_sys_path_*()
+#include "inout.h" // tr_ioRead()
 #include "variant.h"
 
 #include "test-fixtures.h"
 
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace libtransmission
 {
@@ -189,6 +192,55 @@ TEST_F(MoveTest, setLocation)
     tr_torrentRemove(tor, true, tr_sys_path_remove);
 }
 
+TEST_F(MoveTest, readsFindFilesThatWereMovedBehindOurBack)
+{
+    // init a torrent and read from each of its files, so that we know where they are
+    auto* tor = zeroTorrentInit();
+    zeroTorrentPopulate(tor, true);
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0, tr_torrentStat(tor)->leftUntilDone);
+
+    struct ReadData
+    {
+        tr_torrent* tor = {};
+        std::vector<uint8_t> buf;
+        int err = {};
+        bool done = {};
+    };
+
+    auto const read_threadfunc = [](void* vdata) noexcept
+    {
+        auto* data = static_cast<ReadData*>(vdata);
+        tr_fdTorrentClose(data->tor->session, tr_torrentId(data->tor));
+        data->err = tr_ioRead(data->tor, 0, 0, std::size(data->buf), std::data(data->buf));
+        data->done = true;
+    };
+
+    auto const read_first_piece = [&]()
+    {
+        auto data = ReadData{};
+        data.tor = tor;
+        data.buf.resize(tor->pieceSize(0));
+        tr_runInEventThread(session_, read_threadfunc, &data);
+        EXPECT_TRUE(waitFor([&data]() { return data.done; }, 1000));
+        return data.err;
+    };
+
+    EXPECT_EQ(0, read_first_piece());
+
+    // move the first file to where a partial copy would be
+    auto const oldpath = makeString(tr_torrentFindFile(tor, 0));
+    auto const newpath = oldpath + ".part";
+    EXPECT_TRUE(tr_sys_path_rename(oldpath.c_str(), newpath.c_str(), nullptr));
+
+    // confirm that reading it still works, and that it's found in its new place
+    EXPECT_EQ(0, read_first_piece());
+    EXPECT_EQ(newpath, makeString(tr_torrentFindFile(tor, 0)));
+
+    // cleanup
+    tr_torrentRemove(tor, true, tr_sys_path_remove);
+}
+
 } // namespace test
 
 } // namespace libtransmission
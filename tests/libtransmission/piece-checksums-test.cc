@@ -0,0 +1,148 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h"
+#include "file.h"
+#include "piece-checksums.h"
+#include "utils.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class PieceChecksumsTest : public SandboxedTest
+{
+protected:
+    static auto constexpr NumPieces = size_t{ 100 };
+
+    static std::vector<tr_sha1_digest_t> makeChecksums()
+    {
+        auto checksums = std::vector<tr_sha1_digest_t>(NumPieces);
+        for (size_t i = 0; i < NumPieces; ++i)
+        {
+            checksums[i].fill(std::byte(i + 1));
+        }
+        return checksums;
+    }
+
+    static std::string toString(std::vector<tr_sha1_digest_t> const& checksums)
+    {
+        auto const* const begin = reinterpret_cast<char const*>(std::data(checksums));
+        return std::string{ begin, std::size(checksums) * sizeof(tr_sha1_digest_t) };
+    }
+
+    // write a .torrent-ish benc file with `prefix` before the info dict. @return the `pieces` string's offset
+    size_t writeTorrentFile(std::string const& filename, std::string_view prefix) const
+    {
+        auto const pieces = toString(makeChecksums());
+        auto const head = "d"s + std::string{ prefix } + "4:infod6:pieces" + std::to_string(std::size(pieces)) + ":";
+        auto const contents = head + pieces + "ee";
+        createFileWithContents(filename, std::data(contents), std::size(contents));
+        return std::size(head);
+    }
+};
+
+TEST_F(PieceChecksumsTest, holdsChecksumsInMemory)
+{
+    auto const expected = makeChecksums();
+    auto const checksums = tr_piece_checksums{ makeChecksums() };
+
+    EXPECT_EQ(NumPieces, std::size(checksums));
+    EXPECT_FALSE(checksums.hasSource());
+    EXPECT_TRUE(checksums.isLoaded());
+    EXPECT_EQ(expected[0], checksums.get(0));
+    EXPECT_EQ(expected[NumPieces - 1], checksums.get(NumPieces - 1));
+}
+
+TEST_F(PieceChecksumsTest, mapsChecksumsWhenNeeded)
+{
+    auto const expected = makeChecksums();
+    auto const filename = tr_strvPath(sandboxDir(), "test.torrent");
+
+    // put them past the first mmap alignment boundary
+    auto const offset = writeTorrentFile(filename, "7:comment70000:"s + std::string(70000, 'x'));
+
+    auto checksums = tr_piece_checksums{ makeChecksums() };
+    checksums.setSource(filename, offset);
+    EXPECT_TRUE(checksums.hasSource());
+    EXPECT_FALSE(checksums.isLoaded());
+    EXPECT_EQ(NumPieces, std::size(checksums));
+
+    for (size_t i = 0; i < NumPieces; ++i)
+    {
+        EXPECT_EQ(expected[i], checksums.get(i));
+    }
+    EXPECT_TRUE(checksums.isLoaded());
+
+    // recently used, so kept
+    EXPECT_FALSE(checksums.releaseIfIdle(tr_time() - 60));
+    EXPECT_TRUE(checksums.isLoaded());
+
+    EXPECT_TRUE(checksums.releaseIfIdle(tr_time() + 1));
+    EXPECT_FALSE(checksums.isLoaded());
+
+    // and mapped again when needed
+    EXPECT_EQ(expected[7], checksums.get(7));
+    EXPECT_TRUE(checksums.isLoaded());
+}
+
+TEST_F(PieceChecksumsTest, findsChecksumsThatMoved)
+{
+    auto const expected = makeChecksums();
+    auto const filename = tr_strvPath(sandboxDir(), "test.torrent");
+    auto const offset = writeTorrentFile(filename, ""sv);
+
+    auto checksums = tr_piece_checksums{ makeChecksums() };
+    checksums.setSource(filename, offset);
+
+    // the file's rewritten with a new tracker
+    EXPECT_NE(offset, writeTorrentFile(filename, "8:announce19:http://example.com/"sv));
+    EXPECT_EQ(expected[3], checksums.get(3));
+    EXPECT_TRUE(checksums.isLoaded());
+}
+
+TEST_F(PieceChecksumsTest, returnsZeroesIfFileIsGone)
+{
+    auto const filename = tr_strvPath(sandboxDir(), "test.torrent");
+    auto const offset = writeTorrentFile(filename, ""sv);
+
+    auto checksums = tr_piece_checksums{ makeChecksums() };
+    checksums.setSource(filename, offset);
+
+    // truncated
+    auto const contents = "d4:infod6:pieces"sv;
+    createFileWithContents(filename, std::data(contents), std::size(contents));
+    EXPECT_EQ(tr_sha1_digest_t{}, checksums.get(0));
+    EXPECT_FALSE(checksums.isLoaded());
+
+    // removed
+    tr_sys_path_remove(filename.c_str(), nullptr);
+    EXPECT_EQ(tr_sha1_digest_t{}, checksums.get(0));
+    EXPECT_FALSE(checksums.isLoaded());
+
+    // replaced with different checksums
+    auto other = makeChecksums();
+    other[0].fill(std::byte{ 0xFF });
+    auto const replaced = "d4:infod6:pieces"s + std::to_string(std::size(toString(other))) + ":" + toString(other) + "ee";
+    createFileWithContents(filename, std::data(replaced), std::size(replaced));
+    EXPECT_EQ(tr_sha1_digest_t{}, checksums.get(0));
+}
+
+} // namespace test
+
+} // namespace libtransmission
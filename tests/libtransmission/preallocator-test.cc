@@ -0,0 +1,337 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+#include "cache.h"
+#include "file.h"
+#include "peer-common.h" // MAX_BLOCK_SIZE
+#include "preallocator.h"
+#include "rpcimpl.h"
+#include "session.h"
+#include "torrent.h"
+#include "utils.h" // tr_strvPath()
+#include "variant.h"
+
+#include "test-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class PreallocatorTest : public SandboxedTest
+{
+protected:
+    static auto constexpr TorId = int{ 1 };
+    static auto constexpr FileLength = uint64_t{ 256 * 1024 };
+
+    std::vector<tr_preallocator::File> makeFiles(size_t n, std::string const& subdir = "subdir") const
+    {
+        auto files = std::vector<tr_preallocator::File>{};
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto const filename = tr_strvPath(sandboxDir(), subdir, "file" + std::to_string(i));
+            files.push_back({ tr_file_index_t(i), filename, FileLength, {} });
+        }
+
+        return files;
+    }
+
+    static uint64_t fileSize(std::string const& filename)
+    {
+        auto info = tr_sys_path_info{};
+        return tr_sys_path_get_info(filename.c_str(), 0, &info, nullptr) ? info.size : 0;
+    }
+};
+
+TEST_F(PreallocatorTest, createsFiles)
+{
+    auto const files = makeFiles(4);
+
+    for (auto const mode : { TR_PREALLOCATE_SPARSE, TR_PREALLOCATE_FULL })
+    {
+        auto preallocator = tr_preallocator{};
+        preallocator.add(TorId, mode, files);
+        EXPECT_TRUE(waitFor([&preallocator]() { return !preallocator.progress(TorId); }, 5000));
+        EXPECT_FALSE(preallocator.isPending(TorId, 0, std::size(files) - 1));
+
+        for (auto const& file : files)
+        {
+            EXPECT_EQ(FileLength, fileSize(file.filename));
+            tr_sys_path_remove(file.filename.c_str(), nullptr);
+        }
+    }
+}
+
+TEST_F(PreallocatorTest, skipsExistingFiles)
+{
+    auto files = makeFiles(2);
+    auto const elsewhere = makeFiles(2, "elsewhere");
+    files[0].elsewhere.push_back(elsewhere[0].filename);
+    files[1].elsewhere.push_back(elsewhere[1].filename);
+
+    // file 0 is already at one of the other places it might be
+    createFileWithContents(elsewhere[0].filename, "hello");
+
+    auto preallocator = tr_preallocator{};
+    preallocator.add(TorId, TR_PREALLOCATE_SPARSE, files);
+    EXPECT_TRUE(waitFor([&preallocator]() { return !preallocator.progress(TorId); }, 5000));
+
+    EXPECT_FALSE(tr_sys_path_exists(files[0].filename.c_str(), nullptr));
+    EXPECT_EQ(5U, fileSize(elsewhere[0].filename));
+    EXPECT_EQ(FileLength, fileSize(files[1].filename));
+}
+
+TEST_F(PreallocatorTest, claim)
+{
+    auto const files = makeFiles(32);
+    auto const last = tr_file_index_t(std::size(files) - 1);
+
+    auto preallocator = tr_preallocator{};
+    preallocator.add(TorId, TR_PREALLOCATE_SPARSE, files);
+
+    // once a file's claimed, the preallocator won't touch it:
+    // either it never creates it, or it's already done with it
+    auto const dropped = preallocator.claim(TorId, last);
+    EXPECT_FALSE(preallocator.isPending(TorId, last, last));
+    auto const& filename = files.back().filename;
+    if (dropped)
+    {
+        EXPECT_FALSE(tr_sys_path_exists(filename.c_str(), nullptr));
+    }
+    else
+    {
+        EXPECT_EQ(FileLength, fileSize(filename));
+    }
+
+    // a file that isn't queued can't be claimed
+    EXPECT_FALSE(preallocator.claim(TorId, last));
+    EXPECT_FALSE(preallocator.claim(TorId + 1, 0));
+
+    // and it still counts towards the progress
+    EXPECT_TRUE(waitFor([&preallocator]() { return !preallocator.progress(TorId); }, 5000));
+
+    if (dropped)
+    {
+        EXPECT_FALSE(tr_sys_path_exists(filename.c_str(), nullptr));
+    }
+
+    for (auto const& file : files)
+    {
+        if (file.index != last)
+        {
+            EXPECT_EQ(FileLength, fileSize(file.filename));
+        }
+    }
+}
+
+TEST_F(PreallocatorTest, cancel)
+{
+    auto const files = makeFiles(32);
+    auto const other_files = makeFiles(1, "other");
+
+    auto preallocator = tr_preallocator{};
+    preallocator.add(TorId, TR_PREALLOCATE_FULL, files);
+    preallocator.add(TorId + 1, TR_PREALLOCATE_SPARSE, other_files);
+
+    preallocator.cancel(TorId);
+    EXPECT_FALSE(preallocator.progress(TorId));
+    EXPECT_FALSE(preallocator.isPending(TorId, 0, std::size(files) - 1));
+
+    // other torrents' files are unaffected
+    EXPECT_TRUE(waitFor([&preallocator]() { return !preallocator.progress(TorId + 1); }, 5000));
+    EXPECT_EQ(FileLength, fileSize(other_files.front().filename));
+}
+
+TEST_F(PreallocatorTest, progress)
+{
+    auto preallocator = tr_preallocator{};
+    EXPECT_FALSE(preallocator.progress(TorId));
+    EXPECT_FALSE(preallocator.isPending(TorId, 0, 0));
+
+    preallocator.add(TorId, TR_PREALLOCATE_SPARSE, {});
+    EXPECT_FALSE(preallocator.progress(TorId));
+
+    preallocator.add(TorId, TR_PREALLOCATE_FULL, makeFiles(8));
+    auto const progress = preallocator.progress(TorId);
+
+    if (progress)
+    {
+        EXPECT_LE(0.0, *progress);
+        EXPECT_GE(1.0, *progress);
+    }
+
+    EXPECT_TRUE(waitFor([&preallocator]() { return !preallocator.progress(TorId); }, 5000));
+}
+
+/***
+****
+***/
+
+class PreallocatorSessionTest : public SessionTest
+{
+protected:
+    static auto constexpr BusyId = int{ 999 };
+    static auto constexpr CacheBlocks = int{ 16 };
+
+    void SetUp() override
+    {
+        tr_variantDictAddInt(settings(), TR_KEY_preallocation, TR_PREALLOCATE_FULL);
+        SessionTest::SetUp();
+    }
+
+    void inEventThread(std::function<void()> func)
+    {
+        struct Data
+        {
+            std::function<void()> func;
+            std::atomic<bool> done = false;
+        };
+
+        auto data = Data{ std::move(func) };
+        tr_runInEventThread(
+            session_,
+            [](void* vdata) noexcept
+            {
+                auto* const d = static_cast<Data*>(vdata);
+                d->func();
+                d->done = true;
+            },
+            &data);
+        EXPECT_TRUE(waitFor([&data]() { return data.done.load(); }, 30000));
+    }
+
+    // keep the preallocator's one worker busy with someone else's files,
+    // so that the files queued after them stay queued until it's cancelled
+    void keepPreallocatorBusy()
+    {
+        auto files = std::vector<tr_preallocator::File>{};
+        auto const dir = tr_strvPath(sandboxDir(), "busy");
+
+        for (tr_file_index_t i = 0; i < 50000; ++i)
+        {
+            files.push_back({ i, tr_strvPath(dir, std::to_string(i)), 1, {} });
+        }
+
+        session_->preallocator.add(BusyId, TR_PREALLOCATE_SPARSE, std::move(files));
+    }
+
+    // write blocks [begin..end) of the torrent through the cache
+    void writeBlocks(tr_torrent* tor, tr_block_index_t begin, tr_block_index_t end)
+    {
+        inEventThread(
+            [&]()
+            {
+                auto* const buf = evbuffer_new();
+
+                for (auto block = begin; block < end; ++block)
+                {
+                    auto const piece = tor->pieceForBlock(block);
+                    auto const offset = (block - piece * tor->n_blocks_in_piece) * tor->block_size;
+                    auto const len = tor->blockSize(block);
+                    auto const data = std::vector<char>(len, '\1');
+                    evbuffer_add(buf, std::data(data), len);
+                    EXPECT_EQ(0, tr_cacheWriteBlock(session_->cache, tor, piece, offset, len, buf));
+                }
+
+                evbuffer_free(buf);
+            });
+    }
+
+    double rpcPreallocationProgress(tr_torrent const* tor)
+    {
+        auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+        {
+            *static_cast<tr_variant*>(setme) = *response;
+            tr_variantInitBool(response, false);
+        };
+
+        auto request = tr_variant{};
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantListAddInt(tr_variantDictAddList(args, TR_KEY_ids, 1), tr_torrentId(tor));
+        tr_variantListAddStrView(tr_variantDictAddList(args, TR_KEY_fields, 1), "preallocationProgress");
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+        tr_variantFree(&request);
+
+        auto progress = double{ -1 };
+        tr_variant* response_args = nullptr;
+        tr_variant* torrents = nullptr;
+        auto* const t = tr_variantDictFindDict(&response, TR_KEY_arguments, &response_args) &&
+                tr_variantDictFindList(response_args, TR_KEY_torrents, &torrents) ?
+            tr_variantListChild(torrents, 0) :
+            nullptr;
+        EXPECT_NE(nullptr, t);
+        EXPECT_TRUE(t != nullptr && tr_variantDictFindReal(t, TR_KEY_preallocationProgress, &progress));
+        tr_variantFree(&response);
+        return progress;
+    }
+};
+
+TEST_F(PreallocatorSessionTest, writesToQueuedFiles)
+{
+    inEventThread([this]() { tr_cacheSetLimit(session_->cache, int64_t{ CacheBlocks } * MAX_BLOCK_SIZE); });
+    keepPreallocatorBusy();
+
+    // start a torrent, which queues its files behind the busy ones
+    auto* const tor = zeroTorrentInit();
+    auto const last_file = tr_file_index_t(tor->fileCount() - 1);
+    tr_torrentStart(tor);
+    auto const queued = [this, tor, last_file]()
+    {
+        return session_->preallocator.isPending(tor->uniqueId, 0, last_file);
+    };
+    EXPECT_TRUE(waitFor(queued, 5000));
+
+    // nothing's been preallocated yet
+    EXPECT_DOUBLE_EQ(0.0, tr_torrentStat(tor)->preallocationProgress);
+    EXPECT_DOUBLE_EQ(0.0, rpcPreallocationProgress(tor));
+
+    // the cache holds the blocks written to a queued file, even past its limit...
+    auto filename = std::string{};
+    writeBlocks(tor, 0, CacheBlocks + 8);
+    EXPECT_FALSE(tor->findFile(filename, 0));
+    EXPECT_TRUE(session_->preallocator.isPending(tor->uniqueId, 0, 0));
+
+    // ...until it's twice full, when it writes them. That takes the file
+    // out of the queue, rather than waiting for it to be preallocated
+    auto const n_blocks = tr_block_index_t(2 * CacheBlocks + 8);
+    writeBlocks(tor, CacheBlocks + 8, n_blocks);
+    EXPECT_TRUE(tor->findFile(filename, 0));
+    EXPECT_FALSE(session_->preallocator.isPending(tor->uniqueId, 0, 0));
+    EXPECT_TRUE(session_->preallocator.isPending(tor->uniqueId, 1, last_file));
+
+    // and that file counts as preallocated
+    auto const expected = float(tor->file(0).length) / float(tor->info.totalSize);
+    EXPECT_FLOAT_EQ(expected, tr_torrentStat(tor)->preallocationProgress);
+    EXPECT_NEAR(expected, rpcPreallocationProgress(tor), 0.001);
+
+    // once the worker gets to the rest, the preallocation finishes
+    session_->preallocator.cancel(BusyId);
+    EXPECT_TRUE(waitFor([this, tor]() { return !session_->preallocator.progress(tor->uniqueId); }, 5000));
+    EXPECT_DOUBLE_EQ(1.0, tr_torrentStat(tor)->preallocationProgress);
+    EXPECT_TRUE(tor->findFile(filename, last_file));
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
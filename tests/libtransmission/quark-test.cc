@@ -11,9 +11,12 @@
 
 #include "gtest/gtest.h"
 
+#include <array>
 #include <cstring>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 class QuarkTest : public ::testing::Test
 {
@@ -47,3 +50,40 @@ TEST_F(QuarkTest, newQuarkByStringView)
     EXPECT_EQ(UniqueString, tr_quark_get_string(q, &len));
     EXPECT_EQ(std::size(UniqueString), len);
 }
+
+TEST_F(QuarkTest, newQuarksFromManyThreads)
+{
+    auto constexpr ThreadCount = size_t{ 4 };
+    auto constexpr KeyCount = size_t{ 500 };
+
+    // every thread adds the same keys, as parsers on worker threads do
+    auto quarks = std::array<std::vector<tr_quark>, ThreadCount>{};
+    auto threads = std::vector<std::thread>{};
+    for (auto& thread_quarks : quarks)
+    {
+        threads.emplace_back(
+            [&thread_quarks]()
+            {
+                for (size_t i = 0; i < KeyCount; ++i)
+                {
+                    thread_quarks.push_back(tr_quark_new("threaded-key-" + std::to_string(i)));
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < KeyCount; ++i)
+    {
+        auto const q = quarks.front()[i];
+        EXPECT_EQ("threaded-key-" + std::to_string(i), quarkGetString(q));
+
+        for (auto const& thread_quarks : quarks)
+        {
+            EXPECT_EQ(q, thread_quarks[i]);
+        }
+    }
+}
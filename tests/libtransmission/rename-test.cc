@@ -152,12 +152,11 @@ TEST_F(RenameTest, singleFilenameTorrent)
         "OmhlbGxvLXdvcmxkLnR4dDEyOnBpZWNlIGxlbmd0aGkzMjc2OGU2OnBpZWNlczIwOukboJcrkFUY"
         "f6LvqLXBVvSHqCk6Nzpwcml2YXRlaTBlZWU=");
     EXPECT_TRUE(tr_isTorrent(tor));
-    auto const& files = tor->info.files;
 
     // sanity check the info
     EXPECT_EQ(tr_file_index_t{ 1 }, tor->info.fileCount);
-    EXPECT_STREQ("hello-world.txt", files[0].name);
-    EXPECT_FALSE(files[0].priv.is_renamed);
+    EXPECT_STREQ("hello-world.txt", tor->file(0).name);
+    EXPECT_FALSE(tor->file(0).priv.is_renamed);
 
     // sanity check the (empty) stats
     blockingTorrentVerify(tor);
@@ -190,8 +189,8 @@ TEST_F(RenameTest, singleFilenameTorrent)
     EXPECT_EQ(0, torrentRenameAndWait(tor, "hello-world.txt", "hello-world.txt"));
     EXPECT_EQ(EINVAL, torrentRenameAndWait(tor, "hello-world.txt", "hello/world.txt"));
 
-    EXPECT_FALSE(files[0].priv.is_renamed);
-    EXPECT_STREQ("hello-world.txt", files[0].name);
+    EXPECT_FALSE(tor->file(0).priv.is_renamed);
+    EXPECT_STREQ("hello-world.txt", tor->file(0).name);
 
     /***
     ****  Now try a rename that should succeed
@@ -202,9 +201,9 @@ TEST_F(RenameTest, singleFilenameTorrent)
     EXPECT_STREQ("hello-world.txt", tr_torrentName(tor));
     EXPECT_EQ(0, torrentRenameAndWait(tor, tor->info.name, "foobar"));
     EXPECT_FALSE(tr_sys_path_exists(tmpstr.c_str(), nullptr)); // confirm the old filename can't be found
-    EXPECT_TRUE(files[0].priv.is_renamed); // confirm the file's 'renamed' flag is set
+    EXPECT_TRUE(tor->file(0).priv.is_renamed); // confirm the file's 'renamed' flag is set
     EXPECT_STREQ("foobar", tr_torrentName(tor)); // confirm the torrent's name is now 'foobar'
-    EXPECT_STREQ("foobar", files[0].name); // confirm the file's name is now 'foobar' in our struct
+    EXPECT_STREQ("foobar", tor->file(0).name); // confirm the file's name is now 'foobar' in our struct
     EXPECT_STREQ(nullptr, strstr(tor->info.torrent, "foobar")); // confirm the name in the .torrent file hasn't changed
     tmpstr = tr_strvPath(tor->currentDir, "foobar");
     EXPECT_TRUE(tr_sys_path_exists(tmpstr.c_str(), nullptr)); // confirm the file's name is now 'foobar' on the disk
@@ -213,7 +212,7 @@ TEST_F(RenameTest, singleFilenameTorrent)
     // (while it's renamed: confirm that the .resume file remembers the changes)
     tr_torrentSaveResume(tor);
     sync();
-    loaded = tr_torrentLoadResume(tor, ~0ULL, ctor, nullptr);
+    loaded = tr_torrentLoadResume(tor, ~0ULL, ctor, nullptr, nullptr);
     EXPECT_STREQ("foobar", tr_torrentName(tor));
     EXPECT_NE(decltype(loaded){ 0 }, (loaded & TR_FR_NAME));
 
@@ -225,8 +224,8 @@ TEST_F(RenameTest, singleFilenameTorrent)
     EXPECT_TRUE(tr_sys_path_exists(tmpstr.c_str(), nullptr));
     EXPECT_EQ(0, torrentRenameAndWait(tor, "foobar", "hello-world.txt"));
     EXPECT_FALSE(tr_sys_path_exists(tmpstr.c_str(), nullptr));
-    EXPECT_TRUE(files[0].priv.is_renamed);
-    EXPECT_STREQ("hello-world.txt", files[0].name);
+    EXPECT_TRUE(tor->file(0).priv.is_renamed);
+    EXPECT_STREQ("hello-world.txt", tor->file(0).name);
     EXPECT_STREQ("hello-world.txt", tr_torrentName(tor));
     EXPECT_TRUE(testFileExistsAndConsistsOfThisString(tor, 0, "hello, world!\n"));
 
@@ -270,7 +269,6 @@ TEST_F(RenameTest, multifileTorrent)
         "MjpwaWVjZSBsZW5ndGhpMzI3NjhlNjpwaWVjZXMyMDp27buFkmy8ICfNX4nsJmt0Ckm2Ljc6cHJp"
         "dmF0ZWkwZWVl");
     EXPECT_TRUE(tr_isTorrent(tor));
-    auto* files = tor->info.files;
 
     // sanity check the info
     EXPECT_STREQ("Felidae", tor->info.name);
@@ -279,7 +277,7 @@ TEST_F(RenameTest, multifileTorrent)
 
     for (tr_file_index_t i = 0; i < 4; ++i)
     {
-        EXPECT_EQ(expected_files[i], files[i].name);
+        EXPECT_EQ(expected_files[i], tor->file(i).name);
     }
 
     // sanity check the (empty) stats
@@ -306,52 +304,51 @@ TEST_F(RenameTest, multifileTorrent)
 
     // rename a leaf...
     EXPECT_EQ(0, torrentRenameAndWait(tor, "Felidae/Felinae/Felis/catus/Kyphi", "placeholder"));
-    EXPECT_STREQ("Felidae/Felinae/Felis/catus/placeholder", files[1].name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/catus/placeholder", tor->file(1).name);
     EXPECT_TRUE(testFileExistsAndConsistsOfThisString(tor, 1, "Inquisitive\n"));
 
     // ...and back again
     EXPECT_EQ(0, torrentRenameAndWait(tor, "Felidae/Felinae/Felis/catus/placeholder", "Kyphi"));
-    EXPECT_STREQ("Felidae/Felinae/Felis/catus/Kyphi", files[1].name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/catus/Kyphi", tor->file(1).name);
     testFileExistsAndConsistsOfThisString(tor, 1, "Inquisitive\n");
 
     // rename a branch...
     EXPECT_EQ(0, torrentRenameAndWait(tor, "Felidae/Felinae/Felis/catus", "placeholder"));
-    EXPECT_EQ(expected_files[0], files[0].name);
-    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Kyphi", files[1].name);
-    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Saffron", files[2].name);
-    EXPECT_EQ(expected_files[3], files[3].name);
+    EXPECT_EQ(expected_files[0], tor->file(0).name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Kyphi", tor->file(1).name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Saffron", tor->file(2).name);
+    EXPECT_EQ(expected_files[3], tor->file(3).name);
     EXPECT_TRUE(testFileExistsAndConsistsOfThisString(tor, 1, expected_contents[1]));
     EXPECT_TRUE(testFileExistsAndConsistsOfThisString(tor, 2, expected_contents[2]));
-    EXPECT_FALSE(files[0].priv.is_renamed);
-    EXPECT_TRUE(files[1].priv.is_renamed);
-    EXPECT_TRUE(files[2].priv.is_renamed);
-    EXPECT_FALSE(files[3].priv.is_renamed);
+    EXPECT_FALSE(tor->file(0).priv.is_renamed);
+    EXPECT_TRUE(tor->file(1).priv.is_renamed);
+    EXPECT_TRUE(tor->file(2).priv.is_renamed);
+    EXPECT_FALSE(tor->file(3).priv.is_renamed);
 
     // (while the branch is renamed: confirm that the .resume file remembers the changes)
     tr_torrentSaveResume(tor);
     // this is a bit dodgy code-wise, but let's make sure the .resume file got the name
-    tr_free(files[1].name);
-    files[1].name = tr_strdup("gabba gabba hey");
-    auto const loaded = tr_torrentLoadResume(tor, ~0ULL, ctor, nullptr);
+    tor->fileTable().rename(1, "gabba gabba hey");
+    auto const loaded = tr_torrentLoadResume(tor, ~0ULL, ctor, nullptr, nullptr);
     EXPECT_NE(decltype(loaded){ 0 }, (loaded & TR_FR_FILENAMES));
-    EXPECT_EQ(expected_files[0], files[0].name);
-    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Kyphi", files[1].name);
-    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Saffron", files[2].name);
-    EXPECT_EQ(expected_files[3], files[3].name);
+    EXPECT_EQ(expected_files[0], tor->file(0).name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Kyphi", tor->file(1).name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/placeholder/Saffron", tor->file(2).name);
+    EXPECT_EQ(expected_files[3], tor->file(3).name);
 
     // ...and back again
     EXPECT_EQ(0, torrentRenameAndWait(tor, "Felidae/Felinae/Felis/placeholder", "catus"));
 
     for (tr_file_index_t i = 0; i < 4; ++i)
     {
-        EXPECT_EQ(expected_files[i], files[i].name);
+        EXPECT_EQ(expected_files[i], tor->file(i).name);
         EXPECT_TRUE(testFileExistsAndConsistsOfThisString(tor, i, expected_contents[i]));
     }
 
-    EXPECT_FALSE(files[0].priv.is_renamed);
-    EXPECT_TRUE(files[1].priv.is_renamed);
-    EXPECT_TRUE(files[2].priv.is_renamed);
-    EXPECT_FALSE(files[3].priv.is_renamed);
+    EXPECT_FALSE(tor->file(0).priv.is_renamed);
+    EXPECT_TRUE(tor->file(1).priv.is_renamed);
+    EXPECT_TRUE(tor->file(2).priv.is_renamed);
+    EXPECT_FALSE(tor->file(3).priv.is_renamed);
 
     /***
     ****  Test it an incomplete torrent...
@@ -384,17 +381,17 @@ TEST_F(RenameTest, multifileTorrent)
 
     // rename a branch...
     EXPECT_EQ(0, torrentRenameAndWait(tor, "Felidae/Felinae/Felis/catus", "foo"));
-    EXPECT_EQ(expected_files[0], files[0].name);
-    EXPECT_STREQ("Felidae/Felinae/Felis/foo/Kyphi", files[1].name);
-    EXPECT_STREQ("Felidae/Felinae/Felis/foo/Saffron", files[2].name);
-    EXPECT_EQ(expected_files[3], files[3].name);
+    EXPECT_EQ(expected_files[0], tor->file(0).name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/foo/Kyphi", tor->file(1).name);
+    EXPECT_STREQ("Felidae/Felinae/Felis/foo/Saffron", tor->file(2).name);
+    EXPECT_EQ(expected_files[3], tor->file(3).name);
 
     // ...and back again
     EXPECT_EQ(0, torrentRenameAndWait(tor, "Felidae/Felinae/Felis/foo", "catus"));
 
     for (tr_file_index_t i = 0; i < 4; ++i)
     {
-        EXPECT_EQ(expected_files[i], files[i].name);
+        EXPECT_EQ(expected_files[i], tor->file(i).name);
     }
 
     EXPECT_EQ(0, torrentRenameAndWait(tor, "Felidae", "gabba"));
@@ -406,7 +403,7 @@ TEST_F(RenameTest, multifileTorrent)
 
     for (tr_file_index_t i = 0; i < 4; ++i)
     {
-        EXPECT_STREQ(strings[i], files[i].name);
+        EXPECT_STREQ(strings[i], tor->file(i).name);
         testFileExistsAndConsistsOfThisString(tor, i, expected_contents[i]);
     }
 
@@ -421,7 +418,7 @@ TEST_F(RenameTest, multifileTorrent)
 
     for (tr_file_index_t i = 0; i < 4; ++i)
     {
-        EXPECT_STREQ(strings[i], files[i].name);
+        EXPECT_STREQ(strings[i], tor->file(i).name);
         testFileExistsAndConsistsOfThisString(tor, i, expected_contents[i]);
     }
 
@@ -444,23 +441,22 @@ TEST_F(RenameTest, multifileTorrent)
         "MjpwaWVjZSBsZW5ndGhpMzI3NjhlNjpwaWVjZXMyMDp27buFkmy8ICfNX4nsJmt0Ckm2Ljc6cHJp"
         "dmF0ZWkwZWVl");
     EXPECT_TRUE(tr_isTorrent(tor));
-    files = tor->info.files;
 
     // rename prefix of top
     EXPECT_EQ(EINVAL, torrentRenameAndWait(tor, "Feli", "FelidaeX"));
     EXPECT_STREQ("Felidae", tor->info.name);
-    EXPECT_FALSE(files[0].priv.is_renamed);
-    EXPECT_FALSE(files[1].priv.is_renamed);
-    EXPECT_FALSE(files[2].priv.is_renamed);
-    EXPECT_FALSE(files[3].priv.is_renamed);
+    EXPECT_FALSE(tor->file(0).priv.is_renamed);
+    EXPECT_FALSE(tor->file(1).priv.is_renamed);
+    EXPECT_FALSE(tor->file(2).priv.is_renamed);
+    EXPECT_FALSE(tor->file(3).priv.is_renamed);
 
     // rename false path
     EXPECT_EQ(EINVAL, torrentRenameAndWait(tor, "Felidae/FelinaeX", "Genus Felinae"));
     EXPECT_STREQ("Felidae", tor->info.name);
-    EXPECT_FALSE(files[0].priv.is_renamed);
-    EXPECT_FALSE(files[1].priv.is_renamed);
-    EXPECT_FALSE(files[2].priv.is_renamed);
-    EXPECT_FALSE(files[3].priv.is_renamed);
+    EXPECT_FALSE(tor->file(0).priv.is_renamed);
+    EXPECT_FALSE(tor->file(1).priv.is_renamed);
+    EXPECT_FALSE(tor->file(2).priv.is_renamed);
+    EXPECT_FALSE(tor->file(3).priv.is_renamed);
 
     /***
     ****
@@ -487,13 +483,12 @@ TEST_F(RenameTest, partialFile)
     ***/
 
     auto* tor = zeroTorrentInit();
-    auto const& files = tor->info.files;
     EXPECT_EQ(TotalSize, tor->info.totalSize);
     EXPECT_EQ(PieceSize, tor->info.pieceSize);
     EXPECT_EQ(PieceCount, tor->info.pieceCount);
-    EXPECT_STREQ("files-filled-with-zeroes/1048576", files[0].name);
-    EXPECT_STREQ("files-filled-with-zeroes/4096", files[1].name);
-    EXPECT_STREQ("files-filled-with-zeroes/512", files[2].name);
+    EXPECT_STREQ("files-filled-with-zeroes/1048576", tor->file(0).name);
+    EXPECT_STREQ("files-filled-with-zeroes/4096", tor->file(1).name);
+    EXPECT_STREQ("files-filled-with-zeroes/512", tor->file(2).name);
 
     zeroTorrentPopulate(tor, false);
     EXPECT_EQ(Length[0], tr_torrentFile(tor, 0).have + PieceSize);
@@ -516,7 +511,7 @@ TEST_F(RenameTest, partialFile)
 
     for (tr_file_index_t i = 0; i < 3; ++i)
     {
-        EXPECT_STREQ(strings[i], files[i].name);
+        EXPECT_STREQ(strings[i], tor->file(i).name);
     }
 
     strings[0] = "foo/bar.part";
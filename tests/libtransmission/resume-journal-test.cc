@@ -0,0 +1,281 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <string>
+#include <string_view>
+
+#include "transmission.h"
+#include "file.h"
+#include "resume-journal.h"
+#include "utils.h"
+#include "variant.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class ResumeJournalTest : public SandboxedTest
+{
+protected:
+    static auto constexpr HashA = "0000000000000000000000000000000000000000"sv;
+    static auto constexpr HashB = "1111111111111111111111111111111111111111"sv;
+    static auto constexpr HashC = "2222222222222222222222222222222222222222"sv;
+
+    std::string journalFilename() const
+    {
+        return tr_strvPath(sandboxDir(), "resume.journal");
+    }
+
+    static tr_variant makeResume(int64_t uploaded, std::string_view destination)
+    {
+        auto top = tr_variant{};
+        tr_variantInitDict(&top, 3);
+        tr_variantDictAddInt(&top, TR_KEY_uploaded, uploaded);
+        tr_variantDictAddStrView(&top, TR_KEY_destination, destination);
+        tr_variantDictAddBool(&top, TR_KEY_paused, false);
+        return top;
+    }
+
+    static std::string toBenc(tr_variant const* v)
+    {
+        auto len = size_t{};
+        auto* const str = tr_variantToStr(v, TR_VARIANT_FMT_BENC, &len);
+        auto ret = std::string{ str, len };
+        tr_free(str);
+        return ret;
+    }
+
+    // put `v` into the journal, then free it. @return its benc string
+    static std::string put(tr_resume_journal& journal, std::string_view hash_string, tr_variant&& v)
+    {
+        EXPECT_TRUE(journal.put(hash_string, &v));
+        auto ret = toBenc(&v);
+        tr_variantFree(&v);
+        return ret;
+    }
+
+    static std::string get(tr_resume_journal& journal, std::string_view hash_string)
+    {
+        auto v = tr_variant{};
+        if (!journal.get(hash_string, &v))
+        {
+            return {};
+        }
+
+        auto ret = toBenc(&v);
+        tr_variantFree(&v);
+        return ret;
+    }
+};
+
+TEST_F(ResumeJournalTest, savesAndLoads)
+{
+    auto expected_a = std::string{};
+    auto expected_b = std::string{};
+
+    {
+        auto journal = tr_resume_journal{ journalFilename() };
+        EXPECT_EQ(0U, std::size(journal));
+
+        expected_a = put(journal, HashA, makeResume(100, "/a"sv));
+        expected_b = put(journal, HashB, makeResume(200, "/b"sv));
+        EXPECT_EQ(2U, std::size(journal));
+        EXPECT_EQ(expected_a, get(journal, HashA));
+    }
+
+    auto journal = tr_resume_journal{ journalFilename() };
+    EXPECT_EQ(2U, std::size(journal));
+    EXPECT_TRUE(journal.contains(HashA));
+    EXPECT_FALSE(journal.contains(HashC));
+    EXPECT_EQ(expected_a, get(journal, HashA));
+    EXPECT_EQ(expected_b, get(journal, HashB));
+    EXPECT_EQ(""sv, get(journal, HashC));
+
+    // asking again has to go back to the file
+    EXPECT_EQ(expected_a, get(journal, HashA));
+}
+
+TEST_F(ResumeJournalTest, writesOnlyWhatChanged)
+{
+    auto const long_destination = std::string(1000, 'x');
+    auto journal = tr_resume_journal{ journalFilename() };
+
+    put(journal, HashA, makeResume(100, long_destination));
+    auto size = journal.fileSize();
+
+    // unchanged: nothing written
+    put(journal, HashA, makeResume(100, long_destination));
+    EXPECT_EQ(size, journal.fileSize());
+
+    // one small field changed: a small record
+    auto const expected = put(journal, HashA, makeResume(101, long_destination));
+    EXPECT_GT(journal.fileSize(), size);
+    EXPECT_LT(journal.fileSize() - size, 100U);
+    size = journal.fileSize();
+
+    // a removed field
+    auto v = makeResume(101, long_destination);
+    tr_variantDictRemove(&v, TR_KEY_paused);
+    auto const expected_without_paused = put(journal, HashA, std::move(v));
+    EXPECT_LT(journal.fileSize() - size, 100U);
+    EXPECT_NE(expected, expected_without_paused);
+
+    auto reloaded = tr_resume_journal{ journalFilename() };
+    EXPECT_EQ(expected_without_paused, get(reloaded, HashA));
+}
+
+TEST_F(ResumeJournalTest, removes)
+{
+    {
+        auto journal = tr_resume_journal{ journalFilename() };
+        put(journal, HashA, makeResume(100, "/a"sv));
+        put(journal, HashB, makeResume(200, "/b"sv));
+        journal.remove(HashA);
+        EXPECT_FALSE(journal.contains(HashA));
+        EXPECT_EQ(""sv, get(journal, HashA));
+    }
+
+    auto journal = tr_resume_journal{ journalFilename() };
+    EXPECT_EQ(1U, std::size(journal));
+    EXPECT_FALSE(journal.contains(HashA));
+    EXPECT_TRUE(journal.contains(HashB));
+}
+
+TEST_F(ResumeJournalTest, batchesWrites)
+{
+    auto journal = tr_resume_journal{ journalFilename() };
+
+    {
+        auto const batch = tr_resume_journal::Batch{ &journal };
+        put(journal, HashA, makeResume(100, "/a"sv));
+        put(journal, HashB, makeResume(200, "/b"sv));
+        EXPECT_EQ(0U, journal.fileSize());
+        EXPECT_FALSE(tr_sys_path_exists(journalFilename().c_str(), nullptr));
+    }
+
+    EXPECT_NE(0U, journal.fileSize());
+
+    auto const reloaded = tr_resume_journal{ journalFilename() };
+    EXPECT_EQ(2U, std::size(reloaded));
+}
+
+TEST_F(ResumeJournalTest, dropsDamagedTail)
+{
+    auto expected_a = std::string{};
+    auto size = uint64_t{};
+
+    {
+        auto journal = tr_resume_journal{ journalFilename() };
+        expected_a = put(journal, HashA, makeResume(100, "/a"sv));
+        size = journal.fileSize();
+        put(journal, HashB, makeResume(200, "/b"sv));
+    }
+
+    // tear the last record, as if we crashed while writing it
+    auto const fd = tr_sys_file_open(journalFilename().c_str(), TR_SYS_FILE_WRITE, 0, nullptr);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    EXPECT_TRUE(tr_sys_file_truncate(fd, size + 10, nullptr));
+    tr_sys_file_close(fd, nullptr);
+
+    auto expected_c = std::string{};
+
+    {
+        auto journal = tr_resume_journal{ journalFilename() };
+        EXPECT_EQ(size, journal.fileSize());
+        EXPECT_TRUE(journal.contains(HashA));
+        EXPECT_FALSE(journal.contains(HashB));
+
+        // new records go where the torn one was
+        expected_c = put(journal, HashC, makeResume(300, "/c"sv));
+    }
+
+    auto journal = tr_resume_journal{ journalFilename() };
+    EXPECT_EQ(expected_a, get(journal, HashA));
+    EXPECT_EQ(expected_c, get(journal, HashC));
+
+    // a record with a bad checksum is dropped too
+    auto buf = std::vector<char>{};
+    ASSERT_TRUE(tr_loadFile(buf, journalFilename().c_str()));
+    buf.back() ^= 1;
+    createFileWithContents(journalFilename(), std::data(buf), std::size(buf));
+
+    auto damaged = tr_resume_journal{ journalFilename() };
+    EXPECT_TRUE(damaged.contains(HashA));
+    EXPECT_FALSE(damaged.contains(HashC));
+}
+
+TEST_F(ResumeJournalTest, compacts)
+{
+    auto journal = tr_resume_journal{ journalFilename() };
+    auto const big = std::string(100 * 1024, 'x');
+
+    // 30 versions of a 100 KiB field, but the file stays near the 1 MiB compaction threshold
+    auto expected = std::string{};
+    for (int i = 0; i < 30; ++i)
+    {
+        expected = put(journal, HashA, makeResume(i, big + std::to_string(i)));
+        EXPECT_LT(journal.fileSize(), 1200U * 1024U);
+    }
+
+    EXPECT_EQ(expected, get(journal, HashA));
+
+    auto reloaded = tr_resume_journal{ journalFilename() };
+    EXPECT_EQ(expected, get(reloaded, HashA));
+}
+
+TEST_F(ResumeJournalTest, importsAndExportsFiles)
+{
+    auto const resume_dir = tr_strvPath(sandboxDir(), "resume");
+    auto const filename_a = tr_strvPath(resume_dir, std::string{ HashA } + ".resume");
+    auto const filename_b = tr_strvPath(resume_dir, std::string{ HashB } + ".resume");
+    auto const other_filename = tr_strvPath(resume_dir, "Name.0123456789abcdef.resume");
+
+    auto v = makeResume(100, "/a"sv);
+    auto const expected_a = toBenc(&v);
+    createFileWithContents(filename_a, std::data(expected_a), std::size(expected_a));
+    createFileWithContents(other_filename, std::data(expected_a), std::size(expected_a));
+    tr_variantFree(&v);
+
+    v = makeResume(200, "/b"sv);
+    auto const expected_b = toBenc(&v);
+    createFileWithContents(filename_b, std::data(expected_b), std::size(expected_b));
+    tr_variantFree(&v);
+
+    {
+        auto journal = tr_resume_journal{ journalFilename() };
+        EXPECT_EQ(2U, journal.importFiles(resume_dir));
+        EXPECT_EQ(expected_a, get(journal, HashA));
+        EXPECT_EQ(expected_b, get(journal, HashB));
+        EXPECT_FALSE(tr_sys_path_exists(filename_a.c_str(), nullptr));
+        EXPECT_FALSE(tr_sys_path_exists(filename_b.c_str(), nullptr));
+        EXPECT_TRUE(tr_sys_path_exists(other_filename.c_str(), nullptr));
+
+        // nothing left to import
+        EXPECT_EQ(0U, journal.importFiles(resume_dir));
+    }
+
+    auto journal = tr_resume_journal{ journalFilename() };
+    EXPECT_TRUE(journal.exportFiles(resume_dir));
+
+    for (auto const& [filename, expected] : { std::pair{ filename_a, expected_a }, std::pair{ filename_b, expected_b } })
+    {
+        auto buf = std::vector<char>{};
+        EXPECT_TRUE(tr_loadFile(buf, filename.c_str()));
+        EXPECT_EQ(expected, std::string(std::data(buf), std::size(buf)));
+    }
+}
+
+} // namespace test
+
+} // namespace libtransmission
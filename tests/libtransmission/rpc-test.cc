@@ -7,15 +7,25 @@
  */
 
 #include "transmission.h"
+#include "rpc-events.h"
 #include "rpcimpl.h"
+#include "session.h"
+#include "torrent.h"
 #include "utils.h"
 #include "variant.h"
 
 #include "test-fixtures.h"
 
+#include <event2/buffer.h>
+
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <set>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -188,6 +198,1166 @@ TEST_F(RpcTest, sessionGet)
     tr_torrentRemove(tor, false, nullptr);
 }
 
+/***
+****
+***/
+
+class RpcChangeTokenTest : public SessionTest
+{
+protected:
+    tr_variant exec(tr_variant* request)
+    {
+        auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+        {
+            *static_cast<tr_variant*>(setme) = *response;
+            tr_variantInitBool(response, false);
+        };
+
+        auto response = tr_variant{};
+        tr_rpc_request_exec_json(session_, request, rpc_response_func, &response);
+        tr_variantFree(request);
+        return response;
+    }
+
+    // torrent-get with the fields a web client polls for,
+    // and with a change token if `token` is set
+    tr_variant torrentGet(std::optional<int64_t> token)
+    {
+        static auto constexpr Fields = std::array<std::string_view, 18>{
+            "downloadDir"sv,
+            "error"sv,
+            "errorString"sv,
+            "eta"sv,
+            "id"sv,
+            "isFinished"sv,
+            "leftUntilDone"sv,
+            "name"sv,
+            "peersConnected"sv,
+            "percentDone"sv,
+            "queuePosition"sv,
+            "rateDownload"sv,
+            "rateUpload"sv,
+            "seedRatioLimit"sv,
+            "sizeWhenDone"sv,
+            "status"sv,
+            "trackers"sv,
+            "uploadRatio"sv,
+        };
+
+        tr_variant request;
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        tr_variant* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variant* fields = tr_variantDictAddList(args, TR_KEY_fields, std::size(Fields));
+        for (auto const field : Fields)
+        {
+            tr_variantListAddStrView(fields, field);
+        }
+
+        if (token)
+        {
+            tr_variantDictAddInt(args, TR_KEY_change_token, *token);
+        }
+
+        return exec(&request);
+    }
+
+    static tr_variant* torrentsOf(tr_variant* response)
+    {
+        tr_variant* args = nullptr;
+        tr_variant* torrents = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(response, TR_KEY_arguments, &args));
+        EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+        return torrents;
+    }
+
+    static int64_t tokenOf(tr_variant* response)
+    {
+        tr_variant* args = nullptr;
+        auto token = int64_t{};
+        EXPECT_TRUE(tr_variantDictFindDict(response, TR_KEY_arguments, &args));
+        EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_change_token, &token));
+        return token;
+    }
+
+    static size_t fieldCount(tr_variant* entry)
+    {
+        auto key = tr_quark{};
+        tr_variant* val = nullptr;
+        auto n = size_t{};
+        while (tr_variantDictChild(entry, n, &key, &val))
+        {
+            ++n;
+        }
+        return n;
+    }
+
+    static size_t jsonSize(tr_variant const* response)
+    {
+        auto len = size_t{};
+        tr_free(tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN, &len));
+        return len;
+    }
+
+    // a minimal single-file torrent with a unique name, and thus a unique info hash
+    tr_torrent* addTorrent(size_t i)
+    {
+        tr_variant metainfo;
+        tr_variantInitDict(&metainfo, 1);
+        tr_variant* info = tr_variantDictAddDict(&metainfo, TR_KEY_info, 4);
+        tr_variantDictAddInt(info, TR_KEY_length, 16384);
+        tr_variantDictAddStr(info, TR_KEY_name, "torrent-" + std::to_string(i));
+        tr_variantDictAddInt(info, TR_KEY_piece_length, 16384);
+        auto const pieces = std::array<char, 20>{};
+        tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+
+        auto len = size_t{};
+        auto* const benc = tr_variantToStr(&metainfo, TR_VARIANT_FMT_BENC, &len);
+        tr_variantFree(&metainfo);
+
+        auto* ctor = tr_ctorNew(session_);
+        tr_ctorSetMetainfo(ctor, benc, len);
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+        tr_free(benc);
+
+        auto err = int{};
+        auto* const tor = tr_torrentNew(ctor, &err, nullptr);
+        EXPECT_EQ(0, err);
+        tr_ctorFree(ctor);
+        return tor;
+    }
+};
+
+TEST_F(RpcChangeTokenTest, onlyChangedFieldsAreSent)
+{
+    auto* const tor = zeroTorrentInit();
+    EXPECT_NE(nullptr, tor);
+
+    // without a token, every field is sent
+    auto response = torrentGet({});
+    ASSERT_EQ(1U, tr_variantListSize(torrentsOf(&response)));
+    EXPECT_EQ(18U, fieldCount(tr_variantListChild(torrentsOf(&response), 0)));
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    EXPECT_EQ(nullptr, tr_variantDictFind(args, TR_KEY_change_token));
+    tr_variantFree(&response);
+
+    // a zero token gets everything
+    response = torrentGet(0);
+    ASSERT_EQ(1U, tr_variantListSize(torrentsOf(&response)));
+    EXPECT_EQ(18U, fieldCount(tr_variantListChild(torrentsOf(&response), 0)));
+    auto token = tokenOf(&response);
+    tr_variantFree(&response);
+
+    // nothing's changed since then
+    response = torrentGet(token);
+    EXPECT_EQ(0U, tr_variantListSize(torrentsOf(&response)));
+    EXPECT_EQ(token, tokenOf(&response));
+    tr_variantFree(&response);
+
+    // change a setting and get just that, plus the torrent's id
+    tr_torrentSetRatioLimit(tor, 2.5);
+    response = torrentGet(token);
+    ASSERT_EQ(1U, tr_variantListSize(torrentsOf(&response)));
+    auto* const entry = tr_variantListChild(torrentsOf(&response), 0);
+    EXPECT_EQ(2U, fieldCount(entry));
+    auto id = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(entry, TR_KEY_id, &id));
+    EXPECT_EQ(tr_torrentId(tor), id);
+    auto ratio = double{};
+    EXPECT_TRUE(tr_variantDictFindReal(entry, TR_KEY_seedRatioLimit, &ratio));
+    EXPECT_DOUBLE_EQ(2.5, ratio);
+    EXPECT_LT(token, tokenOf(&response));
+    auto const old_token = token;
+    token = tokenOf(&response);
+    tr_variantFree(&response);
+
+    // a client with an older token gets the change too
+    response = torrentGet(old_token);
+    EXPECT_EQ(1U, tr_variantListSize(torrentsOf(&response)));
+    tr_variantFree(&response);
+
+    // a change that's undone before the next poll isn't sent
+    tr_torrentSetRatioLimit(tor, 2.0);
+    tr_torrentSetRatioLimit(tor, 2.5);
+    response = torrentGet(token);
+    EXPECT_EQ(0U, tr_variantListSize(torrentsOf(&response)));
+    tr_variantFree(&response);
+
+    // a token from the future, e.g. from another session, gets everything
+    response = torrentGet(token + 1000);
+    ASSERT_EQ(1U, tr_variantListSize(torrentsOf(&response)));
+    EXPECT_EQ(18U, fieldCount(tr_variantListChild(torrentsOf(&response), 0)));
+    tr_variantFree(&response);
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(RpcChangeTokenTest, onlyChangedTorrentsAreSent)
+{
+    auto constexpr TorrentCount = size_t{ 10 };
+    auto constexpr PollCount = size_t{ 3 };
+
+    auto torrents = std::vector<tr_torrent*>{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        torrents.push_back(addTorrent(i));
+    }
+
+    // the new torrents have no local data to check,
+    // so skip that and let them hold still
+    for (auto* tor : torrents)
+    {
+        tr_torrentStop(tor);
+    }
+
+    auto const test = [&torrents]()
+    {
+        return std::all_of(
+            std::begin(torrents),
+            std::end(torrents),
+            [](auto const* tor) { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; });
+    };
+    EXPECT_TRUE(waitFor(test, 5000));
+
+    // a client polling without a token gets every field of every torrent
+    auto response = torrentGet({});
+    ASSERT_EQ(TorrentCount, tr_variantListSize(torrentsOf(&response)));
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        EXPECT_EQ(18U, fieldCount(tr_variantListChild(torrentsOf(&response), i)));
+    }
+    auto const full_bytes = jsonSize(&response);
+    tr_variantFree(&response);
+
+    // a client polling with a token, while one torrent changes between polls,
+    // gets just that torrent's id and the changed field
+    response = torrentGet(0);
+    EXPECT_EQ(TorrentCount, tr_variantListSize(torrentsOf(&response)));
+    auto token = tokenOf(&response);
+    tr_variantFree(&response);
+
+    for (size_t i = 0; i < PollCount; ++i)
+    {
+        tr_torrentSetRatioLimit(torrents[i], 10.0 + i);
+
+        response = torrentGet(token);
+        ASSERT_EQ(1U, tr_variantListSize(torrentsOf(&response)));
+        auto* const entry = tr_variantListChild(torrentsOf(&response), 0);
+        EXPECT_EQ(2U, fieldCount(entry));
+        auto id = int64_t{};
+        EXPECT_TRUE(tr_variantDictFindInt(entry, TR_KEY_id, &id));
+        EXPECT_EQ(tr_torrentId(torrents[i]), id);
+        auto ratio = double{};
+        EXPECT_TRUE(tr_variantDictFindReal(entry, TR_KEY_seedRatioLimit, &ratio));
+        EXPECT_DOUBLE_EQ(10.0 + i, ratio);
+        EXPECT_LT(jsonSize(&response), full_bytes / TorrentCount);
+
+        EXPECT_LT(token, tokenOf(&response));
+        token = tokenOf(&response);
+        tr_variantFree(&response);
+    }
+
+    for (auto* tor : torrents)
+    {
+        tr_torrentRemove(tor, false, nullptr);
+    }
+}
+
+class RpcRecentlyActiveTest : public RpcChangeTokenTest
+{
+protected:
+    struct Response
+    {
+        int64_t sequence = 0;
+        std::set<int64_t> ids;
+        std::vector<int64_t> removed;
+    };
+
+    // torrent-get "recently-active", passing back `sequence`
+    Response recentlyActive(int64_t sequence)
+    {
+        tr_variant request;
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        tr_variant* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 3);
+        tr_variantDictAddStrView(args, TR_KEY_ids, "recently-active");
+        tr_variantDictAddInt(args, TR_KEY_activity_sequence, sequence);
+        tr_variant* fields = tr_variantDictAddList(args, TR_KEY_fields, 2);
+        tr_variantListAddStrView(fields, "id");
+        tr_variantListAddStrView(fields, "queuePosition");
+        auto response = exec(&request);
+
+        auto ret = Response{};
+        tr_variant* args_out = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args_out));
+        EXPECT_TRUE(tr_variantDictFindInt(args_out, TR_KEY_activity_sequence, &ret.sequence));
+
+        tr_variant* const torrents = torrentsOf(&response);
+        for (size_t i = 0, n = tr_variantListSize(torrents); i < n; ++i)
+        {
+            auto id = int64_t{};
+            EXPECT_TRUE(tr_variantDictFindInt(tr_variantListChild(torrents, i), TR_KEY_id, &id));
+            ret.ids.insert(id);
+        }
+
+        tr_variant* removed = nullptr;
+        EXPECT_TRUE(tr_variantDictFindList(args_out, TR_KEY_removed, &removed));
+        for (size_t i = 0, n = tr_variantListSize(removed); i < n; ++i)
+        {
+            auto id = int64_t{};
+            EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(removed, i), &id));
+            ret.removed.push_back(id);
+        }
+
+        tr_variantFree(&response);
+        return ret;
+    }
+};
+
+TEST_F(RpcRecentlyActiveTest, removalsFromMidQueueAreSent)
+{
+    auto constexpr TorrentCount = size_t{ 5 };
+
+    auto torrents = std::vector<tr_torrent*>{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        torrents.push_back(addTorrent(i));
+    }
+
+    for (auto* tor : torrents)
+    {
+        tr_torrentStop(tor);
+    }
+
+    auto const test = [&torrents]()
+    {
+        return std::all_of(
+            std::begin(torrents),
+            std::end(torrents),
+            [](auto const* tor) { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; });
+    };
+    EXPECT_TRUE(waitFor(test, 5000));
+
+    // a client starting fresh gets everything
+    auto response = recentlyActive(0);
+    EXPECT_EQ(TorrentCount, std::size(response.ids));
+    EXPECT_TRUE(std::empty(response.removed));
+
+    // removing a torrent from the middle of the queue moves up the ones
+    // behind it, so they're sent along with the removal
+    auto const removed_id = tr_torrentId(torrents[1]);
+    tr_torrentRemove(torrents[1], false, nullptr);
+    EXPECT_TRUE(waitFor([this]() { return std::size(session_->torrents) == TorrentCount - 1; }, 5000));
+
+    response = recentlyActive(response.sequence);
+    EXPECT_EQ(std::vector<int64_t>{ removed_id }, response.removed);
+    for (auto const* tor : { torrents[2], torrents[3], torrents[4] })
+    {
+        EXPECT_EQ(1U, response.ids.count(tr_torrentId(tor)));
+    }
+    EXPECT_EQ(0U, response.ids.count(removed_id));
+
+    // when every torrent changed, removals are still sent
+    session_->activity_journal.addAllChanged(tr_time());
+    auto const removed_id_2 = tr_torrentId(torrents[2]);
+    tr_torrentRemove(torrents[2], false, nullptr);
+    EXPECT_TRUE(waitFor([this]() { return std::size(session_->torrents) == TorrentCount - 2; }, 5000));
+
+    response = recentlyActive(response.sequence);
+    EXPECT_EQ(std::vector<int64_t>{ removed_id_2 }, response.removed);
+    EXPECT_EQ(TorrentCount - 2, std::size(response.ids));
+
+    for (auto* tor : { torrents[0], torrents[3], torrents[4] })
+    {
+        tr_torrentRemove(tor, false, nullptr);
+    }
+}
+
+/***
+****
+***/
+
+class RpcStreamTest : public RpcChangeTokenTest
+{
+protected:
+    static tr_variant makeRequest(std::string_view method, std::optional<std::string_view> format, std::optional<int64_t> token)
+    {
+        tr_variant request;
+        tr_variantInitDict(&request, 3);
+        tr_variantDictAddStrView(&request, TR_KEY_method, method);
+        tr_variantDictAddInt(&request, TR_KEY_tag, 42);
+        tr_variant* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 3);
+
+        if (method == "torrent-get"sv)
+        {
+            tr_variant* fields = tr_variantDictAddList(args, TR_KEY_fields, 6);
+            for (auto const field : { "id"sv, "name"sv, "percentDone"sv, "status"sv, "trackers"sv, "files"sv })
+            {
+                tr_variantListAddStrView(fields, field);
+            }
+        }
+
+        if (format)
+        {
+            tr_variantDictAddStrView(args, TR_KEY_format, *format);
+        }
+
+        if (token)
+        {
+            tr_variantDictAddInt(args, TR_KEY_change_token, *token);
+        }
+
+        return request;
+    }
+
+    // the response as the rpc server used to send it
+    std::string viaVariant(tr_variant const* request)
+    {
+        auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+        {
+            auto len = size_t{};
+            auto* const str = tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN, &len);
+            static_cast<std::string*>(setme)->assign(str, len);
+            tr_free(str);
+        };
+
+        auto json = std::string{};
+        tr_rpc_request_exec_json(session_, request, rpc_response_func, &json);
+        return json;
+    }
+
+    std::string streamed(tr_variant const* request)
+    {
+        auto const rpc_response_func = [](tr_session* /*session*/, evbuffer* response, void* setme) noexcept
+        {
+            auto const len = evbuffer_get_length(response);
+            static_cast<std::string*>(setme)->assign(reinterpret_cast<char const*>(evbuffer_pullup(response, -1)), len);
+        };
+
+        auto json = std::string{};
+        tr_rpc_request_exec_json_buf(session_, request, rpc_response_func, &json);
+        return json;
+    }
+
+    // the streamed output doesn't sort dict keys, so reserialize to compare
+    static std::string normalize(std::string const& json)
+    {
+        auto top = tr_variant{};
+        EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, json));
+
+        // these can change between two session-get or session-stats calls
+        tr_variant* args = nullptr;
+        if (tr_variantDictFindDict(&top, TR_KEY_arguments, &args))
+        {
+            tr_variantDictRemove(args, TR_KEY_download_dir_free_space);
+
+            for (auto const key : { TR_KEY_cumulative_stats, TR_KEY_current_stats })
+            {
+                if (tr_variant* stats = nullptr; tr_variantDictFindDict(args, key, &stats))
+                {
+                    tr_variantDictRemove(stats, TR_KEY_secondsActive);
+                }
+            }
+        }
+
+        auto len = size_t{};
+        auto* const str = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN, &len);
+        auto ret = std::string{ str, len };
+        tr_free(str);
+        tr_variantFree(&top);
+        return ret;
+    }
+};
+
+TEST_F(RpcStreamTest, streamedResponsesMatch)
+{
+    auto* const tor = zeroTorrentInit();
+    EXPECT_NE(nullptr, tor);
+    tr_torrentStop(tor);
+    EXPECT_TRUE(waitFor([tor]() { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; }, 5000));
+
+    auto response = torrentGet(0);
+    auto const token = tokenOf(&response);
+    tr_variantFree(&response);
+
+    auto requests = std::vector<tr_variant>{};
+    requests.push_back(makeRequest("torrent-get"sv, {}, {}));
+    requests.push_back(makeRequest("torrent-get"sv, "table"sv, {}));
+    requests.push_back(makeRequest("torrent-get"sv, {}, 0));
+    requests.push_back(makeRequest("torrent-get"sv, "table"sv, token));
+    requests.push_back(makeRequest("session-get"sv, {}, {}));
+    requests.push_back(makeRequest("session-stats"sv, {}, {})); // not streamed
+    requests.push_back(makeRequest("no-such-method"sv, {}, {}));
+
+    for (auto& request : requests)
+    {
+        auto const expected = viaVariant(&request);
+        auto const actual = streamed(&request);
+        EXPECT_FALSE(std::empty(actual));
+        EXPECT_EQ('\n', actual.back());
+        EXPECT_EQ(normalize(expected), normalize(actual));
+        tr_variantFree(&request);
+    }
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(RpcStreamTest, streamingSeveralTorrents)
+{
+    auto constexpr TorrentCount = size_t{ 5 };
+
+    auto torrents = std::vector<tr_torrent*>{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        torrents.push_back(addTorrent(i));
+    }
+
+    for (auto const format : { std::optional<std::string_view>{}, std::optional<std::string_view>{ "table"sv } })
+    {
+        auto request = makeRequest("torrent-get"sv, format, {});
+        EXPECT_EQ(normalize(viaVariant(&request)), normalize(streamed(&request)));
+        tr_variantFree(&request);
+    }
+
+    for (auto* tor : torrents)
+    {
+        tr_torrentRemove(tor, false, nullptr);
+    }
+}
+
+class RpcSnapshotTest : public RpcStreamTest
+{
+protected:
+    std::string async(tr_variant const* request)
+    {
+        struct Reply
+        {
+            std::string json;
+            std::atomic<bool> done = false;
+        };
+
+        auto const rpc_response_func = [](tr_session* /*session*/, evbuffer* response, void* vreply) noexcept
+        {
+            auto* const reply = static_cast<Reply*>(vreply);
+            auto const len = evbuffer_get_length(response);
+            reply->json.assign(reinterpret_cast<char const*>(evbuffer_pullup(response, -1)), len);
+            reply->done = true;
+        };
+
+        auto reply = Reply{};
+        tr_rpc_request_exec_json_buf_async(session_, request, rpc_response_func, &reply);
+        EXPECT_TRUE(waitFor([&reply]() { return reply.done.load(); }, 5000));
+        return reply.json;
+    }
+
+    static tr_variant makeTorrentGet(std::vector<std::string_view> const& fields, tr_torrent const* tor)
+    {
+        tr_variant request;
+        tr_variantInitDict(&request, 3);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get"sv);
+        tr_variantDictAddInt(&request, TR_KEY_tag, 42);
+        tr_variant* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+
+        tr_variant* list = tr_variantDictAddList(args, TR_KEY_fields, std::size(fields));
+        for (auto const field : fields)
+        {
+            tr_variantListAddStrView(list, field);
+        }
+
+        if (tor != nullptr)
+        {
+            list = tr_variantDictAddList(args, TR_KEY_ids, 3);
+            tr_variantListAddInt(list, tr_torrentId(tor));
+            tr_variantListAddStr(list, tr_torrentInfo(tor)->hashString);
+            tr_variantListAddInt(list, 9999);
+        }
+
+        return request;
+    }
+};
+
+TEST_F(RpcSnapshotTest, asyncResponsesMatch)
+{
+    auto* const tor = zeroTorrentInit();
+    EXPECT_NE(nullptr, tor);
+    tr_torrentStop(tor);
+    EXPECT_TRUE(waitFor([tor]() { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; }, 5000));
+
+    // every name that might be a field, except the ones that aren't kept in the snapshot
+    auto all_fields = std::vector<std::string_view>{};
+    for (tr_quark key = TR_KEY_NONE + 1; key < TR_N_KEYS; ++key)
+    {
+        if (key != TR_KEY_files && key != TR_KEY_fileStats && key != TR_KEY_magnetLink && key != TR_KEY_peers &&
+            key != TR_KEY_pieces && key != TR_KEY_priorities && key != TR_KEY_source && key != TR_KEY_trackerStats &&
+            key != TR_KEY_wanted)
+        {
+            all_fields.push_back(tr_quark_get_string_view(key));
+        }
+    }
+
+    auto free_space = tr_variant{};
+    tr_variantInitDict(&free_space, 2);
+    tr_variantDictAddStrView(&free_space, TR_KEY_method, "free-space"sv);
+    tr_variantDictAddDict(&free_space, TR_KEY_arguments, 0);
+
+    auto requests = std::vector<tr_variant>{};
+    requests.push_back(makeTorrentGet(all_fields, nullptr));
+    requests.push_back(makeTorrentGet({ "id"sv, "name"sv, "labels"sv, "trackers"sv, "arguments"sv }, tor));
+    requests.push_back(makeTorrentGet({}, tor));
+    requests.push_back(makeRequest("torrent-get"sv, {}, {})); // asks for files, so not from the snapshot
+    requests.push_back(makeRequest("torrent-get"sv, "table"sv, 0));
+    requests.push_back(makeRequest("session-get"sv, {}, {}));
+    requests.push_back(makeRequest("session-stats"sv, {}, {}));
+    requests.push_back(makeRequest("no-such-method"sv, {}, {}));
+    requests.push_back(free_space);
+
+    for (auto& request : requests)
+    {
+        auto const expected = streamed(&request);
+        auto const actual = async(&request);
+        EXPECT_FALSE(std::empty(actual));
+        EXPECT_EQ('\n', actual.back());
+        EXPECT_EQ(normalize(expected), normalize(actual));
+        tr_variantFree(&request);
+    }
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(RpcSnapshotTest, snapshotSeesChanges)
+{
+    auto* const tor = zeroTorrentInit();
+    EXPECT_NE(nullptr, tor);
+    tr_torrentStop(tor);
+    EXPECT_TRUE(waitFor([tor]() { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; }, 5000));
+
+    auto request = makeTorrentGet({ "id"sv, "seedRatioLimit"sv }, tor);
+    auto const before = async(&request);
+
+    // a change made over RPC is seen at once
+    auto set = tr_variant{};
+    tr_variantInitDict(&set, 2);
+    tr_variantDictAddStrView(&set, TR_KEY_method, "torrent-set"sv);
+    tr_variant* args = tr_variantDictAddDict(&set, TR_KEY_arguments, 2);
+    tr_variantDictAddInt(args, TR_KEY_ids, tr_torrentId(tor));
+    tr_variantDictAddReal(args, TR_KEY_seedRatioLimit, 7.5);
+    async(&set);
+    tr_variantFree(&set);
+
+    auto const after = async(&request);
+    EXPECT_NE(before, after);
+    EXPECT_EQ(normalize(streamed(&request)), normalize(after));
+    EXPECT_NE(std::string::npos, after.find("7.5"));
+
+    tr_variantFree(&request);
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(RpcSnapshotTest, asyncSeveralTorrents)
+{
+    auto constexpr TorrentCount = size_t{ 5 };
+
+    auto torrents = std::vector<tr_torrent*>{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        torrents.push_back(addTorrent(i));
+    }
+
+    for (auto* tor : torrents)
+    {
+        tr_torrentStop(tor);
+    }
+
+    auto const stopped = [&torrents]()
+    {
+        return std::all_of(
+            std::begin(torrents),
+            std::end(torrents),
+            [](auto const* tor) { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; });
+    };
+    EXPECT_TRUE(waitFor(stopped, 5000));
+
+    auto request = makeTorrentGet({ "id"sv, "name"sv, "status"sv, "percentDone"sv, "rateDownload"sv, "rateUpload"sv,
+                                    "eta"sv, "uploadRatio"sv, "error"sv, "errorString"sv, "trackers"sv },
+                                  nullptr);
+
+    // the first request makes the snapshot, and the second reuses it if it's still fresh
+    auto const expected = normalize(streamed(&request));
+    EXPECT_EQ(expected, normalize(async(&request)));
+    EXPECT_EQ(expected, normalize(async(&request)));
+
+    tr_variantFree(&request);
+
+    for (auto* tor : torrents)
+    {
+        tr_torrentRemove(tor, false, nullptr);
+    }
+}
+
+class RpcSelectTest : public RpcChangeTokenTest
+{
+protected:
+    struct Page
+    {
+        std::vector<std::string> names;
+        std::optional<int64_t> match_count;
+        std::string result;
+    };
+
+    // torrent-get "name" with the arguments that `add_args` adds
+    template<typename AddArgs>
+    Page select(AddArgs const& add_args)
+    {
+        tr_variant request;
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get"sv);
+        tr_variant* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 6);
+        tr_variantListAddStrView(tr_variantDictAddList(args, TR_KEY_fields, 1), "name"sv);
+        add_args(args);
+
+        auto response = exec(&request);
+        auto page = Page{};
+
+        auto sv = std::string_view{};
+        EXPECT_TRUE(tr_variantDictFindStrView(&response, TR_KEY_result, &sv));
+        page.result = sv;
+
+        tr_variant* const torrents = torrentsOf(&response);
+        for (size_t i = 0, n = tr_variantListSize(torrents); i < n; ++i)
+        {
+            EXPECT_TRUE(tr_variantDictFindStrView(tr_variantListChild(torrents, i), TR_KEY_name, &sv));
+            page.names.emplace_back(sv);
+        }
+
+        tr_variant* response_args = nullptr;
+        auto count = int64_t{};
+        if (tr_variantDictFindDict(&response, TR_KEY_arguments, &response_args) &&
+            tr_variantDictFindInt(response_args, TR_KEY_match_count, &count))
+        {
+            page.match_count = count;
+        }
+
+        tr_variantFree(&response);
+        return page;
+    }
+
+    static tr_variant* addFilter(tr_variant* args)
+    {
+        return tr_variantDictAddDict(args, TR_KEY_filter, 2);
+    }
+
+    std::vector<tr_torrent*> addStoppedTorrents(size_t n)
+    {
+        auto torrents = std::vector<tr_torrent*>{};
+        for (size_t i = 0; i < n; ++i)
+        {
+            torrents.push_back(addTorrent(i));
+        }
+
+        for (auto* tor : torrents)
+        {
+            tr_torrentStop(tor);
+        }
+
+        auto const stopped = [&torrents]()
+        {
+            return std::all_of(
+                std::begin(torrents),
+                std::end(torrents),
+                [](auto const* tor) { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; });
+        };
+        EXPECT_TRUE(waitFor(stopped, 5000));
+
+        return torrents;
+    }
+
+    // compare the session's index to a walk through every torrent
+    void expectIndexIsCurrent()
+    {
+        for (int activity = TR_STATUS_STOPPED; activity <= TR_STATUS_SEED; ++activity)
+        {
+            auto expected = std::vector<tr_torrent*>{};
+            for (auto* tor : session_->torrents)
+            {
+                if (tr_torrentGetActivity(tor) == activity)
+                {
+                    expected.push_back(tor);
+                }
+            }
+
+            std::sort(std::begin(expected), std::end(expected), [](auto* a, auto* b) { return a->uniqueId < b->uniqueId; });
+            EXPECT_EQ(expected, session_->torrent_index.withActivity(tr_torrent_activity(activity))) << activity;
+        }
+    }
+
+    static void removeTorrents(std::vector<tr_torrent*> const& torrents)
+    {
+        for (auto* tor : torrents)
+        {
+            tr_torrentRemove(tor, false, nullptr);
+        }
+    }
+};
+
+TEST_F(RpcSelectTest, filters)
+{
+    auto const torrents = addStoppedTorrents(30);
+
+    for (size_t i = 0; i < std::size(torrents); ++i)
+    {
+        tr_torrentSetLabels(torrents[i], i % 2 == 0 ? tr_labels_t{ "even" } : tr_labels_t{ "odd", "x" });
+    }
+
+    auto tracker_url = std::string{ "http://tracker.example.org/announce" };
+    auto tracker = tr_tracker_info{ 0, std::data(tracker_url), nullptr, 0 };
+    for (size_t i = 0; i < 5; ++i)
+    {
+        EXPECT_TRUE(tr_torrentSetAnnounceList(torrents[i], &tracker, 1));
+    }
+
+    tr_torrentSetLocalError(torrents[7], "%s", "oops");
+
+    // by label, in id order
+    auto page = select([](tr_variant* args) { tr_variantDictAddStrView(addFilter(args), TR_KEY_labels, "even"sv); });
+    EXPECT_EQ("success", page.result);
+    EXPECT_EQ(15, page.match_count);
+    ASSERT_EQ(15U, std::size(page.names));
+    EXPECT_EQ("torrent-0", page.names.front());
+    EXPECT_EQ("torrent-28", page.names.back());
+
+    // by status and name
+    page = select(
+        [](tr_variant* args)
+        {
+            tr_variant* filter = addFilter(args);
+            tr_variantDictAddInt(filter, TR_KEY_status, TR_STATUS_STOPPED);
+            tr_variantDictAddStrView(filter, TR_KEY_name, "TORRENT-1"sv);
+        });
+    EXPECT_EQ(11, page.match_count);
+
+    page = select([](tr_variant* args) { tr_variantDictAddInt(addFilter(args), TR_KEY_status, TR_STATUS_DOWNLOAD); });
+    EXPECT_EQ(0, page.match_count);
+    EXPECT_TRUE(std::empty(page.names));
+
+    // by tracker host
+    page = select([](tr_variant* args) { tr_variantDictAddStrView(addFilter(args), TR_KEY_tracker, "example.org"sv); });
+    EXPECT_EQ(5, page.match_count);
+    page = select([](tr_variant* args) { tr_variantDictAddStrView(addFilter(args), TR_KEY_tracker, "ample.org"sv); });
+    EXPECT_EQ(0, page.match_count);
+
+    // by error state
+    page = select([](tr_variant* args) { tr_variantDictAddBool(addFilter(args), TR_KEY_error, true); });
+    EXPECT_EQ(std::vector<std::string>{ "torrent-7" }, page.names);
+
+    // a filter applies to the "ids" too
+    page = select(
+        [&torrents](tr_variant* args)
+        {
+            tr_variant* ids = tr_variantDictAddList(args, TR_KEY_ids, 3);
+            tr_variantListAddInt(ids, tr_torrentId(torrents[1]));
+            tr_variantListAddInt(ids, tr_torrentId(torrents[2]));
+            tr_variantListAddInt(ids, tr_torrentId(torrents[3]));
+            tr_variant* labels = tr_variantDictAddList(addFilter(args), TR_KEY_labels, 1);
+            tr_variantListAddStrView(labels, "x"sv);
+        });
+    EXPECT_EQ((std::vector<std::string>{ "torrent-1", "torrent-3" }), page.names);
+
+    removeTorrents(torrents);
+}
+
+TEST_F(RpcSelectTest, sortAndPage)
+{
+    auto const torrents = addStoppedTorrents(30);
+
+    // names sort as strings, so torrent-9 is last
+    auto page = select(
+        [](tr_variant* args)
+        {
+            tr_variantDictAddStrView(args, TR_KEY_sort, "name"sv);
+            tr_variantDictAddBool(args, TR_KEY_sort_reversed, true);
+            tr_variantDictAddInt(args, TR_KEY_offset, 2);
+            tr_variantDictAddInt(args, TR_KEY_limit, 3);
+        });
+    EXPECT_EQ("success", page.result);
+    EXPECT_EQ(30, page.match_count);
+    EXPECT_EQ((std::vector<std::string>{ "torrent-7", "torrent-6", "torrent-5" }), page.names);
+
+    // numbers sort as numbers
+    page = select(
+        [](tr_variant* args)
+        {
+            tr_variantDictAddStrView(args, TR_KEY_sort, "queuePosition"sv);
+            tr_variantDictAddInt(args, TR_KEY_limit, 2);
+        });
+    EXPECT_EQ((std::vector<std::string>{ "torrent-0", "torrent-1" }), page.names);
+
+    // paging past the end
+    page = select([](tr_variant* args) { tr_variantDictAddInt(args, TR_KEY_offset, 100); });
+    EXPECT_EQ(30, page.match_count);
+    EXPECT_TRUE(std::empty(page.names));
+
+    // lists can't be sorted
+    page = select([](tr_variant* args) { tr_variantDictAddStrView(args, TR_KEY_sort, "files"sv); });
+    EXPECT_EQ("invalid sort field", page.result);
+    EXPECT_TRUE(std::empty(page.names));
+
+    page = select([](tr_variant* args) { tr_variantDictAddInt(args, TR_KEY_limit, -1); });
+    EXPECT_EQ("invalid limit", page.result);
+
+    removeTorrents(torrents);
+}
+
+TEST_F(RpcSelectTest, indexFollowsChanges)
+{
+    auto const torrents = addStoppedTorrents(10);
+    expectIndexIsCurrent();
+
+    // start some, and let them check their (missing) local data
+    for (size_t i = 0; i < 3; ++i)
+    {
+        tr_torrentStart(torrents[i]);
+    }
+
+    auto const started = [&torrents]()
+    {
+        return std::all_of(
+            std::begin(torrents),
+            std::begin(torrents) + 3,
+            [](auto const* tor) { return tr_torrentGetActivity(tor) == TR_STATUS_DOWNLOAD; });
+    };
+    EXPECT_TRUE(waitFor(started, 5000));
+    expectIndexIsCurrent();
+    EXPECT_EQ(3U, std::size(session_->torrent_index.withActivity(TR_STATUS_DOWNLOAD)));
+
+    // toggling the download queue changes queued torrents' activity
+    tr_sessionSetQueueSize(session_, TR_DOWN, 3);
+    tr_sessionSetQueueEnabled(session_, TR_DOWN, true);
+    tr_torrentStart(torrents[3]);
+    expectIndexIsCurrent();
+
+    tr_sessionSetQueueEnabled(session_, TR_DOWN, false);
+    expectIndexIsCurrent();
+
+    for (auto* tor : torrents)
+    {
+        tr_torrentStop(tor);
+    }
+
+    auto const stopped = [&torrents]()
+    {
+        return std::all_of(
+            std::begin(torrents),
+            std::end(torrents),
+            [](auto const* tor) { return tr_torrentGetActivity(tor) == TR_STATUS_STOPPED; });
+    };
+    EXPECT_TRUE(waitFor(stopped, 5000));
+    expectIndexIsCurrent();
+
+    // labels
+    tr_torrentSetLabels(torrents[4], { "a", "b" });
+    tr_torrentSetLabels(torrents[5], { "b" });
+    EXPECT_EQ(std::vector<tr_torrent*>{ torrents[4] }, session_->torrent_index.withLabel("a"sv));
+    EXPECT_EQ((std::vector<tr_torrent*>{ torrents[4], torrents[5] }), session_->torrent_index.withLabel("b"sv));
+    tr_torrentSetLabels(torrents[4], {});
+    EXPECT_TRUE(std::empty(session_->torrent_index.withLabel("a"sv)));
+    EXPECT_EQ(std::vector<tr_torrent*>{ torrents[5] }, session_->torrent_index.withLabel("b"sv));
+
+    removeTorrents(torrents);
+    EXPECT_TRUE(waitFor([this]() { return session_->torrent_index.size() == 0; }, 5000));
+}
+
+class RpcEventsTest : public RpcSelectTest
+{
+protected:
+    // tr_rpc_events uses the session's event loop, so it has to run there
+    void inEventThread(std::function<void()> func)
+    {
+        struct Data
+        {
+            std::function<void()> func;
+            std::atomic<bool> done = false;
+        };
+
+        auto data = Data{ std::move(func) };
+        tr_runInEventThread(
+            session_,
+            [](void* vdata) noexcept
+            {
+                auto* const d = static_cast<Data*>(vdata);
+                d->func();
+                d->done = true;
+            },
+            &data);
+        EXPECT_TRUE(waitFor([&data]() { return data.done.load(); }, 30000));
+    }
+
+    static tr_variant parse(std::string const& line)
+    {
+        auto top = tr_variant{};
+        EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, line));
+        return top;
+    }
+
+    static tr_variant* torrentsOfEvent(tr_variant* event)
+    {
+        tr_variant* args = nullptr;
+        tr_variant* torrents = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(event, TR_KEY_torrent_get, &args));
+        EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_torrents, &torrents));
+        return torrents;
+    }
+
+    static std::vector<int64_t> removedOfEvent(tr_variant* event)
+    {
+        tr_variant* args = nullptr;
+        tr_variant* removed = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(event, TR_KEY_torrent_get, &args));
+        EXPECT_TRUE(tr_variantDictFindList(args, TR_KEY_removed, &removed));
+
+        auto ids = std::vector<int64_t>{};
+        for (size_t i = 0, n = tr_variantListSize(removed); i < n; ++i)
+        {
+            auto id = int64_t{};
+            EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(removed, i), &id));
+            ids.push_back(id);
+        }
+
+        return ids;
+    }
+
+    // no timer fires during a test, so batches are only sent by publish()
+    static auto constexpr IntervalMsec = int{ 60 * 60 * 1000 };
+};
+
+TEST_F(RpcEventsTest, changesAreSentToEveryone)
+{
+    auto const torrents = addStoppedTorrents(3);
+
+    auto events = std::unique_ptr<tr_rpc_events>{};
+    auto lines_a = std::vector<std::string>{};
+    auto lines_b = std::vector<std::string>{};
+    auto id_a = tr_rpc_events::Id{};
+
+    inEventThread(
+        [&]()
+        {
+            events = std::make_unique<tr_rpc_events>(session_, IntervalMsec);
+            id_a = events->subscribe({}, [&lines_a](std::string_view line) { lines_a.emplace_back(line); });
+            events->subscribe(
+                { TR_KEY_id, TR_KEY_seedRatioLimit },
+                [&lines_b](std::string_view line) { lines_b.emplace_back(line); });
+        });
+
+    // each subscriber starts with every torrent
+    ASSERT_EQ(1U, std::size(lines_a));
+    ASSERT_EQ(1U, std::size(lines_b));
+    auto event = parse(lines_a.front());
+    EXPECT_EQ(std::size(torrents), tr_variantListSize(torrentsOfEvent(&event)));
+    EXPECT_TRUE(std::empty(removedOfEvent(&event)));
+    tr_variant* stats = nullptr;
+    auto count = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindDict(&event, TR_KEY_session_stats, &stats));
+    EXPECT_TRUE(tr_variantDictFindInt(stats, TR_KEY_torrentCount, &count));
+    EXPECT_EQ(int64_t(std::size(torrents)), count);
+    tr_variantFree(&event);
+
+    event = parse(lines_b.front());
+    ASSERT_EQ(std::size(torrents), tr_variantListSize(torrentsOfEvent(&event)));
+    EXPECT_EQ(2U, fieldCount(tr_variantListChild(torrentsOfEvent(&event), 0)));
+    tr_variantFree(&event);
+
+    // a batch holds just what changed, and everyone gets the same one
+    tr_torrentSetRatioLimit(torrents[0], 3.5);
+    auto const removed_id = tr_torrentId(torrents[2]);
+    tr_torrentRemove(torrents[2], false, nullptr);
+    EXPECT_TRUE(waitFor([this]() { return std::size(session_->torrents) == 2; }, 5000));
+
+    inEventThread([&events]() { events->publish(); });
+
+    ASSERT_EQ(2U, std::size(lines_a));
+    ASSERT_EQ(2U, std::size(lines_b));
+    EXPECT_EQ(lines_a.back(), lines_b.back());
+    event = parse(lines_a.back());
+    ASSERT_EQ(1U, tr_variantListSize(torrentsOfEvent(&event)));
+    auto* const entry = tr_variantListChild(torrentsOfEvent(&event), 0);
+    auto id = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(entry, TR_KEY_id, &id));
+    EXPECT_EQ(tr_torrentId(torrents[0]), id);
+    auto ratio = double{};
+    EXPECT_TRUE(tr_variantDictFindReal(entry, TR_KEY_seedRatioLimit, &ratio));
+    EXPECT_DOUBLE_EQ(3.5, ratio);
+    EXPECT_EQ(std::vector<int64_t>{ removed_id }, removedOfEvent(&event));
+    tr_variantFree(&event);
+
+    // nothing's changed since then
+    inEventThread(
+        [&]()
+        {
+            events->publish();
+            events->unsubscribe(id_a);
+            events->publish();
+        });
+
+    EXPECT_EQ(3U, std::size(lines_a));
+    ASSERT_EQ(4U, std::size(lines_b));
+    event = parse(lines_b.back());
+    EXPECT_EQ(0U, tr_variantListSize(torrentsOfEvent(&event)));
+    EXPECT_TRUE(std::empty(removedOfEvent(&event)));
+    tr_variantFree(&event);
+
+    inEventThread([&events]() { events.reset(); });
+    removeTorrents({ torrents[0], torrents[1] });
+}
+
+TEST_F(RpcEventsTest, manyClients)
+{
+    auto constexpr TorrentCount = size_t{ 5 };
+    auto constexpr ClientCount = size_t{ 10 };
+    auto constexpr RoundCount = size_t{ 3 };
+
+    auto const torrents = addStoppedTorrents(TorrentCount);
+
+    auto events = std::unique_ptr<tr_rpc_events>{};
+    auto lines = std::vector<std::vector<std::string>>(ClientCount);
+    inEventThread(
+        [&]()
+        {
+            events = std::make_unique<tr_rpc_events>(session_, IntervalMsec);
+            for (auto& client_lines : lines)
+            {
+                events->subscribe({}, [&client_lines](std::string_view line) { client_lines.emplace_back(line); });
+            }
+        });
+
+    // every client gets one line per batch, and it's the same line
+    for (size_t round = 0; round < RoundCount; ++round)
+    {
+        tr_torrentSetRatioLimit(torrents[round], 10.0 + round);
+        inEventThread([&events]() { events->publish(); });
+
+        for (auto const& client_lines : lines)
+        {
+            EXPECT_EQ(round + 2, std::size(client_lines));
+            EXPECT_EQ(lines.front().back(), client_lines.back());
+        }
+
+        auto event = parse(lines.front().back());
+        ASSERT_EQ(1U, tr_variantListSize(torrentsOfEvent(&event)));
+        auto* const entry = tr_variantListChild(torrentsOfEvent(&event), 0);
+        auto id = int64_t{};
+        EXPECT_TRUE(tr_variantDictFindInt(entry, TR_KEY_id, &id));
+        EXPECT_EQ(tr_torrentId(torrents[round]), id);
+        auto ratio = double{};
+        EXPECT_TRUE(tr_variantDictFindReal(entry, TR_KEY_seedRatioLimit, &ratio));
+        EXPECT_DOUBLE_EQ(10.0 + round, ratio);
+        tr_variantFree(&event);
+    }
+
+    inEventThread([&events]() { events.reset(); });
+    removeTorrents(torrents);
+}
+
 } // namespace test
 
 } // namespace libtransmission
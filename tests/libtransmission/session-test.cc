@@ -7,19 +7,30 @@
  */
 
 #include "transmission.h"
+#include "file.h"
+#include "net.h"
+#include "peer-mgr.h"
+#include "platform.h" // tr_getTorrentDir()
+#include "resume.h"
 #include "session.h"
 #include "session-id.h"
+#include "torrent.h"
 #include "utils.h"
+#include "variant.h"
 #include "version.h"
 
 #include "test-fixtures.h"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std::literals;
 
@@ -292,6 +303,380 @@ TEST_F(SessionTest, sessionId)
     tr_free(const_cast<char*>(session_id_str_1));
 }
 
+class SessionLoadTest : public SessionTest
+{
+protected:
+    // a minimal single-file .torrent in the torrents dir. @return its hash string
+    std::string writeTorrentFile(size_t i, std::string_view basename = {}) const
+    {
+        tr_variant metainfo;
+        tr_variantInitDict(&metainfo, 1);
+        tr_variant* info = tr_variantDictAddDict(&metainfo, TR_KEY_info, 4);
+        tr_variantDictAddInt(info, TR_KEY_length, 16384);
+        tr_variantDictAddStr(info, TR_KEY_name, "torrent-" + std::to_string(i));
+        tr_variantDictAddInt(info, TR_KEY_piece_length, 16384);
+        auto const pieces = std::array<char, 20>{};
+        tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+
+        auto len = size_t{};
+        auto* const benc = tr_variantToStr(&metainfo, TR_VARIANT_FMT_BENC, &len);
+        tr_variantFree(&metainfo);
+
+        auto* const ctor = tr_ctorNew(session_);
+        tr_ctorSetMetainfo(ctor, benc, len);
+        auto inf = tr_info{};
+        EXPECT_EQ(TR_PARSE_OK, tr_torrentParse(ctor, &inf));
+        auto const hash_string = std::string{ inf.hashString };
+        tr_metainfoFree(&inf);
+        tr_ctorFree(ctor);
+
+        auto const filename = std::empty(basename) ? hash_string + ".torrent" : std::string{ basename };
+        createFileWithContents(tr_strvPath(tr_getTorrentDir(session_), filename), benc, len);
+        tr_free(benc);
+
+        return hash_string;
+    }
+
+    void writeResumeFile(std::string const& hash_string, std::string_view label) const
+    {
+        tr_variant top;
+        tr_variantInitDict(&top, 1);
+        tr_variantListAddStrView(tr_variantDictAddList(&top, TR_KEY_labels, 1), label);
+
+        auto const filename = tr_strvPath(tr_getResumeDir(session_), hash_string + ".resume");
+        buildParentDir(filename);
+        EXPECT_EQ(0, tr_variantToFile(&top, TR_VARIANT_FMT_BENC, filename.c_str()));
+        tr_variantFree(&top);
+    }
+
+    std::vector<tr_torrent*> loadTorrents()
+    {
+        auto* const ctor = tr_ctorNew(session_);
+        tr_ctorSetPaused(ctor, TR_FORCE, true);
+
+        auto n = int{};
+        auto** const torrents = tr_sessionLoadTorrents(session_, ctor, &n);
+        auto ret = std::vector<tr_torrent*>{ torrents, torrents + n };
+
+        tr_free(torrents);
+        tr_ctorFree(ctor);
+        return ret;
+    }
+
+    static void removeTorrents(std::vector<tr_torrent*> const& torrents)
+    {
+        for (auto* tor : torrents)
+        {
+            tr_torrentRemove(tor, false, nullptr);
+        }
+    }
+};
+
+TEST_F(SessionLoadTest, loadTorrents)
+{
+    auto constexpr TorrentCount = size_t{ 5 };
+
+    auto hash_strings = std::vector<std::string>{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        hash_strings.push_back(writeTorrentFile(i));
+    }
+
+    writeResumeFile(hash_strings[1], "one"sv);
+
+    // a duplicate, a file that isn't a torrent, and a file that isn't named like one
+    writeTorrentFile(2, "dupe.torrent"sv);
+    createFileWithContents(tr_strvPath(tr_getTorrentDir(session_), "garbage.torrent"), "garbage");
+    createFileWithContents(tr_strvPath(tr_getTorrentDir(session_), "notes.txt"), "notes");
+
+    auto const torrents = loadTorrents();
+    ASSERT_EQ(TorrentCount, std::size(torrents));
+    EXPECT_EQ(TorrentCount, std::size(session_->torrents));
+
+    auto names = std::set<std::string>{};
+    for (auto* tor : torrents)
+    {
+        names.insert(tr_torrentName(tor));
+
+        auto const expected = tor->info.hashString == hash_strings[1] ? tr_labels_t{ "one" } : tr_labels_t{};
+        EXPECT_EQ(expected, tor->labels) << tr_torrentName(tor);
+    }
+
+    EXPECT_EQ(TorrentCount, std::size(names));
+
+    // ids are handed out in the order that the torrents are returned
+    EXPECT_TRUE(std::is_sorted(
+        std::begin(torrents),
+        std::end(torrents),
+        [](auto const* a, auto const* b) { return a->uniqueId < b->uniqueId; }));
+
+    removeTorrents(torrents);
+}
+
+TEST_F(SessionLoadTest, eventLoopRunsWhileLoading)
+{
+    auto constexpr TorrentCount = size_t{ 20 };
+
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        writeResumeFile(writeTorrentFile(i), "label"sv);
+    }
+
+    auto torrents = std::vector<tr_torrent*>{};
+    auto loaded = std::atomic<bool>{ false };
+    auto loader = std::thread(
+        [this, &torrents, &loaded]()
+        {
+            torrents = loadTorrents();
+            loaded = true;
+        });
+
+    // the event loop keeps answering while the torrents load
+    while (!loaded)
+    {
+        auto done = std::atomic<bool>{ false };
+        tr_runInEventThread(
+            session_,
+            [](void* vdone) noexcept { *static_cast<std::atomic<bool>*>(vdone) = true; },
+            &done);
+        EXPECT_TRUE(waitFor([&done]() { return done.load(); }, 30000));
+    }
+
+    loader.join();
+
+    EXPECT_EQ(TorrentCount, std::size(torrents));
+    EXPECT_TRUE(std::all_of(
+        std::begin(torrents),
+        std::end(torrents),
+        [](auto const* tor) { return tor->labels == tr_labels_t{ "label" }; }));
+
+    removeTorrents(torrents);
+}
+
+TEST_F(SessionLoadTest, savesOffTheEventThread)
+{
+    auto constexpr TorrentCount = size_t{ 20 };
+
+    auto hash_strings = std::vector<std::string>{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        hash_strings.push_back(writeTorrentFile(i));
+    }
+
+    auto const torrents = loadTorrents();
+    ASSERT_EQ(TorrentCount, std::size(torrents));
+    session_->resume_writer_->wait();
+
+    // save every torrent on the event thread, as the save timer does
+    struct SaveBurst
+    {
+        std::vector<tr_torrent*> const& torrents;
+        std::atomic<bool> done = false;
+    };
+
+    auto burst = SaveBurst{ torrents };
+    tr_runInEventThread(
+        session_,
+        [](void* vburst) noexcept
+        {
+            auto* const b = static_cast<SaveBurst*>(vburst);
+            for (auto* tor : b->torrents)
+            {
+                tor->setDirty();
+                tr_torrentSave(tor);
+            }
+            b->done = true;
+        },
+        &burst);
+    EXPECT_TRUE(waitFor([&burst]() { return burst.done.load(); }, 30000));
+    session_->resume_writer_->wait();
+
+    EXPECT_EQ(0U, session_->resume_writer_->pending());
+    EXPECT_TRUE(std::all_of(
+        std::begin(hash_strings),
+        std::end(hash_strings),
+        [this](auto const& hash_string)
+        {
+            auto const filename = tr_strvPath(tr_getResumeDir(session_), hash_string + ".resume");
+            return tr_sys_path_exists(filename.c_str(), nullptr);
+        }));
+
+    removeTorrents(torrents);
+}
+
+TEST_F(SessionLoadTest, cancelDropsOneTorrentsSave)
+{
+    auto constexpr TorrentCount = size_t{ 20 };
+
+    auto hash_strings = std::vector<std::string>{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        hash_strings.push_back(writeTorrentFile(i));
+    }
+
+    auto const torrents = loadTorrents();
+    ASSERT_EQ(TorrentCount, std::size(torrents));
+    auto& writer = *session_->resume_writer_;
+    writer.wait();
+
+    auto const resume_filename = [this](std::string const& hash_string)
+    {
+        return tr_strvPath(tr_getResumeDir(session_), hash_string + ".resume");
+    };
+
+    for (auto const& hash_string : hash_strings)
+    {
+        tr_sys_path_remove(resume_filename(hash_string).c_str(), nullptr);
+    }
+
+    // save every torrent, then cancel one while the batch is being written
+    auto dicts = std::vector<tr_variant>(TorrentCount);
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        tr_variantInitDict(&dicts[i], 1);
+        tr_variantDictAddInt(&dicts[i], TR_KEY_id, i);
+        writer.save(tr_torrentId(torrents[i]), hash_strings[i], resume_filename(hash_strings[i]), &dicts[i]);
+    }
+
+    auto const& cancelled = hash_strings[TorrentCount / 2];
+    writer.cancel(cancelled);
+
+    // nothing is written for it after cancel() returns
+    tr_sys_path_remove(resume_filename(cancelled).c_str(), nullptr);
+    writer.wait();
+    EXPECT_FALSE(tr_sys_path_exists(resume_filename(cancelled).c_str(), nullptr));
+
+    for (auto const& hash_string : hash_strings)
+    {
+        if (hash_string != cancelled)
+        {
+            EXPECT_TRUE(tr_sys_path_exists(resume_filename(hash_string).c_str(), nullptr));
+        }
+    }
+
+    removeTorrents(torrents);
+}
+
+TEST_F(SessionLoadTest, stoppedTorrentsRememberTheirPeers)
+{
+    auto const hash_string = writeTorrentFile(0);
+    auto const torrents = loadTorrents();
+    ASSERT_EQ(1U, std::size(torrents));
+    auto* const tor = torrents.front();
+
+    auto pex = std::vector<tr_pex>{};
+    for (auto const* const address : { "93.184.216.3", "93.184.216.1", "93.184.216.2" })
+    {
+        auto& p = pex.emplace_back();
+        EXPECT_TRUE(tr_address_from_string(&p.addr, address));
+        p.port = htons(51413);
+    }
+
+    auto const get_peers = [tor]()
+    {
+        tr_pex* peers = nullptr;
+        auto const n = tr_peerMgrGetPeers(tor, &peers, TR_AF_INET, TR_PEERS_INTERESTING, 100);
+        auto ret = std::vector<std::string>{};
+        for (int i = 0; i < n; ++i)
+        {
+            ret.emplace_back(tr_address_to_string(&peers[i].addr));
+        }
+        tr_free(peers);
+        return ret;
+    };
+
+    auto const expected = std::vector<std::string>{ "93.184.216.1", "93.184.216.2", "93.184.216.3" };
+
+    // the swarm's hibernating, so they're just remembered
+    EXPECT_EQ(3U, tr_peerMgrAddPex(tor, TR_PEER_FROM_TRACKER, std::data(pex), std::size(pex)));
+    EXPECT_EQ(3U, tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex)));
+    EXPECT_EQ(expected, get_peers());
+
+    // they're atoms while it's running, and remembered again when it stops
+    tr_peerMgrStartTorrent(tor);
+    EXPECT_EQ(expected, get_peers());
+    tr_peerMgrStopTorrent(tor);
+    EXPECT_EQ(expected, get_peers());
+
+    // and saved in the .resume file
+    tor->setDirty();
+    tr_torrentSave(tor);
+    session_->resume_writer_->wait();
+
+    auto top = tr_variant{};
+    auto const filename = tr_strvPath(tr_getResumeDir(session_), hash_string + ".resume");
+    ASSERT_TRUE(tr_variantFromFile(&top, TR_VARIANT_PARSE_BENC, filename.c_str(), nullptr));
+    auto peers2 = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(&top, TR_KEY_peers2, &peers2));
+    EXPECT_EQ(3 * sizeof(tr_pex), std::size(peers2));
+    tr_variantFree(&top);
+
+    removeTorrents(torrents);
+}
+
+class SessionResumeJournalTest : public SessionLoadTest
+{
+protected:
+    void SetUp() override
+    {
+        tr_variantDictAddBool(settings(), TR_KEY_resume_journal_enabled, true);
+        SessionLoadTest::SetUp();
+    }
+};
+
+TEST_F(SessionResumeJournalTest, savesToJournal)
+{
+    auto* const journal = session_->resume_journal_.get();
+    ASSERT_NE(nullptr, journal);
+
+    auto const hash_string = writeTorrentFile(0);
+    auto const torrents = loadTorrents();
+    ASSERT_EQ(1U, std::size(torrents));
+    auto* const tor = torrents.front();
+
+    tr_torrentSetLabels(tor, tr_labels_t{ "one" });
+    tr_torrentSaveResume(tor);
+    session_->resume_writer_->wait();
+    EXPECT_TRUE(journal->contains(hash_string));
+    auto const filename = tr_strvPath(tr_getResumeDir(session_), hash_string + ".resume");
+    EXPECT_FALSE(tr_sys_path_exists(filename.c_str(), nullptr));
+
+    // the labels come back from the journal
+    tor->labels.clear();
+    auto* const ctor = tr_ctorNew(session_);
+    EXPECT_EQ(uint64_t{ TR_FR_LABELS }, tr_torrentLoadResume(tor, TR_FR_LABELS, ctor, nullptr, nullptr));
+    tr_ctorFree(ctor);
+    EXPECT_EQ(tr_labels_t{ "one" }, tor->labels);
+
+    removeTorrents(torrents);
+    EXPECT_TRUE(waitFor([journal, &hash_string]() { return !journal->contains(hash_string); }, 5000));
+}
+
+TEST_F(SessionResumeJournalTest, writeErrorsReachTheTorrent)
+{
+    auto* const journal = session_->resume_journal_.get();
+    ASSERT_NE(nullptr, journal);
+
+    writeTorrentFile(0);
+    auto const torrents = loadTorrents();
+    ASSERT_EQ(1U, std::size(torrents));
+    auto* const tor = torrents.front();
+    EXPECT_EQ(TR_STAT_OK, tor->error);
+
+    // put something that can't be written to in the journal's place
+    auto const& filename = journal->filename();
+    tr_sys_path_remove(filename.c_str(), nullptr);
+    EXPECT_TRUE(tr_sys_dir_create(filename.c_str(), 0, 0700, nullptr));
+
+    tr_torrentSetLabels(tor, tr_labels_t{ "one" });
+    tr_torrentSaveResume(tor);
+    session_->resume_writer_->wait();
+    EXPECT_TRUE(waitFor([tor]() { return tor->error == TR_STAT_LOCAL_ERROR; }, 5000));
+
+    tr_sys_path_remove(filename.c_str(), nullptr);
+    removeTorrents(torrents);
+}
+
 } // namespace test
 
 } // namespace libtransmission
@@ -396,7 +396,7 @@ protected:
     {
         for (tr_file_index_t i = 0; i < tor->info.fileCount; ++i)
         {
-            auto const& file = tor->info.files[i];
+            auto const file = tor->file(i);
 
             auto path = (!complete && i == 0) ?
                 makeString(tr_strdup_printf("%s%c%s.part", tor->currentDir, TR_PATH_DELIMITER, file.name)) :
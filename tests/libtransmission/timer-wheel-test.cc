@@ -0,0 +1,220 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "transmission.h"
+#include "timer-wheel.h"
+
+#include "gtest/gtest.h"
+
+using TimerWheelTest = ::testing::Test;
+
+namespace
+{
+
+auto constexpr TickMsec = uint64_t{ 500 };
+
+struct Counter
+{
+    int fired = 0;
+
+    static void onTimer(void* vself)
+    {
+        ++static_cast<Counter*>(vself)->fired;
+    }
+};
+
+} // namespace
+
+TEST_F(TimerWheelTest, firesAtDeadline)
+{
+    auto wheel = tr_timer_wheel{ nullptr, TickMsec };
+    auto const start = wheel.now();
+
+    auto counter = Counter{};
+    auto timer = tr_timer_wheel::Timer{ wheel, Counter::onTimer, &counter };
+    timer.start(3000);
+    EXPECT_TRUE(timer.isPending());
+    EXPECT_EQ(1, wheel.size());
+
+    wheel.advance(start + 2999);
+    EXPECT_EQ(0, counter.fired);
+    EXPECT_TRUE(timer.isPending());
+
+    wheel.advance(start + 3000);
+    EXPECT_EQ(1, counter.fired);
+    EXPECT_FALSE(timer.isPending());
+    EXPECT_EQ(0, wheel.size());
+
+    // one-shot: nothing else happens until it's re-armed
+    wheel.advance(start + 60000);
+    EXPECT_EQ(1, counter.fired);
+}
+
+TEST_F(TimerWheelTest, stopAndRestart)
+{
+    auto wheel = tr_timer_wheel{ nullptr, TickMsec };
+    auto const start = wheel.now();
+
+    auto counter = Counter{};
+    auto timer = tr_timer_wheel::Timer{ wheel, Counter::onTimer, &counter };
+    timer.start(1000);
+    timer.stop();
+    EXPECT_FALSE(timer.isPending());
+    EXPECT_EQ(0, wheel.size());
+    wheel.advance(start + 5000);
+    EXPECT_EQ(0, counter.fired);
+
+    // re-arming a pending timer replaces its old deadline
+    timer.start(1000);
+    timer.start(10000);
+    EXPECT_EQ(1, wheel.size());
+    wheel.advance(start + 5000 + 9999);
+    EXPECT_EQ(0, counter.fired);
+    wheel.advance(start + 5000 + 10000);
+    EXPECT_EQ(1, counter.fired);
+}
+
+TEST_F(TimerWheelTest, cascadesLongTimers)
+{
+    auto wheel = tr_timer_wheel{ nullptr, TickMsec };
+    auto const start = wheel.now();
+
+    // deadlines in the first level, the second level, and beyond both
+    auto const lap = tr_timer_wheel::Level0Size * TickMsec;
+    auto const reach = tr_timer_wheel::Level1Size * lap;
+    auto const delays = std::vector<uint64_t>{
+        1000, lap - TickMsec, lap, lap + TickMsec, 7 * lap + 1234, reach - TickMsec, reach * 3 + 42,
+    };
+
+    auto counters = std::vector<Counter>(std::size(delays));
+    auto timers = std::vector<std::unique_ptr<tr_timer_wheel::Timer>>{};
+    for (size_t i = 0; i < std::size(delays); ++i)
+    {
+        timers.emplace_back(std::make_unique<tr_timer_wheel::Timer>(wheel, Counter::onTimer, &counters[i]));
+        timers.back()->start(delays[i]);
+    }
+    EXPECT_EQ(std::size(delays), wheel.size());
+
+    for (size_t i = 0; i < std::size(delays); ++i)
+    {
+        // round up to the wheel's resolution
+        auto const deadline = start + (delays[i] + TickMsec - 1) / TickMsec * TickMsec;
+
+        wheel.advance(deadline - 1);
+        EXPECT_EQ(0, counters[i].fired) << "delay " << delays[i];
+        wheel.advance(deadline);
+        EXPECT_EQ(1, counters[i].fired) << "delay " << delays[i];
+    }
+
+    EXPECT_EQ(0, wheel.size());
+}
+
+TEST_F(TimerWheelTest, callbackCanRearm)
+{
+    struct Repeater
+    {
+        std::unique_ptr<tr_timer_wheel::Timer> timer;
+        int fired = 0;
+
+        static void onTimer(void* vself)
+        {
+            auto* self = static_cast<Repeater*>(vself);
+            ++self->fired;
+            self->timer->start(90000);
+        }
+    };
+
+    auto wheel = tr_timer_wheel{ nullptr, TickMsec };
+    auto const start = wheel.now();
+
+    auto repeater = Repeater{};
+    repeater.timer = std::make_unique<tr_timer_wheel::Timer>(wheel, Repeater::onTimer, &repeater);
+    repeater.timer->start(90000);
+
+    wheel.advance(start + 90000 * 10);
+    EXPECT_EQ(10, repeater.fired);
+    EXPECT_EQ(1, wheel.size());
+}
+
+TEST_F(TimerWheelTest, callbackCanDestroyTimers)
+{
+    struct Owner
+    {
+        std::unique_ptr<tr_timer_wheel::Timer> timer;
+        std::unique_ptr<tr_timer_wheel::Timer> sibling;
+
+        static void onTimer(void* vself)
+        {
+            auto* self = static_cast<Owner*>(vself);
+            self->timer.reset();
+            self->sibling.reset();
+        }
+    };
+
+    auto wheel = tr_timer_wheel{ nullptr, TickMsec };
+    auto const start = wheel.now();
+
+    auto counter = Counter{};
+    auto owner = Owner{};
+    owner.timer = std::make_unique<tr_timer_wheel::Timer>(wheel, Owner::onTimer, &owner);
+    owner.sibling = std::make_unique<tr_timer_wheel::Timer>(wheel, Counter::onTimer, &counter);
+    owner.timer->start(1000);
+    owner.sibling->start(1000);
+
+    wheel.advance(start + 1000);
+    EXPECT_EQ(0, wheel.size());
+    EXPECT_EQ(nullptr, owner.timer);
+    EXPECT_EQ(0, counter.fired);
+}
+
+TEST_F(TimerWheelTest, manyTimers)
+{
+    auto wheel = tr_timer_wheel{ nullptr, TickMsec };
+    auto const start = wheel.now();
+
+    // e.g. PEX timers for a large number of peers, spread over the interval
+    auto constexpr N = size_t{ 50000 };
+    auto constexpr Interval = uint64_t{ 90000 };
+    auto counter = Counter{};
+    auto timers = std::vector<std::unique_ptr<tr_timer_wheel::Timer>>{};
+    timers.reserve(N);
+    for (size_t i = 0; i < N; ++i)
+    {
+        timers.emplace_back(std::make_unique<tr_timer_wheel::Timer>(wheel, Counter::onTimer, &counter));
+        timers.back()->start(Interval + i % 1000);
+    }
+    EXPECT_EQ(N, wheel.size());
+
+    // cancel every other one
+    for (size_t i = 0; i < N; i += 2)
+    {
+        timers[i]->stop();
+    }
+    EXPECT_EQ(N / 2, wheel.size());
+
+    wheel.advance(start + Interval + 1000);
+    EXPECT_EQ(int(N / 2), counter.fired);
+    EXPECT_EQ(0, wheel.size());
+}
+
+TEST_F(TimerWheelTest, destroyingWheelOrphansTimers)
+{
+    auto counter = Counter{};
+    auto wheel = std::make_unique<tr_timer_wheel>(nullptr, TickMsec);
+    auto timer = std::make_unique<tr_timer_wheel::Timer>(*wheel, Counter::onTimer, &counter);
+    timer->start(1000);
+
+    wheel.reset();
+    EXPECT_FALSE(timer->isPending());
+    timer.reset();
+    EXPECT_EQ(0, counter.fired);
+}
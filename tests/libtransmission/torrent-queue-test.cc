@@ -0,0 +1,233 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "transmission.h"
+#include "crypto-utils.h"
+#include "torrent-queue.h"
+
+#include "gtest/gtest.h"
+
+class TorrentQueueTest : public ::testing::Test
+{
+protected:
+    // the queue never dereferences its torrents,
+    // so any distinct addresses will do
+    std::vector<char> storage_ = std::vector<char>(64 * 1024);
+
+    tr_torrent* fakeTorrent(size_t i)
+    {
+        return reinterpret_cast<tr_torrent*>(&storage_[i]);
+    }
+
+    static void expectMatches(tr_torrent_queue const& queue, std::vector<tr_torrent*> const& expected)
+    {
+        ASSERT_EQ(std::size(expected), std::size(queue));
+
+        for (size_t i = 0; i < std::size(expected); ++i)
+        {
+            EXPECT_EQ(expected[i], queue.at(i));
+            EXPECT_EQ(i, queue.position(expected[i]));
+        }
+
+        EXPECT_EQ(nullptr, queue.at(std::size(expected)));
+    }
+};
+
+TEST_F(TorrentQueueTest, pushBackAndErase)
+{
+    auto queue = tr_torrent_queue{};
+    EXPECT_TRUE(queue.empty());
+
+    auto expected = std::vector<tr_torrent*>{};
+    for (size_t i = 0; i < 100; ++i)
+    {
+        queue.push_back(fakeTorrent(i));
+        expected.push_back(fakeTorrent(i));
+    }
+    expectMatches(queue, expected);
+
+    // remove from the front, middle, and back
+    for (auto const i : { 0, 50, 99 })
+    {
+        queue.erase(fakeTorrent(i));
+        expected.erase(std::find(std::begin(expected), std::end(expected), fakeTorrent(i)));
+        EXPECT_FALSE(queue.contains(fakeTorrent(i)));
+    }
+    expectMatches(queue, expected);
+
+    // erasing something that isn't there is a no-op
+    queue.erase(fakeTorrent(0));
+    expectMatches(queue, expected);
+}
+
+TEST_F(TorrentQueueTest, move)
+{
+    auto queue = tr_torrent_queue{};
+    auto expected = std::vector<tr_torrent*>{};
+    for (size_t i = 0; i < 10; ++i)
+    {
+        queue.push_back(fakeTorrent(i));
+        expected.push_back(fakeTorrent(i));
+    }
+
+    queue.move(fakeTorrent(9), 0);
+    std::rotate(std::begin(expected), std::begin(expected) + 9, std::end(expected));
+    expectMatches(queue, expected);
+
+    queue.move(fakeTorrent(9), 5);
+    std::rotate(std::begin(expected), std::begin(expected) + 1, std::begin(expected) + 6);
+    expectMatches(queue, expected);
+
+    // positions past the back are clamped
+    queue.move(fakeTorrent(3), 1000);
+    expected.erase(std::find(std::begin(expected), std::end(expected), fakeTorrent(3)));
+    expected.push_back(fakeTorrent(3));
+    expectMatches(queue, expected);
+}
+
+TEST_F(TorrentQueueTest, matchesVector)
+{
+    auto constexpr IterCount = int{ 5000 };
+    auto constexpr MaxTorrents = int{ 500 };
+
+    auto queue = tr_torrent_queue{};
+    auto expected = std::vector<tr_torrent*>{};
+    auto next = size_t{};
+
+    for (int i = 0; i < IterCount; ++i)
+    {
+        auto const n = std::size(expected);
+
+        switch (n == 0 ? 0 : tr_rand_int_weak(3))
+        {
+        case 0:
+            if (n < MaxTorrents)
+            {
+                queue.push_back(fakeTorrent(next));
+                expected.push_back(fakeTorrent(next));
+                ++next;
+            }
+            break;
+
+        case 1:
+            {
+                auto* const tor = expected[tr_rand_int_weak(n)];
+                queue.erase(tor);
+                expected.erase(std::find(std::begin(expected), std::end(expected), tor));
+            }
+            break;
+
+        default:
+            {
+                auto* const tor = expected[tr_rand_int_weak(n)];
+                size_t const pos = tr_rand_int_weak(n);
+                queue.move(tor, pos);
+                expected.erase(std::find(std::begin(expected), std::end(expected), tor));
+                expected.insert(std::begin(expected) + pos, tor);
+            }
+            break;
+        }
+
+        if (i % 100 == 0)
+        {
+            expectMatches(queue, expected);
+        }
+    }
+
+    expectMatches(queue, expected);
+}
+
+TEST_F(TorrentQueueTest, forEachQueued)
+{
+    auto queue = tr_torrent_queue{};
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        queue.push_back(fakeTorrent(i));
+        queue.setQueued(fakeTorrent(i), i % 7 == 0);
+    }
+
+    queue.move(fakeTorrent(700), 0);
+    queue.setQueued(fakeTorrent(14), false);
+    queue.setQueued(fakeTorrent(15), true);
+
+    auto expected = std::vector<tr_torrent*>{ fakeTorrent(700) };
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        if (i != 700 && i != 14 && (i % 7 == 0 || i == 15))
+        {
+            expected.push_back(fakeTorrent(i));
+        }
+    }
+
+    auto visited = std::vector<tr_torrent*>{};
+    queue.forEachQueued(
+        [&visited](tr_torrent* tor)
+        {
+            visited.push_back(tor);
+            return true;
+        });
+    EXPECT_EQ(expected, visited);
+
+    // returning false stops the walk
+    visited.clear();
+    queue.forEachQueued(
+        [&visited](tr_torrent* tor)
+        {
+            visited.push_back(tor);
+            return std::size(visited) < 3;
+        });
+    EXPECT_EQ(std::vector<tr_torrent*>(std::begin(expected), std::begin(expected) + 3), visited);
+
+    // removing a queued torrent removes it from the walk
+    queue.erase(fakeTorrent(700));
+    visited.clear();
+    queue.forEachQueued(
+        [&visited](tr_torrent* tor)
+        {
+            visited.push_back(tor);
+            return true;
+        });
+    EXPECT_EQ(std::vector<tr_torrent*>(std::begin(expected) + 1, std::end(expected)), visited);
+}
+
+TEST_F(TorrentQueueTest, bulkMoveInLargeQueue)
+{
+    // queue-move-top of 5,000 torrents in a 50,000-torrent session
+    auto constexpr TorrentCount = size_t{ 50000 };
+    auto constexpr MoveCount = size_t{ 5000 };
+
+    auto queue = tr_torrent_queue{};
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        queue.push_back(fakeTorrent(i));
+    }
+
+    // move every tenth torrent to the top, last one first, so that they keep their relative order
+    for (size_t i = MoveCount; i-- > 0;)
+    {
+        queue.move(fakeTorrent(i * 10), 0);
+    }
+
+    auto expected = std::vector<tr_torrent*>{};
+    for (size_t i = 0; i < TorrentCount; i += 10)
+    {
+        expected.push_back(fakeTorrent(i));
+    }
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        if (i % 10 != 0)
+        {
+            expected.push_back(fakeTorrent(i));
+        }
+    }
+
+    expectMatches(queue, expected);
+}
@@ -17,8 +17,11 @@
 #include <array>
 #include <cmath> // lrint()
 #include <cctype> // isspace()
+#include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -556,3 +559,256 @@ TEST_F(VariantTest, dictFindType)
 
     tr_variantFree(&top);
 }
+
+// serialize something shaped like a torrent-get response
+TEST_F(VariantTest, serializeTorrentGetPayload)
+{
+    auto constexpr TorrentCount = size_t{ 50 };
+
+    tr_variant top;
+    tr_variantInitDict(&top, 3);
+    tr_variant* const args = tr_variantDictAddDict(&top, TR_KEY_arguments, 1);
+    tr_variant* const torrents = tr_variantDictAddList(args, TR_KEY_torrents, TorrentCount);
+    for (size_t i = 0; i < TorrentCount; ++i)
+    {
+        tr_variant* const tor = tr_variantListAddDict(torrents, 18);
+        tr_variantDictAddStr(tor, TR_KEY_downloadDir, "/home/user/Downloads/Linux ISOs");
+        tr_variantDictAddInt(tor, TR_KEY_error, 0);
+        tr_variantDictAddStr(tor, TR_KEY_errorString, "");
+        tr_variantDictAddInt(tor, TR_KEY_eta, i % 7 == 0 ? -1 : int64_t(i) * 37);
+        tr_variantDictAddInt(tor, TR_KEY_id, i + 1);
+        tr_variantDictAddBool(tor, TR_KEY_isFinished, i % 3 == 0);
+        tr_variantDictAddInt(tor, TR_KEY_leftUntilDone, int64_t(i) * 1048576);
+        tr_variantDictAddStr(tor, TR_KEY_name, "Some.Distro-" + std::to_string(i) + " \"Release\" Édition [x86_64].iso");
+        tr_variantDictAddInt(tor, TR_KEY_peersConnected, i % 50);
+        tr_variantDictAddReal(tor, TR_KEY_percentDone, (i % 1000) / 999.0);
+        tr_variantDictAddInt(tor, TR_KEY_queuePosition, i);
+        tr_variantDictAddInt(tor, TR_KEY_rateDownload, i % 11 * 12345);
+        tr_variantDictAddInt(tor, TR_KEY_rateUpload, i % 13 * 2345);
+        tr_variantDictAddReal(tor, TR_KEY_seedRatioLimit, 2.0);
+        tr_variantDictAddInt(tor, TR_KEY_sizeWhenDone, int64_t{ 4 } * 1024 * 1024 * 1024 + i);
+        tr_variantDictAddInt(tor, TR_KEY_status, i % 7);
+        tr_variantDictAddReal(tor, TR_KEY_uploadRatio, i / 3.0);
+        tr_variant* const trackers = tr_variantDictAddList(tor, TR_KEY_trackers, 1);
+        tr_variant* const tracker = tr_variantListAddDict(trackers, 3);
+        tr_variantDictAddStr(tracker, TR_KEY_announce, "https://tracker.example.com:443/announce?passkey=0123456789abcdef");
+        tr_variantDictAddInt(tracker, TR_KEY_id, 0);
+        tr_variantDictAddInt(tracker, TR_KEY_tier, 0);
+    }
+    tr_variantDictAddStr(&top, TR_KEY_result, "success");
+
+    auto const serialize = [&top](tr_variant_fmt fmt)
+    {
+        auto len = size_t{};
+        auto* const str = tr_variantToStr(&top, fmt, &len);
+        auto ret = std::string{ str, len };
+        tr_free(str);
+        return ret;
+    };
+
+    auto const json = serialize(TR_VARIANT_FMT_JSON_LEAN);
+    auto const benc = serialize(TR_VARIANT_FMT_BENC);
+
+    // the output is well-formed and complete
+    tr_variant parsed;
+    EXPECT_TRUE(tr_variantFromBuf(&parsed, TR_VARIANT_PARSE_JSON, json));
+    tr_variant* parsed_args = nullptr;
+    tr_variant* parsed_torrents = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&parsed, TR_KEY_arguments, &parsed_args));
+    EXPECT_TRUE(tr_variantDictFindList(parsed_args, TR_KEY_torrents, &parsed_torrents));
+    EXPECT_EQ(TorrentCount, tr_variantListSize(parsed_torrents));
+    tr_variantFree(&parsed);
+
+    EXPECT_TRUE(tr_variantFromBuf(&parsed, TR_VARIANT_PARSE_BENC, benc));
+    auto len = size_t{};
+    auto* const reencoded = tr_variantToStr(&parsed, TR_VARIANT_FMT_BENC, &len);
+    EXPECT_EQ(benc, (std::string_view{ reencoded, len }));
+    tr_free(reencoded);
+    tr_variantFree(&parsed);
+
+    tr_variantFree(&top);
+}
+
+TEST_F(VariantTest, parseIntoArena)
+{
+    auto const benc = "d4:listli1ei2ei3ee4:name11:hello world3:subd3:keyi42eee"sv;
+    auto const json = R"({"list":[1,2,3],"name":"escaped \"quotes\"","sub":{"key":42}})"sv;
+
+    for (auto const& [opts, in] : { std::pair{ TR_VARIANT_PARSE_BENC, benc }, std::pair{ TR_VARIANT_PARSE_JSON, json } })
+    {
+        auto arena = tr_variant_arena{ 64 };
+
+        tr_variant heap_top;
+        tr_variant arena_top;
+        EXPECT_TRUE(tr_variantFromBuf(&heap_top, opts, in));
+        EXPECT_TRUE(tr_variantFromBuf(&arena_top, arena, opts, in));
+        EXPECT_GT(arena.blockCount(), 0U);
+
+        // same tree either way
+        auto len = size_t{};
+        auto* str = tr_variantToStr(&heap_top, TR_VARIANT_FMT_BENC, &len);
+        auto const expected = std::string{ str, len };
+        tr_free(str);
+        str = tr_variantToStr(&arena_top, TR_VARIANT_FMT_BENC, &len);
+        EXPECT_EQ(expected, (std::string_view{ str, len }));
+        tr_free(str);
+
+        // an arena tree can still be changed; its lists grow in the arena
+        tr_variant* list = nullptr;
+        EXPECT_TRUE(tr_variantDictFindList(&arena_top, tr_quark_new("list"sv), &list));
+        for (int i = 4; i <= 100; ++i)
+        {
+            tr_variantListAddInt(list, i);
+        }
+        EXPECT_EQ(&arena, list->val.l.arena);
+        EXPECT_EQ(100U, tr_variantListSize(list));
+        auto i = int64_t{};
+        EXPECT_TRUE(tr_variantGetInt(tr_variantListChild(list, 99), &i));
+        EXPECT_EQ(100, i);
+
+        // heap-backed values can be added too, as long as the tree is freed
+        tr_variantDictAddStr(&arena_top, TR_KEY_comment, std::string(100, 'x'));
+
+        tr_variantFree(&arena_top);
+        tr_variantFree(&heap_top);
+    }
+}
+
+TEST_F(VariantTest, arenaParseAllocatesLess)
+{
+    auto constexpr FileCount = 200;
+    auto constexpr IdCount = 200;
+
+    // a metainfo with many files, like a large .torrent
+    tr_variant metainfo;
+    tr_variantInitDict(&metainfo, 2);
+    tr_variant* info = tr_variantDictAddDict(&metainfo, TR_KEY_info, 4);
+    tr_variant* files = tr_variantDictAddList(info, TR_KEY_files, FileCount);
+    for (int i = 0; i < FileCount; ++i)
+    {
+        tr_variant* file = tr_variantListAddDict(files, 2);
+        tr_variantDictAddInt(file, TR_KEY_length, 1048576 + i);
+        tr_variant* path = tr_variantDictAddList(file, TR_KEY_path, 3);
+        tr_variantListAddStr(path, "Some Collection");
+        tr_variantListAddStr(path, "Disc " + std::to_string(i / 10));
+        tr_variantListAddStr(path, "Track " + std::to_string(i) + " - A Fairly Long Title.flac");
+    }
+    tr_variantDictAddStr(info, TR_KEY_name, "Some Collection");
+    tr_variantDictAddInt(info, TR_KEY_piece_length, 4194304);
+    tr_variantDictAddStr(info, TR_KEY_pieces, std::string(20 * 50, 'p'));
+
+    // an RPC request that sets something on many torrents
+    tr_variant request;
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStr(&request, TR_KEY_method, "torrent-set");
+    tr_variant* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+    tr_variant* ids = tr_variantDictAddList(args, TR_KEY_ids, IdCount);
+    for (int i = 0; i < IdCount; ++i)
+    {
+        tr_variantListAddStr(ids, "0123456789abcdef0123456789abcdef" + std::to_string(10000000 + i));
+    }
+    tr_variantDictAddStr(args, TR_KEY_downloadDir, "/media/storage/Some \"quoted\" directory");
+
+    auto len = size_t{};
+    auto* str = tr_variantToStr(&metainfo, TR_VARIANT_FMT_BENC, &len);
+    auto const benc = std::string{ str, len };
+    tr_free(str);
+    str = tr_variantToStr(&request, TR_VARIANT_FMT_JSON_LEAN, &len);
+    auto const json = std::string{ str, len };
+    tr_free(str);
+    tr_variantFree(&metainfo);
+    tr_variantFree(&request);
+
+    // roughly how many heap allocations a tree took,
+    // counting each doubling of a child array from its first 8 slots
+    auto const count_allocs = [](tr_variant const* top)
+    {
+        auto n = size_t{};
+        auto pending = std::vector<tr_variant const*>{ top };
+        while (!std::empty(pending))
+        {
+            auto const* v = pending.back();
+            pending.pop_back();
+
+            if (tr_variantIsString(v) && v->val.s.type == TR_STRING_TYPE_HEAP)
+            {
+                ++n;
+            }
+            else if ((tr_variantIsList(v) || tr_variantIsDict(v)) && v->val.l.vals != nullptr)
+            {
+                for (size_t alloc = 8; alloc <= v->val.l.alloc; alloc *= 2)
+                {
+                    ++n;
+                }
+
+                for (size_t i = 0; i < v->val.l.count; ++i)
+                {
+                    pending.push_back(&v->val.l.vals[i]);
+                }
+            }
+        }
+        return n;
+    };
+
+    for (auto const& [opts, in] : { std::pair{ TR_VARIANT_PARSE_BENC, std::string_view{ benc } },
+                                    std::pair{ TR_VARIANT_PARSE_JSON, std::string_view{ json } } })
+    {
+        tr_variant top;
+        EXPECT_TRUE(tr_variantFromBuf(&top, opts | TR_VARIANT_PARSE_INPLACE, in));
+        auto const heap_allocs = count_allocs(&top);
+        tr_variantFree(&top);
+
+        auto arena = tr_variant_arena{};
+        EXPECT_TRUE(tr_variantFromBuf(&top, arena, opts, in));
+        EXPECT_LT(arena.blockCount(), heap_allocs);
+    }
+}
+
+TEST_F(VariantTest, largeDictLookup)
+{
+    auto constexpr KeyCount = size_t{ 200 };
+
+    auto keys = std::vector<tr_quark>{};
+    for (size_t i = 0; i < KeyCount; ++i)
+    {
+        keys.push_back(tr_quark_new("large-dict-key-" + std::to_string(i)));
+    }
+
+    tr_variant top;
+    tr_variantInitDict(&top, 0);
+    for (size_t i = 0; i < KeyCount; ++i)
+    {
+        tr_variantDictAddInt(&top, keys[i], i);
+    }
+
+    // a parsed dict can have duplicate keys; the first one wins
+    tr_variantInitInt(tr_variantDictAdd(&top, keys[0]), -1);
+
+    auto const find = [&top](tr_quark key)
+    {
+        auto i = int64_t{};
+        return tr_variantDictFindInt(&top, key, &i) ? std::optional<int64_t>{ i } : std::nullopt;
+    };
+
+    for (size_t i = 0; i < KeyCount; ++i)
+    {
+        EXPECT_EQ(int64_t(i), find(keys[i]));
+    }
+    EXPECT_FALSE(find(TR_KEY_name));
+
+    // removing keys moves other children around
+    for (size_t i = 0; i < KeyCount; i += 2)
+    {
+        EXPECT_TRUE(tr_variantDictRemove(&top, keys[i]));
+    }
+
+    // that uncovers the duplicate
+    EXPECT_EQ(-1, find(keys[0]));
+    EXPECT_TRUE(tr_variantDictRemove(&top, keys[0]));
+    for (size_t i = 0; i < KeyCount; ++i)
+    {
+        EXPECT_EQ(i % 2 == 0 ? std::nullopt : std::optional<int64_t>{ i }, find(keys[i])) << i;
+    }
+
+    tr_variantFree(&top);
+}
@@ -0,0 +1,94 @@
+/*
+ * This file Copyright (C) Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "transmission.h"
+#include "worker-pool.h"
+
+#include "gtest/gtest.h"
+
+using WorkerPoolTest = ::testing::Test;
+
+TEST_F(WorkerPoolTest, runsEveryJob)
+{
+    auto pool = tr_worker_pool{ 4 };
+    auto count = std::atomic<int>{ 0 };
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        pool.run([&count]() { ++count; });
+    }
+
+    pool.wait();
+    EXPECT_EQ(1000, count);
+
+    // the workers exited when the queue emptied; make sure new ones start
+    pool.run([&count]() { ++count; });
+    pool.wait();
+    EXPECT_EQ(1001, count);
+}
+
+TEST_F(WorkerPoolTest, staysWithinMaxThreads)
+{
+    auto constexpr MaxThreads = size_t{ 3 };
+    auto pool = tr_worker_pool{ MaxThreads };
+
+    auto mutex = std::mutex{};
+    auto ids = std::set<std::thread::id>{};
+    auto running = std::atomic<size_t>{ 0 };
+    auto most_running = std::atomic<size_t>{ 0 };
+
+    for (int i = 0; i < 100; ++i)
+    {
+        pool.run(
+            [&]()
+            {
+                auto const n = ++running;
+                for (auto most = most_running.load(); n > most && !most_running.compare_exchange_weak(most, n);)
+                {
+                }
+
+                {
+                    auto const lock = std::lock_guard(mutex);
+                    ids.insert(std::this_thread::get_id());
+                }
+
+                std::this_thread::yield();
+                --running;
+            });
+    }
+
+    pool.wait();
+    EXPECT_LE(most_running, MaxThreads);
+    EXPECT_GE(std::size(ids), size_t{ 1 });
+}
+
+TEST_F(WorkerPoolTest, destructorWaits)
+{
+    auto count = std::atomic<int>{ 0 };
+
+    {
+        auto pool = tr_worker_pool{ 2 };
+        for (int i = 0; i < 10; ++i)
+        {
+            pool.run(
+                [&count]()
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    ++count;
+                });
+        }
+    }
+
+    EXPECT_EQ(10, count);
+}
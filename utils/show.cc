@@ -92,8 +92,8 @@ static void doShowMagnet(tr_info const* inf)
 
 static int compare_files_by_name(void const* va, void const* vb)
 {
-    tr_file const* a = *(tr_file const* const*)va;
-    tr_file const* b = *(tr_file const* const*)vb;
+    auto const* a = static_cast<tr_file const*>(va);
+    auto const* b = static_cast<tr_file const*>(vb);
     return strcmp(a->name, b->name);
 }
 
@@ -114,7 +114,7 @@ static char const* time_t_to_str(time_t timestamp)
 static void showInfo(tr_info const* inf)
 {
     char buf[128];
-    tr_file** files;
+    tr_file* files;
     int prevTier = -1;
 
     /**
@@ -173,21 +173,21 @@ static void showInfo(tr_info const* inf)
     **/
 
     printf("\nFILES\n\n");
-    files = tr_new(tr_file*, inf->fileCount);
+    files = tr_new(tr_file, inf->fileCount);
 
     for (unsigned int i = 0; i < inf->fileCount; ++i)
     {
-        files[i] = &inf->files[i];
+        files[i] = tr_infoFile(inf, i);
     }
 
     if (!unsorted)
     {
-        qsort(files, inf->fileCount, sizeof(tr_file*), compare_files_by_name);
+        qsort(files, inf->fileCount, sizeof(tr_file), compare_files_by_name);
     }
 
     for (unsigned int i = 0; i < inf->fileCount; ++i)
     {
-        printf("  %s (%s)\n", files[i]->name, tr_formatter_size_B(buf, files[i]->length, sizeof(buf)));
+        printf("  %s (%s)\n", files[i].name, tr_formatter_size_B(buf, files[i].length, sizeof(buf)));
     }
 
     tr_free(files);